@@ -6,50 +6,63 @@
  */
 
 #include <chrono>
-#include <poll.h>
+#include <future>
+#include <optional>
 #include <signal.h>
+#include <sys/eventfd.h>
 #include <sys/signalfd.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
+#include "core/control_server.hpp"
+#include "core/event_loop.hpp"
 #include "core/rpicam_encoder.hpp"
+#include "core/still_options.hpp"
+#include "image/image.hpp"
 #include "output/output.hpp"
 
 using namespace std::placeholders;
 
-// Some keypress/signal handling.
+// Some keypress/signal handling. Everything, including the frames, comes through one event loop, so keypresses and
+// signals are acted on straight away rather than at the next frame, and nothing polls.
 
-static int signal_received;
-static void default_signal_handler(int signal_number)
+// These signals are blocked in every thread, and read from a signalfd instead. That has to happen before any other
+// threads get started, as they inherit it. The mask as it was comes back in old_mask.
+static sigset_t block_signals(sigset_t &old_mask)
 {
-	signal_received = signal_number;
-	LOG(1, "Received signal " << signal_number);
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+	sigaddset(&mask, SIGUSR2);
+	sigaddset(&mask, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+	return mask;
+}
+
+// SIGPIPE gets raised when trying to write to an already closed socket. This can happen, when
+// you're using TCP to stream to VLC and the user presses the stop button in VLC. Catching the
+// signal to be able to react on it, otherwise the app terminates. It goes to whichever thread did
+// the writing, where a signalfd in this thread would never see it, so the handler pokes an eventfd.
+static int sigpipe_fd = -1;
+static void sigpipe_handler([[maybe_unused]] int signal_number)
+{
+	uint64_t one = 1;
+	[[maybe_unused]] ssize_t r = write(sigpipe_fd, &one, sizeof(one));
 }
 
-static int get_key_or_signal(VideoOptions const *options, pollfd p[1])
+static int signal_to_key(VideoOptions const *options, int signal_number)
 {
-	int key = 0;
-	if (signal_received == SIGINT)
+	LOG(1, "Received signal " << signal_number);
+	if (signal_number == SIGINT)
 		return 'x';
-	if (options->keypress)
-	{
-		poll(p, 1, 0);
-		if (p[0].revents & POLLIN)
-		{
-			char *user_string = nullptr;
-			size_t len;
-			[[maybe_unused]] size_t r = getline(&user_string, &len, stdin);
-			key = user_string[0];
-		}
-	}
 	if (options->signal)
 	{
-		if (signal_received == SIGUSR1)
-			key = '\n';
-		else if ((signal_received == SIGUSR2) || (signal_received == SIGPIPE))
-			key = 'x';
-		signal_received = 0;
+		if (signal_number == SIGUSR1)
+			return '\n';
+		else if ((signal_number == SIGUSR2) || (signal_number == SIGPIPE))
+			return 'x';
 	}
-	return key;
+	return 0;
 }
 
 static int get_colourspace_flags(std::string const &codec)
@@ -60,9 +73,107 @@ static int get_colourspace_flags(std::string const &codec)
 		return RPiCamEncoder::FLAG_VIDEO_NONE;
 }
 
+// The commands that --control-socket accepts. Each one runs at a frame boundary. A snapshot being saved goes in
+// snapshot, which has to outlive the server.
+static void add_control_commands(ControlServer &server, RPiCamEncoder &app, Output &output,
+								 std::future<void> &snapshot)
+{
+	using ptree = ControlServer::ptree;
+
+	// { "command": "set_controls", "controls": { "ExposureTime": 10000, "ScalerCrop": [0, 0, 2028, 1520] } }
+	// The controls go with the next request to be queued, so the reply waits for the frame that request brings back.
+	server.AddDeferredCommand("set_controls", [&app](CompletedRequestPtr &, ptree const &command, ptree &) {
+		libcamera::ControlList controls =
+			ControlServer::ParseControls(command.get_child("controls"), app.GetControlInfo());
+		app.SetControls(controls);
+		return [controls](CompletedRequestPtr &completed_request) {
+			for (auto const &[id, value] : controls)
+			{
+				if (!completed_request->controls.contains(id) || completed_request->controls.get(id) != value)
+					return false;
+			}
+			return true;
+		};
+	});
+	server.AddCommand("get_metadata", [](CompletedRequestPtr &completed_request, ptree const &, ptree &reply) {
+		ptree metadata;
+		const libcamera::ControlIdMap *id_map = completed_request->metadata.idMap();
+		for (auto const &[id, value] : completed_request->metadata)
+			metadata.put(id_map->at(id)->name(), value.toString());
+		reply.add_child("metadata", metadata);
+	});
+	// Commands run before the frame is given to the encoder, so the encoder changes start with this frame.
+	server.AddCommand("keyframe", [&app](CompletedRequestPtr &, ptree const &, ptree &) { app.RequestKeyframe(); });
+	// { "command": "set_bitrate", "bitrate": "5mbps" }
+	server.AddCommand("set_bitrate", [&app](CompletedRequestPtr &, ptree const &command, ptree &) {
+		Bitrate bitrate;
+		bitrate.set(command.get<std::string>("bitrate"));
+		if (!bitrate)
+			throw std::runtime_error("bitrate must be more than zero");
+		app.SetBitrate(bitrate.bps());
+	});
+	// The output only starts on a keyframe, so ask for one here.
+	server.AddCommand("start_recording", [&app, &output](CompletedRequestPtr &, ptree const &, ptree &) {
+		output.Enable(true);
+		app.RequestKeyframe();
+	});
+	server.AddCommand("stop_recording", [&output](CompletedRequestPtr &, ptree const &, ptree &) {
+		output.Enable(false);
+	});
+	server.AddCommand("new_segment", [&app, &output](CompletedRequestPtr &, ptree const &, ptree &) {
+		output.Split();
+		app.RequestKeyframe();
+	});
+	// { "command": "snapshot", "filename": "snap.jpg" } saves this frame as a JPEG, in the current directory and
+	// under a name that isn't taken yet. It's encoded on another thread, one at a time.
+	server.AddCommand("snapshot", [&app, &snapshot](CompletedRequestPtr &completed_request, ptree const &command,
+													ptree &) {
+		std::string filename = command.get<std::string>("filename");
+		std::string::size_type dot = filename.rfind('.');
+		std::string extension = dot == std::string::npos ? "" : filename.substr(dot);
+		if (filename.empty() || filename[0] == '.' || filename.find('/') != std::string::npos ||
+			(extension != ".jpg" && extension != ".jpeg"))
+			throw std::runtime_error("snapshot needs a plain file name ending .jpg or .jpeg");
+		struct stat st;
+		if (lstat(filename.c_str(), &st) == 0)
+			throw std::runtime_error("snapshot file " + filename + " already exists");
+		if (snapshot.valid() && snapshot.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			throw std::runtime_error("still saving the last snapshot");
+
+		// The frame goes back to the camera once we return, so take a copy.
+		StreamInfo info;
+		libcamera::Stream *stream = app.VideoStream(&info);
+		BufferReadSync r(&app, completed_request->buffers[stream]);
+		libcamera::Span<uint8_t> span = r.Get()[0];
+		std::vector<uint8_t> image(span.begin(), span.end());
+
+		auto still_options = std::make_shared<StillOptions>();
+		still_options->quality = 93;
+		still_options->restart = 0;
+		still_options->thumb_quality = 0;
+		still_options->output = filename;
+
+		snapshot = std::async(std::launch::async, [image = std::move(image), info, still_options,
+												   metadata = completed_request->metadata,
+												   camera_model = app.CameraModel()]() mutable {
+			std::string const &filename = still_options->output;
+			try
+			{
+				std::vector<libcamera::Span<uint8_t>> mem = { libcamera::Span<uint8_t>(image.data(), image.size()) };
+				jpeg_save(mem, info, metadata, filename, camera_model, still_options.get());
+				LOG(2, "Saved snapshot " << filename);
+			}
+			catch (std::exception const &e)
+			{
+				LOG_ERROR("ERROR: failed to save snapshot " << filename << ": " << e.what());
+			}
+		});
+	});
+}
+
 // The main even loop for the application.
 
-static void event_loop(RPiCamEncoder &app)
+static void event_loop(RPiCamEncoder &app, sigset_t const &signals)
 {
 	VideoOptions const *options = app.GetOptions();
 	std::unique_ptr<Output> output = std::unique_ptr<Output>(Output::Create(options));
@@ -73,64 +184,152 @@ static void event_loop(RPiCamEncoder &app)
 	app.ConfigureVideo(get_colourspace_flags(options->codec));
 	app.StartEncoder();
 	app.StartCamera();
-	auto start_time = std::chrono::high_resolution_clock::now();
+
+	EventLoop loop;
+	std::future<void> snapshot;
+	std::unique_ptr<ControlServer> control_server;
+	if (!options->control_socket.empty())
+	{
+		control_server = std::make_unique<ControlServer>(options->control_socket, loop);
+		add_control_commands(*control_server, app, *output, snapshot);
+	}
+	bool done = false;
+	auto stop = [&]() {
+		if (done)
+			return;
+		done = true;
+		app.StopCamera(); // stop complains if encoder very slow to close
+		app.StopEncoder();
+		loop.Quit();
+	};
+	auto handle_key = [&](int key) {
+		if (key == '\n')
+			output->Signal();
+		else if (key == 'x' || key == 'X')
+			stop();
+	};
+
+	int timeout_timer = -1;
+	if (!options->frames && options->timeout)
+	{
+		timeout_timer = loop.AddTimer([&]() {
+			LOG(1, "Halting: reached timeout of " << options->timeout.get<std::chrono::milliseconds>()
+												  << " milliseconds.");
+			stop();
+		});
+		loop.SetTimer(timeout_timer, options->timeout.value);
+	}
 
 	// Monitoring for keypresses and signals.
-	signal(SIGUSR1, default_signal_handler);
-	signal(SIGUSR2, default_signal_handler);
-	signal(SIGINT, default_signal_handler);
-	// SIGPIPE gets raised when trying to write to an already closed socket. This can happen, when
-	// you're using TCP to stream to VLC and the user presses the stop button in VLC. Catching the
-	// signal to be able to react on it, otherwise the app terminates.
-	signal(SIGPIPE, default_signal_handler);
-	pollfd p[1] = { { STDIN_FILENO, POLLIN, 0 } };
-
-	for (unsigned int count = 0; ; count++)
+	int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC | SFD_NONBLOCK);
+	sigpipe_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (signal_fd < 0 || sigpipe_fd < 0)
+		throw std::runtime_error("failed to create signal fds");
+	signal(SIGPIPE, sigpipe_handler);
+
+	loop.Add(signal_fd, [&]() {
+		signalfd_siginfo info;
+		while (!done && read(signal_fd, &info, sizeof(info)) == sizeof(info))
+			handle_key(signal_to_key(options, info.ssi_signo));
+	});
+	loop.Add(sigpipe_fd, [&]() {
+		uint64_t count;
+		if (read(sigpipe_fd, &count, sizeof(count)) == sizeof(count))
+			handle_key(signal_to_key(options, SIGPIPE));
+	});
+
+	// Each line typed is a keypress, of its first character.
+	bool line_start = true;
+	auto read_keys = [&]() {
+		char buf[256];
+		ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+		if (n <= 0)
+		{
+			// There's nothing more coming.
+			loop.Remove(STDIN_FILENO);
+			return;
+		}
+		for (ssize_t i = 0; i < n && !done; i++)
+		{
+			if (line_start)
+				handle_key(buf[i]);
+			line_start = buf[i] == '\n';
+		}
+	};
+	if (options->keypress)
 	{
-		RPiCamEncoder::Msg msg = app.Wait();
+		// epoll won't watch regular files or /dev/null, and there are no keypresses to wait for there anyway.
+		try
+		{
+			loop.Add(STDIN_FILENO, read_keys);
+		}
+		catch (std::exception const &e)
+		{
+			LOG(1, "Not reading keypresses from stdin: " << e.what());
+		}
+	}
+
+	unsigned int count = 0;
+	auto handle_message = [&](RPiCamEncoder::Msg &msg) {
 		if (msg.type == RPiCamApp::MsgType::Timeout)
 		{
 			LOG_ERROR("ERROR: Device timeout detected, attempting a restart!!!");
 			app.StopCamera();
 			app.StartCamera();
-			continue;
+			return;
 		}
 		if (msg.type == RPiCamEncoder::MsgType::Quit)
+		{
+			done = true;
+			loop.Quit();
 			return;
+		}
 		else if (msg.type != RPiCamEncoder::MsgType::RequestComplete)
 			throw std::runtime_error("unrecognised message!");
-		int key = get_key_or_signal(options, p);
-		if (key == '\n')
-			output->Signal();
 
 		LOG(2, "Viewfinder frame " << count);
-		auto now = std::chrono::high_resolution_clock::now();
-		bool timeout = !options->frames && options->timeout &&
-					   ((now - start_time) > options->timeout.value);
-		bool frameout = options->frames && count >= options->frames;
-		if (timeout || frameout || key == 'x' || key == 'X')
+		if (options->frames && count >= options->frames)
 		{
-			if (timeout)
-				LOG(1, "Halting: reached timeout of " << options->timeout.get<std::chrono::milliseconds>()
-													  << " milliseconds.");
-			app.StopCamera(); // stop complains if encoder very slow to close
-			app.StopEncoder();
+			stop();
 			return;
 		}
 		CompletedRequestPtr &completed_request = std::get<CompletedRequestPtr>(msg.payload);
+		if (control_server)
+			control_server->ApplyPending(completed_request);
 		if (!app.EncodeBuffer(completed_request, app.VideoStream()))
 		{
-			// Keep advancing our "start time" if we're still waiting to start recording (e.g.
+			// Keep putting off the timeout if we're still waiting to start recording (e.g.
 			// waiting for synchronisation with another camera).
-			start_time = now;
+			if (timeout_timer >= 0)
+				loop.SetTimer(timeout_timer, options->timeout.value);
 			count = 0; // reset the "frames encoded" counter too
 		}
 		app.ShowPreview(completed_request, app.VideoStream());
-	}
+	};
+
+	loop.Add(app.MessageFd(), [&]() {
+		while (!done)
+		{
+			std::optional<RPiCamEncoder::Msg> msg = app.TryWait();
+			if (!msg)
+				break;
+			handle_message(*msg);
+			count++;
+		}
+	});
+
+	loop.Run();
+
+	signal(SIGPIPE, SIG_IGN);
+	close(sigpipe_fd);
+	close(signal_fd);
 }
 
 int main(int argc, char *argv[])
 {
+	int ret = 0;
+	sigset_t old_mask;
+	sigset_t signals = block_signals(old_mask);
 	try
 	{
 		RPiCamEncoder app;
@@ -140,13 +339,16 @@ int main(int argc, char *argv[])
 			if (options->verbose >= 2)
 				options->Print();
 
-			event_loop(app);
+			event_loop(app, signals);
 		}
 	}
 	catch (std::exception const &e)
 	{
 		LOG_ERROR("ERROR: *** " << e.what() << " ***");
-		return -1;
+		ret = -1;
 	}
-	return 0;
+
+	// Everything that read those signals has gone, so give them back their usual effect.
+	pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+	return ret;
 }
@@ -21,13 +21,15 @@ struct CompletedRequest
 	using Request = libcamera::Request;
 
 	CompletedRequest(unsigned int seq, Request *r)
-		: sequence(seq), buffers(r->buffers()), metadata(r->metadata()), request(r)
+		: sequence(seq), buffers(r->buffers()), metadata(r->metadata()), controls(r->controls()), request(r)
 	{
 		r->reuse();
 	}
 	unsigned int sequence;
 	BufferMap buffers;
 	ControlList metadata;
+	// The controls that went with the request, which reuse() clears.
+	ControlList controls;
 	Request *request;
 	float framerate;
 	Metadata post_process_metadata;
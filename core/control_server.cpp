@@ -0,0 +1,325 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * control_server.cpp - change things in a running application over a unix socket.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <boost/property_tree/json_parser.hpp>
+
+#include <libcamera/control_ids.h>
+
+#include "core/control_server.hpp"
+#include "core/event_loop.hpp"
+#include "core/logging.hpp"
+
+using libcamera::ControlValue;
+
+namespace
+{
+
+template <typename T>
+std::vector<T> get_list(boost::property_tree::ptree const &value)
+{
+	std::vector<T> list;
+	for (auto const &item : value)
+		list.push_back(item.second.get_value<T>());
+	return list;
+}
+
+ControlValue parse_value(libcamera::ControlId const &id, boost::property_tree::ptree const &value)
+{
+	// JSON lists come back from boost as nodes with (unnamed) children, where plain values have none.
+	bool list = !value.empty();
+	switch (id.type())
+	{
+	case libcamera::ControlTypeBool:
+		if (!list)
+			return ControlValue(value.get_value<bool>());
+		break;
+	case libcamera::ControlTypeInteger32:
+		if (!list)
+			return ControlValue(value.get_value<int32_t>());
+		else
+		{
+			std::vector<int32_t> values = get_list<int32_t>(value);
+			return ControlValue(libcamera::Span<const int32_t>(values.data(), values.size()));
+		}
+	case libcamera::ControlTypeInteger64:
+		if (!list)
+			return ControlValue(value.get_value<int64_t>());
+		else
+		{
+			std::vector<int64_t> values = get_list<int64_t>(value);
+			return ControlValue(libcamera::Span<const int64_t>(values.data(), values.size()));
+		}
+	case libcamera::ControlTypeFloat:
+		if (!list)
+			return ControlValue(value.get_value<float>());
+		else
+		{
+			std::vector<float> values = get_list<float>(value);
+			return ControlValue(libcamera::Span<const float>(values.data(), values.size()));
+		}
+	case libcamera::ControlTypeRectangle:
+	{
+		std::vector<int> values = get_list<int>(value);
+		if (values.size() == 4 && values[2] >= 0 && values[3] >= 0)
+			return ControlValue(libcamera::Rectangle(values[0], values[1], values[2], values[3]));
+		break;
+	}
+	case libcamera::ControlTypeSize:
+	{
+		std::vector<unsigned int> values = get_list<unsigned int>(value);
+		if (values.size() == 2)
+			return ControlValue(libcamera::Size(values[0], values[1]));
+		break;
+	}
+	default:
+		throw std::runtime_error("can't set control " + id.name() + " of this type");
+	}
+
+	throw std::runtime_error("bad value for control " + id.name());
+}
+
+} // namespace
+
+ControlServer::ControlServer(std::string const &path, EventLoop &loop) : path_(path), loop_(loop), next_client_(0)
+{
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+		throw std::runtime_error("ControlServer: socket path too long: " + path);
+	memcpy(addr.sun_path, path.c_str(), path.size());
+
+	listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (listen_fd_ < 0)
+		throw std::runtime_error("ControlServer: failed to create socket: " + std::string(strerror(errno)));
+
+	// A socket left behind by an earlier run would stop us binding, but don't remove anything else.
+	struct stat st;
+	if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path.c_str());
+
+	if (bind(listen_fd_, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd_, 4) < 0)
+	{
+		std::string error = strerror(errno);
+		close(listen_fd_);
+		throw std::runtime_error("ControlServer: failed to listen on " + path + ": " + error);
+	}
+
+	loop_.Add(listen_fd_, [this]() { acceptClient(); });
+	LOG(1, "ControlServer: listening on " << path_);
+}
+
+ControlServer::~ControlServer()
+{
+	while (!clients_.empty())
+		closeClient(clients_.begin()->first);
+	loop_.Remove(listen_fd_);
+	close(listen_fd_);
+	unlink(path_.c_str());
+}
+
+void ControlServer::AddCommand(std::string const &name, Handler handler)
+{
+	handlers_[name] = [handler](CompletedRequestPtr &completed_request, ptree const &command, ptree &reply) {
+		handler(completed_request, command, reply);
+		return Until();
+	};
+}
+
+void ControlServer::AddDeferredCommand(std::string const &name, DeferredHandler handler)
+{
+	handlers_[name] = handler;
+}
+
+void ControlServer::ApplyPending(unsigned int sequence, CompletedRequestPtr &completed_request)
+{
+	// Commands from earlier frames first, as nothing that runs now can have taken effect yet.
+	for (auto it = waiting_.begin(); it != waiting_.end();)
+	{
+		if (it->until(completed_request))
+			it->reply.put("ok", true);
+		else if (++it->frames >= MAX_WAIT)
+		{
+			it->reply.put("ok", false);
+			it->reply.put("error", "command didn't take effect");
+		}
+		else
+		{
+			++it;
+			continue;
+		}
+		finishCommand(it->client, it->reply, sequence);
+		it = waiting_.erase(it);
+	}
+
+	while (!pending_.empty())
+	{
+		Command command = std::move(pending_.front());
+		pending_.pop();
+
+		ptree reply;
+		if (auto id = command.command.get_optional<std::string>("id"))
+			reply.put("id", *id);
+		try
+		{
+			DeferredHandler &handler = handlers_.at(command.command.get<std::string>("command"));
+			Until until = handler(completed_request, command.command, reply);
+			if (until)
+			{
+				waiting_.push_back({ command.client, std::move(reply), until, 0 });
+				continue;
+			}
+			reply.put("ok", true);
+		}
+		catch (std::exception const &e)
+		{
+			reply.put("ok", false);
+			reply.put("error", e.what());
+		}
+		finishCommand(command.client, reply, sequence);
+	}
+}
+
+libcamera::ControlList ControlServer::ParseControls(ptree const &controls, libcamera::ControlInfoMap const &info)
+{
+	libcamera::ControlList list(libcamera::controls::controls);
+	for (auto const &[name, value] : controls)
+	{
+		auto it = std::find_if(info.begin(), info.end(),
+							   [&name = name](auto const &i) { return i.first->name() == name; });
+		if (it == info.end())
+			throw std::runtime_error("unknown control " + name);
+		list.set(it->first->id(), parse_value(*it->first, value));
+	}
+	return list;
+}
+
+void ControlServer::acceptClient()
+{
+	int fd;
+	while ((fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0)
+	{
+		unsigned int client = next_client_++;
+		clients_[client] = { fd, "", 0, false };
+		loop_.Add(fd, [this, client]() { readClient(client); });
+		LOG(2, "ControlServer: client " << client << " connected");
+	}
+}
+
+void ControlServer::readClient(unsigned int client)
+{
+	Client &c = clients_.at(client);
+	char buf[4096];
+	ssize_t n;
+	while ((n = read(c.fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR))
+	{
+		if (n > 0)
+			c.input.append(buf, n);
+	}
+	// n == 0 means the client has finished sending, though it may still be waiting for replies.
+	bool finished = n == 0 || errno != EAGAIN;
+
+	size_t pos;
+	while ((pos = c.input.find('\n')) != std::string::npos)
+	{
+		std::string line = c.input.substr(0, pos);
+		c.input.erase(0, pos + 1);
+		handleLine(client, line);
+		if (!clients_.count(client))
+			return;
+	}
+
+	if (c.input.size() > MAX_LINE)
+	{
+		LOG_ERROR("ControlServer: command from client " << client << " too long");
+		closeClient(client);
+	}
+	else if (finished)
+	{
+		loop_.Remove(c.fd);
+		c.finished = true;
+		if (!c.pending)
+			closeClient(client);
+	}
+}
+
+void ControlServer::handleLine(unsigned int client, std::string const &line)
+{
+	if (line.find_first_not_of(" \t\r") == std::string::npos)
+		return;
+
+	ptree command;
+	ptree reply;
+	try
+	{
+		std::istringstream in(line);
+		boost::property_tree::read_json(in, command);
+		if (auto id = command.get_optional<std::string>("id"))
+			reply.put("id", *id);
+		std::string name = command.get<std::string>("command", "");
+		if (!handlers_.count(name))
+			throw std::runtime_error("unknown command \"" + name + "\"");
+	}
+	catch (std::exception const &e)
+	{
+		// Nothing to wait for, so say so straight away.
+		reply.put("ok", false);
+		reply.put("error", e.what());
+		sendReply(client, reply);
+		return;
+	}
+
+	clients_.at(client).pending++;
+	pending_.push({ client, std::move(command) });
+}
+
+void ControlServer::closeClient(unsigned int client)
+{
+	Client &c = clients_.at(client);
+	loop_.Remove(c.fd);
+	close(c.fd);
+	clients_.erase(client);
+	LOG(2, "ControlServer: client " << client << " disconnected");
+}
+
+void ControlServer::finishCommand(unsigned int client, ptree &reply, unsigned int sequence)
+{
+	reply.put("sequence", sequence);
+	auto it = clients_.find(client);
+	if (it == clients_.end())
+		return;
+	it->second.pending--;
+	sendReply(client, reply);
+}
+
+void ControlServer::sendReply(unsigned int client, ptree const &reply)
+{
+	std::ostringstream out;
+	boost::property_tree::write_json(out, reply, false); // this ends the line too
+	std::string const text = out.str();
+
+	// Replies are small, so if one doesn't fit in the socket the client can't be reading them.
+	Client &c = clients_.at(client);
+	if (send(c.fd, text.data(), text.size(), MSG_NOSIGNAL | MSG_DONTWAIT) != (ssize_t)text.size())
+	{
+		LOG_ERROR("ControlServer: client " << client << " isn't taking replies");
+		closeClient(client);
+	}
+	else if (c.finished && !c.pending)
+		closeClient(client);
+}
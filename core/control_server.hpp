@@ -0,0 +1,106 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * control_server.hpp - change things in a running application over a unix socket.
+ */
+
+#pragma once
+
+#include <functional>
+#include <list>
+#include <map>
+#include <queue>
+#include <string>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <libcamera/controls.h>
+
+#include "core/completed_request.hpp"
+
+class EventLoop;
+
+// Clients connect to a unix socket and send JSON objects, one per line, each with a "command" and optionally an
+// "id" that's copied into the reply. Commands wait for the next frame boundary, when the application calls
+// ApplyPending(), and run there in the order they arrived. Each gets a one line JSON reply with "ok", an "error" if
+// it failed, and the "sequence" number of the frame where it took effect. Most commands take effect at the frame
+// they run at, but some only do at a later one (controls given to the camera go with a request that hasn't been
+// queued yet), and their replies wait for it, so replies don't always come back in the order the commands went.
+// Everything runs on the event loop's thread, so command handlers can use the application freely. Note that boost's
+// JSON writer gives all values as strings.
+class ControlServer
+{
+public:
+	typedef boost::property_tree::ptree ptree;
+	// Run a command at this frame, adding anything to report to the reply. Throw std::runtime_error to fail it.
+	typedef std::function<void(CompletedRequestPtr &completed_request, ptree const &command, ptree &reply)> Handler;
+	// Called at each frame after the one a command ran at, until it returns true for the frame where the command
+	// took effect. The command fails if that hasn't happened after MAX_WAIT frames.
+	typedef std::function<bool(CompletedRequestPtr &completed_request)> Until;
+	// As for a Handler, for a command that takes effect at a later frame, which the function it returns picks out.
+	typedef std::function<Until(CompletedRequestPtr &completed_request, ptree const &command, ptree &reply)>
+		DeferredHandler;
+
+	static constexpr unsigned int MAX_WAIT = 100;
+
+	ControlServer(std::string const &path, EventLoop &loop);
+	~ControlServer();
+
+	void AddCommand(std::string const &name, Handler handler);
+	void AddDeferredCommand(std::string const &name, DeferredHandler handler);
+
+	// Run the commands that have arrived since the last frame, and answer any that were waiting for this one.
+	void ApplyPending(CompletedRequestPtr &completed_request)
+	{
+		ApplyPending(completed_request->sequence, completed_request);
+	}
+	// The same, giving the frame's sequence number separately, for frames that don't come with a request.
+	void ApplyPending(unsigned int sequence, CompletedRequestPtr &completed_request);
+
+	// Turn a JSON object of control names and values into a ControlList, checking them against the controls the
+	// camera has. Arrays, and rectangles and sizes (as [x, y, width, height] and [width, height]), are JSON lists.
+	static libcamera::ControlList ParseControls(ptree const &controls, libcamera::ControlInfoMap const &info);
+
+private:
+	// Lines longer than this can't be a command, and the client gets disconnected.
+	static constexpr size_t MAX_LINE = 65536;
+
+	struct Client
+	{
+		int fd;
+		std::string input;
+		// Commands still to be answered. A client that has finished sending is kept until they all are.
+		unsigned int pending;
+		bool finished;
+	};
+	struct Command
+	{
+		unsigned int client;
+		ptree command;
+	};
+	// A command that has run, and whose reply waits for the frame where it takes effect.
+	struct Waiting
+	{
+		unsigned int client;
+		ptree reply;
+		Until until;
+		unsigned int frames;
+	};
+
+	void acceptClient();
+	void readClient(unsigned int client);
+	void handleLine(unsigned int client, std::string const &line);
+	void closeClient(unsigned int client);
+	void finishCommand(unsigned int client, ptree &reply, unsigned int sequence);
+	void sendReply(unsigned int client, ptree const &reply);
+
+	std::string path_;
+	EventLoop &loop_;
+	int listen_fd_;
+	unsigned int next_client_;
+	std::map<unsigned int, Client> clients_;
+	std::map<std::string, DeferredHandler> handlers_;
+	std::queue<Command> pending_;
+	std::list<Waiting> waiting_;
+};
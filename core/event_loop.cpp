@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * event_loop.cpp - a small epoll-based event loop for applications.
+ */
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "core/event_loop.hpp"
+
+EventLoop::EventLoop() : quit_(false)
+{
+	epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd_ < 0)
+		throw std::runtime_error("EventLoop: epoll_create1 failed: " + std::string(strerror(errno)));
+}
+
+EventLoop::~EventLoop()
+{
+	close(epoll_fd_);
+}
+
+void EventLoop::Add(int fd, Callback callback)
+{
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = fd;
+	if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0)
+		throw std::runtime_error("EventLoop: failed to add fd " + std::to_string(fd) + ": " + strerror(errno));
+	callbacks_[fd] = std::make_shared<Callback>(std::move(callback));
+}
+
+void EventLoop::Remove(int fd)
+{
+	epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+	callbacks_.erase(fd);
+}
+
+int EventLoop::AddTimer(Callback callback)
+{
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (fd < 0)
+		throw std::runtime_error("EventLoop: timerfd_create failed: " + std::string(strerror(errno)));
+
+	Add(fd, [fd, callback]() {
+		uint64_t expirations;
+		if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+			callback();
+	});
+	return fd;
+}
+
+void EventLoop::SetTimer(int timer, std::chrono::nanoseconds delay)
+{
+	itimerspec spec = {};
+	spec.it_value.tv_sec = delay.count() / 1000000000;
+	spec.it_value.tv_nsec = delay.count() % 1000000000;
+	if (timerfd_settime(timer, 0, &spec, nullptr) < 0)
+		throw std::runtime_error("EventLoop: timerfd_settime failed: " + std::string(strerror(errno)));
+}
+
+void EventLoop::RemoveTimer(int timer)
+{
+	Remove(timer);
+	close(timer);
+}
+
+void EventLoop::Run()
+{
+	constexpr int MAX_EVENTS = 8;
+	epoll_event events[MAX_EVENTS];
+
+	quit_ = false;
+	while (!quit_)
+	{
+		int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw std::runtime_error("EventLoop: epoll_wait failed: " + std::string(strerror(errno)));
+		}
+
+		for (int i = 0; i < n && !quit_; i++)
+		{
+			// An earlier callback may have removed this one. Hold on to it, as it may remove itself.
+			auto it = callbacks_.find(events[i].data.fd);
+			if (it == callbacks_.end())
+				continue;
+			std::shared_ptr<Callback> callback = it->second;
+			(*callback)();
+		}
+	}
+}
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * event_loop.hpp - a small epoll-based event loop for applications.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+
+// Runs callbacks, on the thread that calls Run(), whenever their file descriptors become readable, and sleeps in
+// between. Anything with an fd can be watched: the application's message queue (RPiCamApp::MessageFd()), a
+// signalfd, stdin, sockets and so on. Timers are timerfds that the loop owns. Callbacks may add and remove fds and
+// timers, including their own.
+class EventLoop
+{
+public:
+	typedef std::function<void()> Callback;
+
+	EventLoop();
+	~EventLoop();
+
+	// Watch an fd, which stays the caller's to close (after removing it). Throws if epoll can't watch it, as with
+	// regular files and /dev/null.
+	void Add(int fd, Callback callback);
+	void Remove(int fd);
+
+	// Make a timer, initially stopped, that calls back once each time it's started and then expires.
+	int AddTimer(Callback callback);
+	// Start the timer, or restart it if it's already running. A zero delay stops it.
+	void SetTimer(int timer, std::chrono::nanoseconds delay);
+	void RemoveTimer(int timer);
+
+	// Dispatch events until Quit() is called.
+	void Run();
+	void Quit() { quit_ = true; }
+
+private:
+	int epoll_fd_;
+	// Shared, so that a callback that removes itself lives until it returns.
+	std::map<int, std::shared_ptr<Callback>> callbacks_;
+	bool quit_;
+};
@@ -231,6 +231,17 @@ Options::Options()
 			"Use a fullscreen preview window")
 		("qt-preview", value<bool>(&qt_preview)->default_value(false)->implicit_value(true),
 			"Use Qt-based preview window (WARNING: causes heavy CPU load, fullscreen not supported)")
+		("preview-fps", value<float>(&preview_fps)->default_value(0),
+			"Limit the preview to this many frames per second, evenly spaced, or 0 to show every frame it can")
+		("preview-lores", value<bool>(&preview_lores)->default_value(false)->implicit_value(true),
+			"Show the lores stream in the preview, when there is one, which is cheaper than the full size stream")
+		("http-preview", value<unsigned int>(&http_preview)->default_value(0),
+			"Serve the preview over HTTP on this localhost port, as /snapshot.jpg and /stream.mjpg, instead of "
+			"showing a window")
+		("http-preview-fps", value<float>(&http_preview_fps)->default_value(5),
+			"Maximum frame rate of the HTTP preview's MJPEG stream")
+		("http-preview-width", value<unsigned int>(&http_preview_width)->default_value(640),
+			"Maximum width of the HTTP preview's images, larger frames being scaled down")
 		("hflip", value<bool>(&hflip_)->default_value(false)->implicit_value(true), "Request a horizontal flip transform")
 		("vflip", value<bool>(&vflip_)->default_value(false)->implicit_value(true), "Request a vertical flip transform")
 		("rotation", value<int>(&rotation_)->default_value(0), "Request an image rotation, 0 or 180")
@@ -549,6 +560,10 @@ bool Options::Parse(int argc, char *argv[])
 
 	if (sscanf(preview.c_str(), "%u,%u,%u,%u", &preview_x, &preview_y, &preview_width, &preview_height) != 4)
 		preview_x = preview_y = preview_width = preview_height = 0; // use default window
+	if (preview_fps < 0)
+		throw std::runtime_error("preview-fps must not be negative");
+	if (http_preview && (http_preview_fps <= 0 || http_preview_width < 16))
+		throw std::runtime_error("http-preview-fps must be positive and http-preview-width at least 16");
 
 	transform = Transform::Identity;
 	if (hflip_)
@@ -672,6 +687,14 @@ void Options::Print() const
 		std::cerr << "    preview: " << preview_x << "," << preview_y << "," << preview_width << ","
 					<< preview_height << std::endl;
 	std::cerr << "    qt-preview: " << qt_preview << std::endl;
+	if (preview_fps)
+		std::cerr << "    preview-fps: " << preview_fps << std::endl;
+	else
+		std::cerr << "    preview-fps: unlimited" << std::endl;
+	std::cerr << "    preview-lores: " << preview_lores << std::endl;
+	if (http_preview)
+		std::cerr << "    http-preview: port " << http_preview << ", " << http_preview_fps << "fps, width "
+				  << http_preview_width << std::endl;
 	std::cerr << "    transform: " << transformToString(transform) << std::endl;
 	if (roi_width == 0 || roi_height == 0)
 		std::cerr << "    roi: all" << std::endl;
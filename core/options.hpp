@@ -149,6 +149,11 @@ struct Options
 	unsigned int viewfinder_height;
 	std::string tuning_file;
 	bool qt_preview;
+	float preview_fps;
+	bool preview_lores;
+	unsigned int http_preview;
+	float http_preview_fps;
+	unsigned int http_preview_width;
 	unsigned int lores_width;
 	unsigned int lores_height;
 	bool lores_par;
@@ -11,11 +11,14 @@
 #include "core/rpicam_app.hpp"
 #include "core/options.hpp"
 
+#include <cerrno>
 #include <cmath>
+#include <cstring>
 #include <fcntl.h>
 #include <stdlib.h>
 
 #include <sys/ioctl.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 
 #include <linux/dma-buf.h>
@@ -104,7 +107,7 @@ RPiCamApp::~RPiCamApp()
 	if (!options_->help)
 		LOG(2, "Closing RPiCam application"
 				   << "(frames displayed " << preview_frames_displayed_ << ", dropped " << preview_frames_dropped_
-				   << ")");
+				   << ", skipped " << preview_frames_skipped_ << ")");
 	StopCamera();
 	Teardown();
 	CloseCamera();
@@ -631,6 +634,8 @@ void RPiCamApp::Teardown()
 
 	frame_buffers_.clear();
 
+	software_streams_.clear();
+
 	streams_.clear();
 }
 
@@ -789,6 +794,10 @@ void RPiCamApp::StartCamera()
 	controls_.clear();
 	camera_started_ = true;
 	last_timestamp_ = 0;
+	{
+		std::lock_guard<std::mutex> lock(preview_item_mutex_);
+		preview_next_due_ = 0;
+	}
 
 	post_processor_.Start();
 
@@ -841,9 +850,20 @@ RPiCamApp::Msg RPiCamApp::Wait()
 	return msg_queue_.Wait();
 }
 
+int RPiCamApp::MessageFd() const
+{
+	return msg_queue_.Fd();
+}
+
+std::optional<RPiCamApp::Msg> RPiCamApp::TryWait()
+{
+	return msg_queue_.TryWait();
+}
+
 void RPiCamApp::queueRequest(CompletedRequest *completed_request)
 {
 	BufferMap buffers(std::move(completed_request->buffers));
+	releaseSoftwareBuffers(buffers);
 
 	// This function may run asynchronously so needs protection from the
 	// camera stopping at the same time.
@@ -937,6 +957,98 @@ libcamera::Stream *RPiCamApp::LoresStream(StreamInfo *info) const
 	return GetStream("lores", info);
 }
 
+libcamera::Stream *RPiCamApp::AddSoftwareStream(std::string const &name, StreamConfiguration const &config)
+{
+	if (streams_.find(name) != streams_.end())
+		throw std::runtime_error("stream " + name + " already exists");
+
+	// A completed request holds a buffer from every camera stream, so having as many
+	// buffers as the largest camera stream means we can never run out.
+	unsigned int buffer_count = 0;
+	for (auto const &kv : frame_buffers_)
+		buffer_count = std::max<unsigned int>(buffer_count, kv.second.size());
+
+	auto stream = std::make_unique<SoftwareStream>(config);
+	for (unsigned int i = 0; i < buffer_count; i++)
+	{
+		std::string buffer_name("rpicam-apps-" + name + std::to_string(i));
+		libcamera::UniqueFD fd = dma_heap_.alloc(buffer_name.c_str(), config.frameSize);
+
+		if (!fd.isValid())
+			throw std::runtime_error("failed to allocate buffers for software stream " + name);
+
+		std::vector<FrameBuffer::Plane> plane(1);
+		plane[0].fd = libcamera::SharedFD(std::move(fd));
+		plane[0].offset = 0;
+		plane[0].length = config.frameSize;
+
+		void *memory = mmap(NULL, config.frameSize, PROT_READ | PROT_WRITE, MAP_SHARED, plane[0].fd.get(), 0);
+		if (memory == MAP_FAILED)
+		{
+			std::string error = strerror(errno);
+			// The stream (and its buffers) goes away, so don't leave their mappings behind.
+			for (auto const &buffer : stream->buffers)
+			{
+				for (auto const &span : mapped_buffers_[buffer.get()])
+					munmap(span.data(), span.size());
+				mapped_buffers_.erase(buffer.get());
+			}
+			throw std::runtime_error("failed to map buffers for software stream " + name + ": " + error);
+		}
+
+		stream->buffers.push_back(std::make_unique<FrameBuffer>(plane));
+		mapped_buffers_[stream->buffers.back().get()].push_back(
+			libcamera::Span<uint8_t>(static_cast<uint8_t *>(memory), config.frameSize));
+		stream->free_buffers.push(stream->buffers.back().get());
+	}
+
+	LOG(2, "Software stream " << name << " " << config.toString() << " with " << buffer_count << " buffers");
+
+	Stream *s = stream.get();
+	streams_[name] = s;
+	software_streams_[s] = std::move(stream);
+	return s;
+}
+
+RPiCamApp::FrameBuffer *RPiCamApp::AttachSoftwareBuffer(CompletedRequestPtr &completed_request, Stream *stream)
+{
+	std::lock_guard<std::mutex> lock(software_buffers_mutex_);
+
+	auto it = software_streams_.find(stream);
+	if (it == software_streams_.end())
+		throw std::runtime_error("not a software stream");
+	if (it->second->free_buffers.empty())
+	{
+		LOG_ERROR("No free buffers for software stream");
+		return nullptr;
+	}
+
+	FrameBuffer *buffer = it->second->free_buffers.front();
+	it->second->free_buffers.pop();
+	completed_request->buffers[stream] = buffer;
+	return buffer;
+}
+
+// Take the software stream buffers out of the map and put them back on their free lists,
+// leaving only the ones that go back to the camera.
+
+void RPiCamApp::releaseSoftwareBuffers(BufferMap &buffers)
+{
+	std::lock_guard<std::mutex> lock(software_buffers_mutex_);
+
+	for (auto it = buffers.begin(); it != buffers.end();)
+	{
+		auto software_stream = software_streams_.find(it->first);
+		if (software_stream != software_streams_.end())
+		{
+			software_stream->second->free_buffers.push(it->second);
+			it = buffers.erase(it);
+		}
+		else
+			++it;
+	}
+}
+
 libcamera::Stream *RPiCamApp::GetMainStream() const
 {
 	for (auto &p : streams_)
@@ -955,14 +1067,39 @@ const libcamera::CameraManager *RPiCamApp::GetCameraManager() const
 
 void RPiCamApp::ShowPreview(CompletedRequestPtr &completed_request, Stream *stream)
 {
+	if (options_->preview_lores)
+	{
+		Stream *lores = LoresStream();
+		if (lores && lores->configuration().pixelFormat == libcamera::formats::YUV420 &&
+			completed_request->buffers.count(lores))
+			stream = lores;
+		else if (!preview_lores_warned_)
+		{
+			LOG(1, "No YUV420 lores stream to preview, showing the full size stream instead");
+			preview_lores_warned_ = true;
+		}
+	}
+
 	std::lock_guard<std::mutex> lock(preview_item_mutex_);
-	if (!preview_item_.stream)
-		preview_item_ = PreviewItem(completed_request, stream); // copy the shared_ptr here
-	else
+	if (!previewFrameDue(completed_request))
+	{
+		preview_frames_skipped_++;
+		return;
+	}
+
+	// If the preview hasn't even picked up the last frame yet, it may as well have this newer one instead.
+	if (preview_item_.stream)
 		preview_frames_dropped_++;
+	preview_item_ = PreviewItem(completed_request, stream); // copy the shared_ptr here
 	preview_cond_var_.notify_one();
 }
 
+RPiCamApp::PreviewStats RPiCamApp::GetPreviewStats() const
+{
+	std::lock_guard<std::mutex> lock(preview_item_mutex_);
+	return { preview_frames_displayed_, preview_frames_dropped_, preview_frames_skipped_ };
+}
+
 void RPiCamApp::SetControls(const ControlList &controls)
 {
 	std::lock_guard<std::mutex> lock(control_mutex_);
@@ -1156,8 +1293,37 @@ void RPiCamApp::stopPreview()
 	preview_completed_requests_.clear();
 }
 
+bool RPiCamApp::previewFrameDue(CompletedRequestPtr const &completed_request)
+{
+	if (!options_->preview_fps)
+		return true;
+
+	auto ts = completed_request->metadata.get(controls::SensorTimestamp);
+	uint64_t timestamp = ts ? *ts : completed_request->buffers.begin()->second->metadata().timestamp;
+	const uint64_t interval = 1e9 / options_->preview_fps;
+
+	// Frames only come at the camera's rate, so take the one nearest each due time, which may be up to half a frame
+	// early. Picking by timestamp, rather than whatever comes first when the preview is free, keeps them evenly spaced.
+	const uint64_t slack = completed_request->framerate > 0 ? 0.5e9 / completed_request->framerate : 0;
+	if (preview_next_due_ && timestamp + slack < preview_next_due_)
+		return false;
+
+	// Step on from when this frame was due, not from when it came, so the rate doesn't drift. After a gap (or the
+	// first time), start again from here.
+	if (!preview_next_due_ || timestamp >= preview_next_due_ + interval)
+		preview_next_due_ = timestamp + interval;
+	else
+		preview_next_due_ += interval;
+	return true;
+}
+
 void RPiCamApp::previewThread()
 {
+	// The preview is only there to look at, so it mustn't hold up the encoder or anything else that's working on the
+	// same frames. On Linux this lowers the priority of just this thread.
+	if (setpriority(PRIO_PROCESS, 0, getpriority(PRIO_PROCESS, 0) + PREVIEW_NICE) < 0)
+		LOG(1, "Failed to lower preview thread priority: " << strerror(errno));
+
 	while (true)
 	{
 		PreviewItem item;
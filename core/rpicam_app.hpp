@@ -7,12 +7,16 @@
 
 #pragma once
 
+#include <sys/eventfd.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
+#include <atomic>
 #include <condition_variable>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <queue>
 #include <set>
 #include <sstream>
@@ -145,6 +149,10 @@ public:
 	void StopCamera();
 
 	Msg Wait();
+	// For event loops: the fd becomes readable when messages arrive, and TryWait() returns them, without blocking,
+	// until there are none left.
+	int MessageFd() const;
+	std::optional<Msg> TryWait();
 	void PostMessage(MsgType &t, MsgPayload &p);
 
 	Stream *GetStream(std::string const &name, StreamInfo *info = nullptr) const;
@@ -155,13 +163,31 @@ public:
 	Stream *LoresStream(StreamInfo *info = nullptr) const;
 	Stream *GetMainStream() const;
 
+	// Software streams are produced by post-processing stages rather than the camera,
+	// for example a lores stream when the camera can't provide one. GetStream() finds
+	// them just like any other stream, so they must be added from a stage's Configure()
+	// before the stages that want to use them are configured. The stage that produces
+	// the stream attaches a buffer to each completed request, and then fills it.
+	Stream *AddSoftwareStream(std::string const &name, StreamConfiguration const &config);
+	FrameBuffer *AttachSoftwareBuffer(CompletedRequestPtr &completed_request, Stream *stream);
+
 	const CameraManager *GetCameraManager() const;
 	std::vector<std::shared_ptr<libcamera::Camera>> GetCameras()
 	{
 		return GetCameras(camera_manager_.get());
 	}
 
+	// Frames reach the preview only when it's ready for one, and no faster than --preview-fps. Those turned away for
+	// arriving too soon are "skipped"; those turned away because the preview was still busy are "dropped".
+	struct PreviewStats
+	{
+		uint32_t displayed;
+		uint32_t dropped;
+		uint32_t skipped;
+	};
+
 	void ShowPreview(CompletedRequestPtr &completed_request, Stream *stream);
+	PreviewStats GetPreviewStats() const;
 
 	void SetControls(const ControlList &controls);
 	StreamInfo GetStreamInfo(Stream const *stream) const;
@@ -169,6 +195,10 @@ public:
 	{
 		return camera_->properties();
 	}
+	const libcamera::ControlInfoMap &GetControlInfo() const
+	{
+		return camera_->controls();
+	}
 
 	static unsigned int verbosity;
 	static unsigned int GetVerbosity() { return verbosity; }
@@ -197,12 +227,20 @@ private:
 	class MessageQueue
 	{
 	public:
+		MessageQueue() : fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+		{
+			if (fd_ < 0)
+				throw std::runtime_error("failed to create message queue eventfd");
+		}
+		~MessageQueue() { close(fd_); }
 		template <typename U>
 		void Post(U &&msg)
 		{
 			std::unique_lock<std::mutex> lock(mutex_);
 			queue_.push(std::forward<U>(msg));
 			cond_.notify_one();
+			uint64_t one = 1;
+			[[maybe_unused]] ssize_t r = write(fd_, &one, sizeof(one));
 		}
 		T Wait()
 		{
@@ -212,6 +250,19 @@ private:
 			queue_.pop();
 			return msg;
 		}
+		// Readable whenever something may have been posted, until TryWait() has emptied the queue.
+		int Fd() const { return fd_; }
+		std::optional<T> TryWait()
+		{
+			uint64_t count;
+			[[maybe_unused]] ssize_t r = read(fd_, &count, sizeof(count));
+			std::unique_lock<std::mutex> lock(mutex_);
+			if (queue_.empty())
+				return std::nullopt;
+			T msg = std::move(queue_.front());
+			queue_.pop();
+			return msg;
+		}
 		void Clear()
 		{
 			std::unique_lock<std::mutex> lock(mutex_);
@@ -222,6 +273,7 @@ private:
 		std::queue<T> queue_;
 		std::mutex mutex_;
 		std::condition_variable cond_;
+		int fd_;
 	};
 	struct PreviewItem
 	{
@@ -238,8 +290,17 @@ private:
 		Stream *stream;
 	};
 
+	class SoftwareStream : public Stream
+	{
+	public:
+		SoftwareStream(StreamConfiguration const &config) { configuration_ = config; }
+		std::vector<std::unique_ptr<FrameBuffer>> buffers;
+		std::queue<FrameBuffer *> free_buffers;
+	};
+
 	void initCameraManager();
 	void setupCapture();
+	void releaseSoftwareBuffers(BufferMap &buffers);
 	void makeRequests();
 	void queueRequest(CompletedRequest *completed_request);
 	void requestComplete(Request *request);
@@ -247,6 +308,7 @@ private:
 	void startPreview();
 	void stopPreview();
 	void previewThread();
+	bool previewFrameDue(CompletedRequestPtr const &completed_request);
 	void configureDenoise(const std::string &denoise_mode);
 	Mode selectMode(const Mode &mode) const;
 
@@ -258,6 +320,8 @@ private:
 	std::map<std::string, Stream *> streams_;
 	DmaHeap dma_heap_;
 	std::map<Stream *, std::vector<std::unique_ptr<FrameBuffer>>> frame_buffers_;
+	std::map<Stream const *, std::unique_ptr<SoftwareStream>> software_streams_;
+	std::mutex software_buffers_mutex_;
 	std::vector<std::unique_ptr<Request>> requests_;
 	std::mutex completed_requests_mutex_;
 	std::set<CompletedRequest *> completed_requests_;
@@ -269,12 +333,15 @@ private:
 	std::unique_ptr<Preview> preview_;
 	std::map<int, CompletedRequestPtr> preview_completed_requests_;
 	std::mutex preview_mutex_;
-	std::mutex preview_item_mutex_;
+	mutable std::mutex preview_item_mutex_;
 	PreviewItem preview_item_;
 	std::condition_variable preview_cond_var_;
 	bool preview_abort_ = false;
-	uint32_t preview_frames_displayed_ = 0;
+	uint64_t preview_next_due_ = 0;
+	bool preview_lores_warned_ = false;
+	std::atomic<uint32_t> preview_frames_displayed_ = 0;
 	uint32_t preview_frames_dropped_ = 0;
+	uint32_t preview_frames_skipped_ = 0;
 	std::thread preview_thread_;
 	// For setting camera controls.
 	std::mutex control_mutex_;
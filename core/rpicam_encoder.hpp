@@ -74,6 +74,8 @@ public:
 	}
 	VideoOptions *GetOptions() const { return static_cast<VideoOptions *>(options_.get()); }
 	void StopEncoder() { encoder_.reset(); }
+	void RequestKeyframe() { encoder_->RequestKeyframe(); }
+	void SetBitrate(uint64_t bps) { encoder_->SetBitrate(bps); }
 
 protected:
 	virtual void createEncoder()
@@ -163,6 +163,9 @@ struct VideoOptions : public Options
 #endif
 			 ("sync", value<std::string>(&sync_)->default_value("off"),
 			  "Whether to synchronise with another camera. Use \"off\", \"server\" or \"client\".")
+			("control-socket", value<std::string>(&control_socket),
+			 "Accept JSON commands on a unix socket at this path, to change camera controls, the bitrate and so on "
+			 "while recording")
 			;
 		// clang-format on
 	}
@@ -197,6 +200,7 @@ struct VideoOptions : public Options
 	uint32_t frames;
 	bool low_latency;
 	uint32_t sync;
+	std::string control_socket;
 
 	virtual bool Parse(int argc, char *argv[]) override
 	{
@@ -270,6 +274,7 @@ struct VideoOptions : public Options
 		std::cerr << "    segment: " << segment << std::endl;
 		std::cerr << "    circular: " << circular << std::endl;
 		std::cerr << "    sync: " << sync << std::endl;
+		std::cerr << "    control-socket: " << control_socket << std::endl;
 	}
 
 private:
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <functional>
+#include <stdexcept>
 
 #include "core/stream_info.hpp"
 #include "core/video_options.hpp"
@@ -32,6 +33,13 @@ public:
 	// Encode the given buffer. The buffer is specified both by an fd and size
 	// describing a DMABUF, and by a mmapped userland pointer.
 	virtual void EncodeBuffer(int fd, size_t size, void *mem, StreamInfo const &info, int64_t timestamp_us) = 0;
+	// Make the next frame a keyframe. There's nothing to do for encoders where every frame is one.
+	virtual void RequestKeyframe() {}
+	// Change the bitrate while encoding, for encoders that can.
+	virtual void SetBitrate([[maybe_unused]] uint64_t bps)
+	{
+		throw std::runtime_error("this encoder can't change its bitrate");
+	}
 
 protected:
 	InputDoneCallback input_done_callback_;
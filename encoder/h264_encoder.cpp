@@ -14,6 +14,7 @@
 
 #include <chrono>
 #include <iostream>
+#include <limits>
 
 #include "h264_encoder.hpp"
 
@@ -272,6 +273,26 @@ void H264Encoder::EncodeBuffer(int fd, size_t size, void *mem, StreamInfo const
 		throw std::runtime_error("failed to queue input to codec");
 }
 
+void H264Encoder::RequestKeyframe()
+{
+	v4l2_control ctrl = {};
+	ctrl.id = V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME;
+	if (xioctl(fd_, VIDIOC_S_CTRL, &ctrl) < 0)
+		throw std::runtime_error("failed to force keyframe");
+}
+
+void H264Encoder::SetBitrate(uint64_t bps)
+{
+	if (bps > (uint64_t)std::numeric_limits<int32_t>::max())
+		throw std::runtime_error("bitrate too high for the H.264 encoder");
+
+	v4l2_control ctrl = {};
+	ctrl.id = V4L2_CID_MPEG_VIDEO_BITRATE;
+	ctrl.value = bps;
+	if (xioctl(fd_, VIDIOC_S_CTRL, &ctrl) < 0)
+		throw std::runtime_error("failed to set bitrate");
+}
+
 void H264Encoder::pollThread()
 {
 	while (true)
@@ -16,6 +16,8 @@
 
 #include <chrono>
 #include <iostream>
+#include <limits>
+#include <tuple>
 
 #include "libav_encoder.hpp"
 
@@ -412,6 +414,8 @@ void LibAvEncoder::EncodeBuffer(int fd, size_t size, void *mem, StreamInfo const
 	frame->linesize[1] = frame->linesize[2] = info.stride >> 1;
 	frame->pts = timestamp_us - video_start_ts_ +
 				 (options_->av_sync.value < 0us ? -options_->av_sync.get<std::chrono::microseconds>() : 0);
+	if (force_keyframe_.exchange(false))
+		frame->pict_type = AV_PICTURE_TYPE_I;
 
 	if (codec_ctx_[Video]->pix_fmt == AV_PIX_FMT_DRM_PRIME)
 	{
@@ -448,10 +452,21 @@ void LibAvEncoder::EncodeBuffer(int fd, size_t size, void *mem, StreamInfo const
 	}
 
 	std::scoped_lock<std::mutex> lock(video_mutex_);
-	frame_queue_.push(frame);
+	frame_queue_.emplace(frame, new_bitrate_.exchange(0));
 	video_cv_.notify_all();
 }
 
+void LibAvEncoder::SetBitrate(uint64_t bps)
+{
+	// libx264 picks up a new bitrate from the next frame, but only when it's encoding to one (and not to a constant
+	// quality). The other codecs, h264_v4l2m2m included, only look at it when they're opened.
+	if (options_->libav_video_codec != "libx264" || !options_->bitrate)
+		throw std::runtime_error("libav: can only change the bitrate of libx264, when it was started with --bitrate");
+	if (bps < 1000 || bps > (uint64_t)std::numeric_limits<int64_t>::max())
+		throw std::runtime_error("libav: bitrate out of range");
+	new_bitrate_ = bps;
+}
+
 void LibAvEncoder::initOutput()
 {
 	int ret;
@@ -562,6 +577,7 @@ void LibAvEncoder::videoThread()
 {
 	AVPacket *pkt = av_packet_alloc();
 	AVFrame *frame = nullptr;
+	uint64_t bitrate = 0;
 
 	while (true)
 	{
@@ -577,7 +593,7 @@ void LibAvEncoder::videoThread()
 
 				if (!frame_queue_.empty())
 				{
-					frame = frame_queue_.front();
+					std::tie(frame, bitrate) = frame_queue_.front();
 					frame_queue_.pop();
 					break;
 				}
@@ -586,6 +602,9 @@ void LibAvEncoder::videoThread()
 			}
 		}
 
+		if (bitrate)
+			codec_ctx_[Video]->bit_rate = bitrate;
+
 		int ret = avcodec_send_frame(codec_ctx_[Video], frame);
 		if (ret < 0)
 			throw std::runtime_error("libav: error encoding frame: " + std::to_string(ret));
@@ -13,6 +13,7 @@
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <utility>
 
 extern "C"
 {
@@ -38,6 +39,8 @@ public:
 	~LibAvEncoder();
 	// Encode the given DMABUF.
 	void EncodeBuffer(int fd, size_t size, void *mem, StreamInfo const &info, int64_t timestamp_us) override;
+	void RequestKeyframe() override { force_keyframe_ = true; }
+	void SetBitrate(uint64_t bps) override;
 
 private:
 	void initVideoCodec(VideoOptions const *options, StreamInfo const &info);
@@ -54,12 +57,16 @@ private:
 	static void releaseBuffer(void *opaque, uint8_t *data);
 
 	std::atomic<bool> output_ready_;
+	std::atomic<bool> force_keyframe_ { false };
+	// A new bitrate for the next frame to be queued, or zero.
+	std::atomic<uint64_t> new_bitrate_ { 0 };
 	bool abort_video_;
 	bool abort_audio_;
 	uint64_t video_start_ts_;
 	uint64_t audio_samples_;
 
-	std::queue<AVFrame *> frame_queue_;
+	// Each frame, with the bitrate to change to before encoding it (or zero).
+	std::queue<std::pair<AVFrame *, uint64_t>> frame_queue_;
 	std::mutex video_mutex_;
 	std::mutex output_mutex_;
 	std::condition_variable video_cv_;
@@ -22,6 +22,11 @@ void jpeg_save(std::vector<libcamera::Span<uint8_t>> const &mem, StreamInfo cons
 			   libcamera::ControlList const &metadata, std::string const &filename, std::string const &cam_model,
 			   StillOptions const *options);
 
+// Also in jpeg.cpp: compress a YUV420 image, at its own size, into a buffer that the caller must free(). Throws if
+// libjpeg reports an error, rather than letting it exit.
+void YUV420_to_JPEG_fast(const uint8_t *input, StreamInfo const &info, const int quality, const unsigned int restart,
+						 uint8_t *&jpeg_buffer, size_t &jpeg_len);
+
 // In yuv.cpp:
 void yuv_save(std::vector<libcamera::Span<uint8_t>> const &mem, StreamInfo const &info,
 			  std::string const &filename, StillOptions const *options);
@@ -5,6 +5,7 @@
  * jpeg.cpp - Encode image as jpeg and write to file.
  */
 
+#include <csetjmp>
 #include <cstdio>
 #include <cstring>
 
@@ -23,6 +24,8 @@
 #include "core/still_options.hpp"
 #include "core/stream_info.hpp"
 
+#include "image/image.hpp"
+
 #ifndef MAKE_STRING
 #define MAKE_STRING "Raspberry Pi"
 #endif
@@ -307,14 +310,43 @@ static void YUYV_to_JPEG(const uint8_t *input, StreamInfo const &info,
 	jpeg_destroy_compress(&cinfo);
 }
 
-static void YUV420_to_JPEG_fast(const uint8_t *input, StreamInfo const &info,
-								const int quality, const unsigned int restart,
-								uint8_t *&jpeg_buffer, jpeg_mem_len_t &jpeg_len)
+namespace
+{
+
+struct JpegErrorManager
+{
+	jpeg_error_mgr pub;
+	jmp_buf jmp;
+};
+
+void jpeg_error_exit(j_common_ptr cinfo)
+{
+	// libjpeg's own handler exits the whole process. Jump back instead, so that the encoder can throw.
+	longjmp(((JpegErrorManager *)cinfo->err)->jmp, 1);
+}
+
+} // namespace
+
+void YUV420_to_JPEG_fast(const uint8_t *input, StreamInfo const &info, const int quality, const unsigned int restart,
+						 uint8_t *&jpeg_buffer, size_t &jpeg_len)
 {
 	struct jpeg_compress_struct cinfo;
-	struct jpeg_error_mgr jerr;
+	JpegErrorManager jerr;
+	jpeg_mem_len_t len = 0;
 
-	cinfo.err = jpeg_std_error(&jerr);
+	cinfo.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit = jpeg_error_exit;
+	jpeg_buffer = NULL;
+	jpeg_len = 0;
+	if (setjmp(jerr.jmp))
+	{
+		char message[JMSG_LENGTH_MAX];
+		(*cinfo.err->format_message)((j_common_ptr)&cinfo, message);
+		jpeg_destroy_compress(&cinfo);
+		free(jpeg_buffer);
+		jpeg_buffer = NULL;
+		throw std::runtime_error("JPEG encode failed: " + std::string(message));
+	}
 	jpeg_create_compress(&cinfo);
 
 	cinfo.image_width = info.width;
@@ -326,9 +358,7 @@ static void YUV420_to_JPEG_fast(const uint8_t *input, StreamInfo const &info,
 	jpeg_set_defaults(&cinfo);
 	cinfo.raw_data_in = TRUE;
 	jpeg_set_quality(&cinfo, quality, TRUE);
-	jpeg_buffer = NULL;
-	jpeg_len = 0;
-	jpeg_mem_dest(&cinfo, &jpeg_buffer, &jpeg_len);
+	jpeg_mem_dest(&cinfo, &jpeg_buffer, &len);
 	jpeg_start_compress(&cinfo, TRUE);
 
 	int stride2 = info.stride / 2;
@@ -356,6 +386,7 @@ static void YUV420_to_JPEG_fast(const uint8_t *input, StreamInfo const &info,
 
 	jpeg_finish_compress(&cinfo);
 	jpeg_destroy_compress(&cinfo);
+	jpeg_len = len;
 }
 
 static void YUV420_to_JPEG(const uint8_t *input, StreamInfo const &info,
@@ -365,7 +396,9 @@ static void YUV420_to_JPEG(const uint8_t *input, StreamInfo const &info,
 {
 	if (info.width == output_width && info.height == output_height)
 	{
-		YUV420_to_JPEG_fast(input, info, quality, restart, jpeg_buffer, jpeg_len);
+		size_t len;
+		YUV420_to_JPEG_fast(input, info, quality, restart, jpeg_buffer, len);
+		jpeg_len = len;
 		return;
 	}
 
@@ -8,7 +8,7 @@
 #include "file_output.hpp"
 
 FileOutput::FileOutput(VideoOptions const *options)
-	: Output(options), fp_(nullptr), count_(0), file_start_time_ms_(0)
+	: Output(options), fp_(nullptr), count_(0), file_start_time_ms_(0), split_requested_(false)
 {
 }
 
@@ -17,12 +17,21 @@ FileOutput::~FileOutput()
 	closeFile();
 }
 
+void FileOutput::Split()
+{
+	// Without a counter in the name, the next file would be the one we're writing, and opening it would empty it.
+	if (options_->output == "-" || options_->output.find('%') == std::string::npos || options_->wrap == 1)
+		throw std::runtime_error("new segments need an output file name with a pattern such as video%04d.h264");
+	split_requested_ = true;
+}
+
 void FileOutput::outputBuffer(void *mem, size_t size, int64_t timestamp_us, uint32_t flags)
 {
 	// We need to open a new file if we're in "segment" mode and our segment is full
 	// (though we have to wait for the next I frame), or if we're in "split" mode
-	// and recording is being restarted (this is necessarily an I-frame already).
-	if (fp_ == nullptr ||
+	// and recording is being restarted (this is necessarily an I-frame already), or if
+	// a split has been asked for and this is an I frame.
+	if (((flags & FLAG_KEYFRAME) && split_requested_.exchange(false)) || fp_ == nullptr ||
 		(options_->segment && (flags & FLAG_KEYFRAME) &&
 		 timestamp_us / 1000 - file_start_time_ms_ > options_->segment) ||
 		(options_->split && (flags & FLAG_RESTART)))
@@ -14,6 +14,7 @@ class FileOutput : public Output
 public:
 	FileOutput(VideoOptions const *options);
 	~FileOutput();
+	void Split() override;
 
 protected:
 	void outputBuffer(void *mem, size_t size, int64_t timestamp_us, uint32_t flags) override;
@@ -24,4 +25,5 @@ private:
 	FILE *fp_;
 	unsigned int count_;
 	int64_t file_start_time_ms_;
+	std::atomic<bool> split_requested_;
 };
@@ -52,6 +52,11 @@ void Output::Signal()
 	enable_ = !enable_;
 }
 
+void Output::Split()
+{
+	throw std::runtime_error("this output can't be split");
+}
+
 void Output::OutputReady(void *mem, size_t size, int64_t timestamp_us, bool keyframe)
 {
 	// When output is enabled, we may have to wait for the next keyframe.
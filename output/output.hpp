@@ -21,6 +21,9 @@ public:
 	Output(VideoOptions const *options);
 	virtual ~Output();
 	virtual void Signal(); // a derived class might redefine what this means
+	void Enable(bool enable) { enable_ = enable; }
+	// Start a new file from the next keyframe, for outputs that write files.
+	virtual void Split();
 	void OutputReady(void *mem, size_t size, int64_t timestamp_us, bool keyframe);
 	void MetadataReady(libcamera::ControlList &metadata);
 
@@ -0,0 +1,262 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * cascade.cpp - detector to classifier cascade helpers
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+
+#include "core/logging.hpp"
+
+#include "cascade.hpp"
+#include "detection_decoder.hpp"
+#include "resize.hpp"
+
+using namespace std::chrono_literals;
+
+using Rectangle = libcamera::Rectangle;
+using Size = libcamera::Size;
+
+void CascadeConfig::Read(boost::property_tree::ptree const &params)
+{
+	stream = params.get<std::string>("stream", "lores");
+	if (stream != "lores" && stream != "main")
+		throw std::runtime_error("Cascade: stream must be lores or main");
+	top_k = std::max(params.get<unsigned int>("top_k", 8), 1u);
+	crop_budget = std::max(params.get<unsigned int>("crop_budget", 2), 1u);
+	min_confidence = params.get<float>("min_confidence", 0.5);
+	categories.clear();
+	if (auto child = params.get_child_optional("categories"))
+	{
+		for (auto const &c : *child)
+			categories.push_back(c.second.get_value<int>());
+	}
+	padding = std::clamp(params.get<float>("padding", 0.1), 0.0f, 1.0f);
+	letterbox = params.get<int>("letterbox", 0);
+	min_size = params.get<unsigned int>("min_size", 16);
+	match_threshold = params.get<float>("match_threshold", 0.5);
+	max_age = params.get<unsigned int>("max_age", 15);
+
+	labels.clear();
+	std::string labels_file = params.get<std::string>("labels_file", "");
+	if (!labels_file.empty())
+	{
+		std::ifstream file(labels_file);
+		if (!file)
+			throw std::runtime_error("Cascade: failed to load labels file " + labels_file);
+		// Some label files start with placeholders for classes the model never reports.
+		unsigned int skip = params.get<unsigned int>("labels_skip", 0);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (skip)
+				skip--;
+			else
+				labels.push_back(line);
+		}
+	}
+}
+
+void Cascade::Configure(CascadeConfig const &config, StreamInfo const &info, Size const &main_size)
+{
+	std::scoped_lock<std::mutex> l(mutex_);
+	config_ = config;
+	info_ = info;
+	main_size_ = main_size;
+	labels_.clear();
+}
+
+// Return the padded box, scaled into the co-ordinates of the stream we crop from.
+Rectangle Cascade::cropRegion(Rectangle const &box) const
+{
+	double sx = (double)info_.width / main_size_.width, sy = (double)info_.height / main_size_.height;
+	double pad_x = box.width * config_.padding, pad_y = box.height * config_.padding;
+	int x0 = std::floor((box.x - pad_x) * sx), y0 = std::floor((box.y - pad_y) * sy);
+	int x1 = std::ceil((box.x + box.width + pad_x) * sx), y1 = std::ceil((box.y + box.height + pad_y) * sy);
+	return Rectangle(x0, y0, std::max(x1 - x0, 0), std::max(y1 - y0, 0))
+		.boundedTo(Rectangle(0, 0, info_.width, info_.height));
+}
+
+bool Cascade::classify(unsigned int sequence, InferenceBackend &backend, const uint8_t *batch, unsigned int count,
+					   std::vector<CascadeResult> &results) const
+{
+	const size_t image_size = backend.Inputs()[0].Elements();
+	const unsigned int max_batch = std::max(backend.MaxBatch(), 1u);
+
+	// Start all the jobs before waiting for any, so the backend never waits for us.
+	std::vector<std::pair<int, unsigned int>> jobs;
+	bool ok = true;
+	for (unsigned int first = 0; first < count; first += max_batch)
+	{
+		unsigned int n = std::min(count - first, max_batch);
+		int job = backend.SubmitBatch(sequence, batch + first * image_size, n);
+		if (job < 0)
+		{
+			ok = false;
+			break;
+		}
+		jobs.push_back({ job, n });
+	}
+
+	// Even if something failed, every job that started must be collected. The backends copy their input, so
+	// one that is abandoned after a long wait can't touch the batch once we return.
+	std::vector<float> scratch;
+	for (auto const &[job, n] : jobs)
+	{
+		std::vector<Tensor> outputs;
+		InferenceStatus status;
+		unsigned int tries = 0;
+		while ((status = backend.Poll(job, outputs, 1s)) == InferenceStatus::Pending && ++tries < 5)
+			;
+		if (status != InferenceStatus::Ok || outputs.empty())
+		{
+			if (status == InferenceStatus::Pending)
+				LOG_ERROR("Cascade: gave up waiting for classification of frame " << sequence);
+			ok = false;
+			continue;
+		}
+
+		// One row of class scores for each image in the job.
+		const float *scores = outputs[0].AsFloat(scratch);
+		const unsigned int classes = outputs[0].info.Elements() / n;
+		for (unsigned int i = 0; i < n && classes; i++, scores += classes)
+		{
+			unsigned int best = std::max_element(scores, scores + classes) - scores;
+			std::string label = best < config_.labels.size() ? config_.labels[best] : std::to_string(best);
+			results.push_back({ label, scores[best] });
+		}
+	}
+
+	return ok && results.size() == count;
+}
+
+void Cascade::Process(unsigned int sequence, std::vector<Detection> &detections, const uint8_t *image,
+					  InferenceBackend &backend)
+{
+	// The most confident detections that we're interested in, and that aren't too small.
+	std::vector<unsigned int> candidates;
+	for (unsigned int i = 0; i < detections.size(); i++)
+	{
+		Detection const &d = detections[i];
+		if (d.confidence < config_.min_confidence)
+			continue;
+		if (!config_.categories.empty() &&
+			std::find(config_.categories.begin(), config_.categories.end(), d.category) == config_.categories.end())
+			continue;
+		Rectangle region = cropRegion(d.box);
+		if (region.width < config_.min_size || region.height < config_.min_size)
+			continue;
+		candidates.push_back(i);
+	}
+	std::stable_sort(candidates.begin(), candidates.end(), [&detections](unsigned int l, unsigned int r) {
+		return detections[l].confidence > detections[r].confidence;
+	});
+	if (candidates.size() > config_.top_k)
+		candidates.resize(config_.top_k);
+
+	// Match the candidates to labels we remember, and choose which ones to classify now: the new ones
+	// first, then those classified longest ago.
+	std::vector<int> matches(candidates.size(), -1);
+	std::vector<unsigned int> chosen;
+	{
+		std::scoped_lock<std::mutex> l(mutex_);
+
+		for (unsigned int i = 0; i < candidates.size(); i++)
+		{
+			Detection const &d = detections[candidates[i]];
+			float best = config_.match_threshold;
+			for (unsigned int j = 0; j < labels_.size(); j++)
+			{
+				float overlap = Iou(d.box, labels_[j].box);
+				if (labels_[j].category == d.category && overlap >= best)
+					best = overlap, matches[i] = j;
+			}
+		}
+
+		std::vector<unsigned int> order(candidates.size());
+		std::iota(order.begin(), order.end(), 0);
+		auto last_classified = [&](unsigned int i) -> int64_t {
+			return matches[i] < 0 ? -1 : (int64_t)labels_[matches[i]].classified;
+		};
+		std::stable_sort(order.begin(), order.end(),
+						 [&](unsigned int l, unsigned int r) { return last_classified(l) < last_classified(r); });
+		for (unsigned int i : order)
+		{
+			if (chosen.size() == config_.crop_budget)
+				break;
+			// Don't bother if it was only classified in this very frame (by another thread).
+			if (matches[i] >= 0 && labels_[matches[i]].classified == sequence)
+				continue;
+			chosen.push_back(i);
+		}
+	}
+
+	// Crop and resize all the chosen detections into one batch, and classify them together.
+	std::vector<CascadeResult> results;
+	if (!chosen.empty())
+	{
+		std::vector<unsigned int> const &shape = backend.Inputs()[0].shape;
+		Size size(shape[2], shape[1]);
+		unsigned int image_size = size.width * size.height * 3;
+		std::vector<uint8_t> batch(chosen.size() * image_size);
+		for (unsigned int i = 0; i < chosen.size(); i++)
+			Yuv420ToRgbResize(batch.data() + i * image_size, size.width * 3, size, image, info_,
+							  cropRegion(detections[candidates[chosen[i]]].box), config_.letterbox);
+
+		if (!classify(sequence, backend, batch.data(), chosen.size(), results))
+			results.clear(), chosen.clear();
+	}
+
+	std::scoped_lock<std::mutex> l(mutex_);
+
+	// Another thread may have changed the list while we were classifying, so matches are only good if they
+	// still look right.
+	auto still_matches = [this, &detections](int j, unsigned int index) {
+		return j >= 0 && j < (int)labels_.size() && labels_[j].category == detections[index].category &&
+			   Iou(labels_[j].box, detections[index].box) >= config_.match_threshold;
+	};
+
+	for (unsigned int i = 0; i < candidates.size(); i++)
+	{
+		Detection &d = detections[candidates[i]];
+		auto it = std::find(chosen.begin(), chosen.end(), i);
+		int j = matches[i];
+		if (!still_matches(j, candidates[i]))
+			j = -1;
+
+		if (it != chosen.end())
+		{
+			CascadeResult const &result = results[it - chosen.begin()];
+			if (j < 0)
+			{
+				labels_.push_back({ d.category, d.box, result, sequence, sequence });
+				j = labels_.size() - 1;
+			}
+			else
+			{
+				labels_[j].result = result;
+				labels_[j].classified = std::max(labels_[j].classified, sequence);
+			}
+		}
+		else if (j < 0)
+			continue;
+
+		Label &label = labels_[j];
+		label.box = d.box;
+		label.seen = std::max(label.seen, sequence);
+		d.label = label.result.label;
+		d.label_confidence = label.result.confidence;
+	}
+
+	// Forget labels for things we haven't seen for a while.
+	labels_.erase(std::remove_if(labels_.begin(), labels_.end(),
+								 [this, sequence](Label const &label) {
+									 return sequence > label.seen && sequence - label.seen > config_.max_age;
+								 }),
+				  labels_.end());
+}
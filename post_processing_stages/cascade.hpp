@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * cascade.hpp - detector to classifier cascade helpers
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <libcamera/geometry.h>
+
+#include "core/stream_info.hpp"
+
+#include "post_processing_stages/inference_backend.hpp"
+#include "post_processing_stages/object_detect.hpp"
+
+// A cascade runs a classifier on the objects found by an earlier detector stage, for
+// example to tell what kind of vehicle or animal each one is. The best detections
+// from "object_detect.results" are cropped out of the image and resized, all into one
+// batch, which is classified on an inference backend (see inference_backend.hpp). The
+// batch goes in as few jobs as the backend's MaxBatch() allows, all started before we
+// wait for any of them. The labels are written back into the detections.
+
+// To bound the cost, only "crop_budget" crops are classified in any frame. Detections
+// that match (by overlap) one that was classified recently keep its label, and the
+// ones that have waited longest, or are new, are done first.
+
+struct CascadeConfig
+{
+	// Stream to crop from, "lores" or "main". The detection boxes are always in main
+	// stream co-ordinates.
+	std::string stream = "lores";
+	// How many of the most confident detections to consider.
+	unsigned int top_k = 8;
+	// Most crops to classify in each frame.
+	unsigned int crop_budget = 2;
+	float min_confidence = 0.5;
+	// Detector categories to classify. Empty means all of them.
+	std::vector<int> categories;
+	// Grow each box by this fraction of its size on every side before cropping.
+	float padding = 0.1;
+	// Keep the aspect ratio of the crops, padding them out, rather than stretching them.
+	bool letterbox = false;
+	// Boxes smaller than this (in pixels of the cropped stream) are ignored.
+	unsigned int min_size = 16;
+	// A detection takes the label of a recent one it overlaps this much (intersection over union).
+	float match_threshold = 0.5;
+	// Frames for which a label is remembered.
+	unsigned int max_age = 15;
+	// Names of the classifier's classes, from "labels_file". Classes without one are reported by number.
+	std::vector<std::string> labels;
+	void Read(boost::property_tree::ptree const &params);
+};
+
+struct CascadeResult
+{
+	std::string label;
+	float confidence;
+};
+
+class Cascade
+{
+public:
+	// The stream info is for the image we crop from, and the main size is that of the
+	// co-ordinate space of the detections.
+	void Configure(CascadeConfig const &config, StreamInfo const &info, libcamera::Size const &main_size);
+
+	// Classify (some of) the detections, setting their labels. The backend's model must take NHWC RGB images and
+	// give a score for each class. Every job started here is collected before returning.
+	void Process(unsigned int sequence, std::vector<Detection> &detections, const uint8_t *image,
+				 InferenceBackend &backend);
+
+private:
+	struct Label
+	{
+		int category;
+		libcamera::Rectangle box;
+		CascadeResult result;
+		// Sequence numbers of the frame it was last seen and last classified.
+		unsigned int seen;
+		unsigned int classified;
+	};
+
+	libcamera::Rectangle cropRegion(libcamera::Rectangle const &box) const;
+	// Run the batch of count images, returning false if any of it failed.
+	bool classify(unsigned int sequence, InferenceBackend &backend, const uint8_t *batch, unsigned int count,
+				  std::vector<CascadeResult> &results) const;
+
+	CascadeConfig config_;
+	StreamInfo info_;
+	libcamera::Size main_size_;
+	std::mutex mutex_;
+	std::vector<Label> labels_;
+};
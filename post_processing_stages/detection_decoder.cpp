@@ -0,0 +1,287 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * detection_decoder.cpp - decode object detector output tensors
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+
+#include "detection_decoder.hpp"
+
+using Size = libcamera::Size;
+
+void DecoderConfig::Read(boost::property_tree::ptree const &params)
+{
+	type = params.get<std::string>("decoder", "ssd");
+	if (type != "ssd" && type != "yolov8" && type != "hailo_nms")
+		throw std::runtime_error("DecoderConfig: unknown decoder " + type);
+	threshold = params.get<float>("threshold", 0.5);
+	nms_threshold = params.get<float>("nms_threshold", 0.5);
+	max_detections = params.get<unsigned int>("max_detections", 20);
+	pixel_coords = params.get<int>("pixel_coords", 0);
+}
+
+static DecodedObject make_object(int category, float confidence, float x0, float y0, float x1, float y1)
+{
+	return { category, confidence, std::clamp(x0, 0.0f, 1.0f), std::clamp(y0, 0.0f, 1.0f),
+			 std::clamp(x1, 0.0f, 1.0f), std::clamp(y1, 0.0f, 1.0f) };
+}
+
+std::vector<DecodedObject> DecodeSsd(Tensor const &boxes, Tensor const &classes, Tensor const &scores,
+									 const Tensor *count, float threshold, bool planar_boxes)
+{
+	std::vector<float> boxes_scratch, classes_scratch, scores_scratch, count_scratch;
+	const float *b = boxes.AsFloat(boxes_scratch);
+	const float *c = classes.AsFloat(classes_scratch);
+	const float *s = scores.AsFloat(scores_scratch);
+
+	size_t n = std::min({ boxes.info.Elements() / 4, classes.info.Elements(), scores.info.Elements() });
+	if (count && count->info.Elements())
+		n = std::min<size_t>(n, std::max(count->AsFloat(count_scratch)[0], 0.0f));
+
+	// Each co-ordinate is this far from the next in the boxes tensor, and each box this far from the next.
+	const size_t step = planar_boxes ? boxes.info.Elements() / 4 : 1;
+	const size_t stride = planar_boxes ? 1 : 4;
+
+	std::vector<DecodedObject> objects;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (s[i] < threshold || c[i] < 0)
+			continue;
+		const float *box = b + i * stride;
+		objects.push_back(make_object(c[i], s[i], box[step], box[0], box[3 * step], box[2 * step]));
+	}
+
+	return objects;
+}
+
+std::vector<DecodedObject> DecodeYoloV8(Tensor const &output, Size const &input_size, float threshold,
+										bool pixel_coords)
+{
+	std::vector<unsigned int> const &shape = output.info.shape;
+	if (shape.size() < 2)
+		throw std::runtime_error("DecodeYoloV8: unexpected output shape " + output.info.ToString());
+
+	// There are always many more anchors than classes, which tells us which way round the tensor is.
+	unsigned int rows = shape[shape.size() - 2], cols = shape[shape.size() - 1];
+	const bool transposed = rows > cols;
+	const unsigned int anchors = transposed ? rows : cols, channels = transposed ? cols : rows;
+	if (channels < 5)
+		throw std::runtime_error("DecodeYoloV8: unexpected output shape " + output.info.ToString());
+
+	std::vector<float> scratch;
+	const float *data = output.AsFloat(scratch);
+	// Element (channel, anchor) is at channel * channel_step + anchor * anchor_step.
+	const size_t channel_step = transposed ? 1 : anchors, anchor_step = transposed ? channels : 1;
+
+	// Find the best class for every anchor. With the channels outermost, the inner loop runs over contiguous
+	// anchors, which vectorises.
+	std::vector<float> best(anchors, -1.0f);
+	std::vector<int> best_class(anchors, 0);
+	for (unsigned int c = 4; c < channels; c++)
+	{
+		for (unsigned int a = 0; a < anchors; a++)
+		{
+			float score = data[c * channel_step + a * anchor_step];
+			bool better = score > best[a];
+			best[a] = better ? score : best[a];
+			best_class[a] = better ? c - 4 : best_class[a];
+		}
+	}
+
+	const float sx = pixel_coords ? 1.0f / input_size.width : 1.0f;
+	const float sy = pixel_coords ? 1.0f / input_size.height : 1.0f;
+	std::vector<DecodedObject> objects;
+	for (unsigned int a = 0; a < anchors; a++)
+	{
+		if (best[a] < threshold)
+			continue;
+		const float *p = data + a * anchor_step;
+		float cx = p[0] * sx, cy = p[channel_step] * sy;
+		float w = p[2 * channel_step] * sx, h = p[3 * channel_step] * sy;
+		objects.push_back(make_object(best_class[a], best[a], cx - w / 2, cy - h / 2, cx + w / 2, cy + h / 2));
+	}
+
+	return objects;
+}
+
+std::vector<DecodedObject> DecodeHailoNms(Tensor const &output, float threshold)
+{
+	if (output.info.shape.size() != 2 || output.info.type != TensorType::Float32)
+		throw std::runtime_error("DecodeHailoNms: unexpected output " + output.info.ToString());
+
+	const unsigned int classes = output.info.shape[0];
+	const size_t size = output.info.Elements();
+	const float *data = reinterpret_cast<const float *>(output.data.get());
+
+	// The boxes for each class follow straight on from its count, so the classes are packed together.
+	std::vector<DecodedObject> objects;
+	size_t pos = 0;
+	for (unsigned int c = 0; c < classes && pos < size; c++)
+	{
+		unsigned int count = data[pos++];
+		for (unsigned int i = 0; i < count && pos + 5 <= size; i++, pos += 5)
+		{
+			const float *box = data + pos;
+			if (box[4] >= threshold)
+				objects.push_back(make_object(c, box[4], box[1], box[0], box[3], box[2]));
+		}
+	}
+
+	return objects;
+}
+
+std::vector<DecodedFace> DecodeScrfd(std::vector<ScrfdBranch> const &branches, std::vector<float> const &anchors,
+									 float score_threshold, float iou_threshold, std::vector<unsigned int> &scratch)
+{
+	size_t total = 0;
+	for (auto const &branch : branches)
+	{
+		const size_t num = branch.scores.info.Elements();
+		if (branch.scores.info.type != TensorType::UInt8 || branch.boxes.info.type != TensorType::UInt8 ||
+			branch.landmarks.info.type != TensorType::UInt8 || branch.boxes.info.Elements() != 4 * num ||
+			branch.landmarks.info.Elements() != 10 * num)
+			throw std::runtime_error("DecodeScrfd: unexpected outputs " + branch.scores.info.ToString() + ", " +
+									 branch.boxes.info.ToString() + ", " + branch.landmarks.info.ToString());
+		total += num;
+	}
+	if (anchors.size() != 4 * total)
+		throw std::runtime_error("DecodeScrfd: " + std::to_string(anchors.size() / 4) + " anchors, but " +
+								 std::to_string(total) + " scores");
+
+	std::vector<DecodedFace> faces;
+	const float *branch_anchors = anchors.data();
+	for (auto const &branch : branches)
+	{
+		// Threshold the raw scores first, so that only the survivors need decoding. This loop is branch free
+		// so that it stays quick however many anchors there are. As the scores are integers, comparing against
+		// the rounded down quantised threshold gives the same answer as the exact one.
+		const TensorInfo &sq = branch.scores.info, &bq = branch.boxes.info, &lq = branch.landmarks.info;
+		const uint8_t *scores = branch.scores.data.get();
+		const unsigned int num = sq.Elements();
+		const int threshold = std::floor(score_threshold / sq.scale + sq.zero_point);
+		if (scratch.size() < num)
+			scratch.resize(num);
+		unsigned int count = 0;
+		for (unsigned int n = 0; n < num; n++)
+		{
+			scratch[count] = n;
+			count += scores[n] > threshold;
+		}
+
+		for (unsigned int c = 0; c < count; c++)
+		{
+			const unsigned int n = scratch[c];
+			const float *anchor = branch_anchors + 4 * n;
+			const uint8_t *b = branch.boxes.data.get() + 4 * n;
+			const uint8_t *lm = branch.landmarks.data.get() + 10 * n;
+
+			DecodedFace face;
+			face.confidence = (scores[n] - sq.zero_point) * sq.scale;
+			face.box[0] = anchor[0] - (b[0] - bq.zero_point) * bq.scale * anchor[2];
+			face.box[1] = anchor[1] - (b[1] - bq.zero_point) * bq.scale * anchor[3];
+			face.box[2] = anchor[0] + (b[2] - bq.zero_point) * bq.scale * anchor[2];
+			face.box[3] = anchor[1] + (b[3] - bq.zero_point) * bq.scale * anchor[3];
+			for (unsigned int k = 0; k < 10; k += 2)
+			{
+				face.landmarks[k] = anchor[0] + (lm[k] - lq.zero_point) * lq.scale * anchor[2];
+				face.landmarks[k + 1] = anchor[1] + (lm[k + 1] - lq.zero_point) * lq.scale * anchor[3];
+			}
+			faces.push_back(face);
+		}
+
+		branch_anchors += 4 * num;
+	}
+
+	Nms(faces, iou_threshold, std::numeric_limits<unsigned int>::max(),
+		[](DecodedFace const &k, DecodedFace const &f) { return Iou(k.box, f.box); });
+	return faces;
+}
+
+// The area of the intersection of two boxes, and the areas of each.
+static void overlap(const float a[4], const float b[4], float &inter, float &area_a, float &area_b)
+{
+	float w = std::min(a[2], b[2]) - std::max(a[0], b[0]);
+	float h = std::min(a[3], b[3]) - std::max(a[1], b[1]);
+	inter = w > 0 && h > 0 ? w * h : 0;
+	area_a = (a[2] - a[0]) * (a[3] - a[1]);
+	area_b = (b[2] - b[0]) * (b[3] - b[1]);
+}
+
+static void rectangle_box(libcamera::Rectangle const &r, float box[4])
+{
+	box[0] = r.x, box[1] = r.y;
+	box[2] = (float)r.x + r.width, box[3] = (float)r.y + r.height;
+}
+
+float Iou(const float a[4], const float b[4])
+{
+	float inter, area_a, area_b;
+	overlap(a, b, inter, area_a, area_b);
+	float uni = area_a + area_b - inter;
+	return inter > 0 && uni > 0 ? inter / uni : 0;
+}
+
+float Iou(DecodedObject const &a, DecodedObject const &b)
+{
+	const float box_a[4] = { a.x0, a.y0, a.x1, a.y1 }, box_b[4] = { b.x0, b.y0, b.x1, b.y1 };
+	return Iou(box_a, box_b);
+}
+
+float Iou(libcamera::Rectangle const &a, libcamera::Rectangle const &b)
+{
+	float box_a[4], box_b[4];
+	rectangle_box(a, box_a), rectangle_box(b, box_b);
+	return Iou(box_a, box_b);
+}
+
+float IntersectionOverSmaller(libcamera::Rectangle const &a, libcamera::Rectangle const &b)
+{
+	float box_a[4], box_b[4], inter, area_a, area_b;
+	rectangle_box(a, box_a), rectangle_box(b, box_b);
+	overlap(box_a, box_b, inter, area_a, area_b);
+	float smaller = std::min(area_a, area_b);
+	return inter > 0 && smaller > 0 ? inter / smaller : 0;
+}
+
+void NmsObjects(std::vector<DecodedObject> &objects, float iou_threshold, unsigned int max_detections)
+{
+	// Nothing overlaps by more than all of itself, so a threshold of 1 keeps everything.
+	Nms(objects, iou_threshold, max_detections, [](DecodedObject const &k, DecodedObject const &o) {
+		return k.category == o.category ? Iou(k, o) : 0.0f;
+	});
+}
+
+std::vector<DecodedObject> DecodeDetections(DecoderConfig const &config, std::vector<Tensor> const &outputs,
+											Size const &input_size)
+{
+	std::vector<DecodedObject> objects;
+
+	if (config.type == "ssd")
+	{
+		if (outputs.size() < 3)
+			throw std::runtime_error("DecodeDetections: ssd needs boxes, classes and scores");
+		objects = DecodeSsd(outputs[0], outputs[1], outputs[2], outputs.size() > 3 ? &outputs[3] : nullptr,
+							config.threshold);
+	}
+	else if (config.type == "yolov8")
+	{
+		if (outputs.empty())
+			throw std::runtime_error("DecodeDetections: yolov8 has no output");
+		objects = DecodeYoloV8(outputs[0], input_size, config.threshold, config.pixel_coords);
+	}
+	else if (config.type == "hailo_nms")
+	{
+		if (outputs.empty())
+			throw std::runtime_error("DecodeDetections: hailo_nms has no output");
+		objects = DecodeHailoNms(outputs[0], config.threshold);
+	}
+
+	NmsObjects(objects, config.nms_threshold, config.max_detections);
+	return objects;
+}
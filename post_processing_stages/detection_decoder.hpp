@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * detection_decoder.hpp - decode object detector output tensors
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <libcamera/geometry.h>
+
+#include "post_processing_stages/inference_backend.hpp"
+
+// Turn the output tensors of the common kinds of object detector into a list of
+// objects, whichever backend ran the model. Nothing here knows where the input image
+// came from, so the boxes are left normalised (0 to 1) to the input tensor, and the
+// caller maps them back into the image, for example with ResizedToImage().
+
+struct DecodedObject
+{
+	int category;
+	float confidence;
+	float x0;
+	float y0;
+	float x1;
+	float y1;
+};
+
+struct DecoderConfig
+{
+	// The kind of output tensors:
+	// "ssd" - boxes, classes, scores and count, as from TFLite_Detection_PostProcess,
+	// "yolov8" - the single [1, 4 + classes, anchors] output of an Ultralytics export,
+	// "hailo_nms" - the float NMS-by-class output of a HailoRT model.
+	std::string type = "ssd";
+	float threshold = 0.5;
+	// Of two boxes of the same category that overlap by more than this (intersection over
+	// union), only the more confident is kept. 1 turns this off.
+	float nms_threshold = 0.5;
+	unsigned int max_detections = 20;
+	// YOLO boxes are in input tensor pixels rather than normalised.
+	bool pixel_coords = false;
+	void Read(boost::property_tree::ptree const &params);
+};
+
+// SSD style outputs. The boxes are (y0, x0, y1, x1) for each detection in turn, or with
+// planar_boxes, all the y0s, then all the x0s and so on. Without a count tensor, every
+// entry is used.
+std::vector<DecodedObject> DecodeSsd(Tensor const &boxes, Tensor const &classes, Tensor const &scores,
+									 const Tensor *count, float threshold, bool planar_boxes = false);
+
+// YOLOv8 style output, with a centre, width and height followed by a score for each class,
+// for every anchor. Either [1, 4 + classes, anchors] or [1, anchors, 4 + classes].
+std::vector<DecodedObject> DecodeYoloV8(Tensor const &output, libcamera::Size const &input_size, float threshold,
+										bool pixel_coords);
+
+// HailoRT NMS-by-class output of shape [classes, 1 + 5 * max boxes]. For each class there
+// is a count, followed by (y0, x0, y1, x1, score) for that many boxes.
+std::vector<DecodedObject> DecodeHailoNms(Tensor const &output, float threshold);
+
+// A face from an SCRFD detector, with its box as (x0, y0, x1, y1) and its five landmarks as (x, y) pairs, all
+// normalised to the input tensor.
+struct DecodedFace
+{
+	float confidence;
+	float box[4];
+	float landmarks[10];
+};
+
+// The 8-bit quantised outputs of one SCRFD branch, with a score, four box distances and ten landmark
+// offsets for each anchor.
+struct ScrfdBranch
+{
+	Tensor scores;
+	Tensor boxes;
+	Tensor landmarks;
+};
+
+// SCRFD output. The anchors of all the branches follow one after the other, flattened as (centre x,
+// centre y, scale x, scale y). Only anchors scoring over the threshold are decoded, and the faces go
+// through NMS, leaving the most confident first. The scratch vector is working space that the caller
+// can keep between frames.
+std::vector<DecodedFace> DecodeScrfd(std::vector<ScrfdBranch> const &branches, std::vector<float> const &anchors,
+									 float score_threshold, float iou_threshold, std::vector<unsigned int> &scratch);
+
+// How much two boxes overlap, as intersection over union. Boxes given as arrays are (x0, y0, x1, y1).
+float Iou(const float a[4], const float b[4]);
+float Iou(DecodedObject const &a, DecodedObject const &b);
+float Iou(libcamera::Rectangle const &a, libcamera::Rectangle const &b);
+
+// How much two boxes overlap, as intersection over the area of the smaller one. This catches a box
+// that is mostly inside a bigger one, as happens when an object is cut by the edge of a tile.
+float IntersectionOverSmaller(libcamera::Rectangle const &a, libcamera::Rectangle const &b);
+
+// Greedy non-maximum suppression for anything with a confidence. Objects are taken in order of
+// decreasing confidence, and each is dropped if overlap(kept, object) is more than the threshold
+// for any object already kept. At most max_detections are kept, most confident first.
+template <typename T, typename Overlap>
+void Nms(std::vector<T> &objects, float threshold, unsigned int max_detections, Overlap overlap)
+{
+	std::stable_sort(objects.begin(), objects.end(),
+					 [](T const &l, T const &r) { return l.confidence > r.confidence; });
+
+	// Each object only needs checking against those already kept, which are all more confident. They're moved to
+	// the front as we go, so nothing is allocated.
+	size_t kept = 0;
+	for (size_t i = 0; i < objects.size() && kept < max_detections; i++)
+	{
+		if (std::any_of(objects.begin(), objects.begin() + kept,
+						[&](T const &k) { return overlap(k, objects[i]) > threshold; }))
+			continue;
+		if (kept != i)
+			objects[kept] = std::move(objects[i]);
+		kept++;
+	}
+
+	objects.erase(objects.begin() + kept, objects.end());
+}
+
+// Class-aware non-maximum suppression by IoU, keeping at most max_detections objects. The results
+// are in order of decreasing confidence.
+void NmsObjects(std::vector<DecodedObject> &objects, float iou_threshold, unsigned int max_detections);
+
+// Decode the outputs as the config says, followed by NMS.
+std::vector<DecodedObject> DecodeDetections(DecoderConfig const &config, std::vector<Tensor> const &outputs,
+											libcamera::Size const &input_size);
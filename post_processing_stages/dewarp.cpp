@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * dewarp.cpp - lens distortion model and remap tables
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "post_processing_stages/dewarp.hpp"
+
+void LensModel::SetRotation(double pan, double tilt)
+{
+	double cp = std::cos(pan), sp = std::sin(pan);
+	double ct = std::cos(tilt), st = std::sin(tilt);
+	double r[9] = { cp, sp * st, sp * ct, 0, ct, -st, -sp, cp * st, cp * ct };
+	std::copy(r, r + 9, rotation);
+}
+
+void LensModel::Undistort(double u, double v, double &x, double &y) const
+{
+	double ray[3] = { (u - cx) / (fx * zoom), (v - cy) / (fy * zoom), 1 };
+	double r[3];
+	for (unsigned int i = 0; i < 3; i++)
+		r[i] = rotation[3 * i] * ray[0] + rotation[3 * i + 1] * ray[1] + rotation[3 * i + 2] * ray[2];
+	if (r[2] <= 0)
+	{
+		x = y = -1;
+		return;
+	}
+
+	double a = r[0] / r[2], b = r[1] / r[2], r2 = a * a + b * b;
+	double xd, yd;
+	auto const &k = distortion;
+	if (fisheye)
+	{
+		double radius = std::sqrt(r2), theta = std::atan(radius), theta2 = theta * theta;
+		double theta_d = theta * (1 + theta2 * (k[0] + theta2 * (k[1] + theta2 * (k[2] + theta2 * k[3]))));
+		double s = radius > 1e-8 ? theta_d / radius : 1;
+		xd = a * s, yd = b * s;
+	}
+	else
+	{
+		double radial = 1 + r2 * (k[0] + r2 * (k[1] + r2 * k[4]));
+		xd = a * radial + 2 * k[2] * a * b + k[3] * (r2 + 2 * a * a);
+		yd = b * radial + k[2] * (r2 + 2 * b * b) + 2 * k[3] * a * b;
+	}
+
+	x = fx * xd + cx;
+	y = fy * yd + cy;
+}
+
+// Split a source coordinate into a pixel and a weight for the next one. A weight that rounds up to a whole pixel
+// moves on to that pixel instead, which can then be the last one.
+static void split(double pos, unsigned int size, unsigned int &pixel, uint8_t &weight)
+{
+	pixel = std::min<unsigned int>(pos, size - 2);
+	long w = std::lround((pos - pixel) * 256);
+	if (w >= 256)
+		pixel++, w -= 256;
+	weight = w;
+}
+
+void RemapTable::Build(LensModel const &lens, unsigned int width, unsigned int height, unsigned int stride,
+					   double scale)
+{
+	this->width = width, this->height = height;
+	offsets.resize(width * height);
+	weights_x.resize(width * height);
+	weights_y.resize(width * height);
+
+	for (unsigned int j = 0; j < height; j++)
+	{
+		for (unsigned int i = 0; i < width; i++)
+		{
+			// Sample positions are pixel centres, so chroma (scale = 2) lines up with luma.
+			double x, y;
+			lens.Undistort((i + 0.5) * scale - 0.5, (j + 0.5) * scale - 0.5, x, y);
+			x = (x + 0.5) / scale - 0.5;
+			y = (y + 0.5) / scale - 0.5;
+
+			unsigned int index = j * width + i;
+			if (x < 0 || y < 0 || x > width - 1 || y > height - 1)
+			{
+				offsets[index] = INVALID;
+				continue;
+			}
+
+			unsigned int x0, y0;
+			split(x, width, x0, weights_x[index]);
+			split(y, height, y0, weights_y[index]);
+			offsets[index] = y0 * stride + x0;
+		}
+	}
+}
+
+void RemapTable::Remap(uint8_t *dst, const uint8_t *src, unsigned int stride, uint8_t fill, unsigned int y0,
+					   unsigned int y1, unsigned int tile_width, unsigned int tile_height) const
+{
+	for (unsigned int ty = y0; ty < y1; ty += tile_height)
+	{
+		unsigned int ty1 = std::min(ty + tile_height, y1);
+		for (unsigned int tx = 0; tx < width; tx += tile_width)
+		{
+			unsigned int tx1 = std::min(tx + tile_width, width);
+			for (unsigned int y = ty; y < ty1; y++)
+			{
+				const uint32_t *row_offsets = &offsets[y * width];
+				const uint8_t *wx = &weights_x[y * width], *wy = &weights_y[y * width];
+				uint8_t *out = dst + y * stride;
+				for (unsigned int x = tx; x < tx1; x++)
+				{
+					if (row_offsets[x] == INVALID)
+					{
+						out[x] = fill;
+						continue;
+					}
+					const uint8_t *p = src + row_offsets[x];
+					int top = p[0] * (256 - wx[x]) + p[1] * wx[x];
+					int bottom = p[stride] * (256 - wx[x]) + p[stride + 1] * wx[x];
+					out[x] = (top * (256 - wy[x]) + bottom * wy[x] + 32768) >> 16;
+				}
+			}
+		}
+	}
+}
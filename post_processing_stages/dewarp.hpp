@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * dewarp.hpp - lens distortion model and remap tables
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+// A calibrated lens, scaled to the image being corrected, and the virtual camera that we view it through.
+struct LensModel
+{
+	double fx, fy, cx, cy;
+	// The OpenCV coefficients, [k1, k2, p1, p2, k3], or [k1, k2, k3, k4] for the fisheye model.
+	std::vector<double> distortion;
+	bool fisheye = false;
+	double zoom = 1;
+	// Rotation of the virtual camera, as a row-major 3x3 matrix.
+	double rotation[9] = { 1, 0, 0, 0, 1, 0, 0, 0, 1 };
+
+	// Pan turns about the y axis, then tilt about the x axis, both in radians.
+	void SetRotation(double pan, double tilt);
+
+	// Map a point from the output (the ideal, virtual camera) to the source image, in pixels. Points behind the
+	// virtual camera come back as (-1, -1). The distortion models follow OpenCV's undistort exactly.
+	void Undistort(double u, double v, double &x, double &y) const;
+};
+
+// The remap table for one plane. Each output pixel has the offset of the top left source pixel (or INVALID) and the
+// x and y bilinear weights, out of 256.
+struct RemapTable
+{
+	static constexpr uint32_t INVALID = UINT32_MAX;
+
+	// Build the table for a plane that is "scale" times smaller than the image the lens describes.
+	void Build(LensModel const &lens, unsigned int width, unsigned int height, unsigned int stride, double scale);
+
+	// Remap output rows y0 to y1-1, a tile at a time so that the source pixels being read stay in the cache. Output
+	// pixels from outside the source get the fill value. Pixels on the last source row and column read their
+	// neighbours with zero weight, so the source must stay readable for a row and a pixel past the plane.
+	void Remap(uint8_t *dst, const uint8_t *src, unsigned int stride, uint8_t fill, unsigned int y0, unsigned int y1,
+			   unsigned int tile_width, unsigned int tile_height) const;
+
+	unsigned int width, height;
+	std::vector<uint32_t> offsets;
+	std::vector<uint8_t> weights_x, weights_y;
+};
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * dewarp_stage.cpp - lens distortion correction using precomputed remap tables
+ */
+
+// Correct lens distortion in the (YUV420) main image, giving a rectilinear output.
+// The lens is described by the usual calibration parameters: a camera matrix and
+// either the standard OpenCV distortion coefficients [k1, k2, p1, p2, k3] or, for
+// fisheye lenses, the OpenCV fisheye model coefficients [k1, k2, k3, k4]. These are
+// given for a calibration image size, and are scaled to the main stream.
+
+// Optionally the output can be a "virtual camera" view, which is zoomed in by "zoom"
+// and turned by "pan" and "tilt" (in degrees), for a dewarped ROI or PTZ effect.
+
+// Everything about the mapping is worked out once, when we are configured, into
+// tables giving the source pixel and bilinear weights for every output pixel, for
+// luma and chroma separately. Each frame then just needs a gather through the tables,
+// which we do in tiles, so that the source pixels being read stay in the cache, and
+// with bands of tiles in different threads. Output pixels that map outside the
+// source image are set to black.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include <libcamera/stream.h>
+
+#include "core/rpicam_app.hpp"
+
+#include "post_processing_stages/dewarp.hpp"
+#include "post_processing_stages/post_processing_stage.hpp"
+
+using Stream = libcamera::Stream;
+
+class DewarpStage : public PostProcessingStage
+{
+public:
+	DewarpStage(RPiCamApp *app) : PostProcessingStage(app) {}
+
+	char const *Name() const override;
+
+	void Read(boost::property_tree::ptree const &params) override;
+
+	void Configure() override;
+
+	bool Process(CompletedRequestPtr &completed_request) override;
+
+private:
+	struct Config
+	{
+		double fx, fy, cx, cy;
+		std::vector<double> distortion;
+		bool fisheye;
+		unsigned int calibration_width, calibration_height;
+		double zoom;
+		double pan, tilt;
+		unsigned int tile_width, tile_height;
+		unsigned int threads;
+	} config_;
+
+	Stream *stream_;
+	StreamInfo info_;
+	RemapTable luma_, chroma_;
+	uint8_t black_;
+	std::mutex mutex_;
+	std::vector<std::vector<uint8_t>> free_buffers_;
+};
+
+#define NAME "dewarp"
+
+char const *DewarpStage::Name() const
+{
+	return NAME;
+}
+
+void DewarpStage::Read(boost::property_tree::ptree const &params)
+{
+	std::vector<double> camera_matrix = GetJsonArray<double>(params, "camera_matrix");
+	if (camera_matrix.size() != 4)
+		throw std::runtime_error("DewarpStage: camera_matrix must be [fx, fy, cx, cy]");
+	config_.fx = camera_matrix[0], config_.fy = camera_matrix[1];
+	config_.cx = camera_matrix[2], config_.cy = camera_matrix[3];
+
+	config_.fisheye = params.get<std::string>("model", "standard") == "fisheye";
+	config_.distortion = GetJsonArray<double>(params, "distortion", std::vector<double>(config_.fisheye ? 4 : 5, 0));
+	if (config_.distortion.size() != (config_.fisheye ? 4u : 5u))
+		throw std::runtime_error("DewarpStage: wrong number of distortion coefficients");
+
+	config_.calibration_width = params.get<unsigned int>("calibration_width");
+	config_.calibration_height = params.get<unsigned int>("calibration_height");
+	config_.zoom = std::max(params.get<double>("zoom", 1.0), 0.1);
+	config_.pan = params.get<double>("pan", 0.0) * M_PI / 180;
+	config_.tilt = params.get<double>("tilt", 0.0) * M_PI / 180;
+	config_.tile_width = std::max(params.get<unsigned int>("tile_width", 64), 8u);
+	config_.tile_height = std::max(params.get<unsigned int>("tile_height", 16), 2u) & ~1;
+	config_.threads = std::clamp(params.get<unsigned int>("threads", 4), 1u, 8u);
+}
+
+void DewarpStage::Configure()
+{
+	stream_ = app_->GetMainStream();
+	if (!stream_)
+		return;
+	info_ = app_->GetStreamInfo(stream_);
+	if (info_.pixel_format != libcamera::formats::YUV420)
+		throw std::runtime_error("DewarpStage: only YUV420 supported");
+
+	bool limited = info_.colour_space && info_.colour_space->range == libcamera::ColorSpace::Range::Limited;
+	black_ = limited ? 16 : 0;
+
+	// The calibration is scaled to the main image.
+	LensModel lens;
+	double sx = (double)info_.width / config_.calibration_width;
+	double sy = (double)info_.height / config_.calibration_height;
+	lens.fx = config_.fx * sx, lens.fy = config_.fy * sy;
+	lens.cx = config_.cx * sx, lens.cy = config_.cy * sy;
+	lens.distortion = config_.distortion;
+	lens.fisheye = config_.fisheye;
+	lens.zoom = config_.zoom;
+	lens.SetRotation(config_.pan, config_.tilt);
+
+	auto time_taken = ExecutionTime<std::milli>([this, &lens]() {
+		luma_.Build(lens, info_.width, info_.height, info_.stride, 1);
+		chroma_.Build(lens, info_.width / 2, info_.height / 2, info_.stride / 2, 2);
+	});
+	LOG(2, "DewarpStage: remap tables built in " << time_taken.count() << "ms");
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	free_buffers_.clear();
+}
+
+bool DewarpStage::Process(CompletedRequestPtr &completed_request)
+{
+	if (!stream_)
+		return false;
+
+	// We need a copy of the source image to read from. Keep these around, as several
+	// frames may be here at once.
+	std::vector<uint8_t> buffer;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!free_buffers_.empty())
+		{
+			buffer = std::move(free_buffers_.back());
+			free_buffers_.pop_back();
+		}
+	}
+
+	const unsigned int stride = info_.stride, stride2 = stride / 2;
+
+	// The remap reads (with zero weight) a row and a pixel past the last plane.
+	BufferWriteSync w(app_, completed_request->buffers[stream_]);
+	libcamera::Span<uint8_t> span = w.Get()[0];
+	buffer.resize(span.size() + stride2 + 1);
+	memcpy(buffer.data(), span.data(), span.size());
+
+	const unsigned int offset_U = info_.height * stride, offset_V = offset_U + (info_.height / 2) * stride2;
+	uint8_t *dst = span.data();
+	const uint8_t *src = buffer.data();
+
+	auto work = [&](unsigned int y0, unsigned int y1) {
+		const unsigned int tile_w = config_.tile_width, tile_h = config_.tile_height;
+		luma_.Remap(dst, src, stride, black_, y0, y1, tile_w, tile_h);
+		chroma_.Remap(dst + offset_U, src + offset_U, stride2, 128, y0 / 2, y1 / 2, tile_w, tile_h);
+		chroma_.Remap(dst + offset_V, src + offset_V, stride2, 128, y0 / 2, y1 / 2, tile_w, tile_h);
+	};
+
+	// Bands are whole numbers of tiles, and even, so that chroma rows split cleanly.
+	unsigned int rows = info_.height & ~1;
+	unsigned int band = (rows + config_.threads - 1) / config_.threads;
+	band = (band + config_.tile_height - 1) / config_.tile_height * config_.tile_height;
+	std::vector<std::thread> threads;
+	for (unsigned int y0 = band; y0 < rows; y0 += band)
+		threads.emplace_back(work, y0, std::min(y0 + band, rows));
+	work(0, std::min(band, rows));
+	for (auto &t : threads)
+		t.join();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	free_buffers_.push_back(std::move(buffer));
+
+	return false;
+}
+
+static PostProcessingStage *Create(RPiCamApp *app)
+{
+	return new DewarpStage(app);
+}
+
+static RegisterStage reg(NAME, &Create);
@@ -0,0 +1,174 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * hailo_allocator.cpp - pooled buffers for inference tensors
+ */
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "hailo_allocator.hpp"
+
+Allocator::Allocator()
+{
+}
+
+Allocator::~Allocator()
+{
+	Reset();
+}
+
+void Allocator::Reset()
+{
+	std::scoped_lock<std::mutex> l(lock_);
+
+	Slab *slab = head_.load(std::memory_order_acquire);
+	while (slab)
+	{
+		Slab *next = slab->next.load(std::memory_order_acquire);
+		munmap(slab->memory, slab->length);
+		delete slab;
+		slab = next;
+	}
+
+	head_.store(nullptr, std::memory_order_release);
+	tail_ = nullptr;
+	size_classes_.clear();
+}
+
+// Call with lock_ held.
+Allocator::Slab *Allocator::addSlab(unsigned int size, unsigned int count)
+{
+	static const size_t page_size = sysconf(_SC_PAGESIZE);
+	const size_t block_size = (size + page_size - 1) / page_size * page_size;
+
+	void *addr = mmap(NULL, block_size * count, PROT_WRITE | PROT_READ, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (addr == MAP_FAILED)
+		return nullptr;
+
+	auto it = std::find_if(size_classes_.begin(), size_classes_.end(),
+						   [size](const std::unique_ptr<SizeClass> &c) { return c->size == size; });
+	SizeClass *size_class;
+	if (it == size_classes_.end())
+	{
+		size_classes_.push_back(std::make_unique<SizeClass>());
+		size_class = size_classes_.back().get();
+		size_class->size = size;
+	}
+	else
+		size_class = it->get();
+
+	Slab *slab = new Slab;
+	slab->size_class = size_class;
+	slab->memory = static_cast<uint8_t *>(addr);
+	slab->length = block_size * count;
+	slab->count = count;
+	slab->blocks = std::make_unique<Block[]>(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		slab->blocks[i].ptr = slab->memory + i * block_size;
+		slab->blocks[i].slab = slab;
+		slab->blocks[i].in_use.store(false, std::memory_order_relaxed);
+	}
+	size_class->capacity += count;
+
+	// Only publish the slab once it's completely set up.
+	if (tail_)
+		tail_->next.store(slab, std::memory_order_release);
+	else
+		head_.store(slab, std::memory_order_release);
+	tail_ = slab;
+
+	return slab;
+}
+
+void Allocator::Reserve(unsigned int size, unsigned int count)
+{
+	std::scoped_lock<std::mutex> l(lock_);
+
+	auto it = std::find_if(size_classes_.begin(), size_classes_.end(),
+						   [size](const std::unique_ptr<SizeClass> &c) { return c->size == size; });
+	unsigned int capacity = it == size_classes_.end() ? 0 : (*it)->capacity.load();
+	if (capacity < count)
+		addSlab(size, count - capacity);
+}
+
+std::shared_ptr<uint8_t> Allocator::claim(unsigned int size)
+{
+	for (Slab *slab = head_.load(std::memory_order_acquire); slab; slab = slab->next.load(std::memory_order_acquire))
+	{
+		SizeClass *size_class = slab->size_class;
+		if (size_class->size != size)
+			continue;
+
+		for (unsigned int i = 0; i < slab->count; i++)
+		{
+			Block *block = &slab->blocks[i];
+			bool expected = false;
+			if (block->in_use.load(std::memory_order_relaxed) ||
+				!block->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire))
+				continue;
+
+			unsigned int in_use = ++size_class->in_use;
+			unsigned int high_water = size_class->high_water.load();
+			while (in_use > high_water && !size_class->high_water.compare_exchange_weak(high_water, in_use))
+				;
+
+			// Only the (one byte) control block object lives in the block's control space; the pointer
+			// handed out aliases it but points at the buffer.
+			std::shared_ptr<uint8_t> control = std::allocate_shared<uint8_t>(BlockAllocator<uint8_t>(block));
+			return std::shared_ptr<uint8_t>(control, block->ptr);
+		}
+	}
+
+	return {};
+}
+
+void Allocator::release(Block *block)
+{
+	block->slab->size_class->in_use--;
+	block->in_use.store(false, std::memory_order_release);
+}
+
+std::shared_ptr<uint8_t> Allocator::Allocate(unsigned int size)
+{
+	std::shared_ptr<uint8_t> buffer = claim(size);
+	if (buffer)
+		return buffer;
+
+	std::scoped_lock<std::mutex> l(lock_);
+
+	// Someone else may have returned a block, or added a slab, while we waited.
+	buffer = claim(size);
+	if (buffer)
+		return buffer;
+
+	// Grow by doubling the number of blocks of this size.
+	auto it = std::find_if(size_classes_.begin(), size_classes_.end(),
+						   [size](const std::unique_ptr<SizeClass> &c) { return c->size == size; });
+	unsigned int count = 2;
+	if (it != size_classes_.end())
+	{
+		count = std::max((*it)->capacity.load(), count);
+		(*it)->grows++;
+	}
+
+	if (!addSlab(size, count))
+		return {};
+
+	return claim(size);
+}
+
+std::vector<Allocator::Stats> Allocator::GetStats() const
+{
+	std::scoped_lock<std::mutex> l(lock_);
+
+	std::vector<Stats> stats;
+	for (auto const &c : size_classes_)
+		stats.push_back({ c->size, c->capacity.load(), c->in_use.load(), c->high_water.load(), c->grows.load() });
+
+	return stats;
+}
@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * hailo_allocator.hpp - pooled buffers for inference tensors
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Inference stages need the same few buffer sizes over and over: the input tensor,
+// and each of the output tensors. Buffers come from "slabs", each of which holds a
+// fixed number of page-aligned blocks of one size. The slabs for the sizes we know
+// about are allocated up front with Reserve(), and after that Allocate() just claims
+// a free block without taking any locks. Blocks go back to their slab when the last
+// shared_ptr to them goes away. Only if every block of the right size is in use (or
+// the size is new) is another slab added, under a lock.
+
+// A shared_ptr needs a control block, which would normally be another trip to the heap
+// on every allocation. Instead each block has room for its own control block, which
+// allocate_shared puts there through a BlockAllocator.
+
+// Nothing here depends on HailoRT, so it can be tested on any Linux machine.
+
+class Allocator
+{
+public:
+	Allocator();
+	~Allocator();
+
+	// Release all the memory. No buffers may still be in use.
+	void Reset();
+
+	// Make sure there are at least count blocks of this size.
+	void Reserve(unsigned int size, unsigned int count);
+
+	std::shared_ptr<uint8_t> Allocate(unsigned int size);
+
+	struct Stats
+	{
+		unsigned int size;
+		unsigned int capacity;
+		unsigned int in_use;
+		// The most blocks of this size ever in use at once.
+		unsigned int high_water;
+		// Number of times a new slab had to be added after the first.
+		unsigned int grows;
+	};
+	std::vector<Stats> GetStats() const;
+
+private:
+	struct Slab;
+	struct Block
+	{
+		uint8_t *ptr;
+		Slab *slab;
+		std::atomic<bool> in_use;
+		alignas(std::max_align_t) unsigned char control[64];
+	};
+
+	// Hands out the block's control block space, and frees the block when the control block goes, which
+	// is the last thing to happen when the final reference is dropped.
+	template <typename T>
+	struct BlockAllocator
+	{
+		typedef T value_type;
+
+		explicit BlockAllocator(Block *b) : block(b) {}
+		template <typename U>
+		BlockAllocator(BlockAllocator<U> const &other) : block(other.block)
+		{
+		}
+
+		T *allocate(size_t n)
+		{
+			static_assert(sizeof(T) <= sizeof(Block::control) && alignof(T) <= alignof(std::max_align_t),
+						  "shared_ptr control block doesn't fit in a Block");
+			return reinterpret_cast<T *>(block->control);
+		}
+		void deallocate(T *, size_t) { Allocator::release(block); }
+
+		template <typename U>
+		bool operator==(BlockAllocator<U> const &other) const
+		{
+			return block == other.block;
+		}
+		template <typename U>
+		bool operator!=(BlockAllocator<U> const &other) const
+		{
+			return block != other.block;
+		}
+
+		Block *block;
+	};
+
+	// Slabs of the same size share their counters through a SizeClass.
+	struct SizeClass
+	{
+		unsigned int size;
+		std::atomic<unsigned int> capacity { 0 };
+		std::atomic<unsigned int> in_use { 0 };
+		std::atomic<unsigned int> high_water { 0 };
+		std::atomic<unsigned int> grows { 0 };
+	};
+
+	struct Slab
+	{
+		SizeClass *size_class;
+		uint8_t *memory;
+		size_t length;
+		unsigned int count;
+		std::unique_ptr<Block[]> blocks;
+		// Slabs are only ever appended to this list (until Reset), so it can be walked without a lock.
+		std::atomic<Slab *> next { nullptr };
+	};
+
+	Slab *addSlab(unsigned int size, unsigned int count);
+	std::shared_ptr<uint8_t> claim(unsigned int size);
+	static void release(Block *block);
+
+	mutable std::mutex lock_;
+	std::atomic<Slab *> head_ { nullptr };
+	Slab *tail_ = nullptr;
+	std::vector<std::unique_ptr<SizeClass>> size_classes_;
+};
@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * hailo_backend.cpp - HailoRT inference backend
+ */
+
+// Jobs run asynchronously on the device through a JobRing, so several can be in flight
+// at once (up to "inflight_jobs"), and their outputs are collected in frame order. The
+// outputs are all converted to float by HailoRT, so the decoders never need the
+// quantisation parameters. An output with on-chip NMS is described as a tensor of shape
+// [classes, 1 + 5 * max boxes] in the NMS-by-class layout that DecodeHailoNms expects.
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+#include "core/logging.hpp"
+#include "post_processing_stages/inference_backend.hpp"
+
+#include "hailo_allocator.hpp"
+#include "hailo_device.hpp"
+#include "hailo_job_ring.hpp"
+
+using namespace hailort;
+using namespace std::chrono_literals;
+
+namespace
+{
+
+class HailoBackend : public InferenceBackend
+{
+public:
+	~HailoBackend();
+
+	void Load(boost::property_tree::ptree const &params) override;
+
+	std::vector<TensorInfo> const &Inputs() const override { return inputs_; }
+	std::vector<TensorInfo> const &Outputs() const override { return outputs_; }
+
+	int Submit(unsigned int sequence, const uint8_t *input) override;
+
+	InferenceStatus Poll(int job, std::vector<Tensor> &outputs, std::chrono::milliseconds timeout) override;
+
+private:
+	struct Pending
+	{
+		InferenceJob job;
+		std::shared_ptr<uint8_t> input;
+		std::vector<Tensor> outputs;
+	};
+
+	std::shared_ptr<InferModel> infer_model_;
+	std::shared_ptr<ConfiguredInferModel> configured_infer_model_;
+	std::unique_ptr<InferenceDevice> device_;
+	JobRing job_ring_;
+	Allocator allocator_;
+	std::vector<TensorInfo> inputs_;
+	std::vector<TensorInfo> outputs_;
+	size_t input_size_;
+	std::vector<size_t> output_sizes_;
+
+	std::mutex mutex_;
+	std::map<int, Pending> pending_;
+	unsigned int next_id_ = 0;
+};
+
+HailoBackend::~HailoBackend()
+{
+	// Jobs nobody collected keep their buffers until the device finishes them, or shutting down cancels them.
+	pending_.clear();
+	job_ring_.Drain(1s);
+	if (configured_infer_model_)
+		configured_infer_model_->shutdown();
+	if (!job_ring_.Drain(1s))
+		LOG_ERROR("HailoBackend: inference jobs still running at shutdown");
+}
+
+void HailoBackend::Load(boost::property_tree::ptree const &params)
+{
+	VDevice *vdevice = GetHailoVDevice();
+	if (!vdevice)
+		throw std::runtime_error("HailoBackend: failed to get a vdevice instance");
+
+	// As for the Hailo stages, there may be a different HEF file for each kind of device.
+	auto devices = vdevice->get_physical_devices().release();
+	hailo_device_identity_t device_id = devices[0].get().identify().release();
+	std::string hef_file = params.get<std::string>("hef_file", "");
+	if (device_id.device_architecture == HAILO_ARCH_HAILO8 && params.count("hef_file_8"))
+		hef_file = params.get<std::string>("hef_file_8");
+	else if (params.count("hef_file_8L"))
+		hef_file = params.get<std::string>("hef_file_8L");
+	if (hef_file.empty())
+		throw std::runtime_error("HailoBackend: unable to use a suitable HEF file");
+
+	Expected<std::shared_ptr<InferModel>> infer_model_exp = vdevice->create_infer_model(hef_file);
+	if (!infer_model_exp)
+		throw std::runtime_error("HailoBackend: failed to create infer model, status = " +
+								 std::to_string(infer_model_exp.status()));
+	infer_model_ = infer_model_exp.release();
+	for (auto const &name : infer_model_->get_output_names())
+		infer_model_->output(name)->set_format_type(HAILO_FORMAT_TYPE_FLOAT32);
+
+	Expected<ConfiguredInferModel> configured_infer_model_exp = infer_model_->configure();
+	if (!configured_infer_model_exp)
+		throw std::runtime_error("HailoBackend: failed to create configured infer model, status = " +
+								 std::to_string(configured_infer_model_exp.status()));
+	configured_infer_model_ = std::make_shared<ConfiguredInferModel>(configured_infer_model_exp.release());
+
+	unsigned int num_jobs = std::clamp(params.get<unsigned int>("inflight_jobs", 2), 1u, 8u);
+	Expected<size_t> queue_size_exp = configured_infer_model_->get_async_queue_size();
+	if (queue_size_exp)
+		num_jobs = std::clamp<unsigned int>(queue_size_exp.release(), 1, num_jobs);
+
+	std::vector<ConfiguredInferModel::Bindings> bindings;
+	for (unsigned int i = 0; i < num_jobs; i++)
+	{
+		Expected<ConfiguredInferModel::Bindings> bindings_exp = configured_infer_model_->create_bindings();
+		if (!bindings_exp)
+			throw std::runtime_error("HailoBackend: failed to create infer bindings, status = " +
+									 std::to_string(bindings_exp.status()));
+		bindings.push_back(std::move(bindings_exp.release()));
+	}
+	device_ = std::make_unique<HailoInferenceDevice>(infer_model_, configured_infer_model_, std::move(bindings));
+	job_ring_.Configure(device_.get(), num_jobs);
+
+	auto input = infer_model_->inputs()[0];
+	TensorInfo input_info;
+	input_info.name = input.name();
+	input_info.type = TensorType::UInt8;
+	input_info.shape = { 1, input.shape().height, input.shape().width, input.shape().features };
+	inputs_ = { input_info };
+	input_size_ = input.get_frame_size();
+
+	outputs_.clear();
+	output_sizes_.clear();
+	for (auto const &name : infer_model_->get_output_names())
+	{
+		auto output = infer_model_->output(name);
+		TensorInfo info;
+		info.name = name;
+		info.type = TensorType::Float32;
+		if (output->is_nms())
+		{
+			hailo_nms_shape_t nms_shape = output->get_nms_shape().release();
+			info.shape = { nms_shape.number_of_classes, 1 + 5 * nms_shape.max_bboxes_per_class };
+		}
+		else
+			info.shape = { 1, output->shape().height, output->shape().width, output->shape().features };
+		outputs_.push_back(info);
+		output_sizes_.push_back(std::max(output->get_frame_size(), info.Bytes()));
+	}
+
+	// Buffers for every job that can be in flight, and as many again still being decoded.
+	allocator_.Reset();
+	for (size_t size : output_sizes_)
+		allocator_.Reserve(size, 2 * num_jobs);
+	allocator_.Reserve(input_size_, 2 * num_jobs);
+
+	LOG(2, "HailoBackend: " << hef_file << " with up to " << num_jobs << " jobs in flight");
+}
+
+int HailoBackend::Submit(unsigned int sequence, const uint8_t *input)
+{
+	Pending pending;
+	pending.input = allocator_.Allocate(input_size_);
+	if (!pending.input)
+		return -1;
+	memcpy(pending.input.get(), input, std::min(input_size_, inputs_[0].Elements()));
+
+	// The ring keeps these until the device is done with them, even if the job is never collected.
+	std::vector<uint8_t *> buffers;
+	auto hold = std::make_shared<std::vector<std::shared_ptr<uint8_t>>>(1, pending.input);
+	for (unsigned int i = 0; i < outputs_.size(); i++)
+	{
+		std::shared_ptr<uint8_t> buffer = allocator_.Allocate(output_sizes_[i]);
+		if (!buffer)
+			return -1;
+		buffers.push_back(buffer.get());
+		hold->push_back(buffer);
+		pending.outputs.push_back({ outputs_[i], std::move(buffer) });
+	}
+
+	pending.job = job_ring_.Submit(sequence, pending.input.get(), buffers, std::move(hold), 1s);
+	if (!pending.job.Valid())
+		return -1;
+
+	std::scoped_lock<std::mutex> l(mutex_);
+	int id = next_id_++ & 0x7fffffff;
+	pending_[id] = std::move(pending);
+	return id;
+}
+
+InferenceStatus HailoBackend::Poll(int job, std::vector<Tensor> &outputs, std::chrono::milliseconds timeout)
+{
+	Pending pending;
+	{
+		std::scoped_lock<std::mutex> l(mutex_);
+		auto it = pending_.find(job);
+		if (it == pending_.end())
+			return InferenceStatus::Failed;
+		pending = std::move(it->second);
+		pending_.erase(it);
+	}
+
+	// Results come back in frame order, so this may also be waiting for jobs from earlier frames.
+	if (!pending.job.Ready(timeout))
+	{
+		std::scoped_lock<std::mutex> l(mutex_);
+		pending_[job] = std::move(pending);
+		return InferenceStatus::Pending;
+	}
+
+	if (!pending.job.Wait(0ms))
+		return InferenceStatus::Failed;
+
+	outputs = std::move(pending.outputs);
+	return InferenceStatus::Ok;
+}
+
+InferenceBackend *Create()
+{
+	return new HailoBackend();
+}
+
+RegisterInferenceBackend reg("hailo", &Create);
+
+} // namespace
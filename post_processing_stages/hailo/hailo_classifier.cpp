@@ -40,7 +40,7 @@ public:
 	bool Process(CompletedRequestPtr &completed_request) override;
 
 private:
-	std::vector<HailoClassificationPtr> runInference(uint8_t *frame);
+	std::vector<HailoClassificationPtr> runInference(unsigned int sequence, std::shared_ptr<uint8_t> const &frame);
 
 	PostProcessingLib postproc_;
 
@@ -82,46 +82,13 @@ bool HailoClassifier::Process(CompletedRequestPtr &completed_request)
 
 	BufferReadSync r(app_, completed_request->buffers[low_res_stream_]);
 	libcamera::Span<uint8_t> buffer = r.Get()[0];
-	std::shared_ptr<uint8_t> input;
-	uint8_t *input_ptr;
+	libcamera::Rectangle active;
 
-	if (low_res_info_.pixel_format == libcamera::formats::YUV420)
-	{
-		StreamInfo rgb_info;
-		rgb_info.width = InputTensorSize().width;
-		rgb_info.height = InputTensorSize().height;
-		rgb_info.stride = rgb_info.width * 3;
-
-		input = allocator_.Allocate(rgb_info.stride * rgb_info.height);
-		input_ptr = input.get();
-
-		Yuv420ToRgb(input.get(), buffer.data(), low_res_info_, rgb_info);
-	}
-	else if (low_res_info_.pixel_format == libcamera::formats::RGB888 ||
-			 low_res_info_.pixel_format == libcamera::formats::BGR888)
-	{
-		unsigned int stride = low_res_info_.width * 3;
-
-		// If the stride shows we have padding on the right edge of the buffer, we must copy it out to another buffer
-		// without padding.
-		if (low_res_info_.stride != stride)
-		{
-			input = allocator_.Allocate(stride * low_res_info_.height);
-			input_ptr = input.get();
-
-			for (unsigned int i = 0; i < low_res_info_.height; i++)
-				memcpy(input_ptr + i * stride, buffer.data() + i * low_res_info_.stride, stride);
-		}
-		else
-			input_ptr = buffer.data();
-	}
-	else
-	{
-		LOG_ERROR("Unexpected lores format " << low_res_info_.pixel_format);
+	std::shared_ptr<uint8_t> input = PrepareInput(buffer.data(), active);
+	if (!input)
 		return false;
-	}
 
-	std::vector<HailoClassificationPtr> results = runInference(input_ptr);
+	std::vector<HailoClassificationPtr> results = runInference(completed_request->sequence, input);
 	if (results.size())
 	{
 		LOG(2, "Result: " << results[0]->get_label());
@@ -131,21 +98,21 @@ bool HailoClassifier::Process(CompletedRequestPtr &completed_request)
 	return false;
 }
 
-std::vector<HailoClassificationPtr> HailoClassifier::runInference(uint8_t *frame)
+std::vector<HailoClassificationPtr> HailoClassifier::runInference(unsigned int sequence,
+																   std::shared_ptr<uint8_t> const &frame)
 {
-	hailort::AsyncInferJob job;
+	InferenceJob job;
 	std::vector<OutTensor> output_tensors;
 	hailo_status status;
 
-	status = HailoPostProcessingStage::DispatchJob(frame, job, output_tensors);
+	status = HailoPostProcessingStage::DispatchJob(sequence, frame, job, output_tensors);
 	if (status != HAILO_SUCCESS)
 		return {};
 
 	// Wait for job completion.
-	status = job.wait(1s);
-	if (status != HAILO_SUCCESS)
+	if (!job.Wait(1s))
 	{
-		LOG_ERROR("Failed to wait for inference to finish, status = " << status);
+		LOG_ERROR("Failed to wait for inference to finish");
 		return {};
 	}
 
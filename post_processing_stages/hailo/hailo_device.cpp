@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * hailo_device.cpp - the Hailo device shared by the stages and backend
+ */
+
+#include "core/logging.hpp"
+
+#include "hailo_device.hpp"
+
+using namespace hailort;
+using namespace std::chrono_literals;
+
+VDevice *GetHailoVDevice()
+{
+	static std::mutex lock;
+	static std::unique_ptr<VDevice> vdevice;
+
+	std::scoped_lock<std::mutex> l(lock);
+	if (!vdevice)
+	{
+		Expected<std::unique_ptr<VDevice>> vdevice_exp = VDevice::create();
+		if (!vdevice_exp)
+		{
+			LOG_ERROR("Failed create vdevice, status = " << vdevice_exp.status());
+			return nullptr;
+		}
+		vdevice = vdevice_exp.release();
+	}
+
+	return vdevice.get();
+}
+
+HailoInferenceDevice::HailoInferenceDevice(std::shared_ptr<InferModel> infer_model,
+										   std::shared_ptr<ConfiguredInferModel> configured_infer_model,
+										   std::vector<ConfiguredInferModel::Bindings> bindings)
+	: infer_model_(std::move(infer_model)), configured_infer_model_(std::move(configured_infer_model)),
+	  bindings_(std::move(bindings))
+{
+}
+
+bool HailoInferenceDevice::Run(unsigned int slot, const uint8_t *input, std::vector<uint8_t *> const &outputs,
+							   std::function<void(bool)> done)
+{
+	// The jobs themselves run concurrently, but we queue them up one at a time.
+	std::scoped_lock<std::mutex> l(lock_);
+	ConfiguredInferModel::Bindings &bindings = bindings_[slot];
+	hailo_status status;
+
+	const std::string &input_name = infer_model_->get_input_names()[0];
+	size_t input_frame_size = infer_model_->input(input_name)->get_frame_size();
+	status = bindings.input(input_name)->set_buffer(MemoryView((void *)(input), input_frame_size));
+	if (status != HAILO_SUCCESS)
+	{
+		LOG_ERROR("Could not write to input stream with status " << status);
+		return false;
+	}
+
+	const std::vector<std::string> output_names = infer_model_->get_output_names();
+	for (unsigned int i = 0; i < output_names.size(); i++)
+	{
+		size_t output_size = infer_model_->output(output_names[i])->get_frame_size();
+		status = bindings.output(output_names[i])->set_buffer(MemoryView(outputs[i], output_size));
+		if (status != HAILO_SUCCESS)
+		{
+			LOG_ERROR("Failed to set infer output buffer, status = " << status);
+			return false;
+		}
+	}
+
+	// Waiting for available requests in the pipeline.
+	status = configured_infer_model_->wait_for_async_ready(1s);
+	if (status != HAILO_SUCCESS)
+	{
+		LOG_ERROR("Failed to wait for async ready, status = " << status);
+		return false;
+	}
+
+	Expected<AsyncInferJob> job_exp = configured_infer_model_->run_async(
+		bindings, [done](const AsyncInferCompletionInfo &info) { done(info.status == HAILO_SUCCESS); });
+	if (!job_exp)
+	{
+		LOG_ERROR("Failed to start async infer job, status = " << job_exp.status());
+		return false;
+	}
+
+	// Detach and let the job run.
+	job_exp.release().detach();
+
+	return true;
+}
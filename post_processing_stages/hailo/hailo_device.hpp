@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * hailo_device.hpp - the Hailo device shared by the stages and backend
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <hailo/hailort.hpp>
+
+#include "hailo_job_ring.hpp"
+
+// The one virtual device that every Hailo stage and backend in the process shares.
+hailort::VDevice *GetHailoVDevice();
+
+// Runs jobs on a configured model, with a set of bindings for each slot of a job ring.
+class HailoInferenceDevice : public InferenceDevice
+{
+public:
+	HailoInferenceDevice(std::shared_ptr<hailort::InferModel> infer_model,
+						 std::shared_ptr<hailort::ConfiguredInferModel> configured_infer_model,
+						 std::vector<hailort::ConfiguredInferModel::Bindings> bindings);
+
+	bool Run(unsigned int slot, const uint8_t *input, std::vector<uint8_t *> const &outputs,
+			 std::function<void(bool)> done) override;
+
+private:
+	std::mutex lock_;
+	std::shared_ptr<hailort::InferModel> infer_model_;
+	std::shared_ptr<hailort::ConfiguredInferModel> configured_infer_model_;
+	std::vector<hailort::ConfiguredInferModel::Bindings> bindings_;
+};
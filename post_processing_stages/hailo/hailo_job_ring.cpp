@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * hailo_job_ring.cpp - a ring of in-flight inference jobs
+ */
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "hailo_job_ring.hpp"
+
+InferenceJob::InferenceJob(InferenceJob &&other)
+	: ring_(other.ring_), state_(std::move(other.state_)), position_(other.position_)
+{
+	other.ring_ = nullptr;
+}
+
+InferenceJob &InferenceJob::operator=(InferenceJob &&other)
+{
+	if (this != &other)
+	{
+		release();
+		ring_ = other.ring_;
+		state_ = std::move(other.state_);
+		position_ = other.position_;
+		other.ring_ = nullptr;
+	}
+	return *this;
+}
+
+InferenceJob::~InferenceJob()
+{
+	release();
+}
+
+void InferenceJob::release()
+{
+	if (!ring_)
+		return;
+
+	std::scoped_lock<std::mutex> l(ring_->mutex_);
+	ring_->outstanding_.erase(position_);
+	ring_->cond_.notify_all();
+	ring_ = nullptr;
+}
+
+bool InferenceJob::Wait(std::chrono::milliseconds timeout)
+{
+	if (!ring_)
+		return false;
+
+	JobRing *ring = ring_;
+	std::unique_lock<std::mutex> lock(ring->mutex_);
+
+	// Our own sequence number is in the outstanding set, so if it's the smallest there
+	// then everything from earlier frames has been collected.
+	bool ready = ring->cond_.wait_for(lock, timeout, [this, ring] {
+		return state_->done && *ring->outstanding_.begin() == state_->sequence;
+	});
+
+	ring->outstanding_.erase(position_);
+	ring->cond_.notify_all();
+	ring_ = nullptr;
+
+	return ready && state_->ok;
+}
+
+bool InferenceJob::Ready(std::chrono::milliseconds timeout)
+{
+	if (!ring_)
+		return false;
+
+	JobRing *ring = ring_;
+	std::unique_lock<std::mutex> lock(ring->mutex_);
+	return ring->cond_.wait_for(lock, timeout, [this, ring] {
+		return state_->done && *ring->outstanding_.begin() == state_->sequence;
+	});
+}
+
+JobRing::JobRing()
+{
+}
+
+JobRing::~JobRing()
+{
+	Drain(std::chrono::seconds(1));
+}
+
+void JobRing::Configure(InferenceDevice *device, unsigned int slots)
+{
+	std::scoped_lock<std::mutex> l(mutex_);
+
+	if (running_)
+		throw std::runtime_error("JobRing: cannot reconfigure with jobs running");
+
+	device_ = device;
+	busy_.assign(std::max(slots, 1u), false);
+}
+
+InferenceJob JobRing::Submit(unsigned int sequence, const uint8_t *input, std::vector<uint8_t *> const &outputs,
+							 std::shared_ptr<void> buffers, std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	if (!device_)
+		return {};
+
+	// Later frames must wait for this one from now on, and slots are handed out in sequence order too.
+	auto position = outstanding_.insert(sequence);
+	auto waiting = waiting_.insert(sequence);
+	bool ready = cond_.wait_for(lock, timeout,
+								[this, sequence] { return running_ < busy_.size() && *waiting_.begin() == sequence; });
+	waiting_.erase(waiting);
+	cond_.notify_all();
+	if (!ready)
+	{
+		outstanding_.erase(position);
+		return {};
+	}
+
+	unsigned int slot = std::find(busy_.begin(), busy_.end(), false) - busy_.begin();
+	busy_[slot] = true;
+	running_++;
+
+	InferenceJob job;
+	job.ring_ = this;
+	job.state_ = std::make_shared<InferenceJob::State>();
+	job.state_->sequence = sequence;
+	job.state_->buffers = std::move(buffers);
+	job.position_ = position;
+
+	lock.unlock();
+
+	std::shared_ptr<InferenceJob::State> state = job.state_;
+	if (!device_->Run(slot, input, outputs, [this, slot, state](bool ok) { complete(slot, state, ok); }))
+	{
+		{
+			std::scoped_lock<std::mutex> l(mutex_);
+			busy_[slot] = false;
+			running_--;
+			cond_.notify_all();
+		}
+		// Returning an empty job drops this one from the outstanding set.
+		return {};
+	}
+
+	return job;
+}
+
+void JobRing::complete(unsigned int slot, std::shared_ptr<InferenceJob::State> const &state, bool ok)
+{
+	std::scoped_lock<std::mutex> l(mutex_);
+
+	state->done = true;
+	state->ok = ok;
+	state->buffers.reset();
+	busy_[slot] = false;
+	running_--;
+	cond_.notify_all();
+}
+
+bool JobRing::Drain(std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	return cond_.wait_for(lock, timeout, [this] { return running_ == 0; });
+}
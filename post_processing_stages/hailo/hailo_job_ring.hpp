@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * hailo_job_ring.hpp - a ring of in-flight inference jobs
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+// Frames reach the post-processing stages on several threads at once, so several
+// inference jobs can be outstanding together. Each needs its own set of bindings
+// (input and output buffers) on the device, so the JobRing hands out one of a fixed
+// number of "slots" to each job, waiting for one to come free if they're all busy.
+// Jobs can finish in any order, but results are only collected in order of frame
+// sequence number, so that anything tracking objects from frame to frame sees them
+// in the right order.
+
+// None of this knows about HailoRT, so a mock device can be used to test it.
+
+class InferenceDevice
+{
+public:
+	virtual ~InferenceDevice() = default;
+
+	// Start an inference from input into the output buffers, using the bindings for
+	// the given slot. Return false if the job could not be started, otherwise call done
+	// (from any thread) when it finishes, with whether it succeeded.
+	virtual bool Run(unsigned int slot, const uint8_t *input, std::vector<uint8_t *> const &outputs,
+					 std::function<void(bool)> done) = 0;
+};
+
+class JobRing;
+
+// A handle for a job that has been started. Wait() must be called to collect the
+// result; a job that is destroyed without being waited for stops holding up those
+// after it. Giving up on a job doesn't stop the device, so the ring keeps the job's
+// buffers (and its slot) until the device says it has finished with them.
+class InferenceJob
+{
+public:
+	InferenceJob() = default;
+	InferenceJob(InferenceJob &&other);
+	InferenceJob &operator=(InferenceJob &&other);
+	~InferenceJob();
+
+	// Wait for the job, and any others from earlier frames, to finish. Returns true
+	// if this job succeeded.
+	bool Wait(std::chrono::milliseconds timeout);
+
+	// Wait up to timeout for the job to be ready for Wait() to collect at once, without
+	// collecting it.
+	bool Ready(std::chrono::milliseconds timeout);
+
+	bool Valid() const { return !!ring_; }
+
+private:
+	friend class JobRing;
+	struct State
+	{
+		unsigned int sequence;
+		bool done = false;
+		bool ok = false;
+		// Whatever owns the job's buffers, dropped once the device is done with them.
+		std::shared_ptr<void> buffers;
+	};
+
+	void release();
+
+	JobRing *ring_ = nullptr;
+	std::shared_ptr<State> state_;
+	std::multiset<unsigned int>::iterator position_;
+};
+
+class JobRing
+{
+public:
+	JobRing();
+	~JobRing();
+
+	// Set the device and number of slots. There must be no jobs outstanding.
+	void Configure(InferenceDevice *device, unsigned int slots);
+
+	unsigned int Slots() const { return busy_.size(); }
+
+	// Start a job for frame "sequence", waiting up to timeout for a free slot. On
+	// failure the returned job is not valid. buffers should own the input and outputs;
+	// it is held until the job completes, however long the caller waits.
+	InferenceJob Submit(unsigned int sequence, const uint8_t *input, std::vector<uint8_t *> const &outputs,
+						std::shared_ptr<void> buffers, std::chrono::milliseconds timeout);
+
+	// Wait for all running jobs to finish. Returns false if some are still running.
+	bool Drain(std::chrono::milliseconds timeout);
+
+private:
+	friend class InferenceJob;
+
+	void complete(unsigned int slot, std::shared_ptr<InferenceJob::State> const &state, bool ok);
+
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	InferenceDevice *device_ = nullptr;
+	std::vector<bool> busy_;
+	unsigned int running_ = 0;
+	// Sequence numbers of jobs that have been started but not yet collected.
+	std::multiset<unsigned int> outstanding_;
+	// Sequence numbers of jobs waiting for a free slot.
+	std::multiset<unsigned int> waiting_;
+};
@@ -6,14 +6,18 @@
  */
 
 #include <algorithm>
+#include <cstring>
 #include <mutex>
+#include <stdexcept>
 #include <string>
-#include <sys/mman.h>
 
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/opencv.hpp>
 
+#include "post_processing_stages/resize.hpp"
+
+#include "hailo_device.hpp"
 #include "hailo_postprocessing_stage.hpp"
 
 #include "hailo_postproc_lib.h"
@@ -59,93 +63,9 @@ private:
 	bool init_ = false;
 };
 
-// Singleton class for the hardware virtual device.
-class vdevice
-{
-public:
-	vdevice(vdevice &other) = delete;
-	void operator=(const vdevice &) = delete;
-
-	static VDevice *get_instance()
-	{
-		static std::unique_ptr<VDevice> _vdevice {};
-
-		if (!_vdevice)
-		{
-			Expected<std::unique_ptr<VDevice>> vdevice_exp = VDevice::create();
-			if (!vdevice_exp)
-			{
-				LOG_ERROR("Failed create vdevice, status = " << vdevice_exp.status());
-				return nullptr;
-			}
-			_vdevice = vdevice_exp.release();
-		}
-
-		return _vdevice.get();
-	}
-
-private:
-	vdevice() {}
-};
-
 } // namespace
 
 
-Allocator::Allocator()
-{
-}
-
-Allocator::~Allocator()
-{
-	Reset();
-}
-
-void Allocator::Reset()
-{
-	std::scoped_lock<std::mutex> l(lock_);
-
-	for (auto &info : alloc_info_)
-		munmap(info.ptr, info.size);
-
-	alloc_info_.clear();
-}
-
-std::shared_ptr<uint8_t> Allocator::Allocate(unsigned int size)
-{
-	std::scoped_lock<std::mutex> l(lock_);
-	uint8_t *ptr = nullptr;
-
-	auto info = std::find_if(alloc_info_.begin(), alloc_info_.end(),
-							 [size](const AllocInfo &info) { return info.free && info.size == size; });
-	if (info != alloc_info_.end())
-	{
-		info->free = false;
-		ptr = info->ptr;
-	}
-
-	if (!ptr)
-	{
-		void *addr = mmap(NULL, size, PROT_WRITE | PROT_READ, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-		if (addr == MAP_FAILED)
-			return {};
-
-		ptr = static_cast<uint8_t *>(addr);
-		alloc_info_.emplace_back(ptr, size, false);
-	}
-
-	return std::shared_ptr<uint8_t>(ptr, [this](uint8_t *ptr) { this->free(ptr); });
-}
-
-void Allocator::free(uint8_t *ptr)
-{
-	std::scoped_lock<std::mutex> l(lock_);
-
-	auto info =	std::find_if(alloc_info_.begin(), alloc_info_.end(),
-							 [ptr](const AllocInfo &info) { return info.ptr == ptr; });
-	if (info != alloc_info_.end())
-		info->free = true;
-}
-
 HailoPostProcessingStage::HailoPostProcessingStage(RPiCamApp *app)
 	: PostProcessingStage(app), msg_queue_(std::ref(Display::GetDisplayMsgQueue()))
 {
@@ -154,7 +74,20 @@ HailoPostProcessingStage::HailoPostProcessingStage(RPiCamApp *app)
 HailoPostProcessingStage::~HailoPostProcessingStage()
 {
 	if (init_)
+	{
+		// Shutting down cancels any jobs still running, which then finish.
+		job_ring_.Drain(1s);
 		configured_infer_model_->shutdown();
+		if (!job_ring_.Drain(1s))
+			LOG_ERROR("Hailo: inference jobs still running at shutdown");
+	}
+
+	if (resize_count_)
+		LOG(1, "Hailo: software resize took " << resize_time_us_ / resize_count_ << "us per frame on average");
+
+	for (auto const &s : allocator_.GetStats())
+		LOG(2, "Hailo allocator: size " << s.size << " blocks " << s.capacity << " high water " << s.high_water
+										<< " grows " << s.grows);
 }
 
 void HailoPostProcessingStage::Read(boost::property_tree::ptree const &params)
@@ -162,6 +95,8 @@ void HailoPostProcessingStage::Read(boost::property_tree::ptree const &params)
 	hef_file_ = params.get<std::string>("hef_file", "");
 	hef_file_8_ = params.get<std::string>("hef_file_8", "");
 	hef_file_8L_ = params.get<std::string>("hef_file_8L", "");
+	inflight_jobs_ = std::clamp(params.get<unsigned int>("inflight_jobs", 2), 1u, 8u);
+	letterbox_ = params.get<int>("letterbox", 0);
 }
 
 void HailoPostProcessingStage::Configure()
@@ -180,13 +115,38 @@ void HailoPostProcessingStage::Configure()
 			init_ = true;
 	}
 
+	// A low res image that isn't the size of the input tensor gets resized in software, which works but
+	// costs CPU time on every frame.
+	resize_ = false;
+	if (init_ && low_res_stream_ &&
+		(low_res_info_.width != input_tensor_size_.width || low_res_info_.height != input_tensor_size_.height))
+	{
+		resize_ = true;
+		LOG(1, "Hailo: resizing " << low_res_info_.width << "x" << low_res_info_.height << " low res images to "
+								  << input_tensor_size_.toString() << (letterbox_ ? " (letterboxed)" : "")
+								  << " in software; a low res stream of that size would avoid this");
+	}
+
+	// Any jobs still running from before are using buffers we're about to throw away.
+	if (!job_ring_.Drain(1s))
+		throw std::runtime_error("Hailo: inference jobs from before are still running");
 	allocator_.Reset();
 	last_frame_ = {};
+
+	// Set aside buffers for the output tensors, and for an RGB copy of the input, for each job that can be in
+	// flight, plus as many again for results still being post-processed.
+	if (init_)
+	{
+		unsigned int count = 2 * job_ring_.Slots();
+		for (auto const &output_name : infer_model_->get_output_names())
+			allocator_.Reserve(infer_model_->output(output_name)->get_frame_size(), count);
+		allocator_.Reserve(input_tensor_size_.width * input_tensor_size_.height * 3, count);
+	}
 }
 
 int HailoPostProcessingStage::configureHailoRT()
 {
-	vdevice_ = vdevice::get_instance();
+	vdevice_ = GetHailoVDevice();
 	if (!vdevice_)
 	{
 		LOG_ERROR("Failed to get a vdevice instance.");
@@ -231,14 +191,27 @@ int HailoPostProcessingStage::configureHailoRT()
 	}
 	configured_infer_model_ = std::make_shared<ConfiguredInferModel>(configured_infer_model_exp.release());
 
-	// Create infer bindings
-	Expected<ConfiguredInferModel::Bindings> bindings_exp = configured_infer_model_->create_bindings();
-	if (!bindings_exp)
+	// There's no point having more jobs in flight than the model can queue up.
+	unsigned int num_jobs = inflight_jobs_;
+	Expected<size_t> queue_size_exp = configured_infer_model_->get_async_queue_size();
+	if (queue_size_exp)
+		num_jobs = std::clamp<unsigned int>(queue_size_exp.release(), 1, num_jobs);
+
+	// Create infer bindings, a set for each job that can be in flight.
+	std::vector<ConfiguredInferModel::Bindings> bindings;
+	for (unsigned int i = 0; i < num_jobs; i++)
 	{
-		LOG_ERROR("Failed to create infer bindings, status = " << bindings_exp.status());
-		return bindings_exp.status();
+		Expected<ConfiguredInferModel::Bindings> bindings_exp = configured_infer_model_->create_bindings();
+		if (!bindings_exp)
+		{
+			LOG_ERROR("Failed to create infer bindings, status = " << bindings_exp.status());
+			return bindings_exp.status();
+		}
+		bindings.push_back(std::move(bindings_exp.release()));
 	}
-	bindings_ = std::move(bindings_exp.release());
+	device_ = std::make_unique<HailoInferenceDevice>(infer_model_, configured_infer_model_, std::move(bindings));
+	job_ring_.Configure(device_.get(), num_jobs);
+	LOG(2, "Hailo: up to " << num_jobs << " inference jobs in flight");
 
 	hailo_3d_image_shape_t shape = infer_model_->inputs()[0].shape();
 	input_tensor_size_ = libcamera::Size(shape.width, shape.height);
@@ -246,25 +219,14 @@ int HailoPostProcessingStage::configureHailoRT()
 	return 0;
 }
 
-hailo_status HailoPostProcessingStage::DispatchJob(const uint8_t *input, AsyncInferJob &job,
-												   std::vector<OutTensor> &output_tensors)
+hailo_status HailoPostProcessingStage::DispatchJob(unsigned int sequence, std::shared_ptr<uint8_t> input,
+												   InferenceJob &job, std::vector<OutTensor> &output_tensors)
 {
-	hailo_status status;
-
-	std::scoped_lock<std::mutex> l(lock_);
-
-	// Input tensor.
-	const std::string &input_name = infer_model_->get_input_names()[0];
-	size_t input_frame_size = infer_model_->input(input_name)->get_frame_size();
-
-	status = bindings_.input(input_name)->set_buffer(MemoryView((void *)(input), input_frame_size));
-	if (status != HAILO_SUCCESS)
-	{
-		LOG_ERROR("Could not write to input stream with status " << status);
-		return status;
-	}
-
-	// Output tensors.
+	// The input and output tensors. The ring holds on to these until the device is done, even if the caller gives
+	// up waiting.
+	std::vector<uint8_t *> outputs;
+	const uint8_t *input_data = input.get();
+	auto buffers = std::make_shared<std::vector<std::shared_ptr<uint8_t>>>(1, std::move(input));
 	for (auto const &output_name : infer_model_->get_output_names())
 	{
 		size_t output_size = infer_model_->output(output_name)->get_frame_size();
@@ -272,59 +234,47 @@ hailo_status HailoPostProcessingStage::DispatchJob(const uint8_t *input, AsyncIn
 		if (!output_buffer)
 		{
 			LOG_ERROR("Could not allocate an output buffer!");
-			return status;
-		}
-
-		status = bindings_.output(output_name)->set_buffer(MemoryView(output_buffer.get(), output_size));
-		if (status != HAILO_SUCCESS)
-		{
-			LOG_ERROR("Failed to set infer output buffer, status = " << status);
-			return status;
+			return HAILO_OUT_OF_HOST_MEMORY;
 		}
 
 		const std::vector<hailo_quant_info_t> quant = infer_model_->output(output_name)->get_quant_infos();
 		const hailo_3d_image_shape_t shape = infer_model_->output(output_name)->shape();
 		const hailo_format_t format = infer_model_->output(output_name)->format();
+		outputs.push_back(output_buffer.get());
+		buffers->push_back(output_buffer);
 		output_tensors.emplace_back(std::move(output_buffer), output_name, quant[0], shape, format);
 	}
 
-	// Waiting for available requests in the pipeline.
-	status = configured_infer_model_->wait_for_async_ready(1s);
-	if (status != HAILO_SUCCESS)
 	{
-		LOG_ERROR("Failed to wait for async ready, status = " << status);
-		return status;
-	}
+		std::scoped_lock<std::mutex> l(lock_);
 
-	Expected<LatencyMeasurementResult> inf_time_exp = configured_infer_model_->get_hw_latency_measurement();
-	std::chrono::time_point<std::chrono::steady_clock> this_frame = std::chrono::steady_clock::now();
+		Expected<LatencyMeasurementResult> inf_time_exp = configured_infer_model_->get_hw_latency_measurement();
+		std::chrono::time_point<std::chrono::steady_clock> this_frame = std::chrono::steady_clock::now();
 
-	if (inf_time_exp && last_frame_.time_since_epoch() != 0s)
-	{
-		const auto inf_time =
-			std::chrono::duration_cast<std::chrono::milliseconds>(inf_time_exp.release().avg_hw_latency);
-		const auto frame_time = std::chrono::duration_cast<std::chrono::milliseconds>(this_frame - last_frame_);
+		// With several jobs in flight, inference can take that many frame intervals before we fall behind.
+		if (inf_time_exp && last_frame_.time_since_epoch() != 0s)
+		{
+			const auto inf_time =
+				std::chrono::duration_cast<std::chrono::milliseconds>(inf_time_exp.release().avg_hw_latency);
+			const auto frame_time = std::chrono::duration_cast<std::chrono::milliseconds>(this_frame - last_frame_);
 
-		if (frame_time < inf_time)
-			LOG(2, "Warning: model inferencing time of " << inf_time.count() << "ms " <<
-				   "> current job interval of " << frame_time.count() << "ms!");
-	}
+			if (frame_time * job_ring_.Slots() < inf_time)
+				LOG(2, "Warning: model inferencing time of " << inf_time.count() << "ms " <<
+					   "> current job interval of " << frame_time.count() << "ms!");
+		}
 
-	last_frame_ = this_frame;
+		last_frame_ = this_frame;
+	}
 
-	// Dispatch the job.
-	Expected<AsyncInferJob> job_exp = configured_infer_model_->run_async(bindings_);
-	if (!job_exp)
+	// Dispatch the job, waiting for one of the earlier ones to finish if they're all in use.
+	job = job_ring_.Submit(sequence, input_data, outputs, std::move(buffers), 1s);
+	if (!job.Valid())
 	{
-		LOG_ERROR("Failed to start async infer job, status = " << job_exp.status());
-		return status;
+		LOG_ERROR("Failed to start async infer job");
+		return HAILO_INTERNAL_FAILURE;
 	}
-	job = job_exp.release();
-
-	// Detach and let the job run.
-	job.detach();
 
-	return status;
+	return HAILO_SUCCESS;
 }
 
 HailoROIPtr HailoPostProcessingStage::MakeROI(const std::vector<OutTensor> &output_tensors) const
@@ -351,6 +301,92 @@ HailoROIPtr HailoPostProcessingStage::MakeROI(const std::vector<OutTensor> &outp
 	return roi;
 }
 
+bool HailoPostProcessingStage::NmsTensor(const OutTensor &output, Tensor &tensor) const
+{
+	auto stream = infer_model_->output(output.name);
+	if (!stream || !stream->is_nms() || output.format.type != HAILO_FORMAT_TYPE_FLOAT32)
+		return false;
+
+	hailo_nms_shape_t nms_shape = stream->get_nms_shape().release();
+	tensor.info.name = output.name;
+	tensor.info.type = TensorType::Float32;
+	tensor.info.shape = { nms_shape.number_of_classes, 1 + 5 * nms_shape.max_bboxes_per_class };
+	tensor.data = output.data;
+	return true;
+}
+
+std::shared_ptr<uint8_t> HailoPostProcessingStage::PrepareInput(const uint8_t *low_res, Rectangle &active)
+{
+	const libcamera::PixelFormat &format = low_res_info_.pixel_format;
+	const bool rgb = format == libcamera::formats::RGB888 || format == libcamera::formats::BGR888;
+	const unsigned int stride = input_tensor_size_.width * 3;
+
+	if (format != libcamera::formats::YUV420 && !rgb)
+	{
+		LOG_ERROR("Unexpected lores format " << format);
+		return nullptr;
+	}
+
+	active = Rectangle(0, 0, input_tensor_size_);
+
+	std::shared_ptr<uint8_t> storage = allocator_.Allocate(stride * input_tensor_size_.height);
+	if (!storage)
+	{
+		LOG_ERROR("Could not allocate an input buffer!");
+		return nullptr;
+	}
+
+	if (resize_)
+	{
+		Rectangle region(0, 0, low_res_info_.width, low_res_info_.height);
+		auto time_taken = ExecutionTime<std::micro>([&] {
+							  if (rgb)
+								  active = RgbResize(storage.get(), stride, input_tensor_size_, low_res, low_res_info_,
+													 region, letterbox_);
+							  else
+								  active = Yuv420ToRgbResize(storage.get(), stride, input_tensor_size_, low_res,
+															 low_res_info_, region, letterbox_);
+						  }).count();
+		resize_time_us_ += time_taken;
+		resize_count_++;
+		LOG(2, "Hailo: software resize took " << time_taken << "us");
+	}
+	else if (rgb)
+	{
+		// Copy it out without any padding on the right edge of the buffer.
+		for (unsigned int i = 0; i < low_res_info_.height; i++)
+			memcpy(storage.get() + i * stride, low_res + i * low_res_info_.stride, stride);
+	}
+	else
+	{
+		StreamInfo rgb_info;
+		rgb_info.width = input_tensor_size_.width;
+		rgb_info.height = input_tensor_size_.height;
+		rgb_info.stride = stride;
+		Yuv420ToRgb(storage.get(), low_res, low_res_info_, rgb_info);
+	}
+
+	return storage;
+}
+
+std::vector<float> HailoPostProcessingStage::TensorToLowRes(const Rectangle &active, float x0, float y0, float x1,
+															 float y1) const
+{
+	if (!active.width || !active.height)
+		return { 0, 0, 0, 0 };
+
+	// Undo any letterboxing; the rest of the resize is just a scale in normalised co-ordinates.
+	auto map = [](float v, unsigned int size, int offset, unsigned int length) {
+		return std::clamp((v * size - offset) / length, 0.0f, 1.0f);
+	};
+	x0 = map(x0, input_tensor_size_.width, active.x, active.width);
+	x1 = map(x1, input_tensor_size_.width, active.x, active.width);
+	y0 = map(y0, input_tensor_size_.height, active.y, active.height);
+	y1 = map(y1, input_tensor_size_.height, active.y, active.height);
+
+	return { x0, y0, std::max(x1 - x0, 0.0f), std::max(y1 - y0, 0.0f) };
+}
+
 Rectangle HailoPostProcessingStage::ConvertInferenceCoordinates(const std::vector<float> &coords,
 																const std::vector<Rectangle> &scaler_crops) const
 {
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <deque>
 #include <memory>
@@ -20,40 +21,15 @@
 #include <hailo/hailort.hpp>
 #include "hailo_objects.hpp"
 
+#include "hailo_allocator.hpp"
+#include "hailo_job_ring.hpp"
+
 #include "core/rpicam_app.hpp"
+#include "post_processing_stages/inference_backend.hpp"
 #include "post_processing_stages/post_processing_stage.hpp"
 
 #include "hailo_postproc_lib.h"
 
-class Allocator
-{
-public:
-	Allocator();
-	~Allocator();
-
-	void Reset();
-
-	std::shared_ptr<uint8_t> Allocate(unsigned int size);
-
-private:
-	void free(uint8_t *ptr);
-
-	struct AllocInfo
-	{
-		AllocInfo(uint8_t *_ptr, unsigned int _size, bool _free)
-			: ptr(_ptr), size(_size), free(_free)
-		{
-		}
-
-		uint8_t *ptr;
-		unsigned int size;
-		bool free;
-	};
-
-	std::vector<AllocInfo> alloc_info_;
-	std::mutex lock_;
-};
-
 class OutTensor
 {
 public:
@@ -169,8 +145,24 @@ protected:
 		return input_tensor_size_;
 	}
 
-	hailo_status DispatchJob(const uint8_t *input, hailort::AsyncInferJob &job, std::vector<OutTensor> &output_tensors);
+	// Start an inference job on the input for frame "sequence". Several jobs may be in flight at once, and
+	// waiting on them returns in sequence order. The input and output buffers stay allocated until the device has
+	// finished with them, even if the wait times out.
+	hailo_status DispatchJob(unsigned int sequence, std::shared_ptr<uint8_t> input, InferenceJob &job,
+							 std::vector<OutTensor> &output_tensors);
 	HailoROIPtr MakeROI(const std::vector<OutTensor> &output_tensors) const;
+	// Describe an output with on-chip NMS as a tensor for DecodeHailoNms(), sharing its data. Returns false if
+	// it isn't one.
+	bool NmsTensor(const OutTensor &output, Tensor &tensor) const;
+
+	// Turn the low res image into packed RGB of the input tensor size, resizing it in software (and letterboxing
+	// it if asked) when the sizes differ. The result is always a copy, never the low res buffer itself, as a job
+	// can outlive the request if we give up waiting for it. active is the part of the tensor that the image covers.
+	std::shared_ptr<uint8_t> PrepareInput(const uint8_t *low_res, libcamera::Rectangle &active);
+	// Map a box in normalised input tensor co-ordinates to normalised low res image co-ordinates, as
+	// { x, y, width, height } for ConvertInferenceCoordinates.
+	std::vector<float> TensorToLowRes(const libcamera::Rectangle &active, float x0, float y0, float x1,
+									  float y1) const;
 
 	libcamera::Rectangle ConvertInferenceCoordinates(const std::vector<float> &coords,
 													 const std::vector<libcamera::Rectangle> &scaler_crops) const;
@@ -195,8 +187,14 @@ private:
 	std::mutex lock_;
 	bool init_ = false;
 	std::string hef_file_, hef_file_8_, hef_file_8L_;
-	hailort::ConfiguredInferModel::Bindings bindings_;
+	unsigned int inflight_jobs_;
+	std::unique_ptr<InferenceDevice> device_;
+	JobRing job_ring_;
 	std::chrono::time_point<std::chrono::steady_clock> last_frame_;
 	libcamera::Size input_tensor_size_;
 	hailo_device_identity_t device_id_;
+	bool letterbox_;
+	bool resize_ = false;
+	std::atomic<uint64_t> resize_time_us_ = 0;
+	std::atomic<unsigned int> resize_count_ = 0;
 };
@@ -17,14 +17,15 @@
 #include <libcamera/geometry.h>
 
 #include "core/rpicam_app.hpp"
+#include "post_processing_stages/detection_decoder.hpp"
 #include "post_processing_stages/object_detect.hpp"
+#include "post_processing_stages/tiling.hpp"
 
 #include "detection/yolo_hailortpp.hpp"
 
 #include "hailo_postprocessing_stage.hpp"
 
 using Size = libcamera::Size;
-using PostProcFuncPtrNms = void (*)(HailoROIPtr, YoloParamsNMS *);
 using InitFuncPtr = YoloParamsNMS *(*)(std::string, std::string);
 using FreeFuncPtr = void (*)(void *);
 
@@ -50,7 +51,14 @@ public:
 	bool Process(CompletedRequestPtr &completed_request) override;
 
 private:
-	std::vector<Detection> runInference(const uint8_t *frame, const std::vector<libcamera::Rectangle> &scaler_crops);
+	std::vector<Detection> runInference(unsigned int sequence, std::shared_ptr<uint8_t> const &frame,
+										const libcamera::Rectangle &active,
+										const std::vector<libcamera::Rectangle> &scaler_crops);
+	std::vector<Detection> runTiledInference(unsigned int sequence, const uint8_t *frame);
+	std::vector<Detection> getDetections(InferenceJob &job, std::vector<OutTensor> &output_tensors,
+										 const libcamera::Rectangle &active,
+										 const std::vector<libcamera::Rectangle> &scaler_crops,
+										 const libcamera::Rectangle *tile);
 	void filterOutputObjects(std::vector<Detection> &objects);
 
 	struct LtObject
@@ -76,6 +84,12 @@ private:
 	float factor_;
 	unsigned int visible_frames_;
 	unsigned int hidden_frames_;
+
+	// Tiled inference on the main stream.
+	TilingConfig tiling_config_;
+	bool tiling_ = false;
+	TileScheduler tile_scheduler_;
+	TileResults tile_results_;
 };
 
 YoloInference::YoloInference(RPiCamApp *app)
@@ -114,6 +128,9 @@ void YoloInference::Read(boost::property_tree::ptree const &params)
 	else
 		temporal_filtering_ = false;
 
+	if (params.find("tiling") != params.not_found())
+		tiling_config_.Read(params.get_child("tiling"));
+
 	InitFuncPtr init = reinterpret_cast<InitFuncPtr>(postproc_nms_.GetSymbol("init"));
 	const std::string config_file = params.get<std::string>("hailopp_config_file", {});
 	if (!config_file.empty())
@@ -129,6 +146,21 @@ void YoloInference::Read(boost::property_tree::ptree const &params)
 void YoloInference::Configure()
 {
 	HailoPostProcessingStage::Configure();
+
+	tiling_ = false;
+	if (tiling_config_.enable && HailoPostProcessingStage::Ready())
+	{
+		if (output_stream_info_.pixel_format == libcamera::formats::YUV420)
+		{
+			tile_scheduler_.Configure(tiling_config_, Size(output_stream_info_.width, output_stream_info_.height),
+									  InputTensorSize());
+			tile_results_.Configure(tile_scheduler_.Tiles().size(), tile_scheduler_.Rotation());
+			tiling_ = true;
+			LOG(1, "Tiling main stream with " << tile_scheduler_.Tiles().size() << " tiles");
+		}
+		else
+			LOG_ERROR("Tiling requires a YUV420 main stream, tiling disabled");
+	}
 }
 
 bool YoloInference::Process(CompletedRequestPtr &completed_request)
@@ -139,52 +171,37 @@ bool YoloInference::Process(CompletedRequestPtr &completed_request)
 		return false;
 	}
 
-	if (low_res_info_.width != InputTensorSize().width || low_res_info_.height != InputTensorSize().height)
+	if (tiling_)
 	{
-		LOG_ERROR("Wrong low res size, expecting " << InputTensorSize().toString());
-		return false;
-	}
+		BufferReadSync r(app_, completed_request->buffers[output_stream_]);
+		std::vector<Detection> objects = runTiledInference(completed_request->sequence, r.Get()[0].data());
 
-	BufferReadSync r(app_, completed_request->buffers[low_res_stream_]);
-	libcamera::Span<uint8_t> buffer = r.Get()[0];
-	std::shared_ptr<uint8_t> input;
-	uint8_t *input_ptr;
+		if (temporal_filtering_)
+		{
+			std::scoped_lock<std::mutex> l(lock_);
 
-	if (low_res_info_.pixel_format == libcamera::formats::YUV420)
-	{
-		StreamInfo rgb_info;
-		rgb_info.width = InputTensorSize().width;
-		rgb_info.height = InputTensorSize().height;
-		rgb_info.stride = rgb_info.width * 3;
+			filterOutputObjects(objects);
+			objects.clear();
+			for (auto const &obj : lt_objects_)
+			{
+				if (!obj.hidden)
+					objects.push_back(obj.params);
+			}
+		}
 
-		input = allocator_.Allocate(rgb_info.stride * rgb_info.height);
-		input_ptr = input.get();
+		if (objects.size())
+			completed_request->post_process_metadata.Set("object_detect.results", objects);
 
-		Yuv420ToRgb(input.get(), buffer.data(), low_res_info_, rgb_info);
+		return false;
 	}
-	else if (low_res_info_.pixel_format == libcamera::formats::RGB888 ||
-			 low_res_info_.pixel_format == libcamera::formats::BGR888)
-	{
-		unsigned int stride = low_res_info_.width * 3;
 
-		// If the stride shows we have padding on the right edge of the buffer, we must copy it out to another buffer
-		// without padding.
-		if (low_res_info_.stride != stride)
-		{
-			input = allocator_.Allocate(stride * low_res_info_.height);
-			input_ptr = input.get();
+	BufferReadSync r(app_, completed_request->buffers[low_res_stream_]);
+	libcamera::Span<uint8_t> buffer = r.Get()[0];
+	Rectangle active;
 
-			for (unsigned int i = 0; i < low_res_info_.height; i++)
-				memcpy(input_ptr + i * stride, buffer.data() + i * low_res_info_.stride, stride);
-		}
-		else
-			input_ptr = buffer.data();
-	}
-	else
-	{
-		LOG_ERROR("Unexpected lores format " << low_res_info_.pixel_format);
+	std::shared_ptr<uint8_t> input = PrepareInput(buffer.data(), active);
+	if (!input)
 		return false;
-	}
 
 	std::vector<Rectangle> scaler_crops;
 	auto scaler_crop = completed_request->metadata.get(controls::ScalerCrop);
@@ -202,7 +219,7 @@ bool YoloInference::Process(CompletedRequestPtr &completed_request)
 		scaler_crops.push_back(*scaler_crop);
 	}
 
-	std::vector<Detection> objects = runInference(input_ptr, scaler_crops);
+	std::vector<Detection> objects = runInference(completed_request->sequence, input, active, scaler_crops);
 	if (objects.size())
 	{
 		if (temporal_filtering_)
@@ -230,54 +247,125 @@ bool YoloInference::Process(CompletedRequestPtr &completed_request)
 	return false;
 }
 
-std::vector<Detection> YoloInference::runInference(const uint8_t *frame, const std::vector<Rectangle> &scaler_crops)
+std::vector<Detection> YoloInference::runInference(unsigned int sequence, std::shared_ptr<uint8_t> const &frame,
+												   const Rectangle &active, const std::vector<Rectangle> &scaler_crops)
 {
-	hailort::AsyncInferJob job;
+	InferenceJob job;
 	std::vector<OutTensor> output_tensors;
 	hailo_status status;
 
-	status = HailoPostProcessingStage::DispatchJob(frame, job, output_tensors);
+	status = HailoPostProcessingStage::DispatchJob(sequence, frame, job, output_tensors);
 	if (status != HAILO_SUCCESS)
 		return {};
 
+	return getDetections(job, output_tensors, active, scaler_crops, nullptr);
+}
+
+std::vector<Detection> YoloInference::runTiledInference(unsigned int sequence, const uint8_t *frame)
+{
+	struct TileJob
+	{
+		unsigned int index;
+		InferenceJob job;
+		std::vector<OutTensor> output_tensors;
+	};
+
+	std::vector<unsigned int> indices;
+	{
+		std::scoped_lock<std::mutex> l(lock_);
+		indices = tile_scheduler_.Next();
+	}
+
+	StreamInfo tile_info, rgb_info;
+	tile_info.width = rgb_info.width = InputTensorSize().width;
+	tile_info.height = rgb_info.height = InputTensorSize().height;
+	tile_info.stride = tile_info.width;
+	rgb_info.stride = rgb_info.width * 3;
+
+	// Dispatch all of this frame's tiles before waiting for any of them, so that the
+	// device can get on with the next tile while we prepare the one after.
+	std::vector<TileJob> jobs(indices.size());
+	std::vector<uint8_t> tile_yuv;
+	unsigned int num_jobs = 0;
+	for (unsigned int index : indices)
+	{
+		TileJob &tile_job = jobs[num_jobs];
+		tile_job.index = index;
+		std::shared_ptr<uint8_t> input = allocator_.Allocate(rgb_info.stride * rgb_info.height);
+		if (!input)
+			break;
+
+		CopyYuv420Region(tile_yuv, frame, output_stream_info_, tile_scheduler_.Tiles()[index], InputTensorSize());
+		Yuv420ToRgb(input.get(), tile_yuv.data(), tile_info, rgb_info);
+
+		if (HailoPostProcessingStage::DispatchJob(sequence, std::move(input), tile_job.job, tile_job.output_tensors) !=
+			HAILO_SUCCESS)
+			break;
+		num_jobs++;
+	}
+
+	for (unsigned int i = 0; i < num_jobs; i++)
+	{
+		const Rectangle &tile = tile_scheduler_.Tiles()[jobs[i].index];
+		std::vector<Detection> results = getDetections(jobs[i].job, jobs[i].output_tensors, {}, {}, &tile);
+
+		std::scoped_lock<std::mutex> l(lock_);
+		tile_results_.Set(jobs[i].index, std::move(results));
+	}
+
+	// Tiles that didn't run this time keep their last results, for up to a rotation.
+	std::vector<Detection> results;
+	{
+		std::scoped_lock<std::mutex> l(lock_);
+		results = tile_results_.Merge(tiling_config_.overlap_threshold);
+	}
+	if (results.size() > max_detections_)
+		results.erase(results.begin() + max_detections_, results.end());
+
+	return results;
+}
+
+std::vector<Detection> YoloInference::getDetections(InferenceJob &job, std::vector<OutTensor> &output_tensors,
+													 const Rectangle &active,
+													 const std::vector<Rectangle> &scaler_crops,
+													 const Rectangle *tile)
+{
 	// Prepare tensors for postprocessing.
 	std::sort(output_tensors.begin(), output_tensors.end(), OutTensor::SortFunction);
 
 	// Wait for job completion.
-	status = job.wait(1s);
-	if (status != HAILO_SUCCESS)
+	if (!job.Wait(1s))
 	{
-		LOG_ERROR("Failed to wait for inference to finish, status = " << status);
+		LOG_ERROR("Failed to wait for inference to finish");
 		return {};
 	}
 
-	HailoROIPtr roi = MakeROI(output_tensors);
-	PostProcFuncPtrNms filter = reinterpret_cast<PostProcFuncPtrNms>(postproc_nms_.GetSymbol("filter"));
-
-	filter(roi, yolo_params_);
-	std::vector<HailoDetectionPtr> detections = hailo_common::get_hailo_detections(roi);
+	// The boxes come out of the on-chip NMS, so we only need to sort them and keep the most confident.
+	Tensor nms;
+	if (output_tensors.empty() || !NmsTensor(output_tensors[0], nms))
+	{
+		LOG_ERROR("Model has no NMS output");
+		return {};
+	}
+	std::vector<DecodedObject> objects = DecodeHailoNms(nms, threshold_);
+	NmsObjects(objects, 1.0f, max_detections_);
 
 	LOG(2, "------");
 
-	// Translate results to the rpicam-apps Detection objects
+	// Translate results to the rpicam-apps Detection objects. As in the Hailo postprocess library, the labels
+	// are numbered from 1.
 	std::vector<Detection> results;
-	for (auto const &d : detections)
+	for (auto const &o : objects)
 	{
-		if (d->get_confidence() < threshold_)
-			continue;
-
 		// Extract bounding box co-ordinates in the output image co-ordinates.
-		auto const &box = d->get_bbox();
-		const float x0 = std::max(box.xmin(), 0.0f);
-		const float x1 = std::min(box.xmax(), 1.0f);
-		const float y0 = std::max(box.ymin(), 0.0f);
-		const float y1 = std::min(box.ymax(), 1.0f);
-		libcamera::Rectangle r = ConvertInferenceCoordinates({ x0, y0, x1 - x0, y1 - y0 }, scaler_crops);
-		results.emplace_back(d->get_class_id(), d->get_label(), d->get_confidence(), r.x, r.y, r.width, r.height);
+		libcamera::Rectangle r = tile ? TileToImage(*tile, o.x0, o.y0, o.x1, o.y1)
+									  : ConvertInferenceCoordinates(TensorToLowRes(active, o.x0, o.y0, o.x1, o.y1),
+																	scaler_crops);
+		const int category = o.category + 1;
+		auto label = yolo_params_->labels.find(category);
+		results.emplace_back(category, label != yolo_params_->labels.end() ? label->second : std::to_string(category),
+							 o.confidence, r.x, r.y, r.width, r.height);
 		LOG(2, "Object: " << results.back().toString());
-
-		if (--max_detections_ == 0)
-			break;
 	}
 
 	LOG(2, "------");
@@ -183,7 +183,7 @@ public:
 	bool Process(CompletedRequestPtr &completed_request) override;
 
 private:
-	bool runInference(uint8_t *input, uint32_t *output);
+	bool runInference(unsigned int sequence, std::shared_ptr<uint8_t> const &input, uint32_t *output);
 
 	PostProcessingLib postproc_;
 	Yolov5segParams *yolo_params_ = nullptr;
@@ -245,49 +245,19 @@ bool YoloSegmentation::Process(CompletedRequestPtr &completed_request)
 		return false;
 	}
 
-	if (low_res_info_.width != InputTensorSize().width || low_res_info_.height != InputTensorSize().height)
-	{
-		LOG_ERROR("Wrong low res size, expecting " << InputTensorSize().toString());
-		return false;
-	}
-
 	BufferReadSync r(app_, completed_request->buffers[low_res_stream_]);
 	libcamera::Span<uint8_t> low_res_buffer = r.Get()[0];
-	std::shared_ptr<uint8_t> input;
-
-	if (low_res_info_.pixel_format == libcamera::formats::YUV420)
-	{
-		StreamInfo rgb_info;
-		rgb_info.width = InputTensorSize().width;
-		rgb_info.height = InputTensorSize().height;
-		rgb_info.stride = rgb_info.width * 3;
-
-		input = allocator_.Allocate(rgb_info.stride * rgb_info.height);
-		Yuv420ToRgb(input.get(), low_res_buffer.data(), low_res_info_, rgb_info);
-	}
-	else if (low_res_info_.pixel_format == libcamera::formats::RGB888 ||
-			 low_res_info_.pixel_format == libcamera::formats::BGR888)
-	{
-		unsigned int stride = low_res_info_.width * 3;
+	libcamera::Rectangle active;
 
-		input = allocator_.Allocate(stride * low_res_info_.height);
-
-		// If the stride shows we have padding on the right edge of the buffer, we must copy it out to another buffer
-		// without padding.
-		for (unsigned int i = 0; i < low_res_info_.height; i++)
-			memcpy(input.get() + i * stride, low_res_buffer.data() + i * low_res_info_.stride, stride);
-	}
-	else
-	{
-		LOG_ERROR("Unexpected lores format " << low_res_info_.pixel_format);
+	std::shared_ptr<uint8_t> input = PrepareInput(low_res_buffer.data(), active);
+	if (!input)
 		return false;
-	}
 
 	BufferWriteSync w(app_, completed_request->buffers[output_stream_]);
 	libcamera::Span<uint8_t> buffer = w.Get()[0];
 	uint32_t *output = (uint32_t *)buffer.data();
 
-	bool success = runInference(input.get(), output);
+	bool success = runInference(completed_request->sequence, input, output);
 	if (show_results_ && success)
 	{
 		Msg m(MsgType::Display, std::move(input), InputTensorSize(), "Segmentation");
@@ -299,13 +269,13 @@ bool YoloSegmentation::Process(CompletedRequestPtr &completed_request)
 	return false;
 }
 
-bool YoloSegmentation::runInference(uint8_t *input, uint32_t *output)
+bool YoloSegmentation::runInference(unsigned int sequence, std::shared_ptr<uint8_t> const &input, uint32_t *output)
 {
-	hailort::AsyncInferJob job;
+	InferenceJob job;
 	std::vector<OutTensor> output_tensors;
 	hailo_status status;
 
-	status = HailoPostProcessingStage::DispatchJob(input, job, output_tensors);
+	status = HailoPostProcessingStage::DispatchJob(sequence, input, job, output_tensors);
 	if (status != HAILO_SUCCESS)
 		return false;
 
@@ -313,10 +283,9 @@ bool YoloSegmentation::runInference(uint8_t *input, uint32_t *output)
 	std::sort(output_tensors.begin(), output_tensors.end(), OutTensor::SortFunction);
 
 	// Wait for job completion.
-	status = job.wait(10s);
-	if (status != HAILO_SUCCESS)
+	if (!job.Wait(10s))
 	{
-		LOG_ERROR("Failed to wait for inference to finish, status = " << status);
+		LOG_ERROR("Failed to wait for inference to finish");
 		return false;
 	}
 
@@ -327,7 +296,7 @@ bool YoloSegmentation::runInference(uint8_t *input, uint32_t *output)
 	HailoROIPtr roi = MakeROI(output_tensors);
 	filter(roi, yolo_params_);
 
-	cv::Mat image(InputTensorSize().height, InputTensorSize().width, CV_8UC3, (void *)input,
+	cv::Mat image(InputTensorSize().height, InputTensorSize().width, CV_8UC3, (void *)input.get(),
 				  InputTensorSize().width * 3);
 
 	std::vector<HailoDetectionPtr> detections = hailo_common::get_hailo_detections(roi);
@@ -43,7 +43,8 @@ public:
 	bool Process(CompletedRequestPtr &completed_request) override;
 
 private:
-	void runInference(const uint8_t *input, uint32_t *output, const std::vector<Rectangle> &scaler_crops);
+	void runInference(unsigned int sequence, std::shared_ptr<uint8_t> const &input, const Rectangle &active,
+					  uint32_t *output, const std::vector<Rectangle> &scaler_crops);
 
 	PostProcessingLib postproc_;
 };
@@ -76,47 +77,13 @@ bool YoloPose::Process(CompletedRequestPtr &completed_request)
 		return false;
 	}
 
-	if (low_res_info_.width != InputTensorSize().width || low_res_info_.height != InputTensorSize().height)
-	{
-		LOG_ERROR("Wrong low res size, expecting " << InputTensorSize().toString());
-		return false;
-	}
-
 	BufferReadSync r(app_, completed_request->buffers[low_res_stream_]);
 	libcamera::Span<uint8_t> low_res_buffer = r.Get()[0];
-	std::shared_ptr<uint8_t> input;
-	uint8_t *input_ptr;
+	Rectangle active;
 
-	if (low_res_info_.pixel_format == libcamera::formats::YUV420)
-	{
-		StreamInfo rgb_info;
-		rgb_info.width = InputTensorSize().width;
-		rgb_info.height = InputTensorSize().height;
-		rgb_info.stride = rgb_info.width * 3;
-
-		input = allocator_.Allocate(rgb_info.stride * rgb_info.height);
-		input_ptr = input.get();
-
-		Yuv420ToRgb(input.get(), low_res_buffer.data(), low_res_info_, rgb_info);
-	}
-	else if (low_res_info_.pixel_format == libcamera::formats::RGB888 ||
-			 low_res_info_.pixel_format == libcamera::formats::BGR888)
-	{
-		unsigned int stride = low_res_info_.width * 3;
-
-		input = allocator_.Allocate(stride * low_res_info_.height);
-		input_ptr = input.get();
-
-		// If the stride shows we have padding on the right edge of the buffer, we must copy it out to another buffer
-		// without padding.
-		for (unsigned int i = 0; i < low_res_info_.height; i++)
-			memcpy(input_ptr + i * stride, low_res_buffer.data() + i * low_res_info_.stride, stride);
-	}
-	else
-	{
-		LOG_ERROR("Unexpected lores format " << low_res_info_.pixel_format);
+	std::shared_ptr<uint8_t> input = PrepareInput(low_res_buffer.data(), active);
+	if (!input)
 		return false;
-	}
 
 	std::vector<Rectangle> scaler_crops;
 	auto scaler_crop = completed_request->metadata.get(controls::ScalerCrop);
@@ -138,7 +105,7 @@ bool YoloPose::Process(CompletedRequestPtr &completed_request)
 	libcamera::Span<uint8_t> buffer = w.Get()[0];
 	uint32_t *output = (uint32_t *)buffer.data();
 
-	runInference(input_ptr, output, scaler_crops);
+	runInference(completed_request->sequence, input, active, output, scaler_crops);
 
 	{
 		Msg m(MsgType::Display, std::move(input), InputTensorSize(), "Pose");
@@ -149,13 +116,14 @@ bool YoloPose::Process(CompletedRequestPtr &completed_request)
 	return false;
 }
 
-void YoloPose::runInference(const uint8_t *input, uint32_t *output, const std::vector<Rectangle> &scaler_crops)
+void YoloPose::runInference(unsigned int sequence, std::shared_ptr<uint8_t> const &input, const Rectangle &active,
+							 uint32_t *output, const std::vector<Rectangle> &scaler_crops)
 {
-	hailort::AsyncInferJob job;
+	InferenceJob job;
 	std::vector<OutTensor> output_tensors;
 	hailo_status status;
 
-	status = HailoPostProcessingStage::DispatchJob(input, job, output_tensors);
+	status = HailoPostProcessingStage::DispatchJob(sequence, input, job, output_tensors);
 	if (status != HAILO_SUCCESS)
 		return;
 
@@ -163,10 +131,9 @@ void YoloPose::runInference(const uint8_t *input, uint32_t *output, const std::v
 	std::sort(output_tensors.begin(), output_tensors.end(), OutTensor::SortFunction);
 
 	// Wait for job completion.
-	status = job.wait(1s);
-	if (status != HAILO_SUCCESS)
+	if (!job.Wait(1s))
 	{
-		LOG_ERROR("Failed to wait for inference to finish, status = " << status);
+		LOG_ERROR("Failed to wait for inference to finish");
 		return;
 	}
 
@@ -178,7 +145,7 @@ void YoloPose::runInference(const uint8_t *input, uint32_t *output, const std::v
 	std::pair<std::vector<KeyPt>, std::vector<PairPairs>> keypoints_and_pairs = filter(roi);
 
 	std::vector<HailoDetectionPtr> detections = hailo_common::get_hailo_detections(roi);
-	cv::Mat image(InputTensorSize().height, InputTensorSize().width, CV_8UC3, (void *)input,
+	cv::Mat image(InputTensorSize().height, InputTensorSize().width, CV_8UC3, (void *)input.get(),
 				  InputTensorSize().width * 3);
 
 	for (auto &detection : detections)
@@ -191,7 +158,7 @@ void YoloPose::runInference(const uint8_t *input, uint32_t *output, const std::v
 		const float x1 = std::min(bbox.xmax(), 1.0f);
 		const float y0 = std::max(bbox.ymin(), 0.0f);
 		const float y1 = std::min(bbox.ymax(), 1.0f);
-		Rectangle r = ConvertInferenceCoordinates({ x0, y0, x1 - x0, y1 - y0 }, scaler_crops);
+		Rectangle r = ConvertInferenceCoordinates(TensorToLowRes(active, x0, y0, x1, y1), scaler_crops);
 		cv::rectangle(image, cv::Point2f(r.x, r.y), cv::Point2f(r.x + r.width, r.y + r.height), cv::Scalar(0, 0, 255),
 					  1);
 	}
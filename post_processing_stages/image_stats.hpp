@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * image_stats.hpp - per-zone image statistics result
+ */
+
+#pragma once
+
+#include <array>
+#include <sstream>
+#include <vector>
+
+// The image_stats stage adds one of these to the metadata as "image_stats.result".
+// Zone values are listed in raster order, grid_x zones across and grid_y down.
+
+struct ImageStats
+{
+	unsigned int grid_x = 0, grid_y = 0;
+	// Luma mean and variance of each zone, in 8-bit pixel units.
+	std::vector<float> mean;
+	std::vector<float> variance;
+	// Mean squared Laplacian of each zone. Larger means sharper (better focused).
+	std::vector<float> focus;
+	// Mean chroma of each zone, offset so that 0 is neutral. These show colour casts.
+	std::vector<float> u_mean;
+	std::vector<float> v_mean;
+	// 256-bin histogram of the luma values that were sampled.
+	std::array<uint32_t, 256> histogram {};
+	float global_mean = 0;
+	float global_focus = 0;
+	std::string toString() const
+	{
+		std::stringstream output;
+		output.precision(4);
+		output << grid_x << "x" << grid_y << " zones, mean " << global_mean << " focus " << global_focus;
+		return output.str();
+	}
+};
@@ -0,0 +1,266 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * image_stats_stage.cpp - per-zone image statistics
+ */
+
+// Gather statistics from a YUV420 image (lores by default) that other stages or the
+// application can use for monitoring, or for their own exposure or focus logic. In
+// a single pass over the luma rows we accumulate, for each zone of a grid, the sum
+// and sum of squares (for the mean and variance) and the squared Laplacian (for a
+// focus metric), as well as a global histogram. Chroma means per zone are gathered
+// from the U and V planes afterwards.
+
+// The sums are done over contiguous runs of pixels with no branching, so that the
+// compiler vectorises them. The histogram can't be vectorised, but we spread it over
+// several sub-histograms to avoid stalls when neighbouring pixels land in the same
+// bin. Use "row_skip" to sample only every so many rows, if it's still too slow. With
+// "verbose" set, the measured cost in microseconds per megapixel is reported.
+
+// Measured cost, on a 4x3 grid with row_skip 1 and an image of random noise: about
+// 1.9ms per megapixel (600us for 640x480 lores, 3.9ms for 1920x1080) on one core of
+// an x86-64 Intel Xeon server, in a release build. It hasn't been measured on a Pi.
+
+#include <algorithm>
+
+#include <libcamera/stream.h>
+
+#include "core/rpicam_app.hpp"
+
+#include "post_processing_stages/image_stats.hpp"
+#include "post_processing_stages/post_processing_stage.hpp"
+
+using Stream = libcamera::Stream;
+
+class ImageStatsStage : public PostProcessingStage
+{
+public:
+	ImageStatsStage(RPiCamApp *app) : PostProcessingStage(app) {}
+
+	char const *Name() const override;
+
+	void Read(boost::property_tree::ptree const &params) override;
+
+	void Configure() override;
+
+	bool Process(CompletedRequestPtr &completed_request) override;
+
+private:
+	void calculate(const uint8_t *image, ImageStats &stats) const;
+
+	struct Config
+	{
+		std::string stream;
+		unsigned int grid_x, grid_y;
+		unsigned int row_skip;
+		unsigned int frame_period;
+		bool verbose;
+	} config_;
+
+	Stream *stream_;
+	StreamInfo info_;
+	// Start of each zone column, with an extra entry for the right hand edge.
+	std::vector<unsigned int> cols_;
+	std::vector<unsigned int> rows_;
+	std::mutex mutex_;
+	double total_us_;
+	unsigned int count_;
+};
+
+#define NAME "image_stats"
+
+char const *ImageStatsStage::Name() const
+{
+	return NAME;
+}
+
+void ImageStatsStage::Read(boost::property_tree::ptree const &params)
+{
+	config_.stream = params.get<std::string>("stream", "lores");
+	config_.grid_x = std::clamp(params.get<unsigned int>("grid_x", 4), 1u, 64u);
+	config_.grid_y = std::clamp(params.get<unsigned int>("grid_y", 3), 1u, 64u);
+	config_.row_skip = std::max(params.get<unsigned int>("row_skip", 1), 1u);
+	config_.frame_period = params.get<unsigned int>("frame_period", 1);
+	config_.verbose = params.get<int>("verbose", 0);
+}
+
+void ImageStatsStage::Configure()
+{
+	if (config_.stream == "lores")
+		stream_ = app_->LoresStream();
+	else if (config_.stream == "main")
+		stream_ = app_->GetMainStream();
+	else
+		throw std::runtime_error("ImageStatsStage: unknown stream " + config_.stream);
+	if (!stream_)
+		return;
+	info_ = app_->GetStreamInfo(stream_);
+	if (info_.pixel_format != libcamera::formats::YUV420)
+		throw std::runtime_error("ImageStatsStage: only YUV420 supported");
+	if (info_.width < 2 * config_.grid_x || info_.height < 2 * config_.grid_y)
+		throw std::runtime_error("ImageStatsStage: too many zones for the image size");
+
+	// Zone boundaries are even, so that the chroma zones line up exactly.
+	cols_.clear();
+	rows_.clear();
+	for (unsigned int i = 0; i <= config_.grid_x; i++)
+		cols_.push_back((i * info_.width / config_.grid_x) & ~1);
+	for (unsigned int i = 0; i <= config_.grid_y; i++)
+		rows_.push_back((i * info_.height / config_.grid_y) & ~1);
+	cols_.back() = info_.width & ~1;
+	rows_.back() = info_.height & ~1;
+
+	total_us_ = 0;
+	count_ = 0;
+}
+
+void ImageStatsStage::calculate(const uint8_t *image, ImageStats &stats) const
+{
+	const unsigned int width = info_.width, stride = info_.stride, num_zones = config_.grid_x * config_.grid_y;
+	std::vector<uint64_t> sum(num_zones), sum_sq(num_zones), lap_sq(num_zones);
+	std::vector<uint32_t> count(num_zones), lap_count(num_zones);
+	uint32_t histograms[4][256] = {};
+
+	for (unsigned int zy = 0; zy < config_.grid_y; zy++)
+	{
+		for (unsigned int y = rows_[zy]; y < rows_[zy + 1]; y += config_.row_skip)
+		{
+			const uint8_t *row = image + y * stride;
+			// The Laplacian needs the rows above and below, so the outermost rows and columns
+			// of the image are skipped for that.
+			bool interior = y > 0 && y + 1 < info_.height;
+			const uint8_t *above = row - stride, *below = row + stride;
+
+			for (unsigned int zx = 0; zx < config_.grid_x; zx++)
+			{
+				unsigned int zone = zy * config_.grid_x + zx;
+				unsigned int x0 = cols_[zx], x1 = cols_[zx + 1];
+				uint32_t s = 0;
+				uint64_t ss = 0;
+				for (unsigned int x = x0; x < x1; x++)
+				{
+					s += row[x];
+					ss += row[x] * row[x];
+				}
+				sum[zone] += s;
+				sum_sq[zone] += ss;
+				count[zone] += x1 - x0;
+
+				if (interior)
+				{
+					unsigned int lx0 = std::max(x0, 1u), lx1 = std::min(x1, width - 1);
+					uint64_t l_sq = 0;
+					for (unsigned int x = lx0; x < lx1; x++)
+					{
+						int l = 4 * row[x] - row[x - 1] - row[x + 1] - above[x] - below[x];
+						l_sq += l * l;
+					}
+					lap_sq[zone] += l_sq;
+					lap_count[zone] += lx1 - lx0;
+				}
+
+				unsigned int x = x0;
+				for (; x + 4 <= x1; x += 4)
+				{
+					histograms[0][row[x]]++;
+					histograms[1][row[x + 1]]++;
+					histograms[2][row[x + 2]]++;
+					histograms[3][row[x + 3]]++;
+				}
+				for (; x < x1; x++)
+					histograms[0][row[x]]++;
+			}
+		}
+	}
+
+	// Now the chroma means, for which the same rows are sampled.
+	const uint8_t *U = image + info_.height * stride;
+	const uint8_t *V = U + (info_.height / 2) * (stride / 2);
+	std::vector<uint64_t> sum_u(num_zones), sum_v(num_zones);
+	std::vector<uint32_t> count_uv(num_zones);
+	for (unsigned int zy = 0; zy < config_.grid_y; zy++)
+	{
+		for (unsigned int y = rows_[zy] / 2; y < rows_[zy + 1] / 2; y += config_.row_skip)
+		{
+			const uint8_t *row_u = U + y * (stride / 2), *row_v = V + y * (stride / 2);
+			for (unsigned int zx = 0; zx < config_.grid_x; zx++)
+			{
+				unsigned int zone = zy * config_.grid_x + zx;
+				uint32_t su = 0, sv = 0;
+				for (unsigned int x = cols_[zx] / 2; x < cols_[zx + 1] / 2; x++)
+				{
+					su += row_u[x];
+					sv += row_v[x];
+				}
+				sum_u[zone] += su;
+				sum_v[zone] += sv;
+				count_uv[zone] += (cols_[zx + 1] - cols_[zx]) / 2;
+			}
+		}
+	}
+
+	stats.grid_x = config_.grid_x;
+	stats.grid_y = config_.grid_y;
+	stats.mean.resize(num_zones);
+	stats.variance.resize(num_zones);
+	stats.focus.resize(num_zones);
+	stats.u_mean.resize(num_zones);
+	stats.v_mean.resize(num_zones);
+
+	uint64_t total_sum = 0, total_count = 0, total_lap = 0, total_lap_count = 0;
+	for (unsigned int i = 0; i < num_zones; i++)
+	{
+		double n = std::max(count[i], 1u);
+		stats.mean[i] = sum[i] / n;
+		stats.variance[i] = sum_sq[i] / n - stats.mean[i] * stats.mean[i];
+		stats.focus[i] = lap_sq[i] / (double)std::max(lap_count[i], 1u);
+		stats.u_mean[i] = sum_u[i] / (double)std::max(count_uv[i], 1u) - 128;
+		stats.v_mean[i] = sum_v[i] / (double)std::max(count_uv[i], 1u) - 128;
+		total_sum += sum[i];
+		total_count += count[i];
+		total_lap += lap_sq[i];
+		total_lap_count += lap_count[i];
+	}
+	stats.global_mean = total_sum / (double)std::max<uint64_t>(total_count, 1);
+	stats.global_focus = total_lap / (double)std::max<uint64_t>(total_lap_count, 1);
+
+	for (unsigned int i = 0; i < 256; i++)
+		stats.histogram[i] = histograms[0][i] + histograms[1][i] + histograms[2][i] + histograms[3][i];
+}
+
+bool ImageStatsStage::Process(CompletedRequestPtr &completed_request)
+{
+	if (!stream_)
+		return false;
+
+	if (config_.frame_period && completed_request->sequence % config_.frame_period)
+		return false;
+
+	BufferReadSync r(app_, completed_request->buffers[stream_]);
+	const uint8_t *image = r.Get()[0].data();
+
+	ImageStats stats;
+	auto time_taken = ExecutionTime<std::micro>(&ImageStatsStage::calculate, this, image, stats).count();
+
+	if (config_.verbose)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		total_us_ += time_taken;
+		count_++;
+		double megapixels = info_.width * info_.height / 1e6 / config_.row_skip;
+		LOG(1, "ImageStats: " << stats.toString() << " took " << time_taken << "us ("
+							  << total_us_ / count_ / megapixels << "us per megapixel on average)");
+	}
+
+	completed_request->post_process_metadata.Set("image_stats.result", stats);
+
+	return false;
+}
+
+static PostProcessingStage *Create(RPiCamApp *app)
+{
+	return new ImageStatsStage(app);
+}
+
+static RegisterStage reg(NAME, &Create);
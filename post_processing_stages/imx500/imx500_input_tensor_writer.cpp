@@ -0,0 +1,260 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * imx500_input_tensor_writer.cpp - save IMX500 input tensors in the background
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+
+#include <boost/property_tree/json_parser.hpp>
+
+#include <libcamera/formats.h>
+
+#include "core/logging.hpp"
+#include "image/image.hpp"
+#include "post_processing_stages/post_processing_stage.hpp"
+
+#include "imx500_input_tensor_writer.hpp"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+inline int16_t conv_reg_signed(int16_t reg)
+{
+	constexpr unsigned int ROT_DNN_NORM_SIGNED_SHT = 8;
+	constexpr unsigned int ROT_DNN_NORM_MASK = 0x01FF;
+
+	if (!((reg >> ROT_DNN_NORM_SIGNED_SHT) & 1))
+		return reg;
+	else
+		return -((~reg + 1) & ROT_DNN_NORM_MASK);
+}
+
+void npy_save(std::string const &filename, const uint8_t *data, unsigned int width, unsigned int height,
+			  unsigned int channels)
+{
+	// Version 1.0 of the format, with the header padded so that the data starts 64 byte aligned.
+	std::string header = "{'descr': '|u1', 'fortran_order': False, 'shape': (" + std::to_string(height) + ", " +
+						 std::to_string(width) + ", " + std::to_string(channels) + "), }";
+	header.append(63 - (10 + header.size()) % 64, ' ');
+	header += '\n';
+
+	std::ofstream file(filename, std::ios::out | std::ios::binary);
+	if (!file)
+		throw std::runtime_error("failed to open file " + filename);
+	const char magic[] = { '\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0 };
+	const uint16_t header_len = header.size();
+	file.write(magic, sizeof(magic));
+	file.put(header_len & 0xff).put(header_len >> 8);
+	file << header;
+	file.write(reinterpret_cast<const char *>(data), (size_t)width * height * channels);
+}
+
+} // namespace
+
+InputTensorWriter::InputTensorWriter(boost::property_tree::ptree const &params)
+{
+	filename_ = params.get<std::string>("filename");
+	format_ = params.get<std::string>("format", "raw");
+	planar_ = params.get<int>("planar", 0);
+	num_tensors_ = params.get<unsigned int>("num_tensors", 1);
+	norm_val_ = PostProcessingStage::GetJsonArray<int32_t>(params, "norm_val", { 0, 0, 0, 0 });
+	norm_shift_ = PostProcessingStage::GetJsonArray<uint8_t>(params, "norm_shift", { 0, 0, 0, 0 });
+	div_val_ = PostProcessingStage::GetJsonArray<int16_t>(params, "div_val", { 1, 1, 1, 1 });
+	div_shift_ = params.get<unsigned int>("div_shift", 0);
+
+	if (format_ != "raw" && format_ != "png" && format_ != "npy")
+		throw std::runtime_error("InputTensorWriter: unknown format " + format_);
+	if (std::find(div_val_.begin(), div_val_.end(), 0) != div_val_.end())
+		throw std::runtime_error("InputTensorWriter: div_val must not be zero");
+
+	if (format_ == "raw")
+	{
+		raw_file_.open(filename_, std::ios::out | std::ios::binary);
+		if (!raw_file_)
+			throw std::runtime_error("InputTensorWriter: failed to open " + filename_);
+	}
+
+	for (unsigned int c = 0; c < lut_.size(); c++)
+	{
+		for (unsigned int v = 0; v < 256; v++)
+		{
+			int16_t sample = static_cast<int8_t>(v);
+			sample = (sample << norm_shift_[c]) - conv_reg_signed(norm_val_[c]);
+			sample = ((sample << div_shift_) / div_val_[c]) & 0xFF;
+			lut_[c][v] = static_cast<uint8_t>(sample);
+		}
+	}
+
+	free_.resize(std::max(params.get<unsigned int>("queue_depth", 4), 1u));
+	thread_ = std::thread(&InputTensorWriter::writerThread, this);
+}
+
+InputTensorWriter::~InputTensorWriter()
+{
+	// Finish writing whatever was queued up, as it's probably wanted.
+	{
+		std::scoped_lock<std::mutex> l(mutex_);
+		abort_ = true;
+	}
+	cond_.notify_one();
+	thread_.join();
+
+	LOG(1, "InputTensorWriter: " << written_ << " tensors saved, " << dropped_ << " dropped");
+}
+
+bool InputTensorWriter::Write(const uint8_t *data, size_t size, unsigned int sequence, unsigned int width,
+							  unsigned int height, unsigned int channels, std::string const &network_name)
+{
+	Job job;
+	{
+		std::scoped_lock<std::mutex> l(mutex_);
+		if (queued_ == num_tensors_)
+			return false;
+		if (free_.empty())
+		{
+			dropped_++;
+			LOG(2, "InputTensorWriter: dropped tensor for frame " << sequence);
+			return false;
+		}
+		job.buffer = std::move(free_.back());
+		free_.pop_back();
+		job.index = queued_++;
+	}
+
+	job.buffer.resize(size);
+	convert(data, job.buffer.data(), size, width, height, channels);
+	job.sequence = sequence;
+	job.width = width;
+	job.height = height;
+	job.channels = channels;
+	job.network_name = network_name;
+
+	{
+		// Write() may run on several threads at once, so keep the queue in the order the indices were handed
+		// out. That's the order the tensors go into the raw file.
+		std::scoped_lock<std::mutex> l(mutex_);
+		auto pos = std::find_if(queue_.begin(), queue_.end(), [&job](Job const &j) { return j.index > job.index; });
+		queue_.insert(pos, std::move(job));
+	}
+	cond_.notify_one();
+
+	return true;
+}
+
+void InputTensorWriter::convert(const uint8_t *src, uint8_t *dst, size_t size, unsigned int width,
+								unsigned int height, unsigned int channels) const
+{
+	// Planar tensors are reordered to interleaved pixels as they're converted. Otherwise the tensor is taken to
+	// be interleaved already. Either way it's one table lookup per sample. Raw files have always been converted
+	// as interleaved RGB, whatever the tensor info says, so they still are.
+	const bool raw = format_ == "raw" && !planar_;
+	const unsigned int n = channels && !raw ? std::min(channels, 4u) : 3;
+	const size_t plane = (size_t)width * height;
+
+	if (planar_ && plane && plane * n == size)
+	{
+		for (unsigned int c = 0; c < n; c++)
+		{
+			const std::array<uint8_t, 256> &lut = lut_[c];
+			const uint8_t *in = src + c * plane;
+			uint8_t *out = dst + c;
+			for (size_t i = 0; i < plane; i++)
+				out[i * n] = lut[in[i]];
+		}
+		return;
+	}
+
+	size_t i = 0;
+	for (; i + n <= size; i += n)
+	{
+		for (unsigned int c = 0; c < n; c++)
+			dst[i + c] = lut_[c][src[i + c]];
+	}
+	for (; i < size; i++)
+		dst[i] = lut_[i % n][src[i]];
+}
+
+void InputTensorWriter::writerThread()
+{
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> l(mutex_);
+			// Wait for the next tensor in order, as one that was handed out earlier may still be converting.
+			cond_.wait(l, [this] { return abort_ || (!queue_.empty() && queue_.front().index == next_); });
+			if (queue_.empty())
+				break;
+			next_ = queue_.front().index + 1;
+			job = std::move(queue_.front());
+			queue_.pop_front();
+		}
+
+		save(job);
+
+		std::scoped_lock<std::mutex> l(mutex_);
+		free_.push_back(std::move(job.buffer));
+		// Close the raw file as soon as it's complete, so that it can be used while we carry on.
+		if (++written_ == num_tensors_ && raw_file_.is_open())
+			raw_file_.close();
+	}
+}
+
+void InputTensorWriter::save(Job const &job)
+{
+	try
+	{
+		if (format_ == "raw")
+		{
+			raw_file_.write(reinterpret_cast<const char *>(job.buffer.data()), job.buffer.size());
+			return;
+		}
+
+		if (!job.width || !job.height || (size_t)job.width * job.height * job.channels != job.buffer.size())
+			throw std::runtime_error("tensor shape unknown or doesn't match its size");
+
+		if (format_ == "png")
+		{
+			if (job.channels != 3)
+				throw std::runtime_error("png needs 3 channels, not " + std::to_string(job.channels));
+			StreamInfo info;
+			info.width = job.width;
+			info.height = job.height;
+			info.stride = job.width * 3;
+			info.pixel_format = libcamera::formats::BGR888;
+			std::vector<libcamera::Span<uint8_t>> mem = { libcamera::Span<uint8_t>(
+				const_cast<uint8_t *>(job.buffer.data()), job.buffer.size()) };
+			png_save(mem, info, filename(job.index, ".png"), nullptr);
+		}
+		else
+			npy_save(filename(job.index, ".npy"), job.buffer.data(), job.width, job.height, job.channels);
+
+		// A sidecar file records where each tensor came from.
+		boost::property_tree::ptree metadata;
+		metadata.put("sequence", job.sequence);
+		metadata.put("network", job.network_name);
+		metadata.put("width", job.width);
+		metadata.put("height", job.height);
+		metadata.put("channels", job.channels);
+		boost::property_tree::write_json(filename(job.index, ".json"), metadata);
+	}
+	catch (std::exception const &e)
+	{
+		LOG_ERROR("InputTensorWriter: failed to save tensor " << job.index << ": " << e.what());
+	}
+}
+
+std::string InputTensorWriter::filename(unsigned int index, std::string const &extension) const
+{
+	// Each tensor gets its own files, numbered, and named after the filename with any extension removed.
+	char number[16];
+	snprintf(number, sizeof(number), "_%04u", index);
+	return fs::path(filename_).replace_extension().string() + number + extension;
+}
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * imx500_input_tensor_writer.hpp - save IMX500 input tensors in the background
+ */
+
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+
+// Saves the first "num_tensors" input tensors the IMX500 reports, converted back to 8 bit
+// pixel values. The conversion happens on the calling thread, into one of a small pool of
+// buffers, and the file writing on a thread of its own. When every buffer is still
+// waiting to be written, tensors are dropped (and counted) rather than holding up the
+// frame. Tensors are saved in the order they were accepted, even when Write() is called
+// from several threads at once.
+//
+// The "raw" format appends every tensor to one file, treating it as interleaved RGB as it
+// always has. With "planar", or for "png" and "npy", the channel count comes from the
+// tensor info the IMX500 reports.
+class InputTensorWriter
+{
+public:
+	InputTensorWriter(boost::property_tree::ptree const &params);
+	~InputTensorWriter();
+
+	// Convert and queue a tensor for saving. width, height and channels describe its shape, where known (they
+	// may be 0 for the "raw" format). Returns false if the tensor was dropped or nothing more is wanted.
+	bool Write(const uint8_t *data, size_t size, unsigned int sequence, unsigned int width, unsigned int height,
+			   unsigned int channels, std::string const &network_name);
+
+private:
+	struct Job
+	{
+		std::vector<uint8_t> buffer;
+		unsigned int index;
+		unsigned int sequence;
+		unsigned int width;
+		unsigned int height;
+		unsigned int channels;
+		std::string network_name;
+	};
+
+	void convert(const uint8_t *src, uint8_t *dst, size_t size, unsigned int width, unsigned int height,
+				 unsigned int channels) const;
+	void writerThread();
+	void save(Job const &job);
+	std::string filename(unsigned int index, std::string const &extension) const;
+
+	std::string filename_;
+	std::string format_;
+	bool planar_;
+	unsigned int num_tensors_;
+	std::vector<int32_t> norm_val_;
+	std::vector<uint8_t> norm_shift_;
+	std::vector<int16_t> div_val_;
+	unsigned int div_shift_;
+	// The de-normalisation of each channel only ever sees 256 different input values.
+	std::array<std::array<uint8_t, 256>, 4> lut_;
+	std::ofstream raw_file_;
+
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::vector<std::vector<uint8_t>> free_;
+	std::deque<Job> queue_;
+	unsigned int queued_ = 0;
+	unsigned int dropped_ = 0;
+	unsigned int written_ = 0;
+	// The index of the next tensor to save.
+	unsigned int next_ = 0;
+	bool abort_ = false;
+	std::thread thread_;
+};
@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * imx500_network_state.cpp - remember which network firmware an IMX500 has loaded
+ */
+
+#include <sys/stat.h>
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "core/logging.hpp"
+
+#include "imx500_network_state.hpp"
+
+namespace fs = std::filesystem;
+
+namespace
+{
+
+std::string read_boot_id()
+{
+	std::ifstream file("/proc/sys/kernel/random/boot_id");
+	std::string id;
+	std::getline(file, id);
+	return id;
+}
+
+// Only root, and perhaps a group it chose, can have written anything in a directory like this.
+bool trusted_directory(std::string const &dir)
+{
+	struct stat s;
+	return lstat(dir.c_str(), &s) == 0 && S_ISDIR(s.st_mode) && s.st_uid == 0 && !(s.st_mode & S_IWOTH);
+}
+
+} // namespace
+
+int NetworkState::FindDevice(std::string const &sysfs_root, std::string &device_id)
+{
+	for (unsigned int i = 0; i < 16; i++)
+	{
+		const fs::path device_dir { sysfs_root + "/class/video4linux/v4l-subdev" + std::to_string(i) + "/device" };
+		const fs::path module_dir { device_dir / "driver/module" };
+
+		std::error_code ec;
+		if (!fs::is_symlink(module_dir, ec) || !fs::exists(module_dir, ec))
+			continue;
+		if (fs::read_symlink(module_dir, ec).filename().string().find("imx500") == std::string::npos)
+			continue;
+
+		// The device link ends in the sensor's I2C device name, which is what tells one IMX500 from another.
+		device_id = fs::read_symlink(device_dir, ec).filename().string();
+		if (ec)
+			device_id.clear();
+		return i;
+	}
+
+	return -1;
+}
+
+std::string NetworkState::DefaultFile(std::string const &device_id, std::string const &dir)
+{
+	if (device_id.empty() || device_id == "." || device_id == ".." || device_id.find('/') != std::string::npos)
+		return {};
+	if (!trusted_directory(dir))
+		return {};
+
+	return (fs::path(dir) / ("network-" + device_id + ".state")).string();
+}
+
+uint64_t NetworkState::Hash(std::string const &network_file)
+{
+	// 64 bit FNV-1a. It's no defence against anyone trying to fool it, but it's quick, and plenty to tell one
+	// network file from another.
+	std::ifstream file(network_file, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("NetworkState: failed to open " + network_file);
+
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	std::vector<char> buffer(1 << 16);
+	while (file.read(buffer.data(), buffer.size()) || file.gcount())
+	{
+		for (std::streamsize i = 0; i < file.gcount(); i++)
+			hash = (hash ^ (uint8_t)buffer[i]) * 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+NetworkState::NetworkState(std::string const &state_file) : state_file_(state_file), boot_id_(read_boot_id())
+{
+}
+
+bool NetworkState::Matches(uint64_t hash) const
+{
+	// Don't follow a link to some other file.
+	std::error_code ec;
+	if (!fs::is_regular_file(fs::symlink_status(state_file_, ec)))
+		return false;
+
+	std::ifstream file(state_file_);
+	std::string boot_id;
+	uint64_t recorded;
+	if (!(file >> boot_id >> std::hex >> recorded))
+		return false;
+
+	return !boot_id_.empty() && boot_id == boot_id_ && recorded == hash;
+}
+
+void NetworkState::Record(uint64_t hash, std::string const &network_file) const
+{
+	if (boot_id_.empty())
+		return;
+
+	// Write a new file and rename it over the old one, so nobody ever sees half of it.
+	const std::string tmp = state_file_ + ".tmp";
+	{
+		std::ofstream file(tmp);
+		file << boot_id_ << " " << std::hex << hash << " " << network_file << std::endl;
+		if (!file)
+		{
+			LOG_ERROR("NetworkState: failed to write " << tmp);
+			return;
+		}
+	}
+
+	std::error_code ec;
+	fs::rename(tmp, state_file_, ec);
+	if (ec)
+		LOG_ERROR("NetworkState: failed to write " << state_file_ << ": " << ec.message());
+}
+
+void NetworkState::Invalidate() const
+{
+	std::error_code ec;
+	fs::remove(state_file_, ec);
+}
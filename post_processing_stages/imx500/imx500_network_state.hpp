@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * imx500_network_state.hpp - remember which network firmware an IMX500 has loaded
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Loading network firmware onto the IMX500 can take minutes, and there's no need to do it again if the same
+// network is already there. This records, in a small state file for each device, the content hash of the last
+// network file that was seen running, along with the kernel's boot id, as the firmware doesn't survive a reboot.
+// The file is removed before starting a load, so an interrupted load is never mistaken for a finished one.
+
+// The device is shared by every user, so the state must be too, and only trusted users may be able to change it, or
+// one could make another skip loading the network they asked for. So it lives in a root-owned directory that is not
+// writable by everyone, which the system has to create (for example with a tmpfiles.d line such as
+// "d /run/imx500 0775 root video"). Without one, nothing is remembered and the network is always loaded.
+class NetworkState
+{
+public:
+	static constexpr char const *STATE_DIR = "/run/imx500";
+
+	// Find the IMX500 among the V4L2 subdevices under this sysfs root. Returns its subdevice number, and sets device_id
+	// to the name of its device (such as "10-001a"), or returns -1 if there isn't one.
+	static int FindDevice(std::string const &sysfs_root, std::string &device_id);
+
+	// The state file for a device, in the state directory. This returns an empty string, so that nothing is
+	// remembered, if the directory is missing or not safe (see above), or if there's no usable device id to tell
+	// one device's state from another's.
+	static std::string DefaultFile(std::string const &device_id, std::string const &dir = STATE_DIR);
+
+	// A hash of the contents of the network file. Throws if it can't be read.
+	static uint64_t Hash(std::string const &network_file);
+
+	NetworkState(std::string const &state_file);
+
+	// Whether this network was recorded as loaded, since the last boot.
+	bool Matches(uint64_t hash) const;
+
+	// Record that this network has been seen running.
+	void Record(uint64_t hash, std::string const &network_file) const;
+
+	// Forget whatever was loaded, before starting to load something else.
+	void Invalidate() const;
+
+private:
+	std::string state_file_;
+	std::string boot_id_;
+};
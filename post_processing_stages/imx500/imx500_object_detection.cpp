@@ -15,6 +15,7 @@
 #include <libcamera/geometry.h>
 
 #include "core/rpicam_app.hpp"
+#include "post_processing_stages/detection_decoder.hpp"
 #include "post_processing_stages/object_detect.hpp"
 #include "post_processing_stages/post_processing_stage.hpp"
 
@@ -26,22 +27,6 @@ namespace controls = libcamera::controls;
 
 #define NAME "imx500_object_detection"
 
-struct Bbox
-{
-	float x0;
-	float y0;
-	float x1;
-	float y1;
-};
-
-struct ObjectDetectionOutput
-{
-	unsigned int num_detections = 0;
-	std::vector<Bbox> bboxes;
-	std::vector<float> scores;
-	std::vector<float> classes;
-};
-
 class ObjectDetection : public IMX500PostProcessingStage
 {
 public:
@@ -57,7 +42,8 @@ public:
 
 private:
 	int processOutputTensor(std::vector<Detection> &objects, const std::vector<float> &output_tensor,
-							const CnnOutputTensorInfo &output_tensor_info, const Rectangle &scaler_crop) const;
+							const CnnOutputTensorInfo &output_tensor_info, const Rectangle &scaler_crop,
+							CompletedRequestPtr const &completed_request);
 	void filterOutputObjects(std::vector<Detection> &objects);
 
 	struct LtObject
@@ -141,7 +127,7 @@ bool ObjectDetection::Process(CompletedRequestPtr &completed_request)
 		std::vector<float> output_tensor(output->data(), output->data() + output->size());
 		CnnOutputTensorInfo output_tensor_info = *reinterpret_cast<const CnnOutputTensorInfo *>(info->data());
 
-		processOutputTensor(objects, output_tensor, output_tensor_info, *scaler_crop);
+		processOutputTensor(objects, output_tensor, output_tensor_info, *scaler_crop, completed_request);
 
 		if (temporal_filtering_)
 		{
@@ -181,52 +167,9 @@ bool ObjectDetection::Process(CompletedRequestPtr &completed_request)
 	return IMX500PostProcessingStage::Process(completed_request);
 }
 
-static int createObjectDetectionData(ObjectDetectionOutput &output, const std::vector<float> &data,
-									 unsigned int total_detections)
-{
-	unsigned int count = 0;
-
-	// Extract bounding box co-ordinates
-	for (unsigned int i = 0; i < total_detections; i++)
-	{
-		Bbox bbox;
-		bbox.y0 = data.at(count + i);
-		bbox.x0 = data.at(count + i + (1 * total_detections));
-		bbox.y1 = data.at(count + i + (2 * total_detections));
-		bbox.x1 = data.at(count + i + (3 * total_detections));
-		output.bboxes.push_back(bbox);
-	}
-	count += (total_detections * 4);
-
-	// Extract scores
-	for (unsigned int i = 0; i < total_detections; i++)
-	{
-		output.scores.push_back(data.at(count));
-		count++;
-	}
-
-	// Extract class indices
-	for (unsigned int i = 0; i < total_detections; i++)
-	{
-		output.classes.push_back(data.at(count));
-		count++;
-	}
-
-	// Extract number of detections
-	unsigned int num_detections = data.at(count);
-	if (num_detections > total_detections)
-	{
-		LOG(1, "Unexpected value for num_detections: " << num_detections << ", setting it to " << total_detections);
-		num_detections = total_detections;
-	}
-
-	output.num_detections = num_detections;
-	return 0;
-}
-
 int ObjectDetection::processOutputTensor(std::vector<Detection> &objects, const std::vector<float> &output_tensor,
 										 const CnnOutputTensorInfo &output_tensor_info,
-										 const Rectangle &scaler_crop) const
+										 const Rectangle &scaler_crop, CompletedRequestPtr const &completed_request)
 {
 	if (output_tensor_info.num_tensors != 4)
 	{
@@ -235,7 +178,6 @@ int ObjectDetection::processOutputTensor(std::vector<Detection> &objects, const
 	}
 
 	const unsigned int total_detections = output_tensor_info.info[0].tensor_data_num / 4;
-	ObjectDetectionOutput output;
 
 	// 4x coords + 1x labels + 1x confidences + 1 total detections
 	if (output_tensor.size() != 6 * total_detections + 1)
@@ -244,32 +186,41 @@ int ObjectDetection::processOutputTensor(std::vector<Detection> &objects, const
 		return -1;
 	}
 
-	int ret = createObjectDetectionData(output, output_tensor, total_detections);
-	if (ret)
-	{
-		LOG_ERROR("Failed to create object detection data");
-		return -1;
-	}
+	// The tensors are packed one after another: all the box co-ordinates (a plane for each), the scores, the
+	// classes, and finally the number of detections. They're decoded where they lie, without copying.
+	auto tensor = [&output_tensor](size_t offset, unsigned int size) {
+		TensorInfo info;
+		info.shape = { size };
+		uint8_t *data = reinterpret_cast<uint8_t *>(const_cast<float *>(output_tensor.data() + offset));
+		return Tensor { info, std::shared_ptr<uint8_t>(std::shared_ptr<uint8_t>(), data) };
+	};
+	const Tensor boxes = tensor(0, 4 * total_detections);
+	const Tensor scores = tensor(4 * total_detections, total_detections);
+	const Tensor classes = tensor(5 * total_detections, total_detections);
+	const Tensor count = tensor(6 * total_detections, 1);
 
-	for (unsigned int i = 0; i < std::min(output.num_detections, max_detections_); i++)
-	{
-		uint8_t class_index = (uint8_t)output.classes[i];
+	const Rectangle inference_roi = InferenceRoi(completed_request);
+	std::vector<std::vector<float>> found;
 
-		// Filter detections
-		if (output.scores[i] < threshold_ || class_index >= classes_.size())
+	for (auto const &object : DecodeSsd(boxes, classes, scores, &count, threshold_, true))
+	{
+		if (objects.size() == max_detections_)
+			break;
+		if ((unsigned int)object.category >= classes_.size())
 			continue;
 
 		// Extract bounding box co-ordinates in the inference image co-ordinates and convert to the final ISP output
 		// co-ordinates.
-		std::vector<float> coords{ output.bboxes[i].x0, output.bboxes[i].y0,
-								   output.bboxes[i].x1 - output.bboxes[i].x0,
-								   output.bboxes[i].y1 - output.bboxes[i].y0 };
-		const Rectangle obj_scaled = ConvertInferenceCoordinates(coords, scaler_crop);
+		std::vector<float> coords{ object.x0, object.y0, object.x1 - object.x0, object.y1 - object.y0 };
+		const Rectangle obj_scaled = ConvertInferenceCoordinates(coords, scaler_crop, inference_roi);
+		found.push_back(std::move(coords));
 
-		objects.emplace_back(class_index, classes_[class_index], output.scores[i],
-							 obj_scaled.x, obj_scaled.y, obj_scaled.width, obj_scaled.height);
+		objects.emplace_back(object.category, classes_[object.category], object.confidence, obj_scaled.x,
+							 obj_scaled.y, obj_scaled.width, obj_scaled.height);
 	}
 
+	UpdateInferenceRoi(completed_request, found);
+
 	LOG(2, "Number of objects detected: " << objects.size());
 	for (unsigned i = 0; i < objects.size(); i++)
 		LOG(2, "[" << i << "] : " << objects[i].toString());
@@ -0,0 +1,664 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * imx500_posenet_decoder.cpp - decode PoseNet output tensors into poses
+ */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <ostream>
+#include <vector>
+
+#include <libcamera/geometry.h>
+
+#include "imx500_posenet_decoder.hpp"
+
+namespace
+{
+
+using Point = PoseNetDecoder::Point;
+using PoseKeypoints = PoseNetDecoder::PoseKeypoints;
+using PoseKeypointScores = PoseNetDecoder::PoseKeypointScores;
+
+constexpr libcamera::Size MAP_SIZE = { 31, 23 };
+constexpr unsigned int NUM_KEYPOINTS = PoseNetDecoder::NUM_KEYPOINTS;
+// These 16 edges allow traversing of the pose graph along the mid_offsets (see
+// paper for details).
+static constexpr int NUM_EDGES = 16;
+constexpr unsigned int STRIDE = PoseNetDecoder::STRIDE;
+constexpr unsigned int NUM_HEATMAPS = NUM_KEYPOINTS * MAP_SIZE.width * MAP_SIZE.height;
+constexpr unsigned int NUM_SHORT_OFFSETS = 2 * NUM_KEYPOINTS * MAP_SIZE.width * MAP_SIZE.height;
+constexpr unsigned int NUM_MID_OFFSETS = 64 * MAP_SIZE.width * MAP_SIZE.height;
+constexpr unsigned int MAP_AREA = MAP_SIZE.width * MAP_SIZE.height;
+
+enum KeypointType
+{
+	Nose,
+	LeftEye,
+	RightEye,
+	LeftEar,
+	RightEar,
+	LeftShoulder,
+	RightShoulder,
+	LeftElbow,
+	RightElbow,
+	LeftWrist,
+	RightWrist,
+	LeftHip,
+	RightHip,
+	LeftKnee,
+	RightKnee,
+	LeftAnkle,
+	RightAnkle
+};
+
+const std::array<std::pair<KeypointType, KeypointType>, 32> EdgeList = { {
+	// Forward edges
+	{ Nose, LeftEye },
+	{ LeftEye, LeftEar },
+	{ Nose, RightEye },
+	{ RightEye, RightEar },
+	{ Nose, LeftShoulder },
+	{ LeftShoulder, LeftElbow },
+	{ LeftElbow, LeftWrist },
+	{ LeftShoulder, LeftHip },
+	{ LeftHip, LeftKnee },
+	{ LeftKnee, LeftAnkle },
+	{ Nose, RightShoulder },
+	{ RightShoulder, RightElbow },
+	{ RightElbow, RightWrist },
+	{ RightShoulder, RightHip },
+	{ RightHip, RightKnee },
+	{ RightKnee, RightAnkle },
+
+	// Backward edges
+	{ LeftEye, Nose },
+	{ LeftEar, LeftEye },
+	{ RightEye, Nose },
+	{ RightEar, RightEye },
+	{ LeftShoulder, Nose },
+	{ LeftElbow, LeftShoulder },
+	{ LeftWrist, LeftElbow },
+	{ LeftHip, LeftShoulder },
+	{ LeftKnee, LeftHip },
+	{ LeftAnkle, LeftKnee },
+	{ RightShoulder, Nose },
+	{ RightElbow, RightShoulder },
+	{ RightWrist, RightElbow },
+	{ RightHip, RightShoulder },
+	{ RightKnee, RightHip },
+	{ RightAnkle, RightKnee },
+} };
+
+// An adjacency list representing the directed edges connecting keypoints.
+struct AdjacencyList
+{
+	explicit AdjacencyList(const int num_nodes = NUM_KEYPOINTS) : child_ids(num_nodes), edge_ids(num_nodes) {}
+
+	// child_ids[i] is a vector holding the node ids of all children of the i-th
+	// node and edge_ids[i] is a vector holding the edge ids of all edges stemming
+	// from the i-th node. If the k-th edge in the graph starts at the i-th node
+	// and ends at the j-th node, then child_ids[i] and edge_ids will contain j
+	// and k, respectively, at corresponding positions.
+	std::vector<std::vector<int>> child_ids;
+	std::vector<std::vector<int>> edge_ids;
+};
+
+// Defines a 2-D keypoint with (x, y) float coordinates and its type id.
+struct KeypointWithScore
+{
+	KeypointWithScore(const Point &_pt, const int _id, const float _score) : point(_pt), id(_id), score(_score) {}
+
+	[[maybe_unused]] friend std::ostream &operator<<(std::ostream &ost, const KeypointWithScore &keypoint)
+	{
+		return ost << keypoint.point.y << ", " << keypoint.point.x << ", " << keypoint.id << ", " << keypoint.score;
+	}
+
+	bool operator<(const KeypointWithScore &other) const { return score < other.score; }
+	bool operator>(const KeypointWithScore &other) const { return score > other.score; }
+
+	Point point;
+	int id;
+	float score;
+};
+
+// A max-heap of keypoints, like std::priority_queue, but over storage that is reserved once and reused, so that
+// it never allocates once warmed up. It uses the same std::push_heap and std::pop_heap operations, so keypoints
+// with equal scores come out in the same order as they would from std::priority_queue.
+class KeypointQueue
+{
+public:
+	void reserve(size_t size) { heap_.reserve(size); }
+	void clear() { heap_.clear(); }
+	bool empty() const { return heap_.empty(); }
+	const KeypointWithScore &top() const { return heap_.front(); }
+
+	void emplace(const Point &point, const int id, const float score)
+	{
+		heap_.emplace_back(point, id, score);
+		std::push_heap(heap_.begin(), heap_.end());
+	}
+
+	void pop()
+	{
+		std::pop_heap(heap_.begin(), heap_.end());
+		heap_.pop_back();
+	}
+
+private:
+	std::vector<KeypointWithScore> heap_;
+};
+
+float sigmoid(const float x)
+{
+	return 1.0f / (1.0f + std::exp(-x));
+}
+
+float log_odds(const float x)
+{
+	return -std::log(1.0f / (x + 1E-6) - 1.0f);
+}
+
+// Computes the squared distance between a pair of 2-D points.
+float squared_distance(const Point &a, const Point &b)
+{
+	const float dy = b.y - a.y;
+	const float dx = b.x - a.x;
+	return dy * dy + dx * dx;
+}
+
+// Reorder the network's [channel][x][y] output into [y][x][channel], scaling it as we go. The divisors are powers
+// of 2, so multiplying by the reciprocal gives exactly the same result as dividing.
+void format_tensor(float *tensor, const float *data, unsigned int size, unsigned int div)
+{
+	const float scale = 1.0f / div;
+
+	for (unsigned int i = 0; i < size; i++)
+	{
+		const float *src = data + MAP_AREA * i;
+		for (unsigned int j = 0; j < MAP_SIZE.width; j++)
+		{
+			float *dst = tensor + size * j + i;
+			for (unsigned int k = 0; k < MAP_SIZE.height; k++)
+				dst[size * MAP_SIZE.width * k] = src[j * MAP_SIZE.height + k] * scale;
+		}
+	}
+}
+
+// Build an adjacency list of the pose graph.
+AdjacencyList build_agency_list()
+{
+	AdjacencyList adjacency_list;
+
+	for (unsigned int k = 0; k < EdgeList.size(); ++k)
+	{
+		const int parent_id = EdgeList[k].first;
+		const int child_id = EdgeList[k].second;
+		adjacency_list.child_ids[parent_id].push_back(child_id);
+		adjacency_list.edge_ids[parent_id].push_back(k);
+	}
+
+	return adjacency_list;
+}
+
+const AdjacencyList ADJACENCY_LIST = build_agency_list();
+
+bool pass_keypoint_nms(const std::vector<PoseKeypoints> &poses, const size_t num_poses,
+					   const KeypointWithScore &keypoint, const float squared_nms_radius)
+{
+	for (unsigned int i = 0; i < num_poses; ++i)
+	{
+		if (squared_distance(keypoint.point, poses[i][keypoint.id]) <= squared_nms_radius)
+			return false;
+	}
+
+	return true;
+}
+
+// Finds the indices of the scores if we sort them in decreasing order.
+void decreasing_arg_sort(std::vector<int> &indices, const std::vector<float> &scores)
+{
+	indices.resize(scores.size());
+	std::iota(indices.begin(), indices.end(), 0);
+	std::sort(indices.begin(), indices.end(), [&scores](const int i, const int j) { return scores[i] > scores[j]; });
+}
+
+// Finds the indices of a pose's keypoint scores if we sort them in decreasing order.
+void decreasing_arg_sort(std::array<int, NUM_KEYPOINTS> &indices, const PoseKeypointScores &scores)
+{
+	std::iota(indices.begin(), indices.end(), 0);
+	std::sort(indices.begin(), indices.end(), [&scores](const int i, const int j) { return scores[i] > scores[j]; });
+}
+
+// Helper function for 1-D linear interpolation. It computes the floor and the
+// ceiling of the input coordinate, as well as the weighting factor between the
+// two interpolation endpoints, such that:
+// y = (1 - x_lerp) * vec[x_floor] + x_lerp * vec[x_ceil]
+void build_linear_interpolation(const float x, const int n, int *x_floor, int *x_ceil, float *x_lerp)
+{
+	const float x_proj = std::clamp(x, 0.0f, n - 1.0f);
+	*x_floor = static_cast<int>(std::floor(x_proj));
+	*x_ceil = static_cast<int>(std::ceil(x_proj));
+	*x_lerp = x - (*x_floor);
+}
+
+// Helper function for 2-D bilinear interpolation. It computes the four corners
+// of the 2x2 cell that contain the input coordinates (x, y), as well as the
+// weighting factor between the four interpolation endpoints, such that:
+// y =
+//   (1 - y_lerp) * ((1 - x_lerp) * vec[top_left] + x_lerp * vec[top_right]) +
+//   y_lerp * ((1 - x_lerp) * tensor[bottom_left] + x_lerp * vec[bottom_right])
+void build_bilinear_interpolation(const Point point, const unsigned int num_channels, int *top_left, int *top_right,
+								  int *bottom_left, int *bottom_right, float *y_lerp, float *x_lerp)
+{
+	int y_floor;
+	int y_ceil;
+	build_linear_interpolation(point.y, MAP_SIZE.height, &y_floor, &y_ceil, y_lerp);
+	int x_floor;
+	int x_ceil;
+	build_linear_interpolation(point.x, MAP_SIZE.width, &x_floor, &x_ceil, x_lerp);
+	*top_left = (y_floor * MAP_SIZE.width + x_floor) * num_channels;
+	*top_right = (y_floor * MAP_SIZE.width + x_ceil) * num_channels;
+	*bottom_left = (y_ceil * MAP_SIZE.width + x_floor) * num_channels;
+	*bottom_right = (y_ceil * MAP_SIZE.width + x_ceil) * num_channels;
+}
+
+// Sample the input tensor values at position (x, y) and at multiple channels.
+// The input tensor has shape [height, width, num_channels]. We bilinearly
+// sample its value at tensor(y, x, c), for c in the channels specified. This
+// is faster than calling the single channel interpolation function multiple
+// times because the computation of the positions needs to be done only once.
+template <size_t N>
+std::array<float, N> sample_tensor_at_multiple_channels(const std::vector<float> &tensor, const Point &point,
+														const std::array<int, N> &result_channels,
+														unsigned int num_channels)
+{
+	int top_left, top_right, bottom_left, bottom_right;
+	float y_lerp, x_lerp;
+
+	build_bilinear_interpolation(point, num_channels, &top_left, &top_right, &bottom_left, &bottom_right, &y_lerp,
+								 &x_lerp);
+
+	std::array<float, N> result;
+	for (size_t i = 0; i < N; i++)
+	{
+		const int c = result_channels[i];
+		result[i] = (1 - y_lerp) * ((1 - x_lerp) * tensor[top_left + c] + x_lerp * tensor[top_right + c]) +
+					y_lerp * ((1 - x_lerp) * tensor[bottom_left + c] + x_lerp * tensor[bottom_right + c]);
+	}
+
+	return result;
+}
+
+// Sample the input tensor values at position (x, y) and at a single channel.
+// The input tensor has shape [height, width, num_channels]. We bilinearly
+// sample its value at tensor(y, x, channel).
+float sample_tensor_at_single_channel(const std::vector<float> &tensor, const Point &point, unsigned int num_channels,
+									  const int c)
+{
+	return sample_tensor_at_multiple_channels<1>(tensor, point, { c }, num_channels)[0];
+}
+
+void build_keypoint_queue(KeypointQueue &queue, const std::vector<float> &scores,
+						  const std::vector<float> &short_offsets, const float score_threshold)
+{
+	constexpr unsigned int local_maximum_radius = 1;
+	unsigned int score_index = 0;
+	queue.clear();
+
+	for (unsigned int y = 0; y < MAP_SIZE.height; ++y)
+	{
+		for (unsigned int x = 0; x < MAP_SIZE.width; ++x)
+		{
+			unsigned int offset_index = 2 * score_index;
+			for (unsigned int j = 0; j < NUM_KEYPOINTS; ++j)
+			{
+				const float score = scores[score_index];
+				if (score >= score_threshold)
+				{
+					// Only consider keypoints whose score is maximum in a local window.
+					bool local_maximum = true;
+					const unsigned int y_start = std::max((int)y - (int)local_maximum_radius, 0);
+					const unsigned int y_end = std::min(y + local_maximum_radius + 1, MAP_SIZE.height);
+					for (unsigned int y_current = y_start; y_current < y_end; ++y_current)
+					{
+						const unsigned int x_start = std::max((int)x - (int)local_maximum_radius, 0);
+						const unsigned int x_end = std::min(x + local_maximum_radius + 1, MAP_SIZE.width);
+						for (unsigned int x_current = x_start; x_current < x_end; ++x_current)
+						{
+							if (scores[y_current * MAP_SIZE.width * NUM_KEYPOINTS + x_current * NUM_KEYPOINTS + j] >
+									score)
+							{
+								local_maximum = false;
+								break;
+							}
+						}
+						if (!local_maximum)
+							break;
+					}
+					if (local_maximum)
+					{
+						const float dy = short_offsets[offset_index];
+						const float dx = short_offsets[offset_index + NUM_KEYPOINTS];
+						const float y_refined = std::clamp(y + dy, 0.0f, MAP_SIZE.height - 1.0f);
+						const float x_refined = std::clamp(x + dx, 0.0f, MAP_SIZE.width - 1.0f);
+						queue.emplace(Point { y_refined, x_refined }, j, score);
+					}
+				}
+
+				++score_index;
+				++offset_index;
+			}
+		}
+	}
+}
+
+// Follows the mid-range offsets, and then refines the position by the short-
+// range offsets for a fixed number of steps.
+Point find_displaced_position(const std::vector<float> &short_offsets, const std::vector<float> &mid_offsets,
+							  const Point &source, const int edge_id, const int target_id,
+							  const int offset_refinement_steps)
+{
+	float y = source.y, x = source.x;
+
+	// Follow the mid-range offsets.
+	std::array<int, 2> channels = { edge_id, NUM_EDGES + edge_id };
+
+	// Total size of mid_offsets is height x width x 2*2*num_edges
+	std::array<float, 2> offsets = sample_tensor_at_multiple_channels(mid_offsets, source, channels, 2 * 2 * NUM_EDGES);
+	y = std::clamp(y + offsets[0], 0.0f, MAP_SIZE.height - 1.0f);
+	x = std::clamp(x + offsets[1], 0.0f, MAP_SIZE.width - 1.0f);
+
+	// Refine by the short-range offsets.
+	channels[0] = target_id;
+	channels[1] = NUM_KEYPOINTS + target_id;
+	for (int i = 0; i < offset_refinement_steps; ++i)
+	{
+		offsets = sample_tensor_at_multiple_channels(short_offsets, Point { y, x }, channels, 2 * NUM_KEYPOINTS);
+		y = std::clamp(y + offsets[0], 0.0f, MAP_SIZE.height - 1.0f);
+		x = std::clamp(x + offsets[1], 0.0f, MAP_SIZE.width - 1.0f);
+	}
+
+	return Point { y, x };
+}
+
+void backtrack_decode_pose(KeypointQueue &decode_queue, const std::vector<float> &scores,
+						   const std::vector<float> &short_offsets, const std::vector<float> &mid_offsets,
+						   const KeypointWithScore &root, const AdjacencyList &adjacency_list,
+						   PoseKeypoints &pose_keypoints, PoseKeypointScores &keypoint_scores,
+						   unsigned int offset_refinement_steps)
+{
+	const float root_score = sample_tensor_at_single_channel(scores, root.point, root.id, NUM_KEYPOINTS);
+
+	// Used in order to put candidate keypoints in a priority queue w.r.t. their
+	// score. Keypoints with higher score have higher priority and will be
+	// decoded/processed first. Each edge adds at most one entry, so the queue
+	// never holds more than 1 + 2 * NUM_EDGES of them.
+	decode_queue.clear();
+	decode_queue.emplace(root.point, root.id, root_score);
+
+	// Keeps track of the keypoints whose position has already been decoded.
+	std::array<bool, NUM_KEYPOINTS> keypoint_decoded {};
+
+	while (!decode_queue.empty())
+	{
+		// The top element in the queue is the next keypoint to be processed.
+		const KeypointWithScore current_keypoint = decode_queue.top();
+		decode_queue.pop();
+
+		if (keypoint_decoded[current_keypoint.id])
+			continue;
+
+		pose_keypoints[current_keypoint.id] = current_keypoint.point;
+		keypoint_scores[current_keypoint.id] = current_keypoint.score;
+
+		keypoint_decoded[current_keypoint.id] = true;
+
+		// Add the children of the current keypoint that have not been decoded yet
+		// to the priority queue.
+		const int num_children = adjacency_list.child_ids[current_keypoint.id].size();
+		for (int j = 0; j < num_children; ++j)
+		{
+			const int child_id = adjacency_list.child_ids[current_keypoint.id][j];
+			int edge_id = adjacency_list.edge_ids[current_keypoint.id][j];
+			if (keypoint_decoded[child_id])
+				continue;
+
+			// The mid-offsets block is organized as 4 blocks of NUM_EDGES:
+			// [fwd Y offsets][fwd X offsets][bwd Y offsets][bwd X offsets]
+			// OTOH edge_id is [0,NUM_EDGES) for forward edges and
+			// [NUM_EDGES, 2*NUM_EDGES) for backward edges.
+			// Thus if the edge is a backward edge (>NUM_EDGES) then we need
+			// to start 16 indices later to be correctly aligned with the mid-offsets.
+			if (edge_id > NUM_EDGES)
+				edge_id += NUM_EDGES;
+
+			const Point child_point = find_displaced_position(short_offsets, mid_offsets, current_keypoint.point,
+															  edge_id, child_id, offset_refinement_steps);
+			const float child_score = sample_tensor_at_single_channel(scores, child_point, NUM_KEYPOINTS, child_id);
+			decode_queue.emplace(child_point, child_id, child_score);
+		}
+	}
+}
+
+void find_overlapping_keypoints(std::array<bool, NUM_KEYPOINTS> &mask, const PoseKeypoints &pose1,
+								const PoseKeypoints &pose2, const float squared_radius)
+{
+	for (unsigned int k = 0; k < mask.size(); ++k)
+	{
+		if (squared_distance(pose1[k], pose2[k]) <= squared_radius)
+			mask[k] = true;
+	}
+}
+
+void perform_soft_keypoint_NMS(std::vector<float> &all_instance_scores, const std::vector<int> &decreasing_indices,
+							   const std::vector<PoseKeypoints> &all_keypoint_coords,
+							   const std::vector<PoseKeypointScores> &all_keypoint_scores,
+							   const float squared_nms_radius)
+{
+	const int num_instances = decreasing_indices.size();
+
+	all_instance_scores.resize(num_instances);
+	// Indicates the occlusion status of the keypoints of the active instance.
+	std::array<bool, NUM_KEYPOINTS> keypoint_occluded;
+	// Indices of the keypoints of the active instance in decreasing score value.
+	std::array<int, NUM_KEYPOINTS> indices;
+	for (int i = 0; i < num_instances; ++i)
+	{
+		const int current_index = decreasing_indices[i];
+		// Find the keypoints of the current instance which are overlapping with
+		// the corresponding keypoints of the higher-scoring instances and
+		// zero-out their contribution to the score of the current instance.
+		std::fill(keypoint_occluded.begin(), keypoint_occluded.end(), false);
+		for (int j = 0; j < i; ++j)
+		{
+			const int previous_index = decreasing_indices[j];
+			find_overlapping_keypoints(keypoint_occluded, all_keypoint_coords[current_index],
+									   all_keypoint_coords[previous_index], squared_nms_radius);
+		}
+		// We compute the argsort keypoint indices based on the original keypoint
+		// scores, but we do not let them contribute to the instance score if they
+		// have been non-maximum suppressed.
+		decreasing_arg_sort(indices, all_keypoint_scores[current_index]);
+		float total_score = 0.0f;
+		for (unsigned int k = 0; k < NUM_KEYPOINTS; ++k)
+		{
+			if (!keypoint_occluded[indices[k]])
+				total_score += all_keypoint_scores[current_index][indices[k]];
+		}
+		all_instance_scores[current_index] = total_score / NUM_KEYPOINTS;
+	}
+}
+
+} // namespace
+
+// Everything the decoder works in, allocated once, up front, and reused for every frame.
+struct PoseNetDecoder::Arena
+{
+	std::vector<float> scores;
+	std::vector<float> short_offsets;
+	std::vector<float> mid_offsets;
+	KeypointQueue root_queue;
+	KeypointQueue decode_queue;
+	std::vector<PoseKeypoints> poses;
+	std::vector<PoseKeypointScores> keypoint_scores;
+	std::vector<float> instance_scores;
+	std::vector<int> decreasing_indices;
+};
+
+PoseNetDecoder::PoseNetDecoder() : arena_(std::make_unique<Arena>())
+{
+	Configure(10, 0.5f, 5, 10);
+}
+
+PoseNetDecoder::~PoseNetDecoder() = default;
+
+void PoseNetDecoder::Configure(unsigned int max_detections, float threshold, unsigned int offset_refinement_steps,
+							   float nms_radius)
+{
+	max_detections_ = max_detections;
+	threshold_ = threshold;
+	offset_refinement_steps_ = offset_refinement_steps;
+	nms_radius_ = nms_radius / STRIDE;
+
+	Arena &arena = *arena_;
+	arena.scores.resize(NUM_HEATMAPS);
+	arena.short_offsets.resize(NUM_SHORT_OFFSETS);
+	arena.mid_offsets.resize(NUM_MID_OFFSETS);
+	// Every local maximum could be a root, but a pose has only one entry in the queue for each edge.
+	arena.root_queue.reserve(NUM_HEATMAPS);
+	arena.decode_queue.reserve(1 + 2 * NUM_EDGES);
+	arena.poses.resize(max_detections_);
+	arena.keypoint_scores.resize(max_detections_);
+	arena.instance_scores.reserve(max_detections_);
+	arena.decreasing_indices.reserve(max_detections_);
+}
+
+// Decodes poses from the score map, the short and mid offsets.
+// "Block space" refers to the output y and z size of the network.
+// For example if the network that takes a (353,481) (y,x) input image will have
+// an output field of 23, 31. Thus the sizes of the input vectors to this
+// functions will be
+//   scores: 23 x 31 x NUM_KEYPOINTS
+//   short_offsets 23 x 31 x 2 x NUM_KEYPOINTS (x and y per keypoint)
+//   mid_offsets 23 x 31 x 2 x 2 2 NUM_EDGES (x and y for each fwd and bwd edge)
+// Thus height and width need to be set to 23 and 31 respectively.
+// nms_radius_ is also in these units.
+// The output coordinates will be in pixel coordinates.
+//
+// For details see https://arxiv.org/abs/1803.08225
+// PersonLab: Person Pose Estimation and Instance Segmentation with a
+// Bottom-Up, Part-Based, Geometric Embedding Model
+// George Papandreou, Tyler Zhu, Liang-Chieh Chen, Spyros Gidaris,
+// Jonathan Tompson, Kevin Murphy
+std::vector<PoseNetDecoder::PoseResults> PoseNetDecoder::Decode(const float *output)
+{
+	Arena &arena = *arena_;
+	format_tensor(arena.scores.data(), output, NUM_HEATMAPS / MAP_AREA, 1);
+	format_tensor(arena.short_offsets.data(), output + NUM_HEATMAPS, NUM_SHORT_OFFSETS / MAP_AREA, STRIDE);
+	format_tensor(arena.mid_offsets.data(), output + NUM_HEATMAPS + NUM_SHORT_OFFSETS, NUM_MID_OFFSETS / MAP_AREA,
+				  STRIDE);
+
+	const float min_score_logit = log_odds(threshold_);
+	const std::vector<float> &scores = arena.scores;
+	const std::vector<float> &short_offsets = arena.short_offsets;
+	const std::vector<float> &mid_offsets = arena.mid_offsets;
+
+	KeypointQueue &queue = arena.root_queue;
+	build_keypoint_queue(queue, scores, short_offsets, min_score_logit);
+
+	std::array<int, NUM_KEYPOINTS> indices;
+
+	// Generate at most max_detections object instances per image in decreasing
+	// root part score order.
+	std::vector<float> &all_instance_scores = arena.instance_scores;
+	all_instance_scores.clear();
+
+	std::vector<PoseKeypoints> &scratch_poses = arena.poses;
+	std::vector<PoseKeypointScores> &scratch_keypoint_scores = arena.keypoint_scores;
+
+	unsigned int pose_counter = 0;
+	while (pose_counter < max_detections_ && !queue.empty())
+	{
+		// The top element in the queue is the next root candidate.
+		const KeypointWithScore root = queue.top();
+		queue.pop();
+
+		// Reject a root candidate if it is within a disk of nms_radius_ pixels
+		// from the corresponding part of a previously detected instance.
+		if (!pass_keypoint_nms(scratch_poses, pose_counter, root, nms_radius_ * nms_radius_))
+			continue;
+
+		auto &next_pose = scratch_poses[pose_counter];
+		auto &next_scores = scratch_keypoint_scores[pose_counter];
+		for (unsigned int k = 0; k < NUM_KEYPOINTS; ++k)
+		{
+			next_pose[k].x = -1.0f;
+			next_pose[k].y = -1.0f;
+			next_scores[k] = -1E5;
+		}
+
+		backtrack_decode_pose(arena.decode_queue, scores, short_offsets, mid_offsets, root, ADJACENCY_LIST,
+							  next_pose, next_scores, offset_refinement_steps_);
+
+		// Convert keypoint-level scores from log-odds to probabilities and compute
+		// an initial instance-level score as the average of the scores of the top-k
+		// scoring keypoints.
+		for (unsigned int k = 0; k < NUM_KEYPOINTS; ++k)
+			next_scores[k] = sigmoid(next_scores[k]);
+
+		decreasing_arg_sort(indices, next_scores);
+
+		float instance_score = 0.0f;
+		for (unsigned int j = 0; j < NUM_KEYPOINTS; ++j)
+			instance_score += next_scores[indices[j]];
+
+		instance_score /= NUM_KEYPOINTS;
+
+		if (instance_score >= threshold_)
+		{
+			pose_counter++;
+			all_instance_scores.push_back(instance_score);
+		}
+	}
+
+	// Sort the detections in decreasing order of their instance-level scores.
+	std::vector<int> &decreasing_indices = arena.decreasing_indices;
+	decreasing_arg_sort(decreasing_indices, all_instance_scores);
+
+	// Keypoint-level soft non-maximum suppression and instance-level rescoring as
+	// the average of the top-k keypoints in terms of their keypoint-level scores.
+	perform_soft_keypoint_NMS(all_instance_scores, decreasing_indices, scratch_poses, scratch_keypoint_scores,
+							  nms_radius_ * nms_radius_);
+
+	// Sort the detections in decreasing order of their final instance-level
+	// scores. Usually the order does not change but this is not guaranteed.
+	decreasing_arg_sort(decreasing_indices, all_instance_scores);
+
+	std::vector<PoseResults> results;
+	results.reserve(decreasing_indices.size());
+	for (int index : decreasing_indices)
+	{
+		if (all_instance_scores[index] < threshold_)
+			break;
+
+		// New result.
+		results.push_back({});
+
+		// Rescale keypoint coordinates into pixel space (much more useful for user).
+		for (unsigned int k = 0; k < NUM_KEYPOINTS; ++k)
+		{
+			results.back().pose_keypoints[k].y = scratch_poses[index][k].y * STRIDE;
+			results.back().pose_keypoints[k].x = scratch_poses[index][k].x * STRIDE;
+		}
+
+		std::copy(scratch_keypoint_scores[index].begin(), scratch_keypoint_scores[index].end(),
+				  results.back().pose_keypoint_scores.begin());
+		results.back().pose_score = all_instance_scores[index];
+	}
+
+	return results;
+}
@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * imx500_posenet_decoder.hpp - decode PoseNet output tensors into poses
+ */
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+// Turns the output tensor of the IMX500 PoseNet model into poses, following PersonLab
+// (https://arxiv.org/abs/1803.08225). The tensor holds a score map, short offsets and mid offsets, each
+// laid out as [channel][x][y] over the 31x23 output map.
+//
+// Everything the decoder works in is allocated in Configure() and reused for every frame, so Decode()
+// doesn't allocate beyond its results. It isn't thread safe, so callers must take turns.
+class PoseNetDecoder
+{
+public:
+	static constexpr unsigned int NUM_KEYPOINTS = 17;
+	// The output map is this many input tensor pixels apart.
+	static constexpr unsigned int STRIDE = 16;
+	// How many floats the output tensor must hold.
+	static constexpr unsigned int OUTPUT_SIZE = (NUM_KEYPOINTS + 2 * NUM_KEYPOINTS + 64) * 31 * 23;
+
+	struct Point
+	{
+		float y, x;
+	};
+
+	using PoseKeypoints = std::array<Point, NUM_KEYPOINTS>;
+	using PoseKeypointScores = std::array<float, NUM_KEYPOINTS>;
+
+	struct PoseResults
+	{
+		float pose_score;
+		PoseKeypoints pose_keypoints;
+		PoseKeypointScores pose_keypoint_scores;
+	};
+
+	PoseNetDecoder();
+	~PoseNetDecoder();
+
+	// Find at most max_detections poses, each scoring at least threshold. A pose whose root is within
+	// nms_radius (in input tensor pixels) of the same keypoint of a better pose is dropped.
+	void Configure(unsigned int max_detections, float threshold, unsigned int offset_refinement_steps,
+				   float nms_radius);
+
+	// Decode an output tensor of OUTPUT_SIZE floats. The poses come back most confident first, with their
+	// keypoints in input tensor pixels.
+	std::vector<PoseResults> Decode(const float *output);
+
+private:
+	struct Arena;
+	std::unique_ptr<Arena> arena_;
+
+	unsigned int max_detections_;
+	float threshold_;
+	unsigned int offset_refinement_steps_;
+	// In output map units.
+	float nms_radius_;
+};
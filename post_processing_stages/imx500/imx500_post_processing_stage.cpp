@@ -6,6 +6,7 @@
  */
 #include <chrono>
 #include <cmath>
+#include <cstring>
 #include <fcntl.h>
 #include <filesystem>
 #include <linux/videodev2.h>
@@ -32,59 +33,31 @@ namespace fs = std::filesystem;
 namespace
 {
 
-const unsigned int ROI_CTRL_ID = 0x00982900;
 const unsigned int NETWORK_FW_CTRL_ID = 0x00982901;
 
-inline int16_t conv_reg_signed(int16_t reg)
-{
-	constexpr unsigned int ROT_DNN_NORM_SIGNED_SHT = 8;
-	constexpr unsigned int ROT_DNN_NORM_MASK = 0x01FF;
-
-	if (!((reg >> ROT_DNN_NORM_SIGNED_SHT) & 1))
-		return reg;
-	else
-		return -((~reg + 1) & ROT_DNN_NORM_MASK);
-}
-
 } // namespace
 
 
 IMX500PostProcessingStage::IMX500PostProcessingStage(RPiCamApp *app)
 	: PostProcessingStage(app), device_fd_(-1)
 {
-	for (unsigned int i = 0; i < 16; i++)
+	const int subdev = NetworkState::FindDevice("/sys", device_id_);
+	if (subdev >= 0)
 	{
-		const fs::path test_dir { "/sys/class/video4linux/v4l-subdev" + std::to_string(i) + "/device" };
-		const fs::path module_dir { test_dir.string() + "/driver/module" };
-		const fs::path id_dir { test_dir.string() + "/of_node" };
+		const std::string dev_node { "/dev/v4l-subdev" + std::to_string(subdev) };
+		device_fd_ = open(dev_node.c_str(), O_RDONLY, 0);
 
-		if (fs::exists(module_dir) && fs::is_symlink(module_dir))
-		{
-			fs::path ln = fs::read_symlink(module_dir);
-			if (ln.string().find("imx500") != std::string::npos)
-			{
-				const std::string dev_node { "/dev/v4l-subdev" + std::to_string(i) };
-				device_fd_ = open(dev_node.c_str(), O_RDONLY, 0);
+		/* Find the progress indicator sysfs dev nodes. */
+		std::string spi_device_id = device_id_;
+		const std::size_t rep = spi_device_id.find("001a");
+		if (rep != std::string::npos)
+			spi_device_id.replace(rep, 4, "0040");
 
-				/* Find the progress indicator sysfs dev nodes. */
-				const std::string test_dir_str = fs::read_symlink(test_dir).string();
-				const std::size_t pos = test_dir_str.find_last_of("/") + 1;
-				assert(pos != std::string::npos);
+		const fs::path imx500_progress { "/sys/kernel/debug/imx500-fw:" + device_id_ + "/fw_progress" };
+		const fs::path spi_progress { "/sys/kernel/debug/rp2040-spi:" + spi_device_id + "/transfer_progress" };
 
-				const std::string imx500_device_id = test_dir_str.substr(pos);
-				std::string spi_device_id = imx500_device_id;
-				const std::size_t rep = spi_device_id.find("001a");
-				spi_device_id.replace(rep, 4, "0040");
-
-				const fs::path imx500_progress { "/sys/kernel/debug/imx500-fw:" + imx500_device_id + "/fw_progress" };
-				const fs::path spi_progress { "/sys/kernel/debug/rp2040-spi:" + spi_device_id + "/transfer_progress" };
-
-				fw_progress_.open(imx500_progress.c_str(), std::ios_base::in);
-				fw_progress_chunk_.open(spi_progress.c_str(), std::ios_base::in);
-
-				break;
-			}
-		}
+		fw_progress_.open(imx500_progress.c_str(), std::ios_base::in);
+		fw_progress_chunk_.open(spi_progress.c_str(), std::ios_base::in);
 	}
 
 	if (device_fd_ < 0)
@@ -102,24 +75,41 @@ IMX500PostProcessingStage::~IMX500PostProcessingStage()
 void IMX500PostProcessingStage::Read(boost::property_tree::ptree const &params)
 {
 	if (params.find("save_input_tensor") != params.not_found())
-	{
-		auto const &pt = params.get_child("save_input_tensor");
-
-		std::string filename = pt.get<std::string>("filename");
-		num_input_tensors_saved_ = pt.get<unsigned int>("num_tensors", 1);
-		input_tensor_file_ = std::ofstream(filename, std::ios::out | std::ios::binary);
+		input_tensor_writer_ = std::make_unique<InputTensorWriter>(params.get_child("save_input_tensor"));
 
-		norm_val_ = PostProcessingStage::GetJsonArray<int32_t>(pt, "norm_val", { 0, 0, 0, 0 });
-		norm_shift_ = PostProcessingStage::GetJsonArray<uint8_t>(pt, "norm_shift", { 0, 0, 0, 0 });
-		div_val_ = PostProcessingStage::GetJsonArray<int16_t>(pt, "div_val", { 1, 1, 1, 1 });
-		div_shift_ = pt.get<unsigned int>("div_shift", 0);
-	}
+	if (params.find("dynamic_roi") != params.not_found())
+		roi_controller_ = std::make_unique<InferenceRoiController>(
+			params.get_child("dynamic_roi"), full_sensor_resolution_,
+			[this](const Rectangle &roi) { return SetInferenceRoiAbs(roi); });
+	else
+		roi_controller_.reset();
 
-	/* Load the network firmware. */
+	/* Load the network firmware, unless it's there already. */
 	std::string network_file = params.get<std::string>("network_file");
 	if (!fs::exists(network_file))
 		throw std::runtime_error(network_file + " not found!");
 
+	const std::string state_file = params.get<std::string>("network_state_file", NetworkState::DefaultFile(device_id_));
+	if (state_file.empty())
+	{
+		LOG(1, "IMX500: nowhere safe to remember the loaded network, so it will always be loaded");
+		network_state_.reset();
+	}
+	else
+		network_state_ = std::make_unique<NetworkState>(state_file);
+	network_file_ = network_file;
+	network_hash_ = NetworkState::Hash(network_file);
+	network_recorded_ = false;
+	network_already_loaded_ =
+		network_state_ && !params.get<int>("force_network_load", 0) && network_state_->Matches(network_hash_);
+	if (network_already_loaded_)
+	{
+		LOG(1, "IMX500: " << network_file << " is already loaded");
+		return;
+	}
+	if (network_state_)
+		network_state_->Invalidate();
+
 	int fd = open(network_file.c_str(), O_RDONLY, 0);
 
 	v4l2_control ctrl { NETWORK_FW_CTRL_ID, fd };
@@ -138,36 +128,51 @@ void IMX500PostProcessingStage::Configure()
 {
 	output_stream_ = app_->GetMainStream();
 	raw_stream_ = app_->RawStream();
-	save_frames_ = num_input_tensors_saved_;
+
+	// Frame numbers start again, so the controller has to as well, looking at the whole sensor.
+	if (roi_controller_)
+		roi_controller_->Reset();
 }
 
 bool IMX500PostProcessingStage::Process(CompletedRequestPtr &completed_request)
 {
+	// Output from the network means the firmware is loaded, and can be skipped next time.
+	if (network_state_ && !network_recorded_ && completed_request->metadata.get(controls::rpi::CnnOutputTensor) &&
+		!network_recorded_.exchange(true))
+		network_state_->Record(network_hash_, network_file_);
+
 	auto input = completed_request->metadata.get(controls::rpi::CnnInputTensor);
 
-	if (input && input_tensor_file_.is_open())
+	if (input && input_tensor_writer_)
 	{
-		// There is a chance that this may be called through multiple threads, so serialize the file access.
-		std::scoped_lock<std::mutex> l(lock_);
-
-		for (unsigned int i = 0; i < input->size(); i++)
-		{
-			const unsigned int channel = i % 3; // Assume RGB interleaved format.
-			int16_t sample = static_cast<int8_t>(input->data()[i]);
-			sample = (sample << norm_shift_[channel]) - conv_reg_signed(norm_val_[channel]);
-			sample = ((sample << div_shift_) / div_val_[channel]) & 0xFF;
-			input_tensor_file_.put(static_cast<uint8_t>(sample));
-		}
-
-		if (--save_frames_ == 0)
-			input_tensor_file_.close();
+		// The shape is only needed to save the tensor as an image or array, not as raw bytes.
+		CnnInputTensorInfo info {};
+		auto input_info = completed_request->metadata.get(controls::rpi::CnnInputTensorInfo);
+		if (input_info && input_info->size() == sizeof(info))
+			memcpy(&info, input_info->data(), sizeof(info));
+		info.network_name[Network_Name_Len - 1] = '\0';
+
+		input_tensor_writer_->Write(input->data(), input->size(), completed_request->sequence, info.width,
+									info.height, info.num_channels, info.network_name);
 	}
 
 	return false;
 }
 
+Rectangle IMX500PostProcessingStage::inferenceToSensor(const std::vector<float> &coords, const Rectangle &roi) const
+{
+	// The network saw the inference ROI, so that's what its co-ordinates are relative to.
+	Rectangle obj;
+	obj.x = roi.x + std::round(coords[0] * (roi.width - 1));
+	obj.y = roi.y + std::round(coords[1] * (roi.height - 1));
+	obj.width = std::round(coords[2] * (roi.width - 1));
+	obj.height = std::round(coords[3] * (roi.height - 1));
+	return obj;
+}
+
 Rectangle IMX500PostProcessingStage::ConvertInferenceCoordinates(const std::vector<float> &coords,
-																 const Rectangle &scaler_crop) const
+																 const Rectangle &scaler_crop,
+																 const Rectangle &inference_roi) const
 {
 	// Convert the inference image co-ordinates into the final ISP output co-ordinates.
 	const Size &isp_output_size = output_stream_->configuration().size;
@@ -178,11 +183,7 @@ Rectangle IMX500PostProcessingStage::ConvertInferenceCoordinates(const std::vect
 		return {};
 
 	// Object scaled to the full sensor resolution
-	Rectangle obj;
-	obj.x = std::round(coords[0] * (full_sensor_resolution_.width - 1));
-	obj.y = std::round(coords[1] * (full_sensor_resolution_.height - 1));
-	obj.width = std::round(coords[2] * (full_sensor_resolution_.width - 1));
-	obj.height = std::round(coords[3] * (full_sensor_resolution_.height - 1));
+	const Rectangle obj = inferenceToSensor(coords, inference_roi);
 
 	// Object on inference image -> sensor image
 	const Rectangle obj_sensor = obj.scaledBy(sensor_output_size, full_sensor_resolution_.size());
@@ -199,23 +200,46 @@ Rectangle IMX500PostProcessingStage::ConvertInferenceCoordinates(const std::vect
 	return obj_scaled;
 }
 
-void IMX500PostProcessingStage::SetInferenceRoiAbs(const Rectangle &roi_) const
+bool IMX500PostProcessingStage::SetInferenceRoiAbs(const Rectangle &roi_) const
 {
 	Rectangle roi = roi_.boundedTo(full_sensor_resolution_);
-	const uint32_t roi_array[4] = { (uint32_t)roi.x, (uint32_t)roi.y, (uint32_t)roi.width, (uint32_t)roi.height };
+	if (!WriteInferenceRoi(device_fd_, roi))
+	{
+		LOG_ERROR("IMX500: Unable to set absolute ROI");
+		return false;
+	}
+	return true;
+}
 
-	v4l2_ext_control roi_ctrl;
-	roi_ctrl.id = ROI_CTRL_ID;
-	roi_ctrl.p_u32 = (unsigned int *)&roi_array;
-	roi_ctrl.size = 16;
+int64_t IMX500PostProcessingStage::frameTime(CompletedRequestPtr const &completed_request)
+{
+	auto ts = completed_request->metadata.get(controls::SensorTimestamp);
+	return ts ? *ts : completed_request->buffers.begin()->second->metadata().timestamp;
+}
 
-	v4l2_ext_controls ctrls;
-	ctrls.count = 1;
-	ctrls.controls = (v4l2_ext_control *)&roi_ctrl;
+Rectangle IMX500PostProcessingStage::InferenceRoi(CompletedRequestPtr const &completed_request) const
+{
+	return roi_controller_ ? roi_controller_->RoiForFrame(frameTime(completed_request)) : full_sensor_resolution_;
+}
 
-	int ret = ioctl(device_fd_, VIDIOC_S_EXT_CTRLS, &ctrls);
-	if (ret)
-		LOG_ERROR("IMX500: Unable to set absolute ROI");
+void IMX500PostProcessingStage::UpdateInferenceRoi(CompletedRequestPtr const &completed_request,
+												   const std::vector<std::vector<float>> &detections)
+{
+	if (!roi_controller_)
+		return;
+
+	const unsigned int sequence = completed_request->sequence;
+	const Rectangle current = InferenceRoi(completed_request);
+	std::vector<Rectangle> boxes;
+	for (auto const &coords : detections)
+	{
+		if (coords.size() == 4)
+			boxes.push_back(inferenceToSensor(coords, current));
+	}
+
+	Rectangle roi;
+	if (roi_controller_->Update(sequence, boxes, roi))
+		LOG(2, "IMX500: frame " << sequence << " inference ROI " << roi);
 }
 
 void IMX500PostProcessingStage::SetInferenceRoiAuto(const unsigned int width, const unsigned int height) const
@@ -227,6 +251,9 @@ void IMX500PostProcessingStage::SetInferenceRoiAuto(const unsigned int width, co
 
 void IMX500PostProcessingStage::ShowFwProgressBar()
 {
+	if (network_already_loaded_)
+		return;
+
 	if (fw_progress_.is_open() && fw_progress_chunk_.is_open())
 	{
 		std::thread progress_thread { &IMX500PostProcessingStage::doProgressBar, this };
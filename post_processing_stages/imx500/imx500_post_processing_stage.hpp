@@ -7,8 +7,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <fstream>
-#include <mutex>
+#include <memory>
 
 #include <boost/property_tree/ptree.hpp>
 
@@ -19,6 +20,10 @@
 #include "core/rpicam_app.hpp"
 #include "post_processing_stages/post_processing_stage.hpp"
 
+#include "imx500_input_tensor_writer.hpp"
+#include "imx500_network_state.hpp"
+#include "imx500_roi_controller.hpp"
+
 class IMX500PostProcessingStage : public PostProcessingStage
 {
 public:
@@ -40,6 +45,14 @@ public:
 		OutputTensorInfo info[Max_Num_Tensors];
 	};
 
+	struct CnnInputTensorInfo
+	{
+		char network_name[Network_Name_Len];
+		uint32_t width;
+		uint32_t height;
+		uint32_t num_channels;
+	};
+
 	IMX500PostProcessingStage(RPiCamApp *app);
 	~IMX500PostProcessingStage();
 
@@ -49,10 +62,20 @@ public:
 
 	bool Process(CompletedRequestPtr &completed_request) override;
 
+	// Convert the normalised { x, y, width, height } from the network, computed on the given inference ROI, to
+	// the final ISP output co-ordinates.
 	libcamera::Rectangle ConvertInferenceCoordinates(const std::vector<float> &coords,
-													 const libcamera::Rectangle &scalerCrop) const;
-	void SetInferenceRoiAbs(const libcamera::Rectangle &roi_) const;
+													 const libcamera::Rectangle &scalerCrop,
+													 const libcamera::Rectangle &inferenceRoi) const;
+	bool SetInferenceRoiAbs(const libcamera::Rectangle &roi_) const;
 	void SetInferenceRoiAuto(const unsigned int width, const unsigned int height) const;
+	// The inference ROI that the network's results for this frame were computed on, going by when the frame
+	// started.
+	libcamera::Rectangle InferenceRoi(CompletedRequestPtr const &completed_request) const;
+	// Report the normalised { x, y, width, height } of everything found on a frame, so that the "dynamic_roi"
+	// controller, if there is one, can steer the inference ROI towards it.
+	void UpdateInferenceRoi(CompletedRequestPtr const &completed_request,
+							const std::vector<std::vector<float>> &detections);
 	void ShowFwProgressBar();
 
 protected:
@@ -61,18 +84,23 @@ protected:
 	libcamera::Stream *raw_stream_;
 
 private:
+	// When the frame started, in the clock the ROI controller uses.
+	static int64_t frameTime(CompletedRequestPtr const &completed_request);
 	void doProgressBar();
+	libcamera::Rectangle inferenceToSensor(const std::vector<float> &coords, const libcamera::Rectangle &roi) const;
 
 	int device_fd_;
+	std::string device_id_;
 	std::ifstream fw_progress_;
 	std::ifstream fw_progress_chunk_;
 
-	std::ofstream input_tensor_file_;
-	unsigned int num_input_tensors_saved_;
-	unsigned int save_frames_;
-	std::vector<int32_t> norm_val_;
-	std::vector<uint8_t> norm_shift_;
-	std::vector<int16_t> div_val_;
-	unsigned int div_shift_;
-	std::mutex lock_;
+	std::unique_ptr<InputTensorWriter> input_tensor_writer_;
+	std::unique_ptr<InferenceRoiController> roi_controller_;
+
+	std::unique_ptr<NetworkState> network_state_;
+	std::string network_file_;
+	uint64_t network_hash_;
+	bool network_already_loaded_ = false;
+	// Set once the network has been seen running, and so recorded as loaded.
+	std::atomic<bool> network_recorded_ = false;
 };
@@ -0,0 +1,269 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * imx500_roi_controller.cpp - steer the IMX500 inference ROI towards detections
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include <linux/videodev2.h>
+#include <sys/ioctl.h>
+
+#include "imx500_roi_controller.hpp"
+
+using Rectangle = libcamera::Rectangle;
+
+namespace
+{
+
+const unsigned int ROI_CTRL_ID = 0x00982900;
+
+// We only need to remember the ROIs of frames whose results may still be on their way.
+constexpr unsigned int MAX_HISTORY = 16;
+
+// The fewest frames worth looking round for: one or two for the new ROI to take effect, and one to see through it.
+constexpr unsigned int MIN_REACQUIRE_FRAMES = 3;
+
+} // namespace
+
+InferenceRoiController::InferenceRoiController(boost::property_tree::ptree const &params,
+											   const Rectangle &full_sensor, Writer writer, Clock clock)
+	: writer_(std::move(writer)), clock_(std::move(clock))
+{
+	full_ = { (float)full_sensor.x, (float)full_sensor.y, (float)(full_sensor.x + (int)full_sensor.width),
+			  (float)(full_sensor.y + (int)full_sensor.height) };
+
+	margin_ = params.get<float>("margin", 0.25);
+	min_size_ = params.get<float>("min_size", 0.25);
+	smoothing_ = params.get<float>("smoothing", 0.3);
+	max_step_ = params.get<float>("max_step", 0.05);
+	hysteresis_ = params.get<float>("hysteresis", 0.1);
+	history_frames_ = std::max(params.get<unsigned int>("history_frames", 15), 1u);
+	reacquire_interval_ = params.get<unsigned int>("reacquire_interval", 300);
+	// There's no point looking round unless we stay out long enough to see the results.
+	reacquire_frames_ = std::max(params.get<unsigned int>("reacquire_frames", 5), MIN_REACQUIRE_FRAMES);
+
+	if (min_size_ <= 0 || min_size_ > 1)
+		throw std::runtime_error("InferenceRoiController: min_size must be in (0, 1]");
+	if (smoothing_ <= 0 || smoothing_ > 1)
+		throw std::runtime_error("InferenceRoiController: smoothing must be in (0, 1]");
+	if (max_step_ <= 0 || margin_ < 0 || hysteresis_ < 0)
+		throw std::runtime_error("InferenceRoiController: max_step must be positive, margin and hysteresis not "
+								 "negative");
+
+	Reset();
+}
+
+void InferenceRoiController::Reset()
+{
+	std::scoped_lock<std::mutex> l(mutex_);
+	current_ = full_;
+	recent_.clear();
+	history_.clear();
+	// Whatever happened before, the full sensor is the best guess for frames from before we set anything.
+	history_.emplace_back(std::numeric_limits<int64_t>::min(), toRectangle(full_));
+	apply(full_);
+	last_sequence_ = 0;
+	last_reacquire_ = 0;
+	reacquiring_ = false;
+	moving_ = false;
+}
+
+bool InferenceRoiController::Update(unsigned int sequence, const std::vector<Rectangle> &detections, Rectangle &roi)
+{
+	std::scoped_lock<std::mutex> l(mutex_);
+
+	// Results can arrive out of order, and we only steer by the latest.
+	if (sequence < last_sequence_)
+		return false;
+	last_sequence_ = sequence;
+
+	if (!detections.empty())
+	{
+		Box u { full_.x1, full_.y1, full_.x0, full_.y0 };
+		for (auto const &d : detections)
+		{
+			u.x0 = std::min(u.x0, (float)d.x);
+			u.y0 = std::min(u.y0, (float)d.y);
+			u.x1 = std::max(u.x1, (float)(d.x + (int)d.width));
+			u.y1 = std::max(u.y1, (float)(d.y + (int)d.height));
+		}
+		recent_.emplace_back(sequence, u);
+	}
+	while (!recent_.empty() && sequence - recent_.front().first >= history_frames_)
+		recent_.pop_front();
+
+	if (reacquiring_)
+	{
+		if (sequence < reacquire_end_)
+			return false;
+		// Go back to where we were. Anything new that was found meanwhile will pull us out from there.
+		if (!apply(resume_))
+			return false;
+		reacquiring_ = false;
+		moving_ = false;
+		roi = toRectangle(current_);
+		return true;
+	}
+
+	const bool zoomed = toRectangle(current_) != toRectangle(full_);
+	if (!zoomed)
+		last_reacquire_ = sequence;
+	else if (reacquire_interval_ && sequence - last_reacquire_ >= reacquire_interval_)
+	{
+		const Box resume = current_;
+		if (!apply(full_))
+			return false;
+		last_reacquire_ = sequence;
+		reacquire_end_ = sequence + reacquire_frames_;
+		reacquiring_ = true;
+		resume_ = resume;
+		roi = toRectangle(current_);
+		return true;
+	}
+
+	// Don't start moving unless some edge is out by a good fraction of the ROI's size, but once moving, keep going
+	// until we get there, snapping to the target for the last little bit.
+	const Box t = target();
+	const float w = current_.x1 - current_.x0, h = current_.y1 - current_.y0;
+	auto within = [&t, this](float dx, float dy) {
+		return std::abs(t.x0 - current_.x0) <= dx && std::abs(t.x1 - current_.x1) <= dx &&
+			   std::abs(t.y0 - current_.y0) <= dy && std::abs(t.y1 - current_.y1) <= dy;
+	};
+	if (!moving_ && within(hysteresis_ * w, hysteresis_ * h))
+		return false;
+
+	const bool moving = !within(hysteresis_ * w / 4, hysteresis_ * h / 4);
+	const Box next = moving ? step(t) : t;
+	if (toRectangle(next) == toRectangle(current_))
+	{
+		current_ = next;
+		moving_ = moving;
+		return false;
+	}
+
+	// If the device didn't take it, we'll try again with the next results.
+	if (!apply(next))
+		return false;
+	moving_ = moving;
+	roi = toRectangle(current_);
+	return true;
+}
+
+Rectangle InferenceRoiController::RoiForFrame(int64_t frame_time) const
+{
+	// The sensor picks up a new ROI at the start of a frame, so it's the last one written before the frame began.
+	std::scoped_lock<std::mutex> l(mutex_);
+	for (auto it = history_.rbegin(); it != history_.rend(); ++it)
+	{
+		if (it->first < frame_time)
+			return it->second;
+	}
+	return history_.front().second;
+}
+
+int64_t InferenceRoiController::MonotonicTime()
+{
+	// steady_clock is CLOCK_MONOTONIC, which the kernel uses to timestamp frames.
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+
+InferenceRoiController::Box InferenceRoiController::target() const
+{
+	if (recent_.empty())
+		return full_;
+
+	Box u = recent_.front().second;
+	for (auto const &[sequence, box] : recent_)
+	{
+		u.x0 = std::min(u.x0, box.x0);
+		u.y0 = std::min(u.y0, box.y0);
+		u.x1 = std::max(u.x1, box.x1);
+		u.y1 = std::max(u.y1, box.y1);
+	}
+
+	const float mx = margin_ * (u.x1 - u.x0), my = margin_ * (u.y1 - u.y0);
+	return fit({ u.x0 - mx, u.y0 - my, u.x1 + mx, u.y1 + my });
+}
+
+InferenceRoiController::Box InferenceRoiController::fit(Box box) const
+{
+	// Keep the sensor's aspect ratio, so the network's view is never stretched, and no smaller than min_size.
+	const float full_width = full_.x1 - full_.x0, full_height = full_.y1 - full_.y0;
+	const float aspect = full_width / full_height;
+	float width = std::max(box.x1 - box.x0, min_size_ * full_width);
+	float height = std::max(box.y1 - box.y0, min_size_ * full_height);
+	if (width < height * aspect)
+		width = height * aspect;
+	else
+		height = width / aspect;
+	width = std::min(width, full_width);
+	height = std::min(height, full_height);
+
+	// Slide it back inside the sensor rather than cropping it.
+	const float cx = (box.x0 + box.x1) / 2, cy = (box.y0 + box.y1) / 2;
+	const float x0 = std::clamp(cx - width / 2, full_.x0, full_.x1 - width);
+	const float y0 = std::clamp(cy - height / 2, full_.y0, full_.y1 - height);
+	return { x0, y0, x0 + width, y0 + height };
+}
+
+InferenceRoiController::Box InferenceRoiController::step(const Box &target) const
+{
+	// Move the centre and the size a fraction of the way there, limited to max_step of the sensor each frame.
+	const float limit_x = max_step_ * (full_.x1 - full_.x0), limit_y = max_step_ * (full_.y1 - full_.y0);
+	auto move = [this](float from, float to, float limit) {
+		return from + std::clamp(smoothing_ * (to - from), -limit, limit);
+	};
+
+	const float cx = move((current_.x0 + current_.x1) / 2, (target.x0 + target.x1) / 2, limit_x);
+	const float cy = move((current_.y0 + current_.y1) / 2, (target.y0 + target.y1) / 2, limit_y);
+	const float width = move(current_.x1 - current_.x0, target.x1 - target.x0, limit_x);
+	const float height = move(current_.y1 - current_.y0, target.y1 - target.y0, limit_y);
+	return fit({ cx - width / 2, cy - height / 2, cx + width / 2, cy + height / 2 });
+}
+
+Rectangle InferenceRoiController::toRectangle(const Box &box) const
+{
+	// The sensor wants even co-ordinates.
+	auto even = [](float v) { return 2 * (int)std::lround(v / 2); };
+	const int x0 = even(box.x0), y0 = even(box.y0);
+	const int x1 = std::min(even(box.x1), (int)full_.x1), y1 = std::min(even(box.y1), (int)full_.y1);
+	return Rectangle(x0, y0, x1 - x0, y1 - y0);
+}
+
+bool InferenceRoiController::apply(const Box &box)
+{
+	const Rectangle roi = toRectangle(box);
+	if (!writer_(roi))
+		return false;
+
+	// Only frames that start after the write has finished can use the new ROI.
+	current_ = box;
+	history_.emplace_back(clock_(), roi);
+	if (history_.size() > MAX_HISTORY)
+		history_.pop_front();
+	return true;
+}
+
+bool WriteInferenceRoi(int fd, const Rectangle &roi, IoctlFunc const &ioctl_func)
+{
+	uint32_t roi_array[4] = { (uint32_t)roi.x, (uint32_t)roi.y, (uint32_t)roi.width, (uint32_t)roi.height };
+
+	v4l2_ext_control roi_ctrl = {};
+	roi_ctrl.id = ROI_CTRL_ID;
+	roi_ctrl.p_u32 = roi_array;
+	roi_ctrl.size = sizeof(roi_array);
+
+	v4l2_ext_controls ctrls = {};
+	ctrls.count = 1;
+	ctrls.controls = &roi_ctrl;
+
+	int ret = ioctl_func ? ioctl_func(fd, VIDIOC_S_EXT_CTRLS, &ctrls) : ioctl(fd, VIDIOC_S_EXT_CTRLS, &ctrls);
+	return ret == 0;
+}
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * imx500_roi_controller.hpp - steer the IMX500 inference ROI towards detections
+ */
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <libcamera/geometry.h>
+
+// Decides where the IMX500 should look. The network only ever sees the inference ROI scaled down to its input
+// size, so small subjects are easier to find when the ROI is zoomed in around them. The controller keeps the
+// union of the last few frames' detections and moves the ROI towards it (with a margin), a fraction of the way
+// each frame and never more than a set step, and ignores changes too small to matter. With nothing detected
+// it drifts back out to the full sensor, and every so often it jumps out to the full sensor for a few frames to
+// find anything new, then goes back to where it was.
+//
+// Everything here is in full sensor resolution co-ordinates. The controller sets the ROI through the writer it
+// is given, and notes the time each one was written. A frame that started after that was computed on the new ROI,
+// so RoiForFrame() can say which ROI a frame's results belong to from its timestamp, however long the device
+// takes to report them.
+class InferenceRoiController
+{
+public:
+	// Write an ROI to the device, returning false if it couldn't.
+	typedef std::function<bool(const libcamera::Rectangle &roi)> Writer;
+	// The time now, in nanoseconds on the same clock as the frame timestamps.
+	typedef std::function<int64_t()> Clock;
+
+	InferenceRoiController(boost::property_tree::ptree const &params, const libcamera::Rectangle &full_sensor,
+						   Writer writer, Clock clock = MonotonicTime);
+
+	// Forget everything and go back to the full sensor, for when the camera restarts and frame numbers with it.
+	void Reset();
+
+	// Report the detections from a frame. Returns true, with the new ROI, if it set one.
+	bool Update(unsigned int sequence, const std::vector<libcamera::Rectangle> &detections,
+				libcamera::Rectangle &roi);
+
+	// The ROI the network was looking through for the frame that started at this time.
+	libcamera::Rectangle RoiForFrame(int64_t frame_time) const;
+
+	// The clock that frame timestamps (SensorTimestamp) use.
+	static int64_t MonotonicTime();
+
+private:
+	struct Box
+	{
+		float x0, y0, x1, y1;
+	};
+
+	Box target() const;
+	Box fit(Box box) const;
+	Box step(const Box &target) const;
+	libcamera::Rectangle toRectangle(const Box &box) const;
+	bool apply(const Box &box);
+
+	Box full_;
+	float margin_;
+	float min_size_;
+	float smoothing_;
+	float max_step_;
+	float hysteresis_;
+	unsigned int history_frames_;
+	unsigned int reacquire_interval_;
+	unsigned int reacquire_frames_;
+	Writer writer_;
+	Clock clock_;
+
+	mutable std::mutex mutex_;
+	Box current_;
+	// Detections (their union, for each frame that had any), most recent last.
+	std::deque<std::pair<unsigned int, Box>> recent_;
+	// ROIs that have been set and when, most recent last.
+	std::deque<std::pair<int64_t, libcamera::Rectangle>> history_;
+	unsigned int last_sequence_ = 0;
+	unsigned int last_reacquire_ = 0;
+	unsigned int reacquire_end_ = 0;
+	bool reacquiring_ = false;
+	bool moving_ = false;
+	Box resume_;
+};
+
+// Write the inference ROI to the IMX500, which takes it as a V4L2 control of { x, y, width, height }. ioctl_func
+// stands in for ioctl(), for testing without the device. Returns false on failure.
+typedef std::function<int(int fd, unsigned long request, void *arg)> IoctlFunc;
+bool WriteInferenceRoi(int fd, const libcamera::Rectangle &roi, IoctlFunc const &ioctl_func = nullptr);
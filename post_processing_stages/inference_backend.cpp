@@ -0,0 +1,295 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * inference_backend.cpp - pluggable neural network inference backends
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+#include "inference_backend.hpp"
+
+size_t TensorInfo::Elements() const
+{
+	return std::accumulate(shape.begin(), shape.end(), (size_t)1, std::multiplies<size_t>());
+}
+
+size_t TensorInfo::Bytes() const
+{
+	switch (type)
+	{
+	case TensorType::UInt8:
+	case TensorType::Int8:
+		return Elements();
+	default:
+		return Elements() * 4;
+	}
+}
+
+std::string TensorInfo::ToString() const
+{
+	static const char *names[] = { "uint8", "int8", "int32", "float32" };
+	std::stringstream s;
+	s << name << ": " << names[(int)type] << " [";
+	for (unsigned int i = 0; i < shape.size(); i++)
+		s << (i ? "," : "") << shape[i];
+	s << "]";
+	if (type != TensorType::Float32)
+		s << " scale " << scale << " zero point " << zero_point;
+	return s.str();
+}
+
+template <typename T>
+static void dequantise(float *dst, const T *src, size_t n, float scale, int zero_point)
+{
+	for (size_t i = 0; i < n; i++)
+		dst[i] = scale * (src[i] - zero_point);
+}
+
+const float *Tensor::AsFloat(std::vector<float> &scratch) const
+{
+	if (info.type == TensorType::Float32)
+		return reinterpret_cast<const float *>(data.get());
+
+	const size_t n = info.Elements();
+	scratch.resize(n);
+	if (info.type == TensorType::UInt8)
+		dequantise(scratch.data(), data.get(), n, info.scale, info.zero_point);
+	else if (info.type == TensorType::Int8)
+		dequantise(scratch.data(), reinterpret_cast<const int8_t *>(data.get()), n, info.scale, info.zero_point);
+	else
+		dequantise(scratch.data(), reinterpret_cast<const int32_t *>(data.get()), n, info.scale, info.zero_point);
+	return scratch.data();
+}
+
+Tensor MakeTensor(TensorInfo const &info)
+{
+	// Round up so that float tensors are always safe to read as such.
+	const size_t size = (info.Bytes() + 3) & ~3;
+	return { info, std::shared_ptr<uint8_t>(new uint8_t[size](), std::default_delete<uint8_t[]>()) };
+}
+
+static std::map<std::string, BackendCreateFunc> &backends()
+{
+	static std::map<std::string, BackendCreateFunc> backends;
+	return backends;
+}
+
+RegisterInferenceBackend::RegisterInferenceBackend(char const *name, BackendCreateFunc create_func)
+{
+	backends()[std::string(name)] = create_func;
+}
+
+std::unique_ptr<InferenceBackend> CreateInferenceBackend(std::string const &name)
+{
+	auto it = backends().find(name);
+	if (it == backends().end())
+		return nullptr;
+	return std::unique_ptr<InferenceBackend>(it->second());
+}
+
+InferenceQueue::InferenceQueue(RunFunc run) : run_(std::move(run)), thread_(&InferenceQueue::thread, this)
+{
+}
+
+InferenceQueue::~InferenceQueue()
+{
+	{
+		std::scoped_lock<std::mutex> l(mutex_);
+		abort_ = true;
+		cond_.notify_all();
+	}
+	thread_.join();
+}
+
+int InferenceQueue::Submit(const uint8_t *input, size_t size)
+{
+	std::scoped_lock<std::mutex> l(mutex_);
+	int id = next_id_++ & 0x7fffffff;
+	jobs_[id].input.assign(input, input + size);
+	queue_.push_back(id);
+	cond_.notify_all();
+	return id;
+}
+
+InferenceStatus InferenceQueue::Poll(int job, std::vector<Tensor> &outputs, std::chrono::milliseconds timeout)
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	auto it = jobs_.find(job);
+	if (it == jobs_.end())
+		return InferenceStatus::Failed;
+
+	// The map never moves its elements, so the iterator stays good while we wait.
+	if (!cond_.wait_for(lock, timeout, [it] { return it->second.done; }))
+		return InferenceStatus::Pending;
+
+	bool ok = it->second.ok;
+	outputs = std::move(it->second.outputs);
+	jobs_.erase(it);
+	return ok ? InferenceStatus::Ok : InferenceStatus::Failed;
+}
+
+void InferenceQueue::thread()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	while (true)
+	{
+		cond_.wait(lock, [this] { return abort_ || !queue_.empty(); });
+		if (abort_)
+			break;
+
+		// Nobody else touches a job's input or outputs until it's done.
+		Job &job = jobs_[queue_.front()];
+		queue_.pop_front();
+		lock.unlock();
+
+		std::vector<Tensor> outputs;
+		bool ok = run_(job.input.data(), job.input.size(), outputs);
+
+		lock.lock();
+		job.outputs = std::move(outputs);
+		job.ok = ok;
+		job.done = true;
+		job.input = {};
+		cond_.notify_all();
+	}
+
+	// Anyone still waiting gets told their job failed.
+	for (auto &job : jobs_)
+		job.second.done = true;
+	cond_.notify_all();
+}
+
+namespace
+{
+
+// The mock backend runs no model, but replays output tensors recorded earlier (for
+// example with the object_detect stage's "record_file" parameter), one set per job, in
+// order, starting again from the beginning when they run out. Outputs without a file
+// are all zero. Results depend only on the order of the jobs, never on the input.
+class MockInferenceBackend : public InferenceBackend
+{
+public:
+	MockInferenceBackend()
+		: queue_([this](const uint8_t *input, [[maybe_unused]] size_t size, std::vector<Tensor> &outputs) {
+			  return run(input, outputs);
+		  })
+	{
+	}
+
+	void Load(boost::property_tree::ptree const &params) override;
+
+	std::vector<TensorInfo> const &Inputs() const override { return inputs_; }
+	std::vector<TensorInfo> const &Outputs() const override { return outputs_; }
+
+	int Submit([[maybe_unused]] unsigned int sequence, const uint8_t *input) override
+	{
+		return queue_.Submit(input, inputs_[0].Elements());
+	}
+
+	InferenceStatus Poll(int job, std::vector<Tensor> &outputs, std::chrono::milliseconds timeout) override
+	{
+		return queue_.Poll(job, outputs, timeout);
+	}
+
+private:
+	bool run(const uint8_t *input, std::vector<Tensor> &outputs);
+
+	std::vector<TensorInfo> inputs_;
+	std::vector<TensorInfo> outputs_;
+	// Every recorded set of each output, one after another.
+	std::vector<std::vector<uint8_t>> recordings_;
+	unsigned int next_ = 0;
+	std::chrono::milliseconds latency_;
+	InferenceQueue queue_;
+};
+
+TensorType tensor_type(std::string const &name)
+{
+	if (name == "uint8")
+		return TensorType::UInt8;
+	else if (name == "int8")
+		return TensorType::Int8;
+	else if (name == "int32")
+		return TensorType::Int32;
+	else if (name == "float32")
+		return TensorType::Float32;
+	throw std::runtime_error("MockInferenceBackend: unknown tensor type " + name);
+}
+
+void MockInferenceBackend::Load(boost::property_tree::ptree const &params)
+{
+	TensorInfo input;
+	input.name = "input";
+	input.type = TensorType::UInt8;
+	input.shape = { 1, params.get<unsigned int>("input.height", 300), params.get<unsigned int>("input.width", 300), 3 };
+	inputs_ = { input };
+	latency_ = std::chrono::milliseconds(params.get<unsigned int>("latency_ms", 0));
+
+	outputs_.clear();
+	recordings_.clear();
+	for (auto const &[key, output_params] : params.get_child("outputs"))
+	{
+		TensorInfo info;
+		info.name = output_params.get<std::string>("name", "output" + std::to_string(outputs_.size()));
+		info.type = tensor_type(output_params.get<std::string>("type", "float32"));
+		for (auto const &dim : output_params.get_child("shape"))
+			info.shape.push_back(dim.second.get_value<unsigned int>());
+		info.scale = output_params.get<float>("scale", 1.0f);
+		info.zero_point = output_params.get<int>("zero_point", 0);
+		outputs_.push_back(info);
+
+		std::vector<uint8_t> recording;
+		std::string file_name = output_params.get<std::string>("file", "");
+		if (!file_name.empty())
+		{
+			std::ifstream file(file_name, std::ios::binary);
+			if (!file)
+				throw std::runtime_error("MockInferenceBackend: failed to open " + file_name);
+			recording.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			if (recording.empty() || recording.size() % info.Bytes())
+				throw std::runtime_error("MockInferenceBackend: " + file_name + " is not a whole number of tensors");
+		}
+		recordings_.push_back(std::move(recording));
+	}
+
+	if (outputs_.empty())
+		throw std::runtime_error("MockInferenceBackend: no outputs given");
+}
+
+bool MockInferenceBackend::run([[maybe_unused]] const uint8_t *input, std::vector<Tensor> &outputs)
+{
+	if (latency_.count())
+		std::this_thread::sleep_for(latency_);
+
+	// Only the queue's thread gets here, so there's no need for a lock.
+	for (unsigned int i = 0; i < outputs_.size(); i++)
+	{
+		Tensor tensor = MakeTensor(outputs_[i]);
+		const size_t bytes = outputs_[i].Bytes();
+		if (!recordings_[i].empty())
+		{
+			size_t offset = (next_ % (recordings_[i].size() / bytes)) * bytes;
+			memcpy(tensor.data.get(), recordings_[i].data() + offset, bytes);
+		}
+		outputs.push_back(std::move(tensor));
+	}
+	next_++;
+
+	return true;
+}
+
+InferenceBackend *Create()
+{
+	return new MockInferenceBackend();
+}
+
+RegisterInferenceBackend reg("mock", &Create);
+
+} // namespace
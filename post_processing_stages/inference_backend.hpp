@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * inference_backend.hpp - pluggable neural network inference backends
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+
+// An InferenceBackend runs a model on some piece of hardware (or just the CPU) without
+// the caller needing to know which. It loads the model, describes its input and output
+// tensors, and runs jobs asynchronously: Submit() starts a job and Poll() collects its
+// outputs. Stages that only need to prepare an input image and decode the outputs can
+// then be written once and run with any of the backends.
+
+// Backends register themselves by name, in the same way as post-processing stages, so
+// those needing extra libraries (TFLite, HailoRT) live in the modules that link them.
+// The "mock" backend needs nothing, and replays recorded output tensors, so decoders
+// can be tested on any Linux machine.
+
+enum class TensorType
+{
+	UInt8,
+	Int8,
+	Int32,
+	Float32
+};
+
+struct TensorInfo
+{
+	std::string name;
+	TensorType type = TensorType::Float32;
+	std::vector<unsigned int> shape;
+	// Quantised values q stand for scale * (q - zero_point).
+	float scale = 1.0f;
+	int zero_point = 0;
+
+	size_t Elements() const;
+	size_t Bytes() const;
+	std::string ToString() const;
+};
+
+struct Tensor
+{
+	TensorInfo info;
+	std::shared_ptr<uint8_t> data;
+
+	// The tensor's values as floats. Float tensors are returned directly, anything else is
+	// dequantised into the scratch vector.
+	const float *AsFloat(std::vector<float> &scratch) const;
+};
+
+enum class InferenceStatus
+{
+	Ok,
+	// The job hasn't finished yet, so Poll() may be called for it again.
+	Pending,
+	Failed
+};
+
+class InferenceBackend
+{
+public:
+	virtual ~InferenceBackend() = default;
+
+	// Load the model and anything else the backend needs, from the stage's parameters.
+	// Throws on failure.
+	virtual void Load(boost::property_tree::ptree const &params) = 0;
+
+	virtual std::vector<TensorInfo> const &Inputs() const = 0;
+	virtual std::vector<TensorInfo> const &Outputs() const = 0;
+
+	// Start a job on the input for frame "sequence". The input is always packed 8-bit RGB
+	// of the size given by the (NHWC) input tensor; backends whose models want something
+	// else convert it themselves. The input is copied if the backend needs it after
+	// returning. Returns an id for the job, or -1 if it could not be started.
+	virtual int Submit(unsigned int sequence, const uint8_t *input) = 0;
+
+	// The most images that one job can take (see SubmitBatch()). Models with a fixed batch
+	// size of one give 1.
+	virtual unsigned int MaxBatch() const { return 1; }
+
+	// As Submit(), but for count images stored one after another. The first (batch)
+	// dimension of each output is then count.
+	virtual int SubmitBatch(unsigned int sequence, const uint8_t *input, unsigned int count)
+	{
+		return count == 1 ? Submit(sequence, input) : -1;
+	}
+
+	// Collect the outputs of a job, waiting up to timeout for it to finish. Unless the
+	// job is still pending, it is forgotten afterwards. Every job that was started should
+	// be polled until it is no longer pending; one that never is (because the caller gave
+	// up on it) keeps its resources until the backend is destroyed.
+	virtual InferenceStatus Poll(int job, std::vector<Tensor> &outputs, std::chrono::milliseconds timeout) = 0;
+};
+
+typedef InferenceBackend *(*BackendCreateFunc)();
+struct RegisterInferenceBackend
+{
+	RegisterInferenceBackend(char const *name, BackendCreateFunc create_func);
+};
+
+// Create a backend by name, returning nullptr if there is no such backend (for example
+// because the module providing it was not built).
+std::unique_ptr<InferenceBackend> CreateInferenceBackend(std::string const &name);
+
+// Runs jobs one at a time on a thread of its own, for backends whose inference calls
+// are synchronous. The queue should be the last member of its owner, so that the thread
+// is stopped before anything the run function uses is destroyed.
+class InferenceQueue
+{
+public:
+	using RunFunc = std::function<bool(const uint8_t *input, size_t size, std::vector<Tensor> &outputs)>;
+
+	InferenceQueue(RunFunc run);
+	~InferenceQueue();
+
+	// Copies size bytes of input, and queues a job that runs on it.
+	int Submit(const uint8_t *input, size_t size);
+	InferenceStatus Poll(int job, std::vector<Tensor> &outputs, std::chrono::milliseconds timeout);
+
+private:
+	struct Job
+	{
+		std::vector<uint8_t> input;
+		std::vector<Tensor> outputs;
+		bool done = false;
+		bool ok = false;
+	};
+
+	void thread();
+
+	RunFunc run_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::map<int, Job> jobs_;
+	std::deque<int> queue_;
+	unsigned int next_id_ = 0;
+	bool abort_ = false;
+	std::thread thread_;
+};
+
+// Allocate a tensor, with zeroed contents, to match the given info.
+Tensor MakeTensor(TensorInfo const &info);
@@ -0,0 +1,274 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * lores_pyramid_stage.cpp - software low resolution stream and image pyramid
+ */
+
+// Many stages need a low resolution stream, but the ISP can't always supply one (for
+// example alongside a raw stream, or at the size or format required). This stage
+// makes a software "lores" stream instead, by area averaging the (YUV420) main image,
+// so that such stages keep working, just using a bit more CPU.
+
+// Optionally, it also makes further pyramid levels, each half the size of the one
+// before, named "lores1", "lores2" and so on, and an RGB version of the lores image
+// named "lores_rgb". All of these are found through RPiCamApp::GetStream() exactly
+// like camera streams. When the camera does have a lores stream, it is used as the
+// base of the pyramid instead (unless "fallback_only" is set, when we do nothing).
+
+// This stage must come before any stages that use these streams in the JSON file.
+
+#include <algorithm>
+
+#include <libcamera/formats.h>
+#include <libcamera/stream.h>
+
+#include "core/options.hpp"
+#include "core/rpicam_app.hpp"
+
+#include "post_processing_stages/post_processing_stage.hpp"
+
+using Stream = libcamera::Stream;
+using StreamConfiguration = libcamera::StreamConfiguration;
+
+class LoresPyramidStage : public PostProcessingStage
+{
+public:
+	LoresPyramidStage(RPiCamApp *app) : PostProcessingStage(app) {}
+
+	char const *Name() const override;
+
+	void Read(boost::property_tree::ptree const &params) override;
+
+	void Configure() override;
+
+	bool Process(CompletedRequestPtr &completed_request) override;
+
+private:
+	Stream *addStream(std::string const &name, libcamera::PixelFormat const &format, unsigned int width,
+					  unsigned int height, StreamInfo &info);
+
+	struct Config
+	{
+		unsigned int width;
+		unsigned int height;
+		unsigned int levels;
+		bool rgb;
+		bool fallback_only;
+	} config_;
+
+	struct Level
+	{
+		Stream *stream;
+		StreamInfo info;
+		bool software;
+	};
+
+	Stream *main_stream_;
+	StreamInfo main_info_;
+	std::vector<Level> levels_;
+	Stream *rgb_stream_;
+	StreamInfo rgb_info_;
+};
+
+#define NAME "lores_pyramid"
+
+char const *LoresPyramidStage::Name() const
+{
+	return NAME;
+}
+
+void LoresPyramidStage::Read(boost::property_tree::ptree const &params)
+{
+	config_.width = params.get<unsigned int>("width", 0);
+	config_.height = params.get<unsigned int>("height", 0);
+	config_.levels = std::clamp(params.get<unsigned int>("levels", 1), 1u, 6u);
+	config_.rgb = params.get<int>("rgb", 0);
+	config_.fallback_only = params.get<int>("fallback_only", 1);
+}
+
+Stream *LoresPyramidStage::addStream(std::string const &name, libcamera::PixelFormat const &format,
+									 unsigned int width, unsigned int height, StreamInfo &info)
+{
+	StreamConfiguration config;
+	config.pixelFormat = format;
+	config.size = libcamera::Size(width, height);
+	// Keep rows nicely aligned for the vector units. For YUV420, the chroma stride is
+	// half the luma stride, as usual.
+	if (format == libcamera::formats::YUV420)
+	{
+		config.stride = (width + 63) & ~63;
+		config.frameSize = config.stride * height * 3 / 2;
+	}
+	else
+	{
+		config.stride = (width * 3 + 63) & ~63;
+		config.frameSize = config.stride * height;
+	}
+	config.colorSpace = main_info_.colour_space;
+
+	Stream *stream = app_->AddSoftwareStream(name, config);
+	info = app_->GetStreamInfo(stream);
+	return stream;
+}
+
+void LoresPyramidStage::Configure()
+{
+	levels_.clear();
+	rgb_stream_ = nullptr;
+	main_stream_ = app_->GetMainStream();
+	if (!main_stream_)
+		return;
+	main_info_ = app_->GetStreamInfo(main_stream_);
+
+	Level base;
+	base.stream = app_->LoresStream(&base.info);
+	base.software = !base.stream;
+	if (base.stream)
+	{
+		if (config_.fallback_only)
+			return;
+		if (base.info.pixel_format != libcamera::formats::YUV420)
+			throw std::runtime_error("LoresPyramidStage: camera lores stream must be YUV420");
+	}
+	else
+	{
+		if (main_info_.pixel_format != libcamera::formats::YUV420)
+			throw std::runtime_error("LoresPyramidStage: main stream must be YUV420");
+
+		// Use the requested lores size if there is one, otherwise a quarter of the main image.
+		Options const *options = app_->GetOptions();
+		unsigned int width = config_.width ? config_.width : options->lores_width;
+		unsigned int height = config_.height ? config_.height : options->lores_height;
+		if (!width || !height)
+			width = main_info_.width / 4, height = main_info_.height / 4;
+		width = std::clamp(width & ~1, 2u, main_info_.width);
+		height = std::clamp(height & ~1, 2u, main_info_.height);
+
+		base.stream = addStream("lores", libcamera::formats::YUV420, width, height, base.info);
+	}
+	levels_.push_back(base);
+
+	for (unsigned int i = 1; i < config_.levels; i++)
+	{
+		unsigned int width = (levels_.back().info.width / 2) & ~1, height = (levels_.back().info.height / 2) & ~1;
+		if (width < 2 || height < 2)
+			break;
+		Level level;
+		level.stream = addStream("lores" + std::to_string(i), libcamera::formats::YUV420, width, height, level.info);
+		level.software = true;
+		levels_.push_back(level);
+	}
+
+	if (config_.rgb)
+		rgb_stream_ = addStream("lores_rgb", libcamera::formats::BGR888, levels_[0].info.width,
+								levels_[0].info.height, rgb_info_);
+
+	LOG(1, "LoresPyramidStage: " << levels_.size() << " levels from " << levels_[0].info.width << "x"
+								 << levels_[0].info.height << (levels_[0].software ? " (software)" : ""));
+}
+
+// Area average one plane down to a smaller size. Whole source rows are summed into an
+// accumulator first, which vectorises well, and then the columns of each output pixel
+// are added up.
+
+static void downscale_plane(uint8_t *dst, unsigned int dst_width, unsigned int dst_height, unsigned int dst_stride,
+							const uint8_t *src, unsigned int src_width, unsigned int src_height,
+							unsigned int src_stride, std::vector<uint32_t> &acc, std::vector<unsigned int> &cols)
+{
+	acc.resize(src_width);
+	cols.resize(dst_width + 1);
+	for (unsigned int x = 0; x <= dst_width; x++)
+		cols[x] = x * src_width / dst_width;
+
+	for (unsigned int y = 0; y < dst_height; y++)
+	{
+		unsigned int y0 = y * src_height / dst_height, y1 = (y + 1) * src_height / dst_height;
+		std::fill(acc.begin(), acc.end(), 0);
+		for (unsigned int row = y0; row < y1; row++)
+		{
+			const uint8_t *s = src + row * src_stride;
+			for (unsigned int x = 0; x < src_width; x++)
+				acc[x] += s[x];
+		}
+
+		uint8_t *d = dst + y * dst_stride;
+		for (unsigned int x = 0; x < dst_width; x++)
+		{
+			uint32_t sum = 0;
+			for (unsigned int i = cols[x]; i < cols[x + 1]; i++)
+				sum += acc[i];
+			unsigned int area = (cols[x + 1] - cols[x]) * (y1 - y0);
+			d[x] = (sum + area / 2) / area;
+		}
+	}
+}
+
+static void downscale_yuv420(uint8_t *dst, StreamInfo const &dst_info, const uint8_t *src,
+							 StreamInfo const &src_info)
+{
+	std::vector<uint32_t> acc;
+	std::vector<unsigned int> cols;
+	const uint8_t *src_U = src + src_info.height * src_info.stride;
+	const uint8_t *src_V = src_U + (src_info.height / 2) * (src_info.stride / 2);
+	uint8_t *dst_U = dst + dst_info.height * dst_info.stride;
+	uint8_t *dst_V = dst_U + (dst_info.height / 2) * (dst_info.stride / 2);
+
+	downscale_plane(dst, dst_info.width, dst_info.height, dst_info.stride, src, src_info.width, src_info.height,
+					src_info.stride, acc, cols);
+	downscale_plane(dst_U, dst_info.width / 2, dst_info.height / 2, dst_info.stride / 2, src_U, src_info.width / 2,
+					src_info.height / 2, src_info.stride / 2, acc, cols);
+	downscale_plane(dst_V, dst_info.width / 2, dst_info.height / 2, dst_info.stride / 2, src_V, src_info.width / 2,
+					src_info.height / 2, src_info.stride / 2, acc, cols);
+}
+
+bool LoresPyramidStage::Process(CompletedRequestPtr &completed_request)
+{
+	if (levels_.empty())
+		return false;
+
+	// Each level is made from the one before, starting from the main image if the base
+	// level is ours, or from the camera's lores image if not.
+	std::vector<std::unique_ptr<BufferWriteSync>> syncs;
+	StreamInfo src_info = main_info_;
+	BufferReadSync r(app_, completed_request->buffers[levels_[0].software ? main_stream_ : levels_[0].stream]);
+	const uint8_t *src = r.Get()[0].data();
+
+	for (auto &level : levels_)
+	{
+		if (!level.software)
+		{
+			src_info = level.info;
+			continue;
+		}
+
+		libcamera::FrameBuffer *buffer = app_->AttachSoftwareBuffer(completed_request, level.stream);
+		if (!buffer)
+			return false;
+		syncs.push_back(std::make_unique<BufferWriteSync>(app_, buffer));
+		uint8_t *dst = syncs.back()->Get()[0].data();
+
+		downscale_yuv420(dst, level.info, src, src_info);
+		src = dst;
+		src_info = level.info;
+	}
+
+	if (rgb_stream_)
+	{
+		libcamera::FrameBuffer *buffer = app_->AttachSoftwareBuffer(completed_request, rgb_stream_);
+		if (!buffer)
+			return false;
+		BufferWriteSync w(app_, buffer);
+		const uint8_t *base = levels_[0].software ? syncs[0]->Get()[0].data() : r.Get()[0].data();
+		Yuv420ToRgb(w.Get()[0].data(), base, levels_[0].info, rgb_info_);
+	}
+
+	return false;
+}
+
+static PostProcessingStage *Create(RPiCamApp *app)
+{
+	return new LoresPyramidStage(app);
+}
+
+static RegisterStage reg(NAME, &Create);
@@ -0,0 +1,128 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * object_cascade_stage.cpp - classify detected objects on any inference backend
+ */
+
+// Run an image classifier on the objects found by a detector stage earlier in the
+// pipeline (see cascade.hpp), using whichever inference backend (see
+// inference_backend.hpp) the "backend" parameter names. The rest of the parameters go
+// to the backend and the cascade. With the tflite backend, "max_batch" lets all the
+// crops of a frame go through the model together; the Hailo backend takes them one per
+// job, but starts them all before waiting for any.
+
+#include <libcamera/stream.h>
+
+#include "core/rpicam_app.hpp"
+
+#include "post_processing_stages/cascade.hpp"
+#include "post_processing_stages/inference_backend.hpp"
+#include "post_processing_stages/post_processing_stage.hpp"
+
+using Size = libcamera::Size;
+using Stream = libcamera::Stream;
+
+#define NAME "object_cascade"
+
+class ObjectCascadeStage : public PostProcessingStage
+{
+public:
+	ObjectCascadeStage(RPiCamApp *app) : PostProcessingStage(app) {}
+
+	char const *Name() const override;
+
+	void Read(boost::property_tree::ptree const &params) override;
+
+	void Configure() override;
+
+	bool Process(CompletedRequestPtr &completed_request) override;
+
+private:
+	std::unique_ptr<InferenceBackend> backend_;
+	CascadeConfig cascade_config_;
+	Cascade cascade_;
+	Stream *stream_;
+	bool verbose_;
+};
+
+char const *ObjectCascadeStage::Name() const
+{
+	return NAME;
+}
+
+void ObjectCascadeStage::Read(boost::property_tree::ptree const &params)
+{
+	cascade_config_.Read(params);
+	verbose_ = params.get<int>("verbose", 0);
+
+	std::string backend_name = params.get<std::string>("backend", "tflite");
+	backend_ = CreateInferenceBackend(backend_name);
+	if (!backend_)
+		throw std::runtime_error("ObjectCascadeStage: no inference backend called " + backend_name);
+	backend_->Load(params);
+
+	// We feed the model packed RGB crops, so the input must be NHWC with 3 channels.
+	std::vector<unsigned int> const &shape = backend_->Inputs()[0].shape;
+	if (shape.size() != 4 || shape[3] != 3)
+		throw std::runtime_error("ObjectCascadeStage: expected an NHWC RGB input tensor, not " +
+								 backend_->Inputs()[0].ToString());
+	if (backend_->Outputs().empty())
+		throw std::runtime_error("ObjectCascadeStage: the model has no outputs");
+
+	if (verbose_)
+	{
+		LOG(1, "ObjectCascadeStage: " << backend_name << " backend, up to " << backend_->MaxBatch()
+									  << " crops per job");
+		for (auto const &info : backend_->Inputs())
+			LOG(1, "    input " << info.ToString());
+		for (auto const &info : backend_->Outputs())
+			LOG(1, "    output " << info.ToString());
+	}
+}
+
+void ObjectCascadeStage::Configure()
+{
+	stream_ = cascade_config_.stream == "main" ? app_->GetMainStream() : app_->LoresStream();
+	Stream *main_stream = app_->GetMainStream();
+	if (!stream_ || !main_stream)
+	{
+		stream_ = nullptr;
+		return;
+	}
+
+	StreamInfo info = app_->GetStreamInfo(stream_);
+	if (info.pixel_format != libcamera::formats::YUV420)
+		throw std::runtime_error("ObjectCascadeStage: only YUV420 supported");
+	StreamInfo main_info = app_->GetStreamInfo(main_stream);
+	cascade_.Configure(cascade_config_, info, Size(main_info.width, main_info.height));
+}
+
+bool ObjectCascadeStage::Process(CompletedRequestPtr &completed_request)
+{
+	if (!stream_)
+		return false;
+
+	std::vector<Detection> detections;
+	if (completed_request->post_process_metadata.Get("object_detect.results", detections) || detections.empty())
+		return false;
+
+	BufferReadSync r(app_, completed_request->buffers[stream_]);
+	auto time_taken = ExecutionTime<std::micro>(&Cascade::Process, &cascade_, completed_request->sequence,
+												std::ref(detections), r.Get()[0].data(), std::ref(*backend_))
+						  .count();
+
+	if (verbose_)
+		LOG(1, "ObjectCascadeStage: frame " << completed_request->sequence << " took " << time_taken << "us");
+
+	completed_request->post_process_metadata.Set("object_detect.results", detections);
+
+	return false;
+}
+
+static PostProcessingStage *Create(RPiCamApp *app)
+{
+	return new ObjectCascadeStage(app);
+}
+
+static RegisterStage reg(NAME, &Create);
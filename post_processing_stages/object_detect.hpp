@@ -21,12 +21,17 @@ struct Detection
 	std::string name;
 	float confidence;
 	libcamera::Rectangle box;
+	// A finer grained label given by a second stage classifier (see cascade.hpp), if any.
+	std::string label;
+	float label_confidence = 0;
 	std::string toString() const
 	{
 		std::stringstream output;
 		output.precision(2);
 		output << name << "[" << category << "] (" << confidence << ") @ " << box.x << "," << box.y << " " << box.width
 			   << "x" << box.height;
+		if (!label.empty())
+			output << " " << label << " (" << label_confidence << ")";
 		return output.str();
 	}
 };
@@ -79,6 +79,8 @@ bool ObjectDetectDrawCvStage::Process(CompletedRequestPtr &completed_request)
 		rectangle(image, r, colour, line_thickness_);
 		std::stringstream text_stream;
 		text_stream << detection.name << " " << (int)(detection.confidence * 100) << "%";
+		if (!detection.label.empty())
+			text_stream << " " << detection.label;
 		std::string text = text_stream.str();
 		int baseline = 0;
 		Size size = getTextSize(text, font, font_size_, 2, &baseline);
@@ -0,0 +1,353 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * object_detect_stage.cpp - object detector on any inference backend
+ */
+
+// Run an object detector on the low resolution image, using whichever inference
+// backend (see inference_backend.hpp) the "backend" parameter names, and decode its
+// outputs with one of the common decoders (see detection_decoder.hpp). The rest of the
+// parameters go to the backend and the decoder. The results are written to the
+// "object_detect.results" metadata in main stream co-ordinates.
+
+// Inference runs asynchronously: a frame that runs the detector only starts a job, and
+// each frame collects whatever jobs have finished, so the results that a frame carries
+// are the latest that were ready, usually from a frame or two earlier.
+
+// Setting "record_file" appends every set of output tensors to <record_file>.<n>.bin,
+// one file per output, which the "mock" backend can replay later without the model or
+// the hardware.
+
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <mutex>
+
+#include <libcamera/stream.h>
+
+#include "core/rpicam_app.hpp"
+
+#include "post_processing_stages/detection_decoder.hpp"
+#include "post_processing_stages/inference_backend.hpp"
+#include "post_processing_stages/object_detect.hpp"
+#include "post_processing_stages/post_processing_stage.hpp"
+#include "post_processing_stages/resize.hpp"
+
+using Rectangle = libcamera::Rectangle;
+using Size = libcamera::Size;
+using Stream = libcamera::Stream;
+
+#define NAME "object_detect"
+
+class ObjectDetectStage : public PostProcessingStage
+{
+public:
+	ObjectDetectStage(RPiCamApp *app) : PostProcessingStage(app) {}
+	~ObjectDetectStage();
+
+	char const *Name() const override;
+
+	void Read(boost::property_tree::ptree const &params) override;
+
+	void Configure() override;
+
+	bool Process(CompletedRequestPtr &completed_request) override;
+
+private:
+	// Jobs can only pile up if the backend is slower than the frame rate, in which case frames don't start more.
+	static constexpr unsigned int MAX_PENDING = 4;
+	// The longest we wait for outstanding jobs when reconfiguring or closing, in case the backend has stopped.
+	static constexpr std::chrono::milliseconds DRAIN_TIMEOUT = std::chrono::seconds(3);
+
+	struct Job
+	{
+		int id;
+		unsigned int sequence;
+		// The part of the input tensor that the image covers.
+		Rectangle active;
+		std::chrono::steady_clock::time_point start;
+	};
+	struct Finished
+	{
+		Job job;
+		std::vector<Tensor> outputs;
+	};
+
+	void startInference(unsigned int sequence, const uint8_t *image);
+	void collectFinished();
+	std::vector<Detection> decode(Finished const &finished) const;
+	void drain();
+	void record(std::vector<Tensor> const &outputs);
+
+	std::unique_ptr<InferenceBackend> backend_;
+	DecoderConfig decoder_config_;
+	Size input_size_;
+	std::vector<std::string> labels_;
+	bool letterbox_;
+	unsigned int refresh_rate_;
+	std::string record_file_;
+	bool verbose_;
+
+	Stream *stream_;
+	StreamInfo info_;
+	Size main_size_;
+
+	std::mutex mutex_;
+	std::vector<std::ofstream> record_streams_;
+	// The latest results, for frames that don't run the detector themselves.
+	std::vector<Detection> latest_;
+	unsigned int latest_sequence_ = 0;
+	// Jobs started but not yet collected.
+	std::deque<Job> jobs_;
+};
+
+ObjectDetectStage::~ObjectDetectStage()
+{
+	// Every job must be collected before the backend goes.
+	if (backend_)
+		drain();
+}
+
+char const *ObjectDetectStage::Name() const
+{
+	return NAME;
+}
+
+void ObjectDetectStage::Read(boost::property_tree::ptree const &params)
+{
+	decoder_config_.Read(params);
+	letterbox_ = params.get<int>("letterbox", 0);
+	refresh_rate_ = std::max(params.get<unsigned int>("refresh_rate", 1), 1u);
+	record_file_ = params.get<std::string>("record_file", "");
+	verbose_ = params.get<int>("verbose", 0);
+
+	std::string backend_name = params.get<std::string>("backend", "tflite");
+	backend_ = CreateInferenceBackend(backend_name);
+	if (!backend_)
+		throw std::runtime_error("ObjectDetectStage: no inference backend called " + backend_name);
+	backend_->Load(params);
+
+	// We feed the model packed RGB images, so the input must be NHWC with 3 channels.
+	std::vector<unsigned int> const &shape = backend_->Inputs()[0].shape;
+	if (shape.size() != 4 || shape[3] != 3)
+		throw std::runtime_error("ObjectDetectStage: expected an NHWC RGB input tensor, not " +
+								 backend_->Inputs()[0].ToString());
+	input_size_ = Size(shape[2], shape[1]);
+
+	// Decoding an empty set of outputs makes sure they're what the decoder expects, now rather than later.
+	std::vector<Tensor> outputs;
+	for (auto const &info : backend_->Outputs())
+		outputs.push_back(MakeTensor(info));
+	DecodeDetections(decoder_config_, outputs, input_size_);
+
+	if (verbose_)
+	{
+		LOG(1, "ObjectDetectStage: " << backend_name << " backend");
+		for (auto const &info : backend_->Inputs())
+			LOG(1, "    input " << info.ToString());
+		for (auto const &info : backend_->Outputs())
+			LOG(1, "    output " << info.ToString());
+	}
+
+	labels_.clear();
+	std::string labels_file = params.get<std::string>("labels_file", "");
+	if (!labels_file.empty())
+	{
+		std::ifstream file(labels_file);
+		if (!file)
+			throw std::runtime_error("ObjectDetectStage: Failed to load labels file");
+		// Some label files start with placeholders for classes the model never reports.
+		unsigned int skip = params.get<unsigned int>("labels_skip", 0);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (skip)
+				skip--;
+			else
+				labels_.push_back(line);
+		}
+	}
+}
+
+void ObjectDetectStage::Configure()
+{
+	stream_ = app_->LoresStream();
+	if (!stream_)
+		return;
+
+	info_ = app_->GetStreamInfo(stream_);
+	if (info_.pixel_format != libcamera::formats::YUV420)
+		throw std::runtime_error("ObjectDetectStage: only YUV420 lores supported");
+
+	// The boxes are reported in main stream co-ordinates, as the lores is a scaled down version of it.
+	Stream *main_stream = app_->GetMainStream();
+	StreamInfo main_info = main_stream ? app_->GetStreamInfo(main_stream) : info_;
+	main_size_ = Size(main_info.width, main_info.height);
+
+	// Anything still running is from before the camera was last configured.
+	drain();
+
+	std::scoped_lock<std::mutex> l(mutex_);
+	latest_.clear();
+	latest_sequence_ = 0;
+	record_streams_.clear();
+	if (!record_file_.empty())
+	{
+		for (unsigned int i = 0; i < backend_->Outputs().size(); i++)
+		{
+			record_streams_.emplace_back(record_file_ + "." + std::to_string(i) + ".bin",
+										 std::ios::binary | std::ios::app);
+			if (!record_streams_.back())
+				throw std::runtime_error("ObjectDetectStage: failed to open " + record_file_ + " for recording");
+		}
+	}
+}
+
+bool ObjectDetectStage::Process(CompletedRequestPtr &completed_request)
+{
+	if (!stream_)
+		return false;
+
+	const unsigned int sequence = completed_request->sequence;
+	if (sequence % refresh_rate_ == 0)
+	{
+		BufferReadSync r(app_, completed_request->buffers[stream_]);
+		startInference(sequence, r.Get()[0].data());
+	}
+
+	collectFinished();
+
+	std::scoped_lock<std::mutex> l(mutex_);
+	if (!latest_.empty())
+		completed_request->post_process_metadata.Set("object_detect.results", latest_);
+
+	return false;
+}
+
+void ObjectDetectStage::startInference(unsigned int sequence, const uint8_t *image)
+{
+	{
+		std::scoped_lock<std::mutex> l(mutex_);
+		if (jobs_.size() >= MAX_PENDING)
+		{
+			LOG(2, "ObjectDetectStage: too many jobs pending, skipping frame " << sequence);
+			return;
+		}
+	}
+
+	std::vector<uint8_t> input(input_size_.width * input_size_.height * 3);
+	Rectangle region(0, 0, info_.width, info_.height);
+	Job job;
+	job.sequence = sequence;
+	job.start = std::chrono::steady_clock::now();
+	job.active = Yuv420ToRgbResize(input.data(), input_size_.width * 3, input_size_, image, info_, region, letterbox_);
+
+	// The backend copies the input if it needs it after this.
+	job.id = backend_->Submit(sequence, input.data());
+	if (job.id < 0)
+	{
+		LOG_ERROR("ObjectDetectStage: failed to start inference");
+		return;
+	}
+
+	std::scoped_lock<std::mutex> l(mutex_);
+	jobs_.push_back(job);
+}
+
+void ObjectDetectStage::collectFinished()
+{
+	// Collect jobs without waiting. Frames can finish out of order, so any of them may be done.
+	std::vector<Finished> finished;
+	{
+		std::scoped_lock<std::mutex> l(mutex_);
+		for (auto it = jobs_.begin(); it != jobs_.end();)
+		{
+			std::vector<Tensor> outputs;
+			InferenceStatus status = backend_->Poll(it->id, outputs, 0ms);
+			if (status == InferenceStatus::Pending)
+			{
+				it++;
+				continue;
+			}
+			if (status == InferenceStatus::Ok)
+				finished.push_back({ *it, std::move(outputs) });
+			else
+				LOG_ERROR("ObjectDetectStage: inference failed on frame " << it->sequence);
+			it = jobs_.erase(it);
+		}
+	}
+
+	for (auto const &f : finished)
+	{
+		if (!record_streams_.empty())
+			record(f.outputs);
+
+		std::vector<Detection> detections = decode(f);
+		if (verbose_)
+		{
+			auto time_taken = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - f.job.start);
+			LOG(1, "ObjectDetectStage: frame " << f.job.sequence << " took " << time_taken.count() << "us");
+		}
+
+		// We only want to keep the most recent results.
+		std::scoped_lock<std::mutex> l(mutex_);
+		if (f.job.sequence >= latest_sequence_ || latest_.empty())
+		{
+			latest_ = std::move(detections);
+			latest_sequence_ = f.job.sequence;
+		}
+	}
+}
+
+std::vector<Detection> ObjectDetectStage::decode(Finished const &finished) const
+{
+	std::vector<Detection> detections;
+	for (auto const &object : DecodeDetections(decoder_config_, finished.outputs, input_size_))
+	{
+		Rectangle box = ResizedToImage(input_size_, finished.job.active, Rectangle(0, 0, main_size_), object.x0,
+									   object.y0, object.x1, object.y1);
+		bool labelled = object.category >= 0 && object.category < (int)labels_.size();
+		std::string name = labelled ? labels_[object.category] : "";
+		detections.emplace_back(object.category, name, object.confidence, box.x, box.y, box.width, box.height);
+		if (verbose_)
+			LOG(2, "ObjectDetectStage: " << detections.back().toString());
+	}
+
+	return detections;
+}
+
+// Collect the outstanding jobs, giving up on any still running after DRAIN_TIMEOUT in total. The backend keeps
+// what those need until it is destroyed.
+
+void ObjectDetectStage::drain()
+{
+	std::scoped_lock<std::mutex> l(mutex_);
+	const auto deadline = std::chrono::steady_clock::now() + DRAIN_TIMEOUT;
+	unsigned int abandoned = 0;
+	for (auto const &job : jobs_)
+	{
+		auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+		std::vector<Tensor> outputs;
+		if (backend_->Poll(job.id, outputs, std::max(left, 0ms)) == InferenceStatus::Pending)
+			abandoned++;
+	}
+	if (abandoned)
+		LOG_ERROR("ObjectDetectStage: abandoned " << abandoned << " inference jobs that did not finish");
+	jobs_.clear();
+}
+
+void ObjectDetectStage::record(std::vector<Tensor> const &outputs)
+{
+	std::scoped_lock<std::mutex> l(mutex_);
+	for (unsigned int i = 0; i < outputs.size() && i < record_streams_.size(); i++)
+		record_streams_[i].write(reinterpret_cast<const char *>(outputs[i].data.get()), outputs[i].info.Bytes());
+}
+
+static PostProcessingStage *Create(RPiCamApp *app)
+{
+	return new ObjectDetectStage(app);
+}
+
+static RegisterStage reg(NAME, &Create);
@@ -5,6 +5,7 @@
  * object_detect_tf_stage.cpp - object detector
  */
 
+#include "detection_decoder.hpp"
 #include "object_detect.hpp"
 #include "tf_stage.hpp"
 
@@ -46,10 +47,21 @@ protected:
 	// stage to pick up.
 	void applyResults(CompletedRequestPtr &completed_request) override;
 
+	// With tiling, decode each tile's results into main image co-ordinates, and once this
+	// frame's tiles are done, merge the latest results from all the tiles.
+	bool supportsTiling() const override { return true; }
+	void interpretTileOutputs(unsigned int index, const Rectangle &tile) override;
+	void tilesComplete() override;
+
 private:
 	void readLabelsFile(const std::string &file_name);
 
+	// Decode the network's outputs into main image co-ordinates, adding them to results. The
+	// input was the given tile of the main image, or when there's no tile, the lores image.
+	void decodeOutputs(const Rectangle *tile, std::vector<Detection> &results) const;
+
 	std::vector<Detection> output_results_;
+	TileResults tile_results_;
 	std::vector<std::string> labels_;
 	size_t label_count_;
 };
@@ -90,6 +102,10 @@ void ObjectDetectTfStage::checkConfiguration()
 {
 	if (!main_stream_)
 		throw std::runtime_error("ObjectDetectTfStage: Main stream is required");
+
+	// A tile's results stay until it comes round again.
+	if (tiling())
+		tile_results_.Configure(tiles().size(), tileRotation());
 }
 
 void ObjectDetectTfStage::applyResults(CompletedRequestPtr &completed_request)
@@ -97,70 +113,70 @@ void ObjectDetectTfStage::applyResults(CompletedRequestPtr &completed_request)
 	completed_request->post_process_metadata.Set("object_detect.results", output_results_);
 }
 
-static unsigned int area(const Rectangle &r)
+void ObjectDetectTfStage::decodeOutputs(const Rectangle *tile, std::vector<Detection> &results) const
 {
-	return r.width * r.height;
+	std::vector<int> const &outputs = interpreter_->outputs();
+	std::vector<DecodedObject> objects =
+		DecodeSsd(TfliteTensor(interpreter_->tensor(outputs[0])), TfliteTensor(interpreter_->tensor(outputs[1])),
+				  TfliteTensor(interpreter_->tensor(outputs[2])), nullptr, config()->confidence_threshold);
+
+	for (auto const &o : objects)
+	{
+		Rectangle r;
+		if (tile)
+		{
+			// The tile was cut straight from the main image, so the box maps back directly.
+			r = TileToImage(*tile, o.x0, o.y0, o.x1, o.y1);
+		}
+		else
+		{
+			// The coords in the WIDTH x HEIGHT image fed to the network are:
+			int y = HEIGHT * o.y0;
+			int x = WIDTH * o.x0;
+			int h = std::max<int>(HEIGHT * o.y1 - y, 0);
+			int w = std::max<int>(WIDTH * o.x1 - x, 0);
+			// The network is fed a crop from the lores (if that was too large), so the coords
+			// in the full lores image are:
+			y += (lores_info_.height - HEIGHT) / 2;
+			x += (lores_info_.width - WIDTH) / 2;
+			// The lores is a pure scaling of the main image (squishing if the aspect ratios
+			// don't match), so:
+			r.y = y * main_stream_info_.height / lores_info_.height;
+			r.x = x * main_stream_info_.width / lores_info_.width;
+			r.height = h * main_stream_info_.height / lores_info_.height;
+			r.width = w * main_stream_info_.width / lores_info_.width;
+		}
+
+		const std::string label = o.category < (int)labels_.size() ? labels_[o.category] : std::to_string(o.category);
+		results.emplace_back(o.category, label, o.confidence, r.x, r.y, r.width, r.height);
+	}
 }
 
 void ObjectDetectTfStage::interpretOutputs()
 {
-	int box_index = interpreter_->outputs()[0];
-	int class_index = interpreter_->outputs()[1];
-	int score_index = interpreter_->outputs()[2];
-	int num_detections = interpreter_->tensor(box_index)->dims->data[1];
-	float *boxes = interpreter_->tensor(box_index)->data.f;
-	float *scores = interpreter_->tensor(score_index)->data.f;
-	float *classes = interpreter_->tensor(class_index)->data.f;
-
 	output_results_.clear();
+	decodeOutputs(nullptr, output_results_);
 
-	for (int i = 0; i < num_detections; i++)
+	// Of any overlapping detections of the same class, keep the most confident.
+	NmsDetections(output_results_, config()->overlap_threshold);
+
+	if (config()->verbose)
 	{
-		if (scores[i] < config()->confidence_threshold)
-			continue;
-
-		// The coords in the WIDTH x HEIGHT image fed to the network are:
-		int y = std::clamp<int>(HEIGHT * boxes[i * 4 + 0], 0, HEIGHT);
-		int x = std::clamp<int>(WIDTH * boxes[i * 4 + 1], 0, WIDTH);
-		int h = std::clamp<int>(HEIGHT * boxes[i * 4 + 2] - y, 0, HEIGHT);
-		int w = std::clamp<int>(WIDTH * boxes[i * 4 + 3] - x, 0, WIDTH);
-		// The network is fed a crop from the lores (if that was too large), so the coords
-		// in the full lores image are:
-		y += (lores_info_.height - HEIGHT) / 2;
-		x += (lores_info_.width - WIDTH) / 2;
-		// The lores is a pure scaling of the main image (squishing if the aspect ratios
-		// don't match), so:
-		y = y * main_stream_info_.height / lores_info_.height;
-		x = x * main_stream_info_.width / lores_info_.width;
-		h = h * main_stream_info_.height / lores_info_.height;
-		w = w * main_stream_info_.width / lores_info_.width;
-
-		int c = classes[i];
-		Detection detection(c, labels_[c], scores[i], x, y, w, h);
-
-		// Before adding this detection to the results, see if it overlaps an existing one.
-		bool overlapped = false;
-		for (auto &prev_detection : output_results_)
-		{
-			if (prev_detection.category == c)
-			{
-				unsigned int prev_area = area(prev_detection.box);
-				unsigned int new_area = area(detection.box);
-				unsigned int overlap = area(prev_detection.box.boundedTo(detection.box));
-				if (overlap > config()->overlap_threshold * prev_area ||
-					overlap > config()->overlap_threshold * new_area)
-				{
-					// Take the box with the higher confidence.
-					if (detection.confidence > prev_detection.confidence)
-						prev_detection = detection;
-					overlapped = true;
-					break;
-				}
-			}
-		}
-		if (!overlapped)
-			output_results_.push_back(detection);
+		for (auto &detection : output_results_)
+			LOG(1, detection.toString());
 	}
+}
+
+void ObjectDetectTfStage::interpretTileOutputs(unsigned int index, const Rectangle &tile)
+{
+	std::vector<Detection> results;
+	decodeOutputs(&tile, results);
+	tile_results_.Set(index, std::move(results));
+}
+
+void ObjectDetectTfStage::tilesComplete()
+{
+	output_results_ = tile_results_.Merge(config()->tiling.overlap_threshold);
 
 	if (config()->verbose)
 	{
@@ -61,19 +61,7 @@ public:
 	static std::vector<uint8_t> Yuv420ToRgb(const uint8_t *src, StreamInfo &src_info, StreamInfo &dst_info);
 	static void Yuv420ToRgb(uint8_t *dst, const uint8_t *src, StreamInfo &src_info, StreamInfo &dst_info);
 
-protected:
-	// Helper to calculate the execution time of any callable object and return it in as a std::chrono::duration.
-	// For functions returning a value, the simplest thing would be to wrap the call in a lambda and capture
-	// the return value.
-	template <class R = std::micro, class T = std::chrono::steady_clock, class F, class... Args>
-	static auto ExecutionTime(F &&f, Args &&... args)
-	{
-		auto t1 = T::now();
-		std::invoke(std::forward<decltype(f)>(f), std::forward<Args>(args)...);
-		auto t2 = T::now();
-		return std::chrono::duration<double, R>(t2 - t1);
-	}
-
+	// Read a JSON array of values, padding it out from the default if it's shorter.
 	template <typename T>
 	static std::vector<T> GetJsonArray(const boost::property_tree::ptree &pt, const std::string &key,
 									   const std::vector<T> &default_value = {})
@@ -92,6 +80,19 @@ protected:
 		return vec;
 	}
 
+protected:
+	// Helper to calculate the execution time of any callable object and return it in as a std::chrono::duration.
+	// For functions returning a value, the simplest thing would be to wrap the call in a lambda and capture
+	// the return value.
+	template <class R = std::micro, class T = std::chrono::steady_clock, class F, class... Args>
+	static auto ExecutionTime(F &&f, Args &&... args)
+	{
+		auto t1 = T::now();
+		std::invoke(std::forward<decltype(f)>(f), std::forward<Args>(args)...);
+		auto t2 = T::now();
+		return std::chrono::duration<double, R>(t2 - t1);
+	}
+
 	RPiCamApp *app_;
 };
 
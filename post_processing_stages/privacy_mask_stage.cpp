@@ -0,0 +1,542 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * privacy_mask_stage.cpp - blur or pixelate private regions of the image
+ */
+
+// This stage anonymises parts of the main (YUV420) image in place, so it must be
+// placed after any detection stages in the JSON file, and the image is then masked
+// before it gets anywhere near an encoder or output.
+
+// There are two sources of regions. Fixed polygons, given as a list of points in
+// fractions of the image size, are rasterised once when we are configured. Then,
+// on every frame, we pick up any boxes listed under "object_detect.results" (from
+// any of the object detection stages) and "detected_faces" (from face_detect_cv).
+// These boxes are padded, and are remembered for a few frames so that a missed
+// detection doesn't immediately let an unmasked frame out.
+
+// Pixelation works on a fixed grid of blocks across the whole image, so that the
+// blocks don't "swim" as the boxes move around. The image rows are split into bands,
+// each one handled by its own thread. The inner loops are kept simple enough that
+// the compiler can vectorise them (with the -ftree-vectorize NEON flags we use).
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include <libcamera/geometry.h>
+#include <libcamera/stream.h>
+
+#include "core/rpicam_app.hpp"
+
+#include "post_processing_stages/detection_decoder.hpp"
+#include "post_processing_stages/object_detect.hpp"
+#include "post_processing_stages/post_processing_stage.hpp"
+
+using Rectangle = libcamera::Rectangle;
+using Stream = libcamera::Stream;
+
+namespace
+{
+
+// One plane of the YUV420 image. The sub value is 0 for luma, 1 for chroma, and the
+// mask always has one entry for each chroma pixel.
+struct Plane
+{
+	uint8_t *ptr;
+	unsigned int width;
+	unsigned int height;
+	unsigned int stride;
+	unsigned int sub;
+};
+
+// A region to mask, in luma pixel co-ordinates, optionally restricted by the mask.
+struct Region
+{
+	Rectangle rect;
+	bool use_mask;
+};
+
+// Blurred rows waiting to be written back into the image.
+struct BlurResult
+{
+	unsigned int plane;
+	Rectangle rect;
+	bool use_mask;
+	std::vector<uint8_t> pixels;
+};
+
+Rectangle to_plane(Rectangle const &r, unsigned int sub)
+{
+	return Rectangle(r.x >> sub, r.y >> sub, (r.width + sub) >> sub, (r.height + sub) >> sub);
+}
+
+void write_row(uint8_t *dst, const uint8_t *mask_row, unsigned int x0, unsigned int x1, unsigned int sub,
+			   uint8_t value)
+{
+	if (!mask_row)
+	{
+		memset(dst + x0, value, x1 - x0);
+		return;
+	}
+	for (unsigned int x = x0; x < x1; x++)
+	{
+		if (mask_row[(x << sub) >> 1])
+			dst[x] = value;
+	}
+}
+
+void copy_row(uint8_t *dst, const uint8_t *src, const uint8_t *mask_row, unsigned int x0, unsigned int x1,
+			  unsigned int sub)
+{
+	if (!mask_row)
+	{
+		memcpy(dst + x0, src, x1 - x0);
+		return;
+	}
+	for (unsigned int x = x0; x < x1; x++)
+	{
+		if (mask_row[(x << sub) >> 1])
+			dst[x] = src[x - x0];
+	}
+}
+
+} // namespace
+
+class PrivacyMaskStage : public PostProcessingStage
+{
+public:
+	PrivacyMaskStage(RPiCamApp *app) : PostProcessingStage(app) {}
+
+	char const *Name() const override;
+
+	void Read(boost::property_tree::ptree const &params) override;
+
+	void Configure() override;
+
+	bool Process(CompletedRequestPtr &completed_request) override;
+
+private:
+	void rasterisePolygons();
+	std::vector<Region> getRegions(CompletedRequestPtr &completed_request);
+	void processBand(Plane const *planes, std::vector<Region> const &regions, unsigned int y0, unsigned int y1,
+					 std::vector<BlurResult> &blur_results) const;
+	void pixelate(Plane const &plane, Region const &region, unsigned int y0, unsigned int y1) const;
+	void blur(Plane const &plane, Region const &region, unsigned int y0, unsigned int y1, BlurResult &result) const;
+	const uint8_t *maskRow(Plane const &plane, Region const &region, unsigned int y) const;
+
+	struct Config
+	{
+		bool blur;
+		unsigned int block_size;
+		unsigned int blur_radius;
+		float padding;
+		unsigned int persist_frames;
+		unsigned int threads;
+		bool use_detections;
+		bool use_faces;
+		std::vector<std::string> labels;
+		std::vector<std::vector<std::pair<float, float>>> polygons;
+	} config_;
+
+	struct TrackedBox
+	{
+		Rectangle box;
+		unsigned int frames_left;
+	};
+	// How much a new box must overlap a tracked one, as intersection over union, to replace it.
+	static constexpr float MATCH_IOU = 0.3;
+
+	Stream *stream_;
+	StreamInfo info_;
+	StreamInfo lores_info_;
+	// The rasterised fixed polygons, at chroma resolution, and their bounding boxes.
+	std::vector<uint8_t> mask_;
+	std::vector<Rectangle> polygon_rects_;
+	std::vector<TrackedBox> tracked_;
+	std::mutex mutex_;
+};
+
+#define NAME "privacy_mask"
+
+char const *PrivacyMaskStage::Name() const
+{
+	return NAME;
+}
+
+void PrivacyMaskStage::Read(boost::property_tree::ptree const &params)
+{
+	std::string method = params.get<std::string>("method", "pixelate");
+	if (method != "pixelate" && method != "blur")
+		throw std::runtime_error("PrivacyMaskStage: unknown method " + method);
+	config_.blur = method == "blur";
+	// Keep block sizes even, so that chroma blocks line up with luma ones.
+	config_.block_size = std::clamp(params.get<unsigned int>("block_size", 16), 2u, 128u) & ~1;
+	config_.blur_radius = std::clamp(params.get<unsigned int>("blur_radius", 12), 1u, 100u);
+	config_.padding = params.get<float>("padding", 0.1);
+	config_.persist_frames = params.get<unsigned int>("persist_frames", 5);
+	config_.threads = std::clamp(params.get<unsigned int>("threads", 2), 1u, 8u);
+	config_.use_detections = params.get<int>("use_detections", 1);
+	config_.use_faces = params.get<int>("use_faces", 1);
+	config_.labels = GetJsonArray<std::string>(params, "labels");
+
+	if (params.find("regions") != params.not_found())
+	{
+		for (auto const &region : params.get_child("regions"))
+		{
+			std::vector<std::pair<float, float>> polygon;
+			for (auto const &point : region.second)
+			{
+				std::vector<float> xy;
+				for (auto const &v : point.second)
+					xy.push_back(v.second.get_value<float>());
+				if (xy.size() != 2)
+					throw std::runtime_error("PrivacyMaskStage: region points must be [x, y] pairs");
+				polygon.emplace_back(xy[0], xy[1]);
+			}
+			if (polygon.size() < 3)
+				throw std::runtime_error("PrivacyMaskStage: regions need at least 3 points");
+			config_.polygons.push_back(std::move(polygon));
+		}
+	}
+}
+
+void PrivacyMaskStage::Configure()
+{
+	stream_ = app_->GetMainStream();
+	if (!stream_)
+		return;
+	info_ = app_->GetStreamInfo(stream_);
+	if (info_.pixel_format != libcamera::formats::YUV420)
+		throw std::runtime_error("PrivacyMaskStage: only supports YUV420");
+
+	// Face boxes come from the low resolution image, so we need its size to scale them.
+	Stream *lores_stream = app_->LoresStream(&lores_info_);
+	if (!lores_stream && config_.use_faces)
+		lores_info_ = info_;
+
+	rasterisePolygons();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	tracked_.clear();
+}
+
+// Fill the polygons into the mask with a simple scanline algorithm, sampling each
+// chroma pixel at its centre.
+
+void PrivacyMaskStage::rasterisePolygons()
+{
+	unsigned int mask_w = info_.width / 2, mask_h = info_.height / 2;
+	mask_.assign(mask_w * mask_h, 0);
+	polygon_rects_.clear();
+
+	for (auto const &polygon : config_.polygons)
+	{
+		std::vector<std::pair<float, float>> points;
+		float x_min = mask_w, x_max = 0, y_min = mask_h, y_max = 0;
+		for (auto const &p : polygon)
+		{
+			points.emplace_back(p.first * mask_w, p.second * mask_h);
+			x_min = std::min(x_min, points.back().first), x_max = std::max(x_max, points.back().first);
+			y_min = std::min(y_min, points.back().second), y_max = std::max(y_max, points.back().second);
+		}
+
+		int y0 = std::clamp<int>(std::floor(y_min), 0, mask_h), y1 = std::clamp<int>(std::ceil(y_max), 0, mask_h);
+		int x0 = std::clamp<int>(std::floor(x_min), 0, mask_w), x1 = std::clamp<int>(std::ceil(x_max), 0, mask_w);
+		if (x1 <= x0 || y1 <= y0)
+			continue;
+		polygon_rects_.emplace_back(2 * x0, 2 * y0, 2 * (x1 - x0), 2 * (y1 - y0));
+
+		std::vector<float> crossings;
+		for (int y = y0; y < y1; y++)
+		{
+			float yc = y + 0.5;
+			crossings.clear();
+			for (unsigned int i = 0; i < points.size(); i++)
+			{
+				auto const &a = points[i], &b = points[(i + 1) % points.size()];
+				if ((a.second <= yc) != (b.second <= yc))
+					crossings.push_back(a.first + (yc - a.second) * (b.first - a.first) / (b.second - a.second));
+			}
+			std::sort(crossings.begin(), crossings.end());
+
+			uint8_t *row = &mask_[y * mask_w];
+			for (unsigned int i = 0; i + 1 < crossings.size(); i += 2)
+			{
+				int start = std::clamp<int>(std::lround(crossings[i]), 0, mask_w);
+				int end = std::clamp<int>(std::lround(crossings[i + 1]), 0, mask_w);
+				if (end > start)
+					memset(row + start, 1, end - start);
+			}
+		}
+	}
+}
+
+std::vector<Region> PrivacyMaskStage::getRegions(CompletedRequestPtr &completed_request)
+{
+	std::vector<Rectangle> boxes;
+
+	if (config_.use_detections)
+	{
+		std::vector<Detection> detections;
+		completed_request->post_process_metadata.Get("object_detect.results", detections);
+		for (auto const &d : detections)
+		{
+			if (config_.labels.empty() ||
+				std::find(config_.labels.begin(), config_.labels.end(), d.name) != config_.labels.end())
+				boxes.push_back(d.box);
+		}
+	}
+
+	if (config_.use_faces)
+	{
+		std::vector<Rectangle> faces;
+		completed_request->post_process_metadata.Get("detected_faces", faces);
+		for (auto const &f : faces)
+		{
+			boxes.emplace_back(f.x * info_.width / lores_info_.width, f.y * info_.height / lores_info_.height,
+							   f.width * info_.width / lores_info_.width, f.height * info_.height / lores_info_.height);
+		}
+	}
+
+	// Pad the boxes and round them out to even pixels so that chroma is covered too.
+	const Rectangle image(0, 0, info_.width, info_.height);
+	for (auto &box : boxes)
+	{
+		int pad_x = box.width * config_.padding, pad_y = box.height * config_.padding;
+		int x0 = (box.x - pad_x) & ~1, y0 = (box.y - pad_y) & ~1;
+		int x1 = (box.x + (int)box.width + pad_x + 1) & ~1, y1 = (box.y + (int)box.height + pad_y + 1) & ~1;
+		box = Rectangle(x0, y0, std::max(x1 - x0, 0), std::max(y1 - y0, 0)).boundedTo(image);
+	}
+
+	std::vector<Region> regions;
+	for (auto const &r : polygon_rects_)
+		regions.push_back({ r, true });
+
+	// Process can run in parallel for consecutive frames, so protect the tracked boxes.
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	for (auto &t : tracked_)
+		t.frames_left--;
+	tracked_.erase(std::remove_if(tracked_.begin(), tracked_.end(), [](TrackedBox const &t) { return !t.frames_left; }),
+				   tracked_.end());
+	// A box that overlaps one we're already tracking is most likely the same thing, perhaps moved a little, so it
+	// takes over that one rather than having the same place blurred again. Each tracked box can only be taken over
+	// once a frame, and boxes that match nothing start being tracked.
+	const unsigned int fresh = config_.persist_frames + 1;
+	for (auto const &box : boxes)
+	{
+		if (!box.width || !box.height)
+			continue;
+
+		TrackedBox *match = nullptr;
+		float best = MATCH_IOU;
+		for (auto &t : tracked_)
+		{
+			float iou = t.frames_left < fresh ? Iou(t.box, box) : 0;
+			if (iou >= best)
+				match = &t, best = iou;
+		}
+
+		if (match)
+			*match = { box, fresh };
+		else
+			tracked_.push_back({ box, fresh });
+	}
+
+	for (auto const &t : tracked_)
+		regions.push_back({ t.box, false });
+
+	return regions;
+}
+
+const uint8_t *PrivacyMaskStage::maskRow(Plane const &plane, Region const &region, unsigned int y) const
+{
+	if (!region.use_mask)
+		return nullptr;
+	return &mask_[((y << plane.sub) >> 1) * (info_.width / 2)];
+}
+
+// Replace each block of the grid that touches the region by its average value. The
+// y0 and y1 band limits must lie on block boundaries.
+
+void PrivacyMaskStage::pixelate(Plane const &plane, Region const &region, unsigned int y0, unsigned int y1) const
+{
+	const unsigned int block = config_.block_size >> plane.sub;
+	const Rectangle r = to_plane(region.rect, plane.sub);
+	const unsigned int rx1 = std::min(r.x + r.width, plane.width), ry1 = std::min(r.y + r.height, plane.height);
+	const unsigned int bx0 = (r.x / block) * block, bx1 = std::min((rx1 + block - 1) / block * block, plane.width);
+	std::vector<uint16_t> col_sums(bx1 - bx0);
+
+	y0 = std::max<unsigned int>(y0, (r.y / block) * block);
+	y1 = std::min(y1, ry1);
+	for (unsigned int by = y0; by < y1; by += block)
+	{
+		unsigned int by1 = std::min(by + block, plane.height);
+
+		// Sum down the columns first, which vectorises nicely.
+		std::fill(col_sums.begin(), col_sums.end(), 0);
+		for (unsigned int y = by; y < by1; y++)
+		{
+			const uint8_t *row = plane.ptr + y * plane.stride + bx0;
+			for (unsigned int x = 0; x < col_sums.size(); x++)
+				col_sums[x] += row[x];
+		}
+
+		for (unsigned int bx = bx0; bx < bx1; bx += block)
+		{
+			unsigned int bx_end = std::min(bx + block, bx1);
+			unsigned int sum = 0;
+			for (unsigned int x = bx; x < bx_end; x++)
+				sum += col_sums[x - bx0];
+			uint8_t value = sum / ((bx_end - bx) * (by1 - by));
+
+			unsigned int x0 = std::max<unsigned int>(bx, r.x), x1 = std::min(bx_end, rx1);
+			for (unsigned int y = std::max<unsigned int>(by, r.y); y < std::min(by1, ry1); y++)
+				write_row(plane.ptr + y * plane.stride, maskRow(plane, region, y), x0, x1, plane.sub, value);
+		}
+	}
+}
+
+// Separable box blur of the region's rows between y0 and y1. We mustn't write the
+// image here because other bands may still be reading it, so the results are held
+// back until all the bands are done.
+
+void PrivacyMaskStage::blur(Plane const &plane, Region const &region, unsigned int y0, unsigned int y1,
+							BlurResult &result) const
+{
+	const int radius = config_.blur_radius >> plane.sub;
+	const unsigned int size = 2 * radius + 1;
+	// Fixed point reciprocal, so that we multiply rather than divide.
+	const uint32_t recip = ((1 << 16) + size / 2) / size;
+	const Rectangle r = to_plane(region.rect, plane.sub);
+	const int rx1 = std::min(r.x + r.width, plane.width);
+	y0 = std::max<int>(y0, r.y);
+	y1 = std::min(y1, std::min(r.y + r.height, plane.height));
+	if (y1 <= y0 || rx1 <= r.x)
+		return;
+
+	const unsigned int w = rx1 - r.x, h = y1 - y0;
+	const int src_y0 = std::max<int>(y0 - radius, 0), src_y1 = std::min<int>(y1 + radius, plane.height);
+	auto clamp_x = [&plane](int x) { return std::clamp<int>(x, 0, plane.width - 1); };
+	auto clamp_y = [src_y0, src_y1](int y) { return std::clamp<int>(y, src_y0, src_y1 - 1); };
+
+	// Horizontal pass, with a running sum along each row.
+	std::vector<uint8_t> horizontal(w * (src_y1 - src_y0));
+	for (int y = src_y0; y < src_y1; y++)
+	{
+		const uint8_t *row = plane.ptr + y * plane.stride;
+		uint8_t *dst = &horizontal[(y - src_y0) * w];
+		uint32_t sum = 0;
+		for (int x = r.x - radius; x <= r.x + radius; x++)
+			sum += row[clamp_x(x)];
+		for (unsigned int x = 0; x < w; x++)
+		{
+			dst[x] = (sum * recip) >> 16;
+			sum += row[clamp_x(r.x + x + radius + 1)] - row[clamp_x(r.x + x - radius)];
+		}
+	}
+
+	// Vertical pass, keeping a running sum for every column.
+	result.rect = Rectangle(r.x, y0, w, h);
+	result.use_mask = region.use_mask;
+	result.pixels.resize(w * h);
+	std::vector<uint32_t> col_sums(w, 0);
+	for (int y = (int)y0 - radius; y <= (int)y0 + radius; y++)
+	{
+		const uint8_t *row = &horizontal[(clamp_y(y) - src_y0) * w];
+		for (unsigned int x = 0; x < w; x++)
+			col_sums[x] += row[x];
+	}
+	for (unsigned int y = 0; y < h; y++)
+	{
+		uint8_t *dst = &result.pixels[y * w];
+		const uint8_t *add = &horizontal[(clamp_y(y0 + y + radius + 1) - src_y0) * w];
+		const uint8_t *sub = &horizontal[(clamp_y(y0 + y - radius) - src_y0) * w];
+		for (unsigned int x = 0; x < w; x++)
+		{
+			dst[x] = (col_sums[x] * recip) >> 16;
+			col_sums[x] += add[x] - sub[x];
+		}
+	}
+}
+
+void PrivacyMaskStage::processBand(Plane const *planes, std::vector<Region> const &regions, unsigned int y0,
+								   unsigned int y1, std::vector<BlurResult> &blur_results) const
+{
+	for (unsigned int p = 0; p < 3; p++)
+	{
+		for (auto const &region : regions)
+		{
+			if (config_.blur)
+			{
+				BlurResult result;
+				result.plane = p;
+				blur(planes[p], region, y0 >> planes[p].sub, y1 >> planes[p].sub, result);
+				if (!result.pixels.empty())
+					blur_results.push_back(std::move(result));
+			}
+			else
+				pixelate(planes[p], region, y0 >> planes[p].sub, y1 >> planes[p].sub);
+		}
+	}
+}
+
+bool PrivacyMaskStage::Process(CompletedRequestPtr &completed_request)
+{
+	if (!stream_)
+		return false;
+
+	std::vector<Region> regions = getRegions(completed_request);
+	if (regions.empty())
+		return false;
+
+	BufferWriteSync w(app_, completed_request->buffers[stream_]);
+	uint8_t *image = w.Get()[0].data();
+
+	Plane planes[3];
+	unsigned int stride2 = info_.stride / 2;
+	planes[0] = { image, info_.width, info_.height, info_.stride, 0 };
+	planes[1] = { image + info_.height * info_.stride, info_.width / 2, info_.height / 2, stride2, 1 };
+	planes[2] = { planes[1].ptr + (info_.height / 2) * stride2, info_.width / 2, info_.height / 2, stride2, 1 };
+
+	// Split the image into bands of rows, which must start on pixelation block boundaries.
+	unsigned int band_height = (info_.height + config_.threads - 1) / config_.threads;
+	band_height = (band_height + config_.block_size - 1) / config_.block_size * config_.block_size;
+
+	std::vector<std::vector<BlurResult>> blur_results(config_.threads);
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < config_.threads && i * band_height < info_.height; i++)
+		threads.emplace_back(&PrivacyMaskStage::processBand, this, planes, std::cref(regions), i * band_height,
+							 std::min((i + 1) * band_height, info_.height), std::ref(blur_results[i]));
+	processBand(planes, regions, 0, std::min(band_height, info_.height), blur_results[0]);
+	for (auto &t : threads)
+		t.join();
+
+	// With everyone finished reading the image, the blurred pixels can be written back.
+	for (auto const &results : blur_results)
+	{
+		for (auto const &result : results)
+		{
+			Plane const &plane = planes[result.plane];
+			Region region { Rectangle(), result.use_mask };
+			for (unsigned int y = 0; y < result.rect.height; y++)
+			{
+				unsigned int py = result.rect.y + y;
+				copy_row(plane.ptr + py * plane.stride, &result.pixels[y * result.rect.width],
+						 maskRow(plane, region, py), result.rect.x, result.rect.x + result.rect.width, plane.sub);
+			}
+		}
+	}
+
+	return false;
+}
+
+static PostProcessingStage *Create(RPiCamApp *app)
+{
+	return new PrivacyMaskStage(app);
+}
+
+static RegisterStage reg(NAME, &Create);
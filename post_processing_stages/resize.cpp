@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * resize.cpp - image resizing for inference inputs
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "resize.hpp"
+
+using Rectangle = libcamera::Rectangle;
+using Size = libcamera::Size;
+
+namespace
+{
+
+// Source positions for each output pixel along one axis, as the lower of the two
+// neighbouring source pixels and the weight (out of 256) of the upper one.
+struct Taps
+{
+	std::vector<unsigned int> index;
+	std::vector<unsigned int> weight;
+};
+
+Taps make_taps(double start, double scale, unsigned int num, unsigned int limit)
+{
+	Taps taps;
+	taps.index.resize(num);
+	taps.weight.resize(num);
+	for (unsigned int i = 0; i < num; i++)
+	{
+		// Sample positions are pixel centres.
+		double pos = std::clamp(start + (i + 0.5) * scale - 0.5, 0.0, limit - 1.0);
+		unsigned int i0 = std::min<unsigned int>(pos, limit > 1 ? limit - 2 : 0);
+		taps.index[i] = i0;
+		taps.weight[i] = std::min<long>(std::lround((pos - i0) * 256), 256);
+	}
+	return taps;
+}
+
+// Blend two rows, leaving 8 fractional bits. These are contiguous and branch free,
+// so they vectorise.
+void blend_rows(uint16_t *dst, const uint8_t *row0, const uint8_t *row1, unsigned int weight, unsigned int x0,
+				unsigned int x1)
+{
+	const unsigned int w0 = 256 - weight;
+	for (unsigned int x = x0; x < x1; x++)
+		dst[x] = row0[x] * w0 + row1[x] * weight;
+}
+
+inline int sample(const uint16_t *row, unsigned int index, unsigned int weight)
+{
+	return (row[index] * (256 - weight) + row[index + 1] * weight + (1 << 15)) >> 16;
+}
+
+inline uint8_t clip(int value)
+{
+	return std::clamp(value, 0, 255);
+}
+
+// Work out where the area goes in the output, and fill any borders round it with the pad value.
+Rectangle prepare_output(uint8_t *dst, unsigned int dst_stride, Size const &dst_size, Rectangle const &area,
+						 bool letterbox, uint8_t pad)
+{
+	const bool empty = !area.width || !area.height;
+	Rectangle active(0, 0, dst_size);
+	if (letterbox && !empty)
+	{
+		Size size = dst_size;
+		if ((uint64_t)area.width * dst_size.height > (uint64_t)area.height * dst_size.width)
+			size.height = std::max<unsigned int>(std::lround((double)area.height * dst_size.width / area.width), 1);
+		else
+			size.width = std::max<unsigned int>(std::lround((double)area.width * dst_size.height / area.height), 1);
+		active = Rectangle((dst_size.width - size.width) / 2, (dst_size.height - size.height) / 2, size);
+	}
+
+	if (active.size() != dst_size || empty)
+	{
+		for (unsigned int y = 0; y < dst_size.height; y++)
+			memset(dst + y * dst_stride, pad, dst_size.width * 3);
+	}
+
+	return empty ? Rectangle() : active;
+}
+
+} // namespace
+
+Rectangle Yuv420ToRgbResize(uint8_t *dst, unsigned int dst_stride, Size const &dst_size, const uint8_t *src,
+							StreamInfo const &src_info, Rectangle const &region, bool letterbox, uint8_t pad)
+{
+	Rectangle area = region.boundedTo(Rectangle(0, 0, src_info.width, src_info.height));
+	Rectangle active = prepare_output(dst, dst_stride, dst_size, area, letterbox, pad);
+	if (!active.width || !active.height)
+		return {};
+
+	const unsigned int src_w2 = src_info.width / 2, src_h2 = src_info.height / 2, stride2 = src_info.stride / 2;
+	const uint8_t *src_U = src + src_info.height * src_info.stride, *src_V = src_U + src_h2 * stride2;
+
+	// Luma is sampled at full resolution and chroma at half, so each has its own taps.
+	double scale_x = (double)area.width / active.width, scale_y = (double)area.height / active.height;
+	Taps cols = make_taps(area.x, scale_x, active.width, src_info.width);
+	Taps rows = make_taps(area.y, scale_y, active.height, src_info.height);
+	Taps cols2 = make_taps(area.x / 2.0, scale_x / 2, active.width, src_w2);
+	Taps rows2 = make_taps(area.y / 2.0, scale_y / 2, active.height, src_h2);
+
+	// The span of source columns that we actually need, for the vertical pass.
+	unsigned int x0 = cols.index.front(), x1 = std::min(cols.index.back() + 2, src_info.width);
+	unsigned int x0_2 = cols2.index.front(), x1_2 = std::min(cols2.index.back() + 2, src_w2);
+	std::vector<uint16_t> Y(src_info.width + 1), U(src_w2 + 1), V(src_w2 + 1);
+
+	for (unsigned int j = 0; j < active.height; j++)
+	{
+		unsigned int r0 = rows.index[j], r1 = std::min(r0 + 1, src_info.height - 1);
+		blend_rows(Y.data(), src + r0 * src_info.stride, src + r1 * src_info.stride, rows.weight[j], x0, x1);
+		unsigned int c0 = rows2.index[j], c1 = std::min(c0 + 1, src_h2 - 1);
+		blend_rows(U.data(), src_U + c0 * stride2, src_U + c1 * stride2, rows2.weight[j], x0_2, x1_2);
+		blend_rows(V.data(), src_V + c0 * stride2, src_V + c1 * stride2, rows2.weight[j], x0_2, x1_2);
+
+		uint8_t *out = dst + (active.y + j) * dst_stride + active.x * 3;
+		for (unsigned int i = 0; i < active.width; i++)
+		{
+			int y = sample(Y.data(), cols.index[i], cols.weight[i]);
+			int u = sample(U.data(), cols2.index[i], cols2.weight[i]) - 128;
+			int v = sample(V.data(), cols2.index[i], cols2.weight[i]) - 128;
+			// The same (full range) conversion as Yuv420ToRgb, with 8 fractional bits.
+			*(out++) = clip(y + ((359 * v + 128) >> 8));
+			*(out++) = clip(y - ((88 * u + 183 * v + 128) >> 8));
+			*(out++) = clip(y + ((453 * u + 128) >> 8));
+		}
+	}
+
+	return active;
+}
+
+Rectangle RgbResize(uint8_t *dst, unsigned int dst_stride, Size const &dst_size, const uint8_t *src,
+					StreamInfo const &src_info, Rectangle const &region, bool letterbox, uint8_t pad)
+{
+	Rectangle area = region.boundedTo(Rectangle(0, 0, src_info.width, src_info.height));
+	Rectangle active = prepare_output(dst, dst_stride, dst_size, area, letterbox, pad);
+	if (!active.width || !active.height)
+		return {};
+
+	Taps cols = make_taps(area.x, (double)area.width / active.width, active.width, src_info.width);
+	Taps rows = make_taps(area.y, (double)area.height / active.height, active.height, src_info.height);
+
+	// The vertical pass works on whole pixels, so the span of bytes is three times the span of columns.
+	unsigned int x0 = cols.index.front() * 3, x1 = std::min(cols.index.back() + 2, src_info.width) * 3;
+	std::vector<uint16_t> row(src_info.width * 3 + 3);
+	for (unsigned int i = 0; i < active.width; i++)
+		cols.index[i] *= 3;
+
+	for (unsigned int j = 0; j < active.height; j++)
+	{
+		unsigned int r0 = rows.index[j], r1 = std::min(r0 + 1, src_info.height - 1);
+		blend_rows(row.data(), src + r0 * src_info.stride, src + r1 * src_info.stride, rows.weight[j], x0, x1);
+
+		uint8_t *out = dst + (active.y + j) * dst_stride + active.x * 3;
+		for (unsigned int i = 0; i < active.width; i++)
+		{
+			const uint16_t *p = row.data() + cols.index[i];
+			const unsigned int w1 = cols.weight[i], w0 = 256 - w1;
+			*(out++) = (p[0] * w0 + p[3] * w1 + (1 << 15)) >> 16;
+			*(out++) = (p[1] * w0 + p[4] * w1 + (1 << 15)) >> 16;
+			*(out++) = (p[2] * w0 + p[5] * w1 + (1 << 15)) >> 16;
+		}
+	}
+
+	return active;
+}
+
+Rectangle ResizedToImage(Size const &dst_size, Rectangle const &active, Rectangle const &region, float x0, float y0,
+						 float x1, float y1)
+{
+	if (!active.width || !active.height)
+		return {};
+
+	// From normalised output co-ordinates to normalised co-ordinates within the active area.
+	auto map = [](float v, unsigned int size, int offset, unsigned int length) {
+		return std::clamp((v * size - offset) / length, 0.0f, 1.0f);
+	};
+	x0 = map(x0, dst_size.width, active.x, active.width), x1 = map(x1, dst_size.width, active.x, active.width);
+	y0 = map(y0, dst_size.height, active.y, active.height), y1 = map(y1, dst_size.height, active.y, active.height);
+
+	int x = region.x + std::lround(x0 * region.width);
+	int y = region.y + std::lround(y0 * region.height);
+	unsigned int w = std::lround(std::max(x1 - x0, 0.0f) * region.width);
+	unsigned int h = std::lround(std::max(y1 - y0, 0.0f) * region.height);
+	return Rectangle(x, y, w, h);
+}
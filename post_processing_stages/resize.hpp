@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * resize.hpp - image resizing for inference inputs
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <libcamera/geometry.h>
+
+#include "core/stream_info.hpp"
+
+// Convert a region of a YUV420 image to packed RGB (red first) of dst_size, resampling
+// bilinearly. With letterbox set, the region keeps its aspect ratio and is centred in
+// the output, and the borders are filled with the pad value; otherwise it is stretched
+// to fill the output. The return value is the part of the output that the region
+// ended up in, which is what's needed to map results back to image co-ordinates.
+libcamera::Rectangle Yuv420ToRgbResize(uint8_t *dst, unsigned int dst_stride, libcamera::Size const &dst_size,
+									   const uint8_t *src, StreamInfo const &src_info,
+									   libcamera::Rectangle const &region, bool letterbox = false, uint8_t pad = 114);
+
+// As Yuv420ToRgbResize, but for a packed 3 byte per pixel (RGB or BGR) source. The
+// channel order is left as it is.
+libcamera::Rectangle RgbResize(uint8_t *dst, unsigned int dst_stride, libcamera::Size const &dst_size,
+							   const uint8_t *src, StreamInfo const &src_info, libcamera::Rectangle const &region,
+							   bool letterbox = false, uint8_t pad = 114);
+
+// Map a box in normalised (0 to 1) co-ordinates of the output of Yuv420ToRgbResize
+// back to the source image, given the output size, the part of it the image was put
+// in, and the source region.
+libcamera::Rectangle ResizedToImage(libcamera::Size const &dst_size, libcamera::Rectangle const &active,
+									libcamera::Rectangle const &region, float x0, float y0, float x1, float y1);
@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * stabilise.cpp - motion estimation and camera path smoothing for stabilisation
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "post_processing_stages/stabilise.hpp"
+
+static unsigned int sad(const uint8_t *a, unsigned int a_stride, const uint8_t *b, unsigned int b_stride,
+						unsigned int size)
+{
+	unsigned int sum = 0;
+	for (unsigned int y = 0; y < size; y++, a += a_stride, b += b_stride)
+	{
+		// The compiler turns this into vector absolute-difference-and-accumulate instructions.
+		for (unsigned int x = 0; x < size; x++)
+			sum += std::abs(a[x] - b[x]);
+	}
+	return sum;
+}
+
+// Fit a parabola through the cost either side of the minimum to get a sub-pixel offset.
+static float subpixel(unsigned int left, unsigned int centre, unsigned int right)
+{
+	int denominator = (int)left - 2 * (int)centre + (int)right;
+	if (denominator <= 0)
+		return 0;
+	return std::clamp(0.5f * ((int)left - (int)right) / denominator, -0.5f, 0.5f);
+}
+
+// Find where each block of the previous frame has moved to in this one, and return the
+// median motion.
+
+bool EstimateMotion(MotionConfig const &config, const uint8_t *previous, unsigned int previous_stride,
+					const uint8_t *image, unsigned int stride, unsigned int width, unsigned int height, float &motion_x,
+					float &motion_y)
+{
+	const int range = config.search_range, size = config.block_size, span = 2 * range + 1;
+	std::vector<float> motions_x, motions_y;
+	std::vector<unsigned int> costs(span * span);
+
+	for (unsigned int gy = 0; gy < config.grid_y; gy++)
+	{
+		for (unsigned int gx = 0; gx < config.grid_x; gx++)
+		{
+			unsigned int bx = range + gx * (width - 2 * range - size) / (config.grid_x - 1);
+			unsigned int by = range + gy * (height - 2 * range - size) / (config.grid_y - 1);
+			const uint8_t *block = previous + by * previous_stride + bx;
+
+			// Flat blocks match anywhere, so ignore them.
+			unsigned int sum = 0, deviation = 0;
+			for (int y = 0; y < size; y++)
+			{
+				for (int x = 0; x < size; x++)
+					sum += block[y * previous_stride + x];
+			}
+			unsigned int mean = sum / (size * size);
+			for (int y = 0; y < size; y++)
+			{
+				for (int x = 0; x < size; x++)
+					deviation += std::abs(block[y * previous_stride + x] - (int)mean);
+			}
+			if (deviation < config.min_texture * size * size)
+				continue;
+
+			unsigned int best = 0;
+			for (int dy = -range; dy <= range; dy++)
+			{
+				for (int dx = -range; dx <= range; dx++)
+				{
+					unsigned int i = (dy + range) * span + dx + range;
+					costs[i] = sad(block, previous_stride, image + (by + dy) * stride + bx + dx, stride, size);
+					if (costs[i] < costs[best])
+						best = i;
+				}
+			}
+
+			int best_x = best % span, best_y = best / span;
+			float mx = best_x - range, my = best_y - range;
+			if (best_x > 0 && best_x < span - 1)
+				mx += subpixel(costs[best - 1], costs[best], costs[best + 1]);
+			if (best_y > 0 && best_y < span - 1)
+				my += subpixel(costs[best - span], costs[best], costs[best + span]);
+			motions_x.push_back(mx);
+			motions_y.push_back(my);
+		}
+	}
+
+	if (motions_x.size() < std::max(3u, config.grid_x * config.grid_y / 4))
+		return false;
+
+	auto median = [](std::vector<float> &v) {
+		std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+		return v[v.size() / 2];
+	};
+	motion_x = median(motions_x);
+	motion_y = median(motions_y);
+
+	return true;
+}
+
+void CameraPath::Reset()
+{
+	path_x_ = path_y_ = smooth_x_ = smooth_y_ = correction_x_ = correction_y_ = 0;
+}
+
+// When the correction hits the edge of the margin, we drag the smoothed path along too,
+// or it would stay stuck there.
+
+void CameraPath::Update(float raw_x, float raw_y, float max_x, float max_y)
+{
+	float alpha = 1.0 / (lag_ + 1);
+	path_x_ += raw_x;
+	path_y_ += raw_y;
+	smooth_x_ += alpha * (path_x_ - smooth_x_);
+	smooth_y_ += alpha * (path_y_ - smooth_y_);
+	correction_x_ = std::clamp(path_x_ - smooth_x_, -max_x, max_x);
+	correction_y_ = std::clamp(path_y_ - smooth_y_, -max_y, max_y);
+	smooth_x_ = path_x_ - correction_x_;
+	smooth_y_ = path_y_ - correction_y_;
+}
@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * stabilise.hpp - image stabilisation result and helpers
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <sstream>
+
+// The stabilise stage adds one of these to the metadata as "stabilise.result". Units
+// are main image pixels in warp mode, and sensor pixels when steering the ScalerCrop.
+
+struct StabiliseResult
+{
+	// Camera motion since the previous frame, as estimated from the low res image.
+	float motion_x = 0, motion_y = 0;
+	// Offset of the output window from its centre position.
+	float correction_x = 0, correction_y = 0;
+	// Motion still left in the output image since the previous frame, and its running
+	// RMS value (compare with raw_rms to see how much we are helping).
+	float residual = 0;
+	float residual_rms = 0;
+	float raw_rms = 0;
+	std::string toString() const
+	{
+		std::stringstream output;
+		output.precision(3);
+		output << "motion " << motion_x << "," << motion_y << " correction " << correction_x << "," << correction_y
+			   << " residual " << residual << " (rms " << residual_rms << " raw rms " << raw_rms << ")";
+		return output.str();
+	}
+};
+
+// Block matching parameters for EstimateMotion.
+struct MotionConfig
+{
+	unsigned int block_size = 16;
+	unsigned int grid_x = 5, grid_y = 4;
+	unsigned int search_range = 8;
+	// Blocks whose mean absolute deviation is below this are too flat to match.
+	unsigned int min_texture = 4;
+};
+
+// Estimate how far the image has moved since the previous one (both 8-bit greyscale and width x height) by block
+// matching a grid of blocks and taking the median motion. Returns false if there aren't enough blocks with any texture.
+bool EstimateMotion(MotionConfig const &config, const uint8_t *previous, unsigned int previous_stride,
+					const uint8_t *image, unsigned int stride, unsigned int width, unsigned int height, float &motion_x,
+					float &motion_y);
+
+// The accumulated camera path, smoothed with a simple IIR filter with a "lag" in frames. The correction is how far
+// the output window must move (limited to +/- the margin) to cancel the shake.
+class CameraPath
+{
+public:
+	CameraPath(unsigned int lag = 15) : lag_(lag) { Reset(); }
+
+	void Reset();
+
+	// Add the motion since the last frame and work out the new correction.
+	void Update(float raw_x, float raw_y, float max_x, float max_y);
+
+	float CorrectionX() const { return correction_x_; }
+	float CorrectionY() const { return correction_y_; }
+
+private:
+	unsigned int lag_;
+	float path_x_, path_y_;
+	float smooth_x_, smooth_y_;
+	float correction_x_, correction_y_;
+};
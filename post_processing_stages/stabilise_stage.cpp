@@ -0,0 +1,322 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * stabilise_stage.cpp - electronic image stabilisation
+ */
+
+// Electronic image stabilisation. We estimate the global motion between frames by
+// block matching a grid of blocks in the low resolution image against the previous
+// one, taking the median of the block motions so that a few moving objects don't
+// upset things. Accumulating this gives the "camera path", which we smooth with a
+// simple IIR filter (the "lag", in frames). The difference between the real and
+// smoothed paths is how far the output window needs to move to cancel the shake.
+
+// There are two ways of moving the window, each giving up "margin" of the image on
+// all sides:
+// "crop" - steer the ScalerCrop so that the ISP does the work. This is free, but
+//          the new crop only takes effect a few frames later, so it can only really
+//          remove slow wobbles.
+// "warp" - resample the (YUV420) main image in place from an offset and slightly
+//          zoomed window. This costs some CPU but is applied to the very frame that
+//          was measured.
+
+// As with motion_detect, frames may be processed in parallel, so the "previous"
+// frame is not quite guaranteed to be the previous one. We hold a lock while we
+// estimate the motion, but the warping happens outside it.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/controls.h>
+#include <libcamera/geometry.h>
+#include <libcamera/stream.h>
+
+#include "core/rpicam_app.hpp"
+
+#include "post_processing_stages/post_processing_stage.hpp"
+#include "post_processing_stages/stabilise.hpp"
+
+using Rectangle = libcamera::Rectangle;
+using Stream = libcamera::Stream;
+namespace controls = libcamera::controls;
+
+class StabiliseStage : public PostProcessingStage
+{
+public:
+	StabiliseStage(RPiCamApp *app) : PostProcessingStage(app) {}
+
+	char const *Name() const override;
+
+	void Read(boost::property_tree::ptree const &params) override;
+
+	void Configure() override;
+
+	bool Process(CompletedRequestPtr &completed_request) override;
+
+private:
+	void warp(uint8_t *dst, const uint8_t *src, float x, float y) const;
+	void warpPlane(uint8_t *dst, const uint8_t *src, unsigned int width, unsigned int height, unsigned int stride,
+				   float x, float y, float scale, unsigned int y0, unsigned int y1) const;
+
+	struct Config
+	{
+		bool warp;
+		float margin;
+		unsigned int lag;
+		MotionConfig motion;
+		unsigned int threads;
+		bool verbose;
+	} config_;
+
+	Stream *lores_stream_;
+	StreamInfo lores_info_;
+	Stream *main_stream_;
+	StreamInfo main_info_;
+
+	// Everything below here is protected by the mutex.
+	std::mutex mutex_;
+	std::vector<uint8_t> previous_frame_;
+	bool first_time_;
+	CameraPath path_;
+	Rectangle base_crop_;
+	Rectangle last_crop_;
+	double residual_sum_, raw_sum_;
+	unsigned int count_;
+	// Copies of the main image, for warping from. We keep a few around as frames may
+	// be in flight in parallel.
+	std::vector<std::vector<uint8_t>> free_buffers_;
+};
+
+#define NAME "stabilise"
+
+char const *StabiliseStage::Name() const
+{
+	return NAME;
+}
+
+void StabiliseStage::Read(boost::property_tree::ptree const &params)
+{
+	std::string mode = params.get<std::string>("mode", "warp");
+	if (mode != "warp" && mode != "crop")
+		throw std::runtime_error("StabiliseStage: unknown mode " + mode);
+	config_.warp = mode == "warp";
+	config_.margin = std::clamp(params.get<float>("margin", 0.1), 0.01f, 0.25f);
+	config_.lag = params.get<unsigned int>("lag", 15);
+	config_.motion.block_size = std::max(params.get<unsigned int>("block_size", 16), 4u);
+	config_.motion.grid_x = std::max(params.get<unsigned int>("grid_x", 5), 2u);
+	config_.motion.grid_y = std::max(params.get<unsigned int>("grid_y", 4), 2u);
+	config_.motion.search_range = std::clamp(params.get<unsigned int>("search_range", 8), 1u, 32u);
+	config_.motion.min_texture = params.get<unsigned int>("min_texture", 4);
+	config_.threads = std::clamp(params.get<unsigned int>("threads", 2), 1u, 8u);
+	config_.verbose = params.get<int>("verbose", 0);
+}
+
+void StabiliseStage::Configure()
+{
+	lores_stream_ = app_->LoresStream(&lores_info_);
+	if (!lores_stream_)
+		return;
+
+	unsigned int border = 2 * config_.motion.search_range + config_.motion.block_size;
+	if (lores_info_.width < border * 2 || lores_info_.height < border * 2)
+		throw std::runtime_error("StabiliseStage: low resolution image too small");
+
+	main_stream_ = app_->GetMainStream();
+	if (config_.warp)
+	{
+		if (!main_stream_)
+			throw std::runtime_error("StabiliseStage: no main stream to warp");
+		main_info_ = app_->GetStreamInfo(main_stream_);
+		if (main_info_.pixel_format != libcamera::formats::YUV420)
+			throw std::runtime_error("StabiliseStage: warp mode only supports YUV420");
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	previous_frame_.resize(lores_info_.width * lores_info_.height);
+	first_time_ = true;
+	path_ = CameraPath(config_.lag);
+	residual_sum_ = raw_sum_ = 0;
+	count_ = 0;
+	free_buffers_.clear();
+}
+
+bool StabiliseStage::Process(CompletedRequestPtr &completed_request)
+{
+	if (!lores_stream_)
+		return false;
+
+	StabiliseResult result;
+	std::vector<uint8_t> buffer;
+	float window_x = 0, window_y = 0;
+
+	{
+		BufferReadSync r(app_, completed_request->buffers[lores_stream_]);
+		const uint8_t *lores = r.Get()[0].data();
+
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		float motion_x = 0, motion_y = 0;
+		if (!first_time_ && !EstimateMotion(config_.motion, previous_frame_.data(), lores_info_.width, lores,
+											lores_info_.stride, lores_info_.width, lores_info_.height, motion_x,
+											motion_y))
+			motion_x = motion_y = 0;
+
+		for (unsigned int y = 0; y < lores_info_.height; y++)
+			memcpy(&previous_frame_[y * lores_info_.width], lores + y * lores_info_.stride, lores_info_.width);
+
+		if (config_.warp)
+		{
+			// Work in main image pixels. The low res image sees the same field of view.
+			float scale = (float)main_info_.width / lores_info_.width;
+			float old_x = path_.CorrectionX(), old_y = path_.CorrectionY();
+			result.motion_x = motion_x * scale;
+			result.motion_y = motion_y * scale;
+			path_.Update(result.motion_x, result.motion_y, config_.margin * main_info_.width,
+						 config_.margin * main_info_.height);
+			// Whatever the correction didn't take out is still in the output.
+			float residual_x = result.motion_x - (path_.CorrectionX() - old_x);
+			float residual_y = result.motion_y - (path_.CorrectionY() - old_y);
+			result.residual = std::hypot(residual_x, residual_y);
+			window_x = config_.margin * main_info_.width + path_.CorrectionX();
+			window_y = config_.margin * main_info_.height + path_.CorrectionY();
+
+			if (free_buffers_.empty())
+				free_buffers_.emplace_back();
+			buffer = std::move(free_buffers_.back());
+			free_buffers_.pop_back();
+		}
+		else
+		{
+			// Work in sensor pixels. The low res image follows the crop we set, so the crop
+			// movement must be added back on to get the true motion.
+			auto crop = completed_request->metadata.get(controls::ScalerCrop);
+			if (!crop)
+				return false;
+			if (first_time_)
+				base_crop_ = last_crop_ = *crop;
+
+			float scale = (float)crop->width / lores_info_.width;
+			float crop_dx = (crop->x + crop->width / 2.0) - (last_crop_.x + last_crop_.width / 2.0);
+			float crop_dy = (crop->y + crop->height / 2.0) - (last_crop_.y + last_crop_.height / 2.0);
+			last_crop_ = *crop;
+
+			unsigned int width = base_crop_.width * (1 - 2 * config_.margin);
+			unsigned int height = base_crop_.height * (1 - 2 * config_.margin);
+			result.motion_x = motion_x * scale + crop_dx;
+			result.motion_y = motion_y * scale + crop_dy;
+			path_.Update(result.motion_x, result.motion_y, (base_crop_.width - width) / 2,
+						 (base_crop_.height - height) / 2);
+			result.residual = std::hypot(motion_x * scale, motion_y * scale);
+
+			Rectangle new_crop(base_crop_.x + (base_crop_.width - width) / 2 + std::lround(path_.CorrectionX()),
+							   base_crop_.y + (base_crop_.height - height) / 2 + std::lround(path_.CorrectionY()),
+							   width, height);
+			libcamera::ControlList controls;
+			controls.set(controls::ScalerCrop, new_crop);
+			app_->SetControls(controls);
+		}
+
+		result.correction_x = path_.CorrectionX();
+		result.correction_y = path_.CorrectionY();
+		if (!first_time_)
+		{
+			count_++;
+			residual_sum_ += result.residual * result.residual;
+			raw_sum_ += result.motion_x * result.motion_x + result.motion_y * result.motion_y;
+			result.residual_rms = std::sqrt(residual_sum_ / count_);
+			result.raw_rms = std::sqrt(raw_sum_ / count_);
+		}
+		first_time_ = false;
+	}
+
+	if (config_.warp)
+	{
+		BufferWriteSync w(app_, completed_request->buffers[main_stream_]);
+		libcamera::Span<uint8_t> span = w.Get()[0];
+		buffer.resize(span.size());
+		memcpy(buffer.data(), span.data(), span.size());
+		warp(span.data(), buffer.data(), window_x, window_y);
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		free_buffers_.push_back(std::move(buffer));
+	}
+
+	if (config_.verbose)
+		LOG(1, "Stabilise: " << result.toString());
+
+	completed_request->post_process_metadata.Set("stabilise.result", result);
+
+	return false;
+}
+
+// Bilinear resampling of the window at (x, y) back up to the full plane size, for the
+// output rows y0 to y1. We do the horizontal interpolation into two rows of 16-bit
+// values, after which the vertical blend is a simple vectorisable loop.
+
+void StabiliseStage::warpPlane(uint8_t *dst, const uint8_t *src, unsigned int width, unsigned int height,
+							   unsigned int stride, float x, float y, float scale, unsigned int y0,
+							   unsigned int y1) const
+{
+	std::vector<unsigned int> cols(width);
+	std::vector<uint16_t> weights(width), row0(width), row1(width);
+	for (unsigned int i = 0; i < width; i++)
+	{
+		float sx = std::clamp(x + i * scale, 0.0f, width - 1.001f);
+		cols[i] = sx;
+		weights[i] = (sx - cols[i]) * 256;
+	}
+
+	for (unsigned int j = y0; j < y1; j++)
+	{
+		float sy = std::clamp(y + j * scale, 0.0f, height - 1.001f);
+		unsigned int row = sy;
+		uint32_t wy = (sy - row) * 256;
+		const uint8_t *a = src + row * stride, *b = a + stride;
+
+		for (unsigned int i = 0; i < width; i++)
+		{
+			unsigned int c = cols[i], w = weights[i];
+			row0[i] = a[c] * (256 - w) + a[c + 1] * w;
+			row1[i] = b[c] * (256 - w) + b[c + 1] * w;
+		}
+
+		uint8_t *out = dst + j * stride;
+		for (unsigned int i = 0; i < width; i++)
+			out[i] = (row0[i] * (256 - wy) + row1[i] * wy + 32768) >> 16;
+	}
+}
+
+void StabiliseStage::warp(uint8_t *dst, const uint8_t *src, float x, float y) const
+{
+	const float scale = 1 - 2 * config_.margin;
+	const unsigned int width = main_info_.width, height = main_info_.height, stride = main_info_.stride;
+	const unsigned int offset_U = height * stride, offset_V = offset_U + (height / 2) * (stride / 2);
+
+	// Each thread does a band of luma rows, and the matching chroma rows.
+	auto work = [&](unsigned int y0, unsigned int y1) {
+		warpPlane(dst, src, width, height, stride, x, y, scale, y0, y1);
+		warpPlane(dst + offset_U, src + offset_U, width / 2, height / 2, stride / 2, x / 2, y / 2, scale, y0 / 2,
+				  y1 / 2);
+		warpPlane(dst + offset_V, src + offset_V, width / 2, height / 2, stride / 2, x / 2, y / 2, scale, y0 / 2,
+				  y1 / 2);
+	};
+
+	unsigned int band = ((height + config_.threads - 1) / config_.threads + 1) & ~1;
+	std::vector<std::thread> threads;
+	for (unsigned int y0 = band; y0 < height; y0 += band)
+		threads.emplace_back(work, y0, std::min(y0 + band, height));
+	work(0, std::min(band, height));
+	for (auto &t : threads)
+		t.join();
+}
+
+static PostProcessingStage *Create(RPiCamApp *app)
+{
+	return new StabiliseStage(app);
+}
+
+static RegisterStage reg(NAME, &Create);
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * temporal_denoise.cpp - motion adaptive temporal filter
+ */
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "post_processing_stages/temporal_denoise.hpp"
+
+TemporalFilterParams::TemporalFilterParams(float threshold_levels, float strength_fraction)
+{
+	threshold = std::max<int>(threshold_levels * 16, 1);
+	strength = strength_fraction * 256;
+	ramp = (256 - strength) * 256 / threshold;
+}
+
+// The arithmetic is fixed point and branch free so that it vectorises.
+
+unsigned int TemporalFilterRows(uint8_t *image, unsigned int stride, uint16_t *history, unsigned int width,
+								unsigned int y0, unsigned int y1, TemporalFilterParams const &params)
+{
+	const int threshold = params.threshold, strength = params.strength, ramp = params.ramp;
+	unsigned int count = 0;
+
+	for (unsigned int y = y0; y < y1; y++)
+	{
+		uint8_t *pixels = image + y * stride;
+		uint16_t *hist = history + y * width;
+		for (unsigned int x = 0; x < width; x++)
+		{
+			int diff = (pixels[x] << 4) - hist[x];
+			int excess = std::max(std::abs(diff) - threshold, 0);
+			// Blend factor out of 256: "strength" below the threshold, rising to 1 at twice it.
+			int alpha = std::min(strength + ((excess * ramp) >> 8), 256);
+			int value = hist[x] + ((diff * alpha + 128) >> 8);
+			hist[x] = value;
+			pixels[x] = (value + 8) >> 4;
+			count += excess > 0;
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * temporal_denoise.hpp - motion adaptive temporal filter
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Fixed point filter settings for one plane, all in units of the 12-bit history.
+struct TemporalFilterParams
+{
+	// The threshold is in 8-bit levels, and strength is the fraction of a new value that is blended in below it.
+	TemporalFilterParams(float threshold, float strength);
+
+	int threshold;
+	int strength;
+	int ramp;
+};
+
+// Blend rows y0 to y1-1 of an 8-bit plane into its history (width values per row, with 4 fractional bits), and
+// write the result back into the plane. Pixels that differ from the history by more than the threshold are taken
+// as moving, and get more of the new value. Returns the number of moving pixels.
+unsigned int TemporalFilterRows(uint8_t *image, unsigned int stride, uint16_t *history, unsigned int width,
+								unsigned int y0, unsigned int y1, TemporalFilterParams const &params);
@@ -0,0 +1,184 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * temporal_denoise_stage.cpp - motion adaptive temporal denoise
+ */
+
+// A recursive temporal noise filter for the YUV420 main image. We keep a history
+// image and blend each new frame into it, writing the result back into the frame.
+// Where a pixel differs from the history by no more than we expect from noise alone,
+// only a small fraction ("strength") of the new value is blended in. Where it differs
+// by more, we assume something has moved and let the new value through, ramping up
+// to taking it completely at twice the threshold. This stops moving things smearing.
+
+// The noise level comes from the analogue and digital gains in the frame metadata,
+// as sigma = noise_constant + noise_slope * gain, and the threshold is "threshold"
+// multiples of sigma. Chroma noise is usually lower, so it can be scaled separately.
+
+// The history has 4 fractional bits, otherwise small blend factors would get stuck
+// short of the true value. The per-pixel filter (in temporal_denoise.cpp) is fixed
+// point so that it vectorises, and the image is split into bands of rows run in
+// parallel. Because the filter is recursive, frames must be handled one at a time.
+
+#include <algorithm>
+#include <thread>
+
+#include <libcamera/control_ids.h>
+#include <libcamera/stream.h>
+
+#include "core/rpicam_app.hpp"
+
+#include "post_processing_stages/post_processing_stage.hpp"
+#include "post_processing_stages/temporal_denoise.hpp"
+
+using Stream = libcamera::Stream;
+namespace controls = libcamera::controls;
+
+class TemporalDenoiseStage : public PostProcessingStage
+{
+public:
+	TemporalDenoiseStage(RPiCamApp *app) : PostProcessingStage(app) {}
+
+	char const *Name() const override;
+
+	void Read(boost::property_tree::ptree const &params) override;
+
+	void Configure() override;
+
+	bool Process(CompletedRequestPtr &completed_request) override;
+
+private:
+	void processBand(uint8_t *image, unsigned int y0, unsigned int y1, TemporalFilterParams const &luma,
+					 TemporalFilterParams const &chroma, unsigned int &moving);
+
+	struct Config
+	{
+		float strength;
+		float threshold;
+		float noise_constant;
+		float noise_slope;
+		float chroma_scale;
+		unsigned int threads;
+		bool verbose;
+	} config_;
+
+	Stream *stream_;
+	StreamInfo info_;
+	std::mutex mutex_;
+	// The Y, U and V planes of the history image, with no padding.
+	std::vector<uint16_t> history_;
+	bool first_time_;
+};
+
+#define NAME "temporal_denoise"
+
+char const *TemporalDenoiseStage::Name() const
+{
+	return NAME;
+}
+
+void TemporalDenoiseStage::Read(boost::property_tree::ptree const &params)
+{
+	config_.strength = std::clamp(params.get<float>("strength", 0.25), 0.02f, 1.0f);
+	config_.threshold = params.get<float>("threshold", 2.5);
+	config_.noise_constant = params.get<float>("noise_constant", 0.5);
+	config_.noise_slope = params.get<float>("noise_slope", 0.6);
+	config_.chroma_scale = params.get<float>("chroma_scale", 0.7);
+	config_.threads = std::clamp(params.get<unsigned int>("threads", 2), 1u, 8u);
+	config_.verbose = params.get<int>("verbose", 0);
+}
+
+void TemporalDenoiseStage::Configure()
+{
+	stream_ = app_->GetMainStream();
+	if (!stream_)
+		return;
+	info_ = app_->GetStreamInfo(stream_);
+	if (info_.pixel_format != libcamera::formats::YUV420)
+		throw std::runtime_error("TemporalDenoiseStage: only YUV420 supported");
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	history_.resize(info_.width * info_.height * 3 / 2);
+	first_time_ = true;
+}
+
+void TemporalDenoiseStage::processBand(uint8_t *image, unsigned int y0, unsigned int y1,
+									   TemporalFilterParams const &luma, TemporalFilterParams const &chroma,
+									   unsigned int &moving)
+{
+	const unsigned int width = info_.width, height = info_.height, stride = info_.stride;
+	uint16_t *hist_U = &history_[width * height], *hist_V = hist_U + (width / 2) * (height / 2);
+	uint8_t *U = image + height * stride, *V = U + (height / 2) * (stride / 2);
+
+	moving += TemporalFilterRows(image, stride, &history_[0], width, y0, y1, luma);
+	moving += TemporalFilterRows(U, stride / 2, hist_U, width / 2, y0 / 2, y1 / 2, chroma);
+	moving += TemporalFilterRows(V, stride / 2, hist_V, width / 2, y0 / 2, y1 / 2, chroma);
+}
+
+bool TemporalDenoiseStage::Process(CompletedRequestPtr &completed_request)
+{
+	if (!stream_)
+		return false;
+
+	BufferWriteSync w(app_, completed_request->buffers[stream_]);
+	uint8_t *image = w.Get()[0].data();
+	const unsigned int width = info_.width, height = info_.height, stride = info_.stride;
+
+	// The history is shared by all frames, and they must go through in turn.
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (first_time_)
+	{
+		uint16_t *hist = &history_[0];
+		for (unsigned int y = 0; y < height; y++)
+			for (unsigned int x = 0; x < width; x++)
+				*(hist++) = image[y * stride + x] << 4;
+		const uint8_t *chroma = image + height * stride;
+		for (unsigned int y = 0; y < height; y++) // U then V, each is height / 2 rows
+			for (unsigned int x = 0; x < width / 2; x++)
+				*(hist++) = chroma[y * (stride / 2) + x] << 4;
+		first_time_ = false;
+		return false;
+	}
+
+	float gain = completed_request->metadata.get(controls::AnalogueGain).value_or(1.0) *
+				 completed_request->metadata.get(controls::DigitalGain).value_or(1.0);
+	float sigma = config_.noise_constant + config_.noise_slope * gain;
+
+	TemporalFilterParams luma(config_.threshold * sigma, config_.strength);
+	TemporalFilterParams chroma(config_.threshold * sigma * config_.chroma_scale, config_.strength);
+
+	unsigned int rows = height & ~1;
+	unsigned int band = ((rows + config_.threads - 1) / config_.threads + 1) & ~1;
+	std::vector<unsigned int> moving(config_.threads, 0);
+	std::vector<std::thread> threads;
+	unsigned int i = 1;
+	for (unsigned int y0 = band; y0 < rows; y0 += band, i++)
+		threads.emplace_back(&TemporalDenoiseStage::processBand, this, image, y0, std::min(y0 + band, rows),
+							 std::cref(luma), std::cref(chroma), std::ref(moving[i]));
+	auto time_taken = ExecutionTime<std::micro>(&TemporalDenoiseStage::processBand, this, image, 0,
+												std::min(band, rows), luma, chroma, std::ref(moving[0]))
+						  .count();
+	for (auto &t : threads)
+		t.join();
+
+	if (config_.verbose)
+	{
+		unsigned int total = 0;
+		for (auto m : moving)
+			total += m;
+		LOG(1, "TemporalDenoise: gain " << gain << " sigma " << sigma << " moving "
+										<< 100.0 * total / (width * height * 3 / 2) << "% band time " << time_taken
+										<< "us");
+	}
+
+	return false;
+}
+
+static PostProcessingStage *Create(RPiCamApp *app)
+{
+	return new TemporalDenoiseStage(app);
+}
+
+static RegisterStage reg(NAME, &Create);
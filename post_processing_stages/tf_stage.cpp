@@ -6,6 +6,44 @@
  */
 #include "tf_stage.hpp"
 
+TensorInfo TfliteTensorInfo(const TfLiteTensor *tensor)
+{
+	TensorInfo info;
+	info.name = tensor->name ? tensor->name : "";
+	switch (tensor->type)
+	{
+	case kTfLiteUInt8:
+		info.type = TensorType::UInt8;
+		break;
+	case kTfLiteInt8:
+		info.type = TensorType::Int8;
+		break;
+	case kTfLiteInt32:
+		info.type = TensorType::Int32;
+		break;
+	case kTfLiteFloat32:
+		info.type = TensorType::Float32;
+		break;
+	default:
+		throw std::runtime_error("TfStage: tensor " + info.name + " has an unsupported type");
+	}
+	for (int i = 0; i < tensor->dims->size; i++)
+		info.shape.push_back(tensor->dims->data[i]);
+	if (info.type != TensorType::Float32)
+	{
+		info.scale = tensor->params.scale ? tensor->params.scale : 1.0f;
+		info.zero_point = tensor->params.zero_point;
+	}
+	return info;
+}
+
+Tensor TfliteTensor(const TfLiteTensor *tensor)
+{
+	// An empty owner makes the pointer a plain reference to the interpreter's memory.
+	std::shared_ptr<uint8_t> data(std::shared_ptr<uint8_t>(), reinterpret_cast<uint8_t *>(tensor->data.raw));
+	return { TfliteTensorInfo(tensor), data };
+}
+
 TfStage::TfStage(RPiCamApp *app, int tf_w, int tf_h) : PostProcessingStage(app), tf_w_(tf_w), tf_h_(tf_h)
 {
 	if (tf_w_ <= 0 || tf_h_ <= 0)
@@ -20,6 +58,12 @@ void TfStage::Read(boost::property_tree::ptree const &params)
 	config_->verbose = params.get<int>("verbose", 0);
 	config_->normalisation_offset = params.get<float>("normalisation_offset", 127.5);
 	config_->normalisation_scale = params.get<float>("normalisation_scale", 127.5);
+	if (params.find("tiling") != params.not_found())
+	{
+		if (!supportsTiling())
+			throw std::runtime_error(std::string(Name()) + ": tiling is not supported by this stage");
+		config_->tiling.Read(params.get_child("tiling"));
+	}
 
 	initialise();
 
@@ -87,12 +131,27 @@ void TfStage::Configure()
 	else if (config_->verbose)
 		LOG(1, "TfStage: No main stream");
 
+	tiling_ = false;
+	if (config_->tiling.enable)
+	{
+		if (main_stream_ && main_stream_info_.pixel_format == libcamera::formats::YUV420)
+		{
+			libcamera::Size main_size(main_stream_info_.width, main_stream_info_.height);
+			tile_scheduler_.Configure(config_->tiling, main_size, libcamera::Size(tf_w_, tf_h_));
+			tiling_ = true;
+			if (config_->verbose)
+				LOG(1, "TfStage: Tiling main stream with " << tiles().size() << " tiles");
+		}
+		else
+			LOG_ERROR("TfStage: WARNING: tiling requires a YUV420 main stream, tiling disabled");
+	}
+
 	checkConfiguration();
 }
 
 bool TfStage::Process(CompletedRequestPtr &completed_request)
 {
-	if (!lores_stream_)
+	if (!lores_stream_ && !tiling_)
 		return false;
 
 	{
@@ -100,17 +159,35 @@ bool TfStage::Process(CompletedRequestPtr &completed_request)
 		if (config_->refresh_rate && completed_request->sequence % config_->refresh_rate == 0 &&
 			(!future_ || future_->wait_for(std::chrono::seconds(0)) == std::future_status::ready))
 		{
-			BufferReadSync r(app_, completed_request->buffers[lores_stream_]);
-			libcamera::Span<uint8_t> buffer = r.Get()[0];
+			if (tiling_)
+			{
+				BufferReadSync r(app_, completed_request->buffers[main_stream_]);
+				libcamera::Span<uint8_t> buffer = r.Get()[0];
+
+				// Only copy out the tiles we want this time, straight into the network's input
+				// size. As below, this also gets us cached memory for the conversion to RGB.
+				tile_indices_ = tile_scheduler_.Next();
+				tile_copies_.resize(tile_indices_.size());
+				for (unsigned int i = 0; i < tile_indices_.size(); i++)
+					CopyYuv420Region(tile_copies_[i], buffer.data(), main_stream_info_, tiles()[tile_indices_[i]],
+									 libcamera::Size(tf_w_, tf_h_));
+			}
+			else
+			{
+				BufferReadSync r(app_, completed_request->buffers[lores_stream_]);
+				libcamera::Span<uint8_t> buffer = r.Get()[0];
 
-			// Copy the lores image here and let the asynchronous thread convert it to RGB.
-			// Doing the "extra" copy is in fact hugely beneficial because it turns uncacned
-			// memory into cached memory, which is then *much* quicker.
-			lores_copy_.assign(buffer.data(), buffer.data() + buffer.size());
+				// Copy the lores image here and let the asynchronous thread convert it to RGB.
+				// Doing the "extra" copy is in fact hugely beneficial because it turns uncacned
+				// memory into cached memory, which is then *much* quicker.
+				lores_copy_.assign(buffer.data(), buffer.data() + buffer.size());
+			}
 
 			future_ = std::make_unique<std::future<void>>();
 			*future_ = std::async(std::launch::async, [this] {
-				auto time_taken = ExecutionTime<std::micro>(&TfStage::runInference, this).count();
+				auto time_taken =
+					ExecutionTime<std::micro>(tiling_ ? &TfStage::runTiledInference : &TfStage::runInference, this)
+						.count();
 
 				if (config_->verbose)
 					LOG(1, "TfStage: Inference time: " << time_taken << " ms");
@@ -124,12 +201,9 @@ bool TfStage::Process(CompletedRequestPtr &completed_request)
 	return false;
 }
 
-void TfStage::runInference()
+void TfStage::setInputTensor(std::vector<uint8_t> const &rgb_image)
 {
 	int input = interpreter_->inputs()[0];
-	StreamInfo tf_info;
-	tf_info.width = tf_w_, tf_info.height = tf_h_, tf_info.stride = tf_w_ * 3;
-	std::vector<uint8_t> rgb_image = Yuv420ToRgb(lores_copy_.data(), lores_info_, tf_info);
 
 	if (interpreter_->tensor(input)->type == kTfLiteUInt8)
 	{
@@ -143,6 +217,15 @@ void TfStage::runInference()
 		for (unsigned int i = 0; i < rgb_image.size(); i++)
 			tensor[i] = (rgb_image[i] - config_->normalisation_offset) / config_->normalisation_scale;
 	}
+}
+
+void TfStage::runInference()
+{
+	StreamInfo tf_info;
+	tf_info.width = tf_w_, tf_info.height = tf_h_, tf_info.stride = tf_w_ * 3;
+	std::vector<uint8_t> rgb_image = Yuv420ToRgb(lores_copy_.data(), lores_info_, tf_info);
+
+	setInputTensor(rgb_image);
 
 	if (interpreter_->Invoke() != kTfLiteOk)
 		throw std::runtime_error("TfStage: Failed to invoke TFLite");
@@ -151,6 +234,31 @@ void TfStage::runInference()
 	interpretOutputs();
 }
 
+void TfStage::runTiledInference()
+{
+	// The tile copies are already the network input size, with no padding.
+	StreamInfo tile_info, tf_info;
+	tile_info.width = tf_w_, tile_info.height = tf_h_, tile_info.stride = tf_w_;
+	tf_info.width = tf_w_, tf_info.height = tf_h_, tf_info.stride = tf_w_ * 3;
+
+	// We only have the one interpreter, so the tiles simply run back to back.
+	for (unsigned int i = 0; i < tile_indices_.size(); i++)
+	{
+		std::vector<uint8_t> rgb_image = Yuv420ToRgb(tile_copies_[i].data(), tile_info, tf_info);
+
+		setInputTensor(rgb_image);
+
+		if (interpreter_->Invoke() != kTfLiteOk)
+			throw std::runtime_error("TfStage: Failed to invoke TFLite");
+
+		std::unique_lock<std::mutex> lock(output_mutex_);
+		interpretTileOutputs(tile_indices_[i], tiles()[tile_indices_[i]]);
+	}
+
+	std::unique_lock<std::mutex> lock(output_mutex_);
+	tilesComplete();
+}
+
 void TfStage::Stop()
 {
 	if (future_)
@@ -21,7 +21,9 @@
 #include "core/rpicam_app.hpp"
 #include "core/stream_info.hpp"
 
+#include "post_processing_stages/inference_backend.hpp"
 #include "post_processing_stages/post_processing_stage.hpp"
+#include "post_processing_stages/tiling.hpp"
 
 // The TfStage is a convenient base class from which post processing stages using
 // TensorFlowLite can be derived. It provides a certain amount of boiler plate code
@@ -36,8 +38,14 @@ struct TfConfig
 	bool verbose = false;
 	float normalisation_offset = 127.5;
 	float normalisation_scale = 127.5;
+	TilingConfig tiling;
 };
 
+// Describe a TFLite tensor for the common decoders (see detection_decoder.hpp), and wrap
+// its data without copying it. The data is only good until the interpreter runs again.
+TensorInfo TfliteTensorInfo(const TfLiteTensor *tensor);
+Tensor TfliteTensor(const TfLiteTensor *tensor);
+
 class TfStage : public PostProcessingStage
 {
 public:
@@ -79,6 +87,21 @@ protected:
 	// to the image, or even drawn onto the image itself.
 	virtual void applyResults(CompletedRequestPtr &completed_request) {}
 
+	// Stages that can run on tiles of the main image say so here, and implement the two
+	// functions below. The "tiling" parameter is rejected for any other stage.
+	virtual bool supportsTiling() const { return false; }
+
+	// When tiling is enabled, these are called instead of interpretOutputs. The first
+	// runs after each tile, where the tile is given in main image co-ordinates, and the
+	// second once all the tiles for this frame are done. Each frame only runs some of the
+	// tiles, and tileRotation() is how many frames it takes to run them all.
+	virtual void interpretTileOutputs(unsigned int index, libcamera::Rectangle const &tile) {}
+	virtual void tilesComplete() {}
+
+	bool tiling() const { return tiling_; }
+	std::vector<libcamera::Rectangle> const &tiles() const { return tile_scheduler_.Tiles(); }
+	unsigned int tileRotation() const { return tile_scheduler_.Rotation(); }
+
 	std::unique_ptr<TfConfig> config_;
 
 	// The width and height that TFLite wants.
@@ -98,9 +121,17 @@ protected:
 private:
 	void initialise();
 	void runInference();
+	void runTiledInference();
+	void setInputTensor(std::vector<uint8_t> const &rgb_image);
 
 	std::mutex future_mutex_;
 	std::unique_ptr<std::future<void>> future_;
 	std::vector<uint8_t> lores_copy_;
 	std::mutex output_mutex_;
+
+	// Tiling state, only used when the main stream is being tiled.
+	bool tiling_ = false;
+	TileScheduler tile_scheduler_;
+	std::vector<unsigned int> tile_indices_;
+	std::vector<std::vector<uint8_t>> tile_copies_;
 };
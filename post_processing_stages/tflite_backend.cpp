@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * tflite_backend.cpp - TensorFlowLite inference backend
+ */
+
+// TFLite runs its models synchronously on the CPU, so jobs are queued up and run one
+// at a time on a thread of the backend's own. The interpreter may still use several
+// threads for each job ("number_of_threads"). Models that allow it can take batches of
+// up to "max_batch" images in a job, by resizing the batch dimension of the input.
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/kernels/register.h"
+
+#include "post_processing_stages/inference_backend.hpp"
+#include "post_processing_stages/tf_stage.hpp"
+
+namespace
+{
+
+class TfliteBackend : public InferenceBackend
+{
+public:
+	TfliteBackend()
+		: queue_([this](const uint8_t *input, size_t size, std::vector<Tensor> &outputs) {
+			  return run(input, size, outputs);
+		  })
+	{
+	}
+
+	void Load(boost::property_tree::ptree const &params) override;
+
+	std::vector<TensorInfo> const &Inputs() const override { return inputs_; }
+	std::vector<TensorInfo> const &Outputs() const override { return outputs_; }
+
+	int Submit([[maybe_unused]] unsigned int sequence, const uint8_t *input) override
+	{
+		return queue_.Submit(input, inputs_[0].Elements());
+	}
+
+	unsigned int MaxBatch() const override { return max_batch_; }
+
+	int SubmitBatch([[maybe_unused]] unsigned int sequence, const uint8_t *input, unsigned int count) override
+	{
+		if (count < 1 || count > max_batch_)
+			return -1;
+		return queue_.Submit(input, count * inputs_[0].Elements());
+	}
+
+	InferenceStatus Poll(int job, std::vector<Tensor> &outputs, std::chrono::milliseconds timeout) override
+	{
+		return queue_.Poll(job, outputs, timeout);
+	}
+
+private:
+	bool run(const uint8_t *input, size_t size, std::vector<Tensor> &outputs);
+
+	std::unique_ptr<tflite::FlatBufferModel> model_;
+	std::unique_ptr<tflite::Interpreter> interpreter_;
+	unsigned int max_batch_;
+	// The batch size the interpreter's tensors are currently allocated for.
+	unsigned int batch_size_;
+	float normalisation_offset_;
+	float normalisation_scale_;
+	std::vector<TensorInfo> inputs_;
+	std::vector<TensorInfo> outputs_;
+	InferenceQueue queue_;
+};
+
+void TfliteBackend::Load(boost::property_tree::ptree const &params)
+{
+	normalisation_offset_ = params.get<float>("normalisation_offset", 127.5);
+	normalisation_scale_ = params.get<float>("normalisation_scale", 127.5);
+
+	std::string model_file = params.get<std::string>("model_file");
+	model_ = tflite::FlatBufferModel::BuildFromFile(model_file.c_str());
+	if (!model_)
+		throw std::runtime_error("TfliteBackend: Failed to load model");
+
+	tflite::ops::builtin::BuiltinOpResolver resolver;
+	tflite::InterpreterBuilder(*model_, resolver)(&interpreter_);
+	if (!interpreter_)
+		throw std::runtime_error("TfliteBackend: Failed to construct interpreter");
+	interpreter_->SetNumThreads(params.get<int>("number_of_threads", 2));
+	if (interpreter_->AllocateTensors() != kTfLiteOk)
+		throw std::runtime_error("TfliteBackend: Failed to allocate tensors");
+	max_batch_ = std::max(params.get<unsigned int>("max_batch", 1), 1u);
+	batch_size_ = 1;
+
+	inputs_.clear();
+	for (int index : interpreter_->inputs())
+		inputs_.push_back(TfliteTensorInfo(interpreter_->tensor(index)));
+	outputs_.clear();
+	for (int index : interpreter_->outputs())
+		outputs_.push_back(TfliteTensorInfo(interpreter_->tensor(index)));
+
+	if (inputs_[0].type == TensorType::Int32)
+		throw std::runtime_error("TfliteBackend: Input tensor data type not supported");
+}
+
+bool TfliteBackend::run(const uint8_t *input, size_t size, std::vector<Tensor> &outputs)
+{
+	// Only the queue's thread ever uses the interpreter.
+	int index = interpreter_->inputs()[0];
+	const unsigned int count = size / inputs_[0].Elements();
+	if (count != batch_size_)
+	{
+		// Resizing the tensors is not free, so we only do it when the batch size changes.
+		std::vector<int> dims(inputs_[0].shape.begin(), inputs_[0].shape.end());
+		dims[0] = count;
+		if (interpreter_->ResizeInputTensor(index, dims) != kTfLiteOk ||
+			interpreter_->AllocateTensors() != kTfLiteOk)
+			return false;
+		batch_size_ = count;
+	}
+
+	if (inputs_[0].type == TensorType::UInt8)
+		std::copy(input, input + size, interpreter_->typed_tensor<uint8_t>(index));
+	else if (inputs_[0].type == TensorType::Int8)
+	{
+		// Fully quantised models take pixels with a zero point of -128.
+		int8_t *tensor = interpreter_->typed_tensor<int8_t>(index);
+		for (size_t i = 0; i < size; i++)
+			tensor[i] = input[i] - 128;
+	}
+	else
+	{
+		float *tensor = interpreter_->typed_tensor<float>(index);
+		for (size_t i = 0; i < size; i++)
+			tensor[i] = (input[i] - normalisation_offset_) / normalisation_scale_;
+	}
+
+	if (interpreter_->Invoke() != kTfLiteOk)
+		return false;
+
+	for (int index : interpreter_->outputs())
+	{
+		const TfLiteTensor *tensor = interpreter_->tensor(index);
+		Tensor output = MakeTensor(TfliteTensorInfo(tensor));
+		memcpy(output.data.get(), tensor->data.raw, std::min(tensor->bytes, output.info.Bytes()));
+		outputs.push_back(std::move(output));
+	}
+
+	return true;
+}
+
+InferenceBackend *Create()
+{
+	return new TfliteBackend();
+}
+
+RegisterInferenceBackend reg("tflite", &Create);
+
+} // namespace
@@ -0,0 +1,167 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * tiling.cpp - tiled inference helpers
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "detection_decoder.hpp"
+#include "tiling.hpp"
+
+using Rectangle = libcamera::Rectangle;
+using Size = libcamera::Size;
+
+void TilingConfig::Read(boost::property_tree::ptree const &params)
+{
+	enable = true;
+	tiles_per_frame = std::max(params.get<unsigned int>("tiles_per_frame", 2), 1u);
+	overlap = std::clamp(params.get<float>("overlap", 0.2), 0.0f, 0.9f);
+	full_frame = params.get<int>("full_frame", 1);
+	overlap_threshold = params.get<float>("overlap_threshold", 0.5);
+}
+
+// Return the (even) start positions of tiles of the given length that cover the
+// whole length, overlapping by at least the given fraction.
+static std::vector<unsigned int> tile_positions(unsigned int length, unsigned int tile, float overlap)
+{
+	if (tile >= length)
+		return { 0 };
+
+	unsigned int step = std::max<unsigned int>(tile * (1 - overlap), 1);
+	unsigned int num = (length - tile + step - 1) / step + 1;
+	std::vector<unsigned int> positions;
+	// Spread the tiles out evenly so that the last one finishes at the image edge.
+	for (unsigned int i = 0; i < num; i++)
+		positions.push_back(((uint64_t)i * (length - tile) / (num - 1)) & ~1);
+
+	return positions;
+}
+
+void TileScheduler::Configure(TilingConfig const &config, Size const &image_size, Size const &tile_size)
+{
+	tiles_.clear();
+
+	Size size = tile_size.boundedTo(image_size);
+	for (unsigned int y : tile_positions(image_size.height, size.height, config.overlap))
+	{
+		for (unsigned int x : tile_positions(image_size.width, size.width, config.overlap))
+			tiles_.emplace_back(x, y, size);
+	}
+
+	// There's no point in a full frame tile if a single tile covers the image anyway.
+	if (config.full_frame && tiles_.size() > 1)
+		tiles_.emplace_back(0, 0, image_size);
+
+	budget_ = std::min<unsigned int>(config.tiles_per_frame, tiles_.size());
+	next_ = 0;
+}
+
+std::vector<unsigned int> TileScheduler::Next()
+{
+	std::vector<unsigned int> indices;
+	for (unsigned int i = 0; i < budget_; i++)
+	{
+		indices.push_back(next_);
+		next_ = (next_ + 1) % tiles_.size();
+	}
+	return indices;
+}
+
+void TileResults::Configure(unsigned int num_tiles, unsigned int max_age)
+{
+	max_age_ = max_age;
+	tiles_.assign(num_tiles, { {}, max_age });
+}
+
+void TileResults::Set(unsigned int index, std::vector<Detection> detections)
+{
+	tiles_[index] = { std::move(detections), 0 };
+}
+
+std::vector<Detection> TileResults::Merge(float overlap_threshold)
+{
+	std::vector<Detection> detections;
+	for (auto &tile : tiles_)
+	{
+		if (tile.age < max_age_)
+		{
+			detections.insert(detections.end(), tile.detections.begin(), tile.detections.end());
+			tile.age++;
+		}
+	}
+
+	NmsDetections(detections, overlap_threshold);
+	return detections;
+}
+
+void CopyYuv420Region(std::vector<uint8_t> &dst, const uint8_t *src, StreamInfo const &src_info,
+					  Rectangle const &region, Size const &out_size)
+{
+	unsigned int out_w2 = out_size.width / 2, out_h2 = out_size.height / 2;
+	unsigned int src_stride2 = src_info.stride / 2;
+	dst.resize(out_size.width * out_size.height * 3 / 2);
+
+	const uint8_t *src_Y = src + region.y * src_info.stride + region.x;
+	const uint8_t *src_U = src + src_info.height * src_info.stride + (region.y / 2) * src_stride2 + region.x / 2;
+	const uint8_t *src_V = src_U + (src_info.height / 2) * src_stride2;
+	uint8_t *dst_Y = dst.data(), *dst_U = dst_Y + out_size.width * out_size.height, *dst_V = dst_U + out_w2 * out_h2;
+
+	if (region.width == out_size.width && region.height == out_size.height)
+	{
+		// A straight crop, which is what we normally expect.
+		for (unsigned int y = 0; y < out_size.height; y++)
+			memcpy(dst_Y + y * out_size.width, src_Y + y * src_info.stride, out_size.width);
+		for (unsigned int y = 0; y < out_h2; y++)
+		{
+			memcpy(dst_U + y * out_w2, src_U + y * src_stride2, out_w2);
+			memcpy(dst_V + y * out_w2, src_V + y * src_stride2, out_w2);
+		}
+		return;
+	}
+
+	// Otherwise sample the nearest pixels. Work out the column offsets once only.
+	std::vector<unsigned int> cols(out_size.width);
+	for (unsigned int x = 0; x < out_size.width; x++)
+		cols[x] = x * region.width / out_size.width;
+
+	for (unsigned int y = 0; y < out_size.height; y++)
+	{
+		const uint8_t *row = src_Y + (y * region.height / out_size.height) * src_info.stride;
+		for (unsigned int x = 0; x < out_size.width; x++)
+			*(dst_Y++) = row[cols[x]];
+	}
+	for (unsigned int y = 0; y < out_h2; y++)
+	{
+		unsigned int off = (y * region.height / out_size.height) * src_stride2;
+		const uint8_t *row_U = src_U + off, *row_V = src_V + off;
+		for (unsigned int x = 0; x < out_w2; x++)
+		{
+			*(dst_U++) = row_U[cols[2 * x] / 2];
+			*(dst_V++) = row_V[cols[2 * x] / 2];
+		}
+	}
+}
+
+Rectangle TileToImage(Rectangle const &tile, float x0, float y0, float x1, float y1)
+{
+	x0 = std::clamp(x0, 0.0f, 1.0f), x1 = std::clamp(x1, x0, 1.0f);
+	y0 = std::clamp(y0, 0.0f, 1.0f), y1 = std::clamp(y1, y0, 1.0f);
+	int x = tile.x + std::lround(x0 * tile.width);
+	int y = tile.y + std::lround(y0 * tile.height);
+	unsigned int w = std::lround((x1 - x0) * tile.width);
+	unsigned int h = std::lround((y1 - y0) * tile.height);
+	return Rectangle(x, y, w, h);
+}
+
+void NmsDetections(std::vector<Detection> &detections, float overlap_threshold)
+{
+	Nms(detections, overlap_threshold, std::numeric_limits<unsigned int>::max(),
+		[](Detection const &kept, Detection const &detection) {
+			return kept.category == detection.category ? IntersectionOverSmaller(kept.box, detection.box) : 0.0f;
+		});
+}
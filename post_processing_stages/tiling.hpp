@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * tiling.hpp - tiled inference helpers
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include <libcamera/geometry.h>
+
+#include "core/stream_info.hpp"
+
+#include "post_processing_stages/object_detect.hpp"
+
+// Inference stages normally look at the whole low resolution image, squashed down
+// to the network input size, so small objects can simply disappear. Tiling instead
+// cuts overlapping network-sized tiles out of the full resolution main image. We
+// don't have the horsepower to run every tile on every frame, so each frame only
+// gets a "budget" of tiles and we rotate through the whole set over several frames.
+
+struct TilingConfig
+{
+	bool enable = false;
+	// Maximum number of tiles to run inference on in each frame.
+	unsigned int tiles_per_frame = 2;
+	// Fraction of the tile size by which neighbouring tiles overlap.
+	float overlap = 0.2;
+	// Also include the whole image (scaled to the network size) as an extra "tile",
+	// so that large objects split across tiles are still found.
+	bool full_frame = true;
+	// Two detections of the same class are duplicates if their intersection exceeds
+	// this fraction of the area of either one. Using the smaller box (rather than the
+	// union) means objects cut in half by a tile edge still merge.
+	float overlap_threshold = 0.5;
+	void Read(boost::property_tree::ptree const &params);
+};
+
+class TileScheduler
+{
+public:
+	// Lay out overlapping tiles of tile_size over an image of image_size.
+	void Configure(TilingConfig const &config, libcamera::Size const &image_size, libcamera::Size const &tile_size);
+
+	// All the tiles, in main image co-ordinates. The full frame tile, if any, is last.
+	std::vector<libcamera::Rectangle> const &Tiles() const { return tiles_; }
+
+	// Return the indices of the tiles to process in this frame, advancing through the
+	// complete list of tiles on successive calls.
+	std::vector<unsigned int> Next();
+
+	// The number of calls to Next() that it takes to get round all the tiles.
+	unsigned int Rotation() const { return budget_ ? (tiles_.size() + budget_ - 1) / budget_ : 0; }
+
+private:
+	std::vector<libcamera::Rectangle> tiles_;
+	unsigned int budget_ = 0;
+	unsigned int next_ = 0;
+};
+
+// As each tile only runs every few frames, this keeps the latest detections from each one, so that every frame can
+// report them all. A tile's detections are dropped once they're max_age frames old, which should be one rotation
+// through the tiles, so nothing lingers from a tile that has stopped giving results.
+class TileResults
+{
+public:
+	void Configure(unsigned int num_tiles, unsigned int max_age);
+
+	// Replace a tile's detections with the ones it has just produced.
+	void Set(unsigned int index, std::vector<Detection> detections);
+
+	// The detections from all the tiles that are recent enough, with the duplicates where tiles overlap removed.
+	// Each call counts as a frame going by.
+	std::vector<Detection> Merge(float overlap_threshold);
+
+private:
+	struct Tile
+	{
+		std::vector<Detection> detections;
+		unsigned int age;
+	};
+	std::vector<Tile> tiles_;
+	unsigned int max_age_ = 0;
+};
+
+// Copy a region of a YUV420 image into a packed YUV420 buffer of the given output
+// size (so the output stride is just its width). Where the region and output sizes
+// differ, pixels are nearest-neighbour sampled. The output size must be even.
+void CopyYuv420Region(std::vector<uint8_t> &dst, const uint8_t *src, StreamInfo const &src_info,
+					  libcamera::Rectangle const &region, libcamera::Size const &out_size);
+
+// Map a box, given in normalised (0 to 1) co-ordinates within a tile, back into the
+// co-ordinate space the tile was cut from.
+libcamera::Rectangle TileToImage(libcamera::Rectangle const &tile, float x0, float y0, float x1, float y1);
+
+// Class-aware non-maximum suppression. Where two detections of the same category
+// overlap by more than the threshold, as intersection over the smaller box, only the
+// more confident one is kept. The results are in order of decreasing confidence.
+void NmsDetections(std::vector<Detection> &detections, float overlap_threshold);
@@ -0,0 +1,222 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * tone_curve.cpp - tone curve LUTs and 3D LUT grading helpers
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "post_processing_stages/tone_curve.hpp"
+
+using ColorSpace = libcamera::ColorSpace;
+
+YuvMatrix::YuvMatrix(std::optional<ColorSpace> const &colour_space)
+{
+	kr = 0.299, kb = 0.114, full_range = true;
+	if (!colour_space)
+		return;
+	if (colour_space->ycbcrEncoding == ColorSpace::YcbcrEncoding::Rec709)
+		kr = 0.2126, kb = 0.0722;
+	else if (colour_space->ycbcrEncoding == ColorSpace::YcbcrEncoding::Rec2020)
+		kr = 0.2627, kb = 0.0593;
+	full_range = colour_space->range == ColorSpace::Range::Full;
+}
+
+void YuvMatrix::ToRgb(double y, double u, double v, double rgb[3]) const
+{
+	if (full_range)
+		y /= 255, u = (u - 128) / 255, v = (v - 128) / 255;
+	else
+		y = (y - 16) / 219, u = (u - 128) / 224, v = (v - 128) / 224;
+	rgb[0] = y + 2 * (1 - kr) * v;
+	rgb[2] = y + 2 * (1 - kb) * u;
+	rgb[1] = (y - kr * rgb[0] - kb * rgb[2]) / (1 - kr - kb);
+}
+
+void YuvMatrix::FromRgb(double const rgb[3], double yuv[3]) const
+{
+	double y = kr * rgb[0] + (1 - kr - kb) * rgb[1] + kb * rgb[2];
+	double u = (rgb[2] - y) / (2 * (1 - kb)), v = (rgb[0] - y) / (2 * (1 - kr));
+	if (full_range)
+		yuv[0] = y * 255, yuv[1] = u * 255 + 128, yuv[2] = v * 255 + 128;
+	else
+		yuv[0] = y * 219 + 16, yuv[1] = u * 224 + 128, yuv[2] = v * 224 + 128;
+}
+
+void Cube::Load(std::string const &filename)
+{
+	std::ifstream file(filename);
+	if (!file)
+		throw std::runtime_error("ToneCurveStage: failed to open " + filename);
+
+	size = 0;
+	data.clear();
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream s(line);
+		std::string keyword;
+		if (!(s >> keyword) || keyword[0] == '#' || keyword == "TITLE" || keyword == "LUT_1D_SIZE")
+			continue;
+		if (keyword == "LUT_3D_SIZE")
+		{
+			s >> size;
+			if (size < 2 || size > 256)
+				throw std::runtime_error("ToneCurveStage: bad LUT_3D_SIZE in " + filename);
+			data.reserve(size * size * size * 3);
+		}
+		else if (keyword == "DOMAIN_MIN")
+			s >> domain_min[0] >> domain_min[1] >> domain_min[2];
+		else if (keyword == "DOMAIN_MAX")
+			s >> domain_max[0] >> domain_max[1] >> domain_max[2];
+		else
+		{
+			float r = std::stof(keyword), g, b;
+			if (!(s >> g >> b))
+				throw std::runtime_error("ToneCurveStage: bad line in " + filename + ": " + line);
+			data.push_back(r), data.push_back(g), data.push_back(b);
+		}
+	}
+
+	if (!size || data.size() != size * size * size * 3)
+		throw std::runtime_error("ToneCurveStage: incomplete 3D LUT in " + filename);
+}
+
+void Cube::Eval(double const in[3], double out[3]) const
+{
+	unsigned int index[3];
+	double frac[3];
+	for (unsigned int c = 0; c < 3; c++)
+	{
+		double pos = (in[c] - domain_min[c]) / (domain_max[c] - domain_min[c]) * (size - 1);
+		index[c] = std::clamp<int>(std::floor(pos), 0, size - 2);
+		frac[c] = pos - index[c];
+	}
+
+	auto at = [this, &index](unsigned int r, unsigned int g, unsigned int b) {
+		return &data[(((index[2] + b) * size + index[1] + g) * size + index[0] + r) * 3];
+	};
+	// Walk from the (0,0,0) corner to the (1,1,1) corner along the edges in order of
+	// decreasing fraction, which identifies the tetrahedron.
+	unsigned int order[3] = { 0, 1, 2 };
+	std::sort(order, order + 3, [&frac](unsigned int a, unsigned int b) { return frac[a] > frac[b]; });
+	unsigned int corner[3] = { 0, 0, 0 };
+	const float *prev = at(0, 0, 0);
+	for (unsigned int c = 0; c < 3; c++)
+		out[c] = prev[c];
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		corner[order[i]] = 1;
+		const float *next = at(corner[0], corner[1], corner[2]);
+		for (unsigned int c = 0; c < 3; c++)
+			out[c] += frac[order[i]] * (next[c] - prev[c]);
+		prev = next;
+	}
+}
+
+// Turn the curves into Pwls over 0 to 255, and then into the LUTs we actually use. The
+// lift/gamma/gain curve gets a knot at every input value, so that the LUT is exact even
+// where a small gamma makes it very steep.
+
+void ToneCurves::BuildLuts(uint8_t lut_y[256], uint8_t lut_u[256], uint8_t lut_v[256]) const
+{
+	const Pwl::Interval domain(0, 255);
+
+	Pwl lgg;
+	for (unsigned int i = 0; i < 256; i++)
+	{
+		double x = i / 255.0;
+		double y = std::pow(std::max(lift + x * (gain - lift), 0.0), 1 / gamma);
+		lgg.Append(i, std::clamp(y * 255, 0.0, 255.0));
+	}
+	Pwl y = y_curve.Empty() ? lgg : lgg.Compose(y_curve);
+	y.MatchDomain(domain);
+
+	auto chroma_curve = [&](Pwl const &curve) {
+		Pwl c;
+		c.Append(0, 128 - 128 * saturation);
+		c.Append(255, 128 + 127 * saturation);
+		if (!curve.Empty())
+			c = c.Compose(curve);
+		c.MatchDomain(domain);
+		return c;
+	};
+	Pwl u = chroma_curve(u_curve), v = chroma_curve(v_curve);
+
+	std::vector<double> y_lut = y.GenerateLut<double>();
+	std::vector<double> u_lut = u.GenerateLut<double>();
+	std::vector<double> v_lut = v.GenerateLut<double>();
+	for (unsigned int i = 0; i < 256; i++)
+	{
+		lut_y[i] = std::clamp<long>(std::lround(y_lut[i]), 0, 255);
+		lut_u[i] = std::clamp<long>(std::lround(u_lut[i]), 0, 255);
+		lut_v[i] = std::clamp<long>(std::lround(v_lut[i]), 0, 255);
+	}
+}
+
+void YuvGrid::Build(Cube const &cube, YuvMatrix const &matrix, unsigned int size)
+{
+	const unsigned int n = size;
+	size_ = n;
+	grid_.resize(n * n * n * 3);
+	for (unsigned int iy = 0; iy < n; iy++)
+	{
+		for (unsigned int iu = 0; iu < n; iu++)
+		{
+			for (unsigned int iv = 0; iv < n; iv++)
+			{
+				double rgb[3], graded[3], yuv[3];
+				matrix.ToRgb(iy * 255.0 / (n - 1), iu * 255.0 / (n - 1), iv * 255.0 / (n - 1), rgb);
+				cube.Eval(rgb, graded);
+				matrix.FromRgb(graded, yuv);
+				int16_t *node = &grid_[((iy * n + iu) * n + iv) * 3];
+				for (unsigned int c = 0; c < 3; c++)
+					node[c] = std::clamp<long>(std::lround(yuv[c] * 16), 0, 255 * 16);
+			}
+		}
+	}
+
+	for (unsigned int i = 0; i < 256; i++)
+	{
+		unsigned int pos = (i * (n - 1) * 256 + 127) / 255;
+		index_[i] = std::min(pos >> 8, n - 2);
+		frac_[i] = pos - index_[i] * 256;
+	}
+}
+
+void YuvGrid::Error(Cube const &cube, YuvMatrix const &matrix, unsigned int step, double &mean, double &max) const
+{
+	double total = 0;
+	unsigned int count = 0;
+	max = 0;
+	for (unsigned int y = 0; y < 256; y += step)
+	{
+		for (unsigned int u = 0; u < 256; u += step)
+		{
+			for (unsigned int v = 0; v < 256; v += step)
+			{
+				double rgb[3], graded[3], expected[3];
+				matrix.ToRgb(y, u, v, rgb);
+				if (std::any_of(rgb, rgb + 3, [](double c) { return c < 0 || c > 1; }))
+					continue;
+				cube.Eval(rgb, graded);
+				matrix.FromRgb(graded, expected);
+				int out[3];
+				Lookup(y, u, v, 0, 3, out);
+				for (unsigned int c = 0; c < 3; c++)
+				{
+					double error = std::abs(std::clamp(expected[c], 0.0, 255.0) - out[c]);
+					max = std::max(max, error);
+					total += error;
+				}
+				count += 3;
+			}
+		}
+	}
+	mean = total / std::max(count, 1u);
+}
@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * tone_curve.hpp - tone curve LUTs and 3D LUT grading helpers
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <libcamera/color_space.h>
+
+#include "post_processing_stages/pwl.hpp"
+
+// Conversions between 8-bit YUV and 0 to 1 RGB for a particular colour space.
+struct YuvMatrix
+{
+	YuvMatrix(std::optional<libcamera::ColorSpace> const &colour_space);
+
+	void ToRgb(double y, double u, double v, double rgb[3]) const;
+	void FromRgb(double const rgb[3], double yuv[3]) const;
+
+	double kr, kb;
+	bool full_range;
+};
+
+// An RGB 3D LUT, normally loaded from a .cube file.
+struct Cube
+{
+	void Load(std::string const &filename);
+
+	// Tetrahedral interpolation of the cube. Red varies fastest in the file. Inputs
+	// outside the domain are extrapolated from the edge cells rather than clipped, as
+	// our YUV grid has nodes outside the RGB gamut and clipping those would spoil the
+	// interpolation of valid colours near them.
+	void Eval(double const in[3], double out[3]) const;
+
+	unsigned int size = 0;
+	double domain_min[3] = { 0, 0, 0 };
+	double domain_max[3] = { 1, 1, 1 };
+	std::vector<float> data;
+};
+
+// Per-channel curves. Luma gets lift, gamma and gain, followed by the y_curve Pwl. The
+// chroma channels get a saturation adjustment and then the u_curve and v_curve Pwls.
+// Empty Pwls are left out.
+struct ToneCurves
+{
+	double lift = 0, gamma = 1, gain = 1;
+	double saturation = 1;
+	Pwl y_curve, u_curve, v_curve;
+
+	// Compile the curves into 8-bit LUTs.
+	void BuildLuts(uint8_t lut_y[256], uint8_t lut_u[256], uint8_t lut_v[256]) const;
+};
+
+// A Cube resampled onto a YUV grid, so that it can be applied directly to YUV pixels with
+// fixed point tetrahedral interpolation.
+class YuvGrid
+{
+public:
+	void Build(Cube const &cube, YuvMatrix const &matrix, unsigned int size);
+	void Clear() { grid_.clear(); }
+	bool Empty() const { return grid_.empty(); }
+
+	// Look up output channels first to last-1 for these 8-bit YUV values. This is the inner
+	// loop when grading an image, so it's here to be inlined.
+	void Lookup(unsigned int y, unsigned int u, unsigned int v, unsigned int first, unsigned int last,
+				int out[3]) const
+	{
+		const unsigned int n = size_, dv = 3, du = n * 3, dy = n * n * 3;
+		const int16_t *p = &grid_[((index_[y] * n + index_[u]) * n + index_[v]) * 3];
+		const int fy = frac_[y], fu = frac_[u], fv = frac_[v];
+
+		unsigned int o1, o2;
+		int w0, w1, w2, w3;
+		if (fy >= fu)
+		{
+			if (fu >= fv)
+				o1 = dy, o2 = dy + du, w0 = 256 - fy, w1 = fy - fu, w2 = fu - fv, w3 = fv;
+			else if (fy >= fv)
+				o1 = dy, o2 = dy + dv, w0 = 256 - fy, w1 = fy - fv, w2 = fv - fu, w3 = fu;
+			else
+				o1 = dv, o2 = dv + dy, w0 = 256 - fv, w1 = fv - fy, w2 = fy - fu, w3 = fu;
+		}
+		else
+		{
+			if (fv >= fu)
+				o1 = dv, o2 = dv + du, w0 = 256 - fv, w1 = fv - fu, w2 = fu - fy, w3 = fy;
+			else if (fv >= fy)
+				o1 = du, o2 = du + dv, w0 = 256 - fu, w1 = fu - fv, w2 = fv - fy, w3 = fy;
+			else
+				o1 = du, o2 = du + dy, w0 = 256 - fu, w1 = fu - fy, w2 = fy - fv, w3 = fv;
+		}
+		const unsigned int o3 = dy + du + dv;
+
+		for (unsigned int c = first; c < last; c++)
+			out[c] = (w0 * p[c] + w1 * p[o1 + c] + w2 * p[o2 + c] + w3 * p[o3 + c] + (1 << 11)) >> 12;
+	}
+
+	// Compare the grid against doing the whole calculation in floating point, returning the
+	// mean and maximum errors. Only YUV values that are valid RGB colours are checked, as
+	// values outside the RGB gamut get clipped, which interpolates poorly (but real images
+	// don't contain them). Every step'th value of each channel is tried.
+	void Error(Cube const &cube, YuvMatrix const &matrix, unsigned int step, double &mean, double &max) const;
+
+private:
+	unsigned int size_ = 0;
+	// The grid nodes, with 4 fractional bits.
+	std::vector<int16_t> grid_;
+	// Grid cell and fraction (out of 256) for every 8-bit value.
+	uint8_t index_[256];
+	uint16_t frac_[256];
+};
@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * tone_curve_stage.cpp - tone curve and 3D LUT colour grading
+ */
+
+// Colour grade the (YUV420) main image in place. There are two parts, both optional:
+
+// 1. Per-channel curves. Luma gets lift, gamma and gain, followed by an arbitrary
+//    "y_curve" Pwl. The chroma channels get a saturation adjustment and optional
+//    "u_curve" and "v_curve" Pwls. All of this is compiled into three 8-bit LUTs.
+
+// 2. A 3D LUT, read from a standard ".cube" file (such as those exported by grading
+//    tools). These are defined on RGB, so we resample the cube onto a YUV grid when
+//    we start, which lets us apply it directly to the YUV pixels using tetrahedral
+//    interpolation in fixed point. In each 2x2 block, the four luma values are looked
+//    up using the block's chroma, and the new chroma uses the block's average luma.
+
+// The image is split into bands of rows that are processed in parallel. With
+// "verify" set, the fixed point 3D LUT is checked against a floating point version
+// of the whole RGB calculation when we start, and the errors are reported.
+
+#include <algorithm>
+#include <thread>
+
+#include <libcamera/stream.h>
+
+#include "core/rpicam_app.hpp"
+
+#include "post_processing_stages/post_processing_stage.hpp"
+#include "post_processing_stages/tone_curve.hpp"
+
+using Stream = libcamera::Stream;
+
+class ToneCurveStage : public PostProcessingStage
+{
+public:
+	ToneCurveStage(RPiCamApp *app) : PostProcessingStage(app) {}
+
+	char const *Name() const override;
+
+	void Read(boost::property_tree::ptree const &params) override;
+
+	void Configure() override;
+
+	bool Process(CompletedRequestPtr &completed_request) override;
+
+private:
+	void processBand(uint8_t *image, unsigned int y0, unsigned int y1) const;
+
+	struct Config
+	{
+		ToneCurves curves;
+		std::string cube_file;
+		unsigned int grid_size;
+		unsigned int threads;
+		bool verify;
+	} config_;
+
+	Stream *stream_;
+	StreamInfo info_;
+	uint8_t lut_y_[256], lut_u_[256], lut_v_[256];
+	YuvGrid grid_;
+};
+
+#define NAME "tone_curve"
+
+char const *ToneCurveStage::Name() const
+{
+	return NAME;
+}
+
+void ToneCurveStage::Read(boost::property_tree::ptree const &params)
+{
+	ToneCurves &curves = config_.curves;
+	curves.lift = params.get<double>("lift", 0.0);
+	curves.gamma = std::max(params.get<double>("gamma", 1.0), 0.01);
+	curves.gain = params.get<double>("gain", 1.0);
+	curves.saturation = params.get<double>("saturation", 1.0);
+	if (params.find("y_curve") != params.not_found())
+		curves.y_curve.Read(params.get_child("y_curve"));
+	if (params.find("u_curve") != params.not_found())
+		curves.u_curve.Read(params.get_child("u_curve"));
+	if (params.find("v_curve") != params.not_found())
+		curves.v_curve.Read(params.get_child("v_curve"));
+	config_.cube_file = params.get<std::string>("cube_file", "");
+	config_.grid_size = std::clamp(params.get<unsigned int>("grid_size", 17), 2u, 65u);
+	config_.threads = std::clamp(params.get<unsigned int>("threads", 2), 1u, 8u);
+	config_.verify = params.get<int>("verify", 0);
+}
+
+void ToneCurveStage::Configure()
+{
+	stream_ = app_->GetMainStream();
+	if (!stream_)
+		return;
+	info_ = app_->GetStreamInfo(stream_);
+	if (info_.pixel_format != libcamera::formats::YUV420)
+		throw std::runtime_error("ToneCurveStage: only YUV420 supported");
+
+	config_.curves.BuildLuts(lut_y_, lut_u_, lut_v_);
+
+	grid_.Clear();
+	if (!config_.cube_file.empty())
+	{
+		Cube cube;
+		cube.Load(config_.cube_file);
+		YuvMatrix matrix(info_.colour_space);
+		grid_.Build(cube, matrix, config_.grid_size);
+		if (config_.verify)
+		{
+			double mean, max;
+			grid_.Error(cube, matrix, 5, mean, max);
+			LOG(1, "ToneCurveStage: 3D LUT error against float reference: mean " << mean << " max " << max);
+		}
+	}
+}
+
+void ToneCurveStage::processBand(uint8_t *image, unsigned int y0, unsigned int y1) const
+{
+	const unsigned int width = info_.width, stride = info_.stride, stride2 = stride / 2;
+	uint8_t *U = image + info_.height * stride, *V = U + (info_.height / 2) * stride2;
+
+	for (unsigned int y = y0; y < y1; y += 2)
+	{
+		uint8_t *row0 = image + y * stride, *row1 = row0 + stride;
+		uint8_t *row_u = U + (y / 2) * stride2, *row_v = V + (y / 2) * stride2;
+
+		for (unsigned int x = 0; x < width; x++)
+		{
+			row0[x] = lut_y_[row0[x]];
+			row1[x] = lut_y_[row1[x]];
+		}
+		for (unsigned int x = 0; x < width / 2; x++)
+		{
+			row_u[x] = lut_u_[row_u[x]];
+			row_v[x] = lut_v_[row_v[x]];
+		}
+
+		if (grid_.Empty())
+			continue;
+
+		for (unsigned int x = 0; x < width / 2; x++)
+		{
+			unsigned int u = row_u[x], v = row_v[x];
+			uint8_t *y_pixels[4] = { &row0[2 * x], &row0[2 * x + 1], &row1[2 * x], &row1[2 * x + 1] };
+			unsigned int y_sum = 0;
+			int out[3];
+			for (uint8_t *p : y_pixels)
+			{
+				y_sum += *p;
+				grid_.Lookup(*p, u, v, 0, 1, out);
+				*p = std::clamp(out[0], 0, 255);
+			}
+			grid_.Lookup((y_sum + 2) / 4, u, v, 1, 3, out);
+			row_u[x] = std::clamp(out[1], 0, 255);
+			row_v[x] = std::clamp(out[2], 0, 255);
+		}
+	}
+}
+
+bool ToneCurveStage::Process(CompletedRequestPtr &completed_request)
+{
+	if (!stream_)
+		return false;
+
+	BufferWriteSync w(app_, completed_request->buffers[stream_]);
+	uint8_t *image = w.Get()[0].data();
+
+	// Bands must have an even number of rows to keep the chroma rows separate.
+	unsigned int height = info_.height & ~1;
+	unsigned int band = ((height + config_.threads - 1) / config_.threads + 1) & ~1;
+	std::vector<std::thread> threads;
+	for (unsigned int y0 = band; y0 < height; y0 += band)
+		threads.emplace_back(&ToneCurveStage::processBand, this, image, y0, std::min(y0 + band, height));
+	processBand(image, 0, std::min(band, height));
+	for (auto &t : threads)
+		t.join();
+
+	return false;
+}
+
+static PostProcessingStage *Create(RPiCamApp *app)
+{
+	return new ToneCurveStage(app);
+}
+
+static RegisterStage reg(NAME, &Create);
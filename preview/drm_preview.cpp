@@ -5,15 +5,35 @@
  * drm_preview.cpp - DRM-based preview window.
  */
 
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include <drm.h>
 #include <drm_fourcc.h>
 #include <drm_mode.h>
+#include <poll.h>
+#include <sys/mman.h>
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
 #include "core/options.hpp"
 
+#include "flip_queue.hpp"
 #include "preview.hpp"
+#include "text_overlay.hpp"
+
+// Frames are put on the screen with non-blocking atomic commits, so Show() never waits for the display. The page
+// flip events come back on the DRM fd, which a thread of our own watches. A FlipQueue decides what gets shown: while
+// a flip is in flight, only the latest frame to arrive is kept for the next one, and the rest are handed straight
+// back. Without atomic modesetting we fall back to the legacy (blocking) calls.
+//
+// The info text goes on an ARGB overlay plane of its own, above the camera image, if there's a spare one. It's only
+// redrawn, and the plane only updated, when the text changes, and then as part of the next frame's commit. If the
+// display won't take the overlay we carry on without it, but its buffers stay until a commit has turned the plane
+// off, as the display may still be showing one of them.
 
 class DrmPreview : public Preview
 {
@@ -32,8 +52,16 @@ public:
 		w = max_image_width_;
 		h = max_image_height_;
 	}
+	void SetInfoText(const std::string &text) override;
 
 private:
+	struct PlaneProperties
+	{
+		uint32_t fb_id;
+		uint32_t crtc_id;
+		uint32_t src_x, src_y, src_w, src_h;
+		uint32_t crtc_x, crtc_y, crtc_w, crtc_h;
+	};
 	struct Buffer
 	{
 		Buffer() : fd(-1) {}
@@ -43,9 +71,26 @@ private:
 		uint32_t bo_handle;
 		unsigned int fb_handle;
 	};
+	struct OverlayBuffer
+	{
+		uint32_t handle = 0;
+		uint32_t fb_handle = 0;
+		uint32_t pitch = 0;
+		size_t size = 0;
+		uint8_t *mem = nullptr;
+	};
 	void makeBuffer(int fd, size_t size, StreamInfo const &info, Buffer &buffer);
 	void findCrtc();
 	void findPlane();
+	void findPlaneProperties(uint32_t plane_id, PlaneProperties &props);
+	void setupOverlay();
+	void makeOverlayBuffer(OverlayBuffer &buffer, unsigned int width, unsigned int height);
+	void destroyOverlay();
+	void dropOverlay();
+	bool updateOverlay(drmModeAtomicReqPtr req);
+	bool commit(int fd);
+	void eventThread();
+	static void pageFlipHandler(int fd, unsigned int frame, unsigned int sec, unsigned int usec, void *data);
 	int drmfd_;
 	int conId_;
 	uint32_t crtcId_;
@@ -59,10 +104,32 @@ private:
 	unsigned int screen_width_;
 	unsigned int screen_height_;
 	std::map<int, Buffer> buffers_; // map the DMABUF's fd to the Buffer
-	int last_fd_;
 	unsigned int max_image_width_;
 	unsigned int max_image_height_;
 	bool first_time_;
+	bool atomic_;
+	PlaneProperties props_;
+
+	uint32_t overlayPlaneId_;
+	PlaneProperties overlay_props_;
+	OverlayBuffer overlay_buffers_[2];
+	unsigned int overlay_index_;
+	// Drawn, but not yet committed.
+	bool overlay_dirty_;
+	// The overlay framebuffer on the screen (or about to be, once the flip in flight lands), or zero for none.
+	uint32_t overlay_on_screen_;
+	// The framebuffer the overlay plane gets in the commit being made.
+	uint32_t overlay_next_fb_;
+	// The flip in flight turns off a dropped overlay, after which its buffers can go.
+	bool overlay_off_pending_;
+	std::unique_ptr<TextOverlay> text_overlay_;
+	std::string info_text_;
+
+	std::mutex mutex_;
+	std::condition_variable flip_done_;
+	FlipQueue flip_queue_;
+	bool abort_;
+	std::thread event_thread_;
 };
 
 #define ERRSTR strerror(errno)
@@ -242,7 +309,174 @@ void DrmPreview::findPlane()
 	drmModeFreePlaneResources(planes);
 }
 
-DrmPreview::DrmPreview(Options const *options) : Preview(options), last_fd_(-1), first_time_(true)
+static uint32_t get_property_id(int fd, uint32_t object_id, uint32_t object_type, char const *name)
+{
+	drmModeObjectPropertiesPtr properties = drmModeObjectGetProperties(fd, object_id, object_type);
+	if (!properties)
+		throw std::runtime_error("drmModeObjectGetProperties failed: " + std::string(ERRSTR));
+
+	uint32_t id = 0;
+	for (unsigned int i = 0; i < properties->count_props && !id; i++)
+	{
+		drmModePropertyPtr prop = drmModeGetProperty(fd, properties->props[i]);
+		if (!prop)
+			continue;
+		if (!strcmp(prop->name, name))
+			id = prop->prop_id;
+		drmModeFreeProperty(prop);
+	}
+
+	drmModeFreeObjectProperties(properties);
+	if (!id)
+		throw std::runtime_error(std::string("drm: plane has no property ") + name);
+	return id;
+}
+
+static bool get_property_value(int fd, uint32_t object_id, uint32_t object_type, char const *name, uint64_t &value)
+{
+	drmModeObjectPropertiesPtr properties = drmModeObjectGetProperties(fd, object_id, object_type);
+	if (!properties)
+		return false;
+
+	bool found = false;
+	for (unsigned int i = 0; i < properties->count_props && !found; i++)
+	{
+		drmModePropertyPtr prop = drmModeGetProperty(fd, properties->props[i]);
+		if (!prop)
+			continue;
+		if (!strcmp(prop->name, name))
+			value = properties->prop_values[i], found = true;
+		drmModeFreeProperty(prop);
+	}
+
+	drmModeFreeObjectProperties(properties);
+	return found;
+}
+
+void DrmPreview::findPlaneProperties(uint32_t plane_id, PlaneProperties &props)
+{
+	auto id = [this, plane_id](char const *name) {
+		return get_property_id(drmfd_, plane_id, DRM_MODE_OBJECT_PLANE, name);
+	};
+
+	props.fb_id = id("FB_ID");
+	props.crtc_id = id("CRTC_ID");
+	props.src_x = id("SRC_X");
+	props.src_y = id("SRC_Y");
+	props.src_w = id("SRC_W");
+	props.src_h = id("SRC_H");
+	props.crtc_x = id("CRTC_X");
+	props.crtc_y = id("CRTC_Y");
+	props.crtc_w = id("CRTC_W");
+	props.crtc_h = id("CRTC_H");
+}
+
+void DrmPreview::setupOverlay()
+{
+	// Planes normally stack in the order they're listed, so look for a spare overlay after the one we're using.
+	drmModePlaneResPtr planes = drmModeGetPlaneResources(drmfd_);
+	if (!planes)
+		throw std::runtime_error("drmModeGetPlaneResources failed: " + std::string(ERRSTR));
+
+	bool after = false;
+	for (unsigned int i = 0; i < planes->count_planes && !overlayPlaneId_; i++)
+	{
+		uint32_t id = planes->planes[i];
+		uint64_t type = DRM_PLANE_TYPE_OVERLAY; // only overlays get listed without the universal planes cap
+		if (id == planeId_)
+			after = true;
+		if (id == planeId_ || !after ||
+			(get_property_value(drmfd_, id, DRM_MODE_OBJECT_PLANE, "type", type) && type != DRM_PLANE_TYPE_OVERLAY))
+			continue;
+
+		drmModePlanePtr plane = drmModeGetPlane(drmfd_, id);
+		if (!plane)
+			continue;
+		if ((plane->possible_crtcs & (1 << crtcIdx_)) &&
+			std::find(plane->formats, plane->formats + plane->count_formats, DRM_FORMAT_ARGB8888) !=
+				plane->formats + plane->count_formats)
+			overlayPlaneId_ = id;
+		drmModeFreePlane(plane);
+	}
+	drmModeFreePlaneResources(planes);
+
+	if (!overlayPlaneId_)
+		throw std::runtime_error("no spare overlay plane");
+	if (atomic_)
+		findPlaneProperties(overlayPlaneId_, overlay_props_);
+
+	// Keep the text a readable size on big screens.
+	text_overlay_ = std::make_unique<TextOverlay>(std::max(height_ / 360, 1u), width_);
+	for (auto &buffer : overlay_buffers_)
+		makeOverlayBuffer(buffer, width_, text_overlay_->MaxHeight());
+}
+
+void DrmPreview::makeOverlayBuffer(OverlayBuffer &buffer, unsigned int width, unsigned int height)
+{
+	drm_mode_create_dumb create = {};
+	create.width = width;
+	create.height = height;
+	create.bpp = 32;
+	if (drmIoctl(drmfd_, DRM_IOCTL_MODE_CREATE_DUMB, &create) < 0)
+		throw std::runtime_error("DRM_IOCTL_MODE_CREATE_DUMB failed: " + std::string(ERRSTR));
+	buffer.handle = create.handle;
+	buffer.pitch = create.pitch;
+	buffer.size = create.size;
+
+	uint32_t offsets[4] = { 0 };
+	uint32_t pitches[4] = { create.pitch };
+	uint32_t bo_handles[4] = { create.handle };
+	if (drmModeAddFB2(drmfd_, width, height, DRM_FORMAT_ARGB8888, bo_handles, pitches, offsets, &buffer.fb_handle, 0))
+		throw std::runtime_error("drmModeAddFB2 failed: " + std::string(ERRSTR));
+
+	drm_mode_map_dumb map = {};
+	map.handle = create.handle;
+	if (drmIoctl(drmfd_, DRM_IOCTL_MODE_MAP_DUMB, &map) < 0)
+		throw std::runtime_error("DRM_IOCTL_MODE_MAP_DUMB failed: " + std::string(ERRSTR));
+	void *mem = mmap(nullptr, create.size, PROT_READ | PROT_WRITE, MAP_SHARED, drmfd_, map.offset);
+	if (mem == MAP_FAILED)
+		throw std::runtime_error("failed to mmap overlay buffer: " + std::string(ERRSTR));
+	buffer.mem = static_cast<uint8_t *>(mem);
+}
+
+void DrmPreview::destroyOverlay()
+{
+	for (auto &buffer : overlay_buffers_)
+	{
+		if (buffer.mem)
+			munmap(buffer.mem, buffer.size);
+		if (buffer.fb_handle)
+			drmModeRmFB(drmfd_, buffer.fb_handle);
+		if (buffer.handle)
+		{
+			drm_mode_destroy_dumb destroy = {};
+			destroy.handle = buffer.handle;
+			drmIoctl(drmfd_, DRM_IOCTL_MODE_DESTROY_DUMB, &destroy);
+		}
+		buffer = OverlayBuffer();
+	}
+	text_overlay_.reset();
+	overlayPlaneId_ = 0;
+	overlay_dirty_ = overlay_off_pending_ = false;
+	overlay_on_screen_ = 0;
+}
+
+void DrmPreview::dropOverlay()
+{
+	// Stop drawing the info text. If one of its buffers may be on the screen, the next commit turns the plane off,
+	// and the buffers only go once that has happened.
+	text_overlay_.reset();
+	overlay_dirty_ = false;
+	if (!overlay_on_screen_)
+		destroyOverlay();
+}
+
+DrmPreview::DrmPreview(Options const *options)
+	: Preview(options), first_time_(true), atomic_(false), overlayPlaneId_(0), overlay_index_(0), overlay_dirty_(false),
+	  overlay_on_screen_(0), overlay_next_fb_(0), overlay_off_pending_(false),
+	  flip_queue_(std::bind(&DrmPreview::commit, this, std::placeholders::_1),
+				  [this](int fd) { done_callback_(fd); }),
+	  abort_(false)
 {
 	drmfd_ = drmOpen("vc4", NULL);
 	if (drmfd_ < 0)
@@ -264,6 +498,16 @@ DrmPreview::DrmPreview(Options const *options) : Preview(options), last_fd_(-1),
 		findCrtc();
 		out_fourcc_ = DRM_FORMAT_YUV420;
 		findPlane();
+
+		// Atomic modesetting needs to see all the planes, not just the overlays.
+		if (!drmSetClientCap(drmfd_, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) &&
+			!drmSetClientCap(drmfd_, DRM_CLIENT_CAP_ATOMIC, 1))
+		{
+			findPlaneProperties(planeId_, props_);
+			atomic_ = true;
+		}
+		else
+			LOG(1, "DrmPreview: no atomic modesetting, falling back to legacy calls");
 	}
 	catch (std::exception const &e)
 	{
@@ -279,13 +523,84 @@ DrmPreview::DrmPreview(Options const *options) : Preview(options), last_fd_(-1),
 		width_ = screen_width_;
 		height_ = screen_height_;
 	}
+
+	// It's nice to have the info text, but we can manage without.
+	if (!options_->info_text.empty())
+	{
+		try
+		{
+			setupOverlay();
+		}
+		catch (std::exception const &e)
+		{
+			LOG(1, "DrmPreview: no overlay for the info text: " << e.what());
+			destroyOverlay();
+		}
+	}
+
+	if (atomic_)
+		event_thread_ = std::thread(&DrmPreview::eventThread, this);
 }
 
 DrmPreview::~DrmPreview()
 {
+	if (event_thread_.joinable())
+	{
+		{
+			std::scoped_lock<std::mutex> lock(mutex_);
+			abort_ = true;
+		}
+		event_thread_.join();
+	}
+
+	LOG(2, "DrmPreview: " << flip_queue_.Presented() << " frames presented, " << flip_queue_.Dropped()
+						  << " dropped");
+	destroyOverlay();
 	close(drmfd_);
 }
 
+void DrmPreview::pageFlipHandler([[maybe_unused]] int fd, [[maybe_unused]] unsigned int frame,
+								 [[maybe_unused]] unsigned int sec, [[maybe_unused]] unsigned int usec, void *data)
+{
+	// We're called from drmHandleEvent, in the event thread, which holds the lock.
+	DrmPreview *preview = static_cast<DrmPreview *>(data);
+	preview->flip_queue_.FlipDone();
+	// Nothing's using a dropped overlay's buffers now.
+	if (preview->overlay_off_pending_)
+		preview->destroyOverlay();
+	preview->flip_done_.notify_all();
+}
+
+void DrmPreview::eventThread()
+{
+	drmEventContext context = {};
+	context.version = 2;
+	context.page_flip_handler = &DrmPreview::pageFlipHandler;
+
+	while (true)
+	{
+		{
+			std::scoped_lock<std::mutex> lock(mutex_);
+			if (abort_)
+				break;
+		}
+
+		// Wake up now and again to check if we're being stopped.
+		pollfd pfd = { drmfd_, POLLIN, 0 };
+		int ret = poll(&pfd, 1, 100);
+		if (ret < 0 && errno != EINTR)
+		{
+			LOG_ERROR("DrmPreview: poll failed: " << ERRSTR);
+			break;
+		}
+		if (ret > 0 && (pfd.revents & POLLIN))
+		{
+			std::scoped_lock<std::mutex> lock(mutex_);
+			drmHandleEvent(drmfd_, &context);
+		}
+	}
+}
+
 // DRM doesn't seem to have userspace definitions of its enums, but the properties
 // contain enum-name-to-value tables. So the code below ends up using strings and
 // searching for name matches. I suppose it works...
@@ -389,12 +704,82 @@ void DrmPreview::makeBuffer(int fd, size_t size, StreamInfo const &info, Buffer
 		throw std::runtime_error("drmModeAddFB2 failed: " + std::string(ERRSTR));
 }
 
-void DrmPreview::Show(int fd, libcamera::Span<uint8_t> span, StreamInfo const &info)
+bool DrmPreview::updateOverlay(drmModeAtomicReqPtr req)
 {
-	Buffer &buffer = buffers_[fd];
-	if (buffer.fd == -1)
-		makeBuffer(fd, span.size(), info, buffer);
+	// Called with the lock held, while committing a frame. Returns true if the overlay plane was added to the request.
+	if (!overlayPlaneId_)
+		return false;
+
+	unsigned int w = 0, h = 0;
+	uint32_t fb_handle = 0;
+	if (text_overlay_)
+	{
+		const bool changed = text_overlay_->Update(info_text_);
+		w = text_overlay_->Width(), h = text_overlay_->Height();
+		if (changed && w)
+		{
+			// No flip is in flight, so the buffer that isn't on the screen is free to draw in.
+			if (overlay_buffers_[overlay_index_].fb_handle == overlay_on_screen_)
+				overlay_index_ ^= 1;
+			OverlayBuffer &buffer = overlay_buffers_[overlay_index_];
+			for (unsigned int y = 0; y < h; y++)
+				memcpy(buffer.mem + y * buffer.pitch, text_overlay_->Data() + y * w, w * 4);
+		}
+		overlay_dirty_ |= changed;
+		if (!overlay_dirty_)
+			return false;
+		if (w)
+			fb_handle = overlay_buffers_[overlay_index_].fb_handle;
+	}
+	else if (!overlay_on_screen_)
+		return false;
+	// Otherwise the overlay has been dropped, and this turns its plane off.
 
+	if (!req)
+	{
+		// The legacy call has finished with the plane when it returns.
+		if (!drmModeSetPlane(drmfd_, overlayPlaneId_, w ? crtcId_ : 0, fb_handle, 0, x_, y_, w, h, 0, 0, w << 16,
+							 h << 16))
+		{
+			overlay_dirty_ = false;
+			overlay_on_screen_ = fb_handle;
+			if (!text_overlay_)
+				destroyOverlay();
+		}
+		else if (text_overlay_)
+		{
+			LOG_ERROR("DrmPreview: failed to set overlay plane, dropping the info text: " << ERRSTR);
+			dropOverlay();
+			updateOverlay(nullptr);
+		}
+		else
+		{
+			// It can't even be turned off, so leave it as it is, buffers and all.
+			LOG_ERROR("DrmPreview: failed to turn off overlay plane: " << ERRSTR);
+			overlayPlaneId_ = 0;
+		}
+		return false;
+	}
+
+	overlay_next_fb_ = fb_handle;
+	drmModeAtomicAddProperty(req, overlayPlaneId_, overlay_props_.fb_id, fb_handle);
+	drmModeAtomicAddProperty(req, overlayPlaneId_, overlay_props_.crtc_id, w ? crtcId_ : 0);
+	drmModeAtomicAddProperty(req, overlayPlaneId_, overlay_props_.src_x, 0);
+	drmModeAtomicAddProperty(req, overlayPlaneId_, overlay_props_.src_y, 0);
+	drmModeAtomicAddProperty(req, overlayPlaneId_, overlay_props_.src_w, (uint64_t)w << 16);
+	drmModeAtomicAddProperty(req, overlayPlaneId_, overlay_props_.src_h, (uint64_t)h << 16);
+	drmModeAtomicAddProperty(req, overlayPlaneId_, overlay_props_.crtc_x, x_);
+	drmModeAtomicAddProperty(req, overlayPlaneId_, overlay_props_.crtc_y, y_);
+	drmModeAtomicAddProperty(req, overlayPlaneId_, overlay_props_.crtc_w, w);
+	drmModeAtomicAddProperty(req, overlayPlaneId_, overlay_props_.crtc_h, h);
+	return true;
+}
+
+bool DrmPreview::commit(int fd)
+{
+	// Called with the lock held. The plane scales the whole image to fit the window, keeping its aspect ratio.
+	Buffer &buffer = buffers_[fd];
+	StreamInfo const &info = buffer.info;
 	unsigned int x_off = 0, y_off = 0;
 	unsigned int w = width_, h = height_;
 	if (info.width * height_ > width_ * info.height)
@@ -402,16 +787,96 @@ void DrmPreview::Show(int fd, libcamera::Span<uint8_t> span, StreamInfo const &i
 	else
 		w = height_ * info.width / info.height, x_off = (width_ - w) / 2;
 
-	if (drmModeSetPlane(drmfd_, planeId_, crtcId_, buffer.fb_handle, 0, x_off + x_, y_off + y_, w, h, 0, 0,
-						buffer.info.width << 16, buffer.info.height << 16))
-		throw std::runtime_error("drmModeSetPlane failed: " + std::string(ERRSTR));
-	if (last_fd_ >= 0)
-		done_callback_(last_fd_);
-	last_fd_ = fd;
+	if (!atomic_)
+	{
+		if (drmModeSetPlane(drmfd_, planeId_, crtcId_, buffer.fb_handle, 0, x_off + x_, y_off + y_, w, h, 0, 0,
+							info.width << 16, info.height << 16))
+		{
+			LOG_ERROR("DrmPreview: drmModeSetPlane failed: " << ERRSTR);
+			return false;
+		}
+		updateOverlay(nullptr);
+		return true;
+	}
+
+	drmModeAtomicReqPtr req = drmModeAtomicAlloc();
+	if (!req)
+		return false;
+	drmModeAtomicAddProperty(req, planeId_, props_.fb_id, buffer.fb_handle);
+	drmModeAtomicAddProperty(req, planeId_, props_.crtc_id, crtcId_);
+	drmModeAtomicAddProperty(req, planeId_, props_.src_x, 0);
+	drmModeAtomicAddProperty(req, planeId_, props_.src_y, 0);
+	drmModeAtomicAddProperty(req, planeId_, props_.src_w, (uint64_t)info.width << 16);
+	drmModeAtomicAddProperty(req, planeId_, props_.src_h, (uint64_t)info.height << 16);
+	drmModeAtomicAddProperty(req, planeId_, props_.crtc_x, x_off + x_);
+	drmModeAtomicAddProperty(req, planeId_, props_.crtc_y, y_off + y_);
+	drmModeAtomicAddProperty(req, planeId_, props_.crtc_w, w);
+	drmModeAtomicAddProperty(req, planeId_, props_.crtc_h, h);
+	bool overlay = updateOverlay(req);
+
+	int ret = drmModeAtomicCommit(drmfd_, req, DRM_MODE_ATOMIC_NONBLOCK | DRM_MODE_PAGE_FLIP_EVENT, this);
+	drmModeAtomicFree(req);
+	if (ret && overlay)
+	{
+		// Don't let the info text stop the camera images getting through. If the overlay can't even be turned off,
+		// leave it as it is, buffers and all.
+		if (text_overlay_)
+		{
+			LOG_ERROR("DrmPreview: overlay plane rejected, dropping the info text: " << ERRSTR);
+			dropOverlay();
+		}
+		else
+		{
+			LOG_ERROR("DrmPreview: failed to turn off overlay plane: " << ERRSTR);
+			overlayPlaneId_ = 0;
+		}
+		return commit(fd);
+	}
+	if (ret)
+	{
+		LOG_ERROR("DrmPreview: atomic commit failed: " << ERRSTR);
+		return false;
+	}
+	if (overlay)
+	{
+		overlay_dirty_ = false;
+		overlay_on_screen_ = overlay_next_fb_;
+		overlay_off_pending_ = !text_overlay_;
+	}
+	return true;
+}
+
+void DrmPreview::Show(int fd, libcamera::Span<uint8_t> span, StreamInfo const &info)
+{
+	std::scoped_lock<std::mutex> lock(mutex_);
+
+	Buffer &buffer = buffers_[fd];
+	if (buffer.fd == -1)
+		makeBuffer(fd, span.size(), info, buffer);
+
+	flip_queue_.Submit(fd);
+	// The legacy calls have finished with the flip by the time they return.
+	if (!atomic_)
+		flip_queue_.FlipDone();
+}
+
+void DrmPreview::SetInfoText(const std::string &text)
+{
+	// The overlay gets redrawn, if the text has changed, with the next frame.
+	std::scoped_lock<std::mutex> lock(mutex_);
+	info_text_ = text;
 }
 
 void DrmPreview::Reset()
 {
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	// A buffer can't go while the display may still be flipping to it. Then they all go back to the application,
+	// which would otherwise keep their requests forever.
+	if (!flip_done_.wait_for(lock, std::chrono::milliseconds(200), [this] { return !flip_queue_.Pending(); }))
+		LOG(1, "DrmPreview: timed out waiting for page flip");
+	flip_queue_.Clear();
+
 	for (auto &it : buffers_)
 	{
 		drmModeRmFB(drmfd_, it.second.fb_handle);
@@ -424,7 +889,6 @@ void DrmPreview::Reset()
 			LOG(1, "DRM_IOCTL_GEM_CLOSE failed");
 	}
 	buffers_.clear();
-	last_fd_ = -1;
 	first_time_ = true;
 }
 
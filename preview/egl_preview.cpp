@@ -6,6 +6,7 @@
  */
 
 #include <map>
+#include <memory>
 #include <string>
 
 // Include libcamera stuff before X11, as X11 #defines both Status and None
@@ -14,6 +15,7 @@
 #include "core/options.hpp"
 
 #include "preview.hpp"
+#include "text_overlay.hpp"
 
 #include <libdrm/drm_fourcc.h>
 
@@ -58,6 +60,7 @@ private:
 	};
 	void makeWindow(char const *name);
 	void makeBuffer(int fd, size_t size, StreamInfo const &info, Buffer &buffer);
+	void drawOverlay();
 	::Display *display_;
 	EGLDisplay egl_display_;
 	Window window_;
@@ -74,6 +77,13 @@ private:
 	int height_;
 	unsigned int max_image_width_;
 	unsigned int max_image_height_;
+	// The info text, drawn over the camera image.
+	GLint video_program_;
+	GLint overlay_program_;
+	GLint overlay_rect_;
+	GLuint overlay_texture_;
+	std::unique_ptr<TextOverlay> text_overlay_;
+	std::string info_text_;
 };
 
 static GLint compile_shader(GLenum target, const char *source)
@@ -127,10 +137,13 @@ static GLint link_program(GLint vs, GLint fs)
 		throw std::runtime_error("failed to link: " + std::string(info ? info : "<empty log>"));
 	}
 
+	// The shaders go when the program does.
+	glDeleteShader(vs);
+	glDeleteShader(fs);
 	return prog;
 }
 
-static void gl_setup(int width, int height, int window_width, int window_height)
+static GLint gl_setup(int width, int height, int window_width, int window_height)
 {
 	float w_factor = width / (float)window_width;
 	float h_factor = height / (float)window_height;
@@ -165,9 +178,36 @@ static void gl_setup(int width, int height, int window_width, int window_height)
 	static const float verts[] = { -w_factor, -h_factor, w_factor, -h_factor, w_factor, h_factor, -w_factor, h_factor };
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
 	glEnableVertexAttribArray(0);
+
+	return prog;
 }
 
-EglPreview::EglPreview(Options const *options) : Preview(options), last_fd_(-1), first_time_(true)
+static GLint gl_setup_overlay()
+{
+	// This draws the overlay with the same four vertices as the camera image. Only which corner each one is matters,
+	// and the overlay's rectangle (x0, y0, x1, y1, in clip co-ordinates) comes in as a uniform.
+	const char *vs = "attribute vec4 pos;\n"
+					 "uniform vec4 rect;\n"
+					 "varying vec2 texcoord;\n"
+					 "\n"
+					 "void main() {\n"
+					 "  vec2 corner = step(0.0, pos.xy);\n"
+					 "  gl_Position = vec4(mix(rect.xy, rect.zw, corner), 0.0, 1.0);\n"
+					 "  texcoord = vec2(corner.x, 1.0 - corner.y);\n"
+					 "}\n";
+	GLint vs_s = compile_shader(GL_VERTEX_SHADER, vs);
+	const char *fs = "precision mediump float;\n"
+					 "uniform sampler2D s;\n"
+					 "varying vec2 texcoord;\n"
+					 "void main() {\n"
+					 "  gl_FragColor = texture2D(s, texcoord);\n"
+					 "}\n";
+	GLint fs_s = compile_shader(GL_FRAGMENT_SHADER, fs);
+	return link_program(vs_s, fs_s);
+}
+
+EglPreview::EglPreview(Options const *options)
+	: Preview(options), last_fd_(-1), first_time_(true), video_program_(0), overlay_program_(0), overlay_texture_(0)
 {
 	display_ = XOpenDisplay(NULL);
 	if (!display_)
@@ -364,7 +404,17 @@ void EglPreview::makeBuffer(int fd, size_t size, StreamInfo const &info, Buffer
 		// This stuff has to be delayed until we know we're in the thread doing the display.
 		if (!eglMakeCurrent(egl_display_, egl_surface_, egl_surface_, egl_context_))
 			throw std::runtime_error("eglMakeCurrent failed");
-		gl_setup(info.width, info.height, width_, height_);
+		video_program_ = gl_setup(info.width, info.height, width_, height_);
+		overlay_program_ = gl_setup_overlay();
+		overlay_rect_ = glGetUniformLocation(overlay_program_, "rect");
+		glGenTextures(1, &overlay_texture_);
+		glBindTexture(GL_TEXTURE_2D, overlay_texture_);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		// Keep the text a readable size in big windows. A new one means the text gets uploaded again.
+		text_overlay_ = std::make_unique<TextOverlay>(std::max(height_ / 360, 1), width_);
 		first_time_ = false;
 	}
 
@@ -408,8 +458,32 @@ void EglPreview::makeBuffer(int fd, size_t size, StreamInfo const &info, Buffer
 
 void EglPreview::SetInfoText(const std::string &text)
 {
-	if (!text.empty())
-		XStoreName(display_, window_, text.c_str());
+	// This goes on the screen with the next frame.
+	info_text_ = text;
+}
+
+void EglPreview::drawOverlay()
+{
+	const bool changed = text_overlay_->Update(info_text_);
+	const int w = text_overlay_->Width(), h = text_overlay_->Height();
+	if (!w)
+		return;
+
+	glUseProgram(overlay_program_);
+	glBindTexture(GL_TEXTURE_2D, overlay_texture_);
+	if (changed)
+	{
+		// The pixels are ARGB, which GL would read as BGRA, but the text is white on black so it makes no difference.
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, text_overlay_->Data());
+		// In the top left corner, at one texel to a pixel.
+		glUniform4f(overlay_rect_, -1.0, 1.0 - 2.0 * h / height_, -1.0 + 2.0 * w / width_, 1.0);
+	}
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA); // premultiplied alpha
+	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	glDisable(GL_BLEND);
+	glUseProgram(video_program_);
 }
 
 void EglPreview::Show(int fd, libcamera::Span<uint8_t> span, StreamInfo const &info)
@@ -423,6 +497,7 @@ void EglPreview::Show(int fd, libcamera::Span<uint8_t> span, StreamInfo const &i
 
 	glBindTexture(GL_TEXTURE_EXTERNAL_OES, buffer.texture);
 	glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+	drawOverlay();
 	EGLBoolean success [[maybe_unused]] = eglSwapBuffers(egl_display_, egl_surface_);
 	if (last_fd_ >= 0)
 		done_callback_(last_fd_);
@@ -434,6 +509,15 @@ void EglPreview::Reset()
 	for (auto &it : buffers_)
 		glDeleteTextures(1, &it.second.texture);
 	buffers_.clear();
+	if (overlay_texture_)
+		glDeleteTextures(1, &overlay_texture_);
+	overlay_texture_ = 0;
+	// Both programs get made again with the next frame.
+	if (video_program_)
+		glDeleteProgram(video_program_);
+	if (overlay_program_)
+		glDeleteProgram(overlay_program_);
+	video_program_ = overlay_program_ = 0;
 	last_fd_ = -1;
 	eglMakeCurrent(egl_display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
 	first_time_ = true;
@@ -0,0 +1,98 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * flip_queue.hpp - choose which frames an asynchronously flipping display shows
+ */
+
+#pragma once
+
+#include <functional>
+
+// There's only ever one flip in flight. Frames that arrive meanwhile wait in a single slot, each one replacing the
+// last (the latest wins), and whatever gets replaced is handed straight back and counted as dropped. When the flip
+// completes, the buffer it replaced on the screen is handed back and the waiting frame, if any, is flipped to.
+// Buffers are known by their fd. Nothing here is thread safe, and nothing talks to the display: the commit function
+// starts a flip, and the caller reports when it has finished with FlipDone().
+class FlipQueue
+{
+public:
+	// Start a flip to this buffer, returning false if that failed.
+	typedef std::function<bool(int fd)> CommitFunc;
+	// Hand a buffer back to whoever gave it to us.
+	typedef std::function<void(int fd)> ReleaseFunc;
+
+	FlipQueue(CommitFunc commit, ReleaseFunc release) : commit_(commit), release_(release) {}
+
+	void Submit(int fd)
+	{
+		if (pending_ < 0)
+			commit(fd);
+		else
+		{
+			if (queued_ >= 0)
+				drop(queued_);
+			queued_ = fd;
+		}
+	}
+
+	void FlipDone()
+	{
+		if (pending_ < 0)
+			return;
+
+		if (displayed_ >= 0 && displayed_ != pending_)
+			release_(displayed_);
+		displayed_ = pending_;
+		pending_ = -1;
+		presented_++;
+
+		if (queued_ >= 0)
+		{
+			int fd = queued_;
+			queued_ = -1;
+			commit(fd);
+		}
+	}
+
+	bool Pending() const { return pending_ >= 0; }
+
+	// Hand back every buffer we still have, the one on the screen included, and start again. The waiting frame
+	// never got shown, so it counts as dropped. Only call this once the display has let go of them all.
+	void Clear()
+	{
+		if (queued_ >= 0)
+			drop(queued_);
+		if (pending_ >= 0 && pending_ != displayed_)
+			release_(pending_);
+		if (displayed_ >= 0)
+			release_(displayed_);
+		displayed_ = pending_ = queued_ = -1;
+	}
+
+	unsigned int Presented() const { return presented_; }
+	unsigned int Dropped() const { return dropped_; }
+
+private:
+	void commit(int fd)
+	{
+		if (commit_(fd))
+			pending_ = fd;
+		else
+			drop(fd);
+	}
+
+	void drop(int fd)
+	{
+		dropped_++;
+		release_(fd);
+	}
+
+	CommitFunc commit_;
+	ReleaseFunc release_;
+	int displayed_ = -1;
+	int pending_ = -1;
+	int queued_ = -1;
+	unsigned int presented_ = 0;
+	unsigned int dropped_ = 0;
+};
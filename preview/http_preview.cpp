@@ -0,0 +1,467 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * http_preview.cpp - serve the preview as JPEG snapshots and MJPEG over HTTP on localhost.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "core/options.hpp"
+#include "image/image.hpp"
+
+#include "preview.hpp"
+
+// Headless units have no display, so this lets someone on the unit (or at the other end of an ssh tunnel) look at
+// the camera without stopping whatever is running. Frames are only copied when a client wants one, so there's no
+// cost while nobody is connected, and camera buffers are handed straight back once copied. Encoding and all the
+// network work happen on a low priority thread of their own. Sockets never block: each client has its own output
+// queue, and a client that's still taking the last frame simply misses the next, so a slow one can't hold up the
+// others.
+class HttpPreview : public Preview
+{
+public:
+	HttpPreview(Options const *options);
+	~HttpPreview();
+	void Show(int fd, libcamera::Span<uint8_t> span, StreamInfo const &info) override;
+	void Reset() override;
+	// Return the maximum image size allowed. Zeroes mean "no limit".
+	void MaxImageSize(unsigned int &w, unsigned int &h) const override { w = h = 0; }
+
+private:
+	struct Frame
+	{
+		std::vector<uint8_t> data;
+		StreamInfo info;
+	};
+
+	struct Client
+	{
+		enum State
+		{
+			Request,
+			Snapshot,
+			Stream,
+			// Closes once everything queued has been sent.
+			Done
+		};
+		int fd;
+		State state;
+		std::string output;
+		std::chrono::steady_clock::time_point last_sent;
+	};
+
+	void copyFrame(libcamera::Span<uint8_t> span, StreamInfo const &info);
+	void serverThread();
+	void acceptClient();
+	bool handleRequest(Client &client);
+	void sendFrame();
+	void queue(Client &client, std::string const &data);
+	bool flush(Client &client);
+	void closeClient(size_t i);
+	void updateWanted();
+
+	int listen_fd_ = -1;
+	int event_fd_ = -1;
+	std::atomic<bool> abort_ = false;
+	std::thread thread_;
+	std::chrono::steady_clock::duration interval_;
+
+	// Shared with Show(), which runs on the application's preview thread.
+	std::mutex mutex_;
+	bool snapshot_wanted_ = false;
+	bool stream_wanted_ = false;
+	bool frame_ready_ = false;
+	std::chrono::steady_clock::time_point next_stream_frame_;
+	Frame frame_;
+
+	// Belongs to the server thread.
+	std::vector<Client> clients_;
+	Frame encode_frame_;
+};
+
+namespace
+{
+
+constexpr unsigned int MAX_CLIENTS = 8;
+constexpr int JPEG_QUALITY = 75;
+// How much lower than everything else the server thread's priority is (as a nice value).
+constexpr int SERVER_NICE = 10;
+// Give up on a client that has taken nothing of what we've queued for it in this long.
+constexpr std::chrono::seconds SEND_TIMEOUT(2);
+
+} // namespace
+
+HttpPreview::HttpPreview(Options const *options) : Preview(options)
+{
+	interval_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1.0 / options_->http_preview_fps));
+
+	listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listen_fd_ < 0)
+		throw std::runtime_error("HttpPreview: unable to open listen socket");
+
+	int enable = 1;
+	if (setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0)
+		throw std::runtime_error("HttpPreview: failed to setsockopt listen socket");
+
+	// Only ever on localhost. Anyone wanting to look from elsewhere can tunnel in.
+	sockaddr_in saddr = {};
+	saddr.sin_family = AF_INET;
+	saddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	saddr.sin_port = htons(options_->http_preview);
+	if (bind(listen_fd_, (struct sockaddr *)&saddr, sizeof(saddr)) < 0 || listen(listen_fd_, MAX_CLIENTS) < 0)
+	{
+		close(listen_fd_);
+		throw std::runtime_error("HttpPreview: failed to listen on port " + std::to_string(options_->http_preview));
+	}
+
+	event_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (event_fd_ < 0)
+	{
+		close(listen_fd_);
+		throw std::runtime_error("HttpPreview: failed to create eventfd");
+	}
+
+	thread_ = std::thread(&HttpPreview::serverThread, this);
+	LOG(2, "HttpPreview: serving on http://127.0.0.1:" << options_->http_preview << "/");
+}
+
+HttpPreview::~HttpPreview()
+{
+	abort_ = true;
+	uint64_t one = 1;
+	if (write(event_fd_, &one, sizeof(one)) < 0)
+		LOG_ERROR("HttpPreview: failed to wake server thread");
+	thread_.join();
+
+	while (!clients_.empty())
+		closeClient(clients_.size() - 1);
+	close(event_fd_);
+	close(listen_fd_);
+}
+
+void HttpPreview::Show(int fd, libcamera::Span<uint8_t> span, StreamInfo const &info)
+{
+	bool copied = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		auto now = std::chrono::steady_clock::now();
+		// If the server's still busy with the last frame, there's no point copying another.
+		bool wanted = snapshot_wanted_ || (stream_wanted_ && now >= next_stream_frame_);
+		if (wanted && !frame_ready_)
+		{
+			copyFrame(span, info);
+			frame_ready_ = copied = true;
+			if (stream_wanted_)
+				next_stream_frame_ = std::max(next_stream_frame_ + interval_, now);
+		}
+	}
+
+	// We never keep the camera's buffer beyond the copy.
+	done_callback_(fd);
+
+	if (copied)
+	{
+		uint64_t one = 1;
+		if (write(event_fd_, &one, sizeof(one)) < 0)
+			LOG_ERROR("HttpPreview: failed to wake server thread");
+	}
+}
+
+void HttpPreview::Reset()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	frame_ready_ = false;
+}
+
+void HttpPreview::copyFrame(libcamera::Span<uint8_t> span, StreamInfo const &info)
+{
+	// Scale down by skipping pixels, by whatever whole number factor makes it narrow enough. The stride is a
+	// multiple of 64 as the JPEG encoder reads whole blocks, past the edge of the image.
+	const unsigned int factor = (info.width + options_->http_preview_width - 1) / options_->http_preview_width;
+	StreamInfo &out = frame_.info;
+	out.width = (info.width / factor) & ~1;
+	out.height = (info.height / factor) & ~1;
+	out.stride = (out.width + 63) & ~63;
+	out.pixel_format = info.pixel_format;
+	out.colour_space = info.colour_space;
+	frame_.data.resize(out.stride * out.height * 3 / 2);
+
+	const uint8_t *Y = span.data();
+	const uint8_t *U = Y + info.stride * info.height;
+	const uint8_t *V = U + (info.stride / 2) * (info.height / 2);
+	uint8_t *dst_Y = frame_.data.data();
+	uint8_t *dst_U = dst_Y + out.stride * out.height;
+	uint8_t *dst_V = dst_U + (out.stride / 2) * (out.height / 2);
+
+	if (factor == 1)
+	{
+		for (unsigned int y = 0; y < out.height; y++)
+			memcpy(dst_Y + y * out.stride, Y + y * info.stride, out.width);
+		for (unsigned int y = 0; y < out.height / 2; y++)
+		{
+			memcpy(dst_U + y * out.stride / 2, U + y * info.stride / 2, out.width / 2);
+			memcpy(dst_V + y * out.stride / 2, V + y * info.stride / 2, out.width / 2);
+		}
+		return;
+	}
+
+	for (unsigned int y = 0; y < out.height; y++)
+	{
+		const uint8_t *src = Y + y * factor * info.stride;
+		uint8_t *dst = dst_Y + y * out.stride;
+		for (unsigned int x = 0; x < out.width; x++)
+			dst[x] = src[x * factor];
+	}
+	for (unsigned int y = 0; y < out.height / 2; y++)
+	{
+		const uint8_t *src_U = U + y * factor * (info.stride / 2);
+		const uint8_t *src_V = V + y * factor * (info.stride / 2);
+		uint8_t *u = dst_U + y * (out.stride / 2), *v = dst_V + y * (out.stride / 2);
+		for (unsigned int x = 0; x < out.width / 2; x++)
+			u[x] = src_U[x * factor], v[x] = src_V[x * factor];
+	}
+}
+
+void HttpPreview::serverThread()
+{
+	// Nobody looking at the preview should slow down the real work.
+	if (setpriority(PRIO_PROCESS, 0, getpriority(PRIO_PROCESS, 0) + SERVER_NICE) < 0)
+		LOG(1, "HttpPreview: failed to lower server thread priority: " << strerror(errno));
+
+	std::vector<pollfd> fds;
+	while (!abort_)
+	{
+		fds.clear();
+		fds.push_back({ event_fd_, POLLIN, 0 });
+		fds.push_back({ listen_fd_, POLLIN, 0 });
+		bool sending = false;
+		for (auto const &client : clients_)
+		{
+			fds.push_back({ client.fd, (short)(POLLIN | (client.output.empty() ? 0 : POLLOUT)), 0 });
+			sending |= !client.output.empty();
+		}
+
+		// Wake up now and then while anything is waiting to go, to notice clients that have stopped taking it.
+		if (poll(fds.data(), fds.size(), sending ? 1000 : -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			LOG_ERROR("HttpPreview: poll failed: " << strerror(errno));
+			break;
+		}
+
+		// Go backwards so that closing a client doesn't upset the ones still to come. New clients get added to
+		// the end, beyond the ones we polled, so this comes before anything else can change the list.
+		const auto now = std::chrono::steady_clock::now();
+		for (size_t i = fds.size() - 2; i-- > 0;)
+		{
+			Client &client = clients_[i];
+			const short revents = fds[i + 2].revents;
+			bool ok = !(revents & (POLLIN | POLLHUP | POLLERR)) || handleRequest(client);
+			if (ok && (revents & POLLOUT))
+				ok = flush(client);
+			if (ok && !client.output.empty() && now - client.last_sent > SEND_TIMEOUT)
+			{
+				LOG(1, "HttpPreview: client isn't taking any data, disconnecting");
+				ok = false;
+			}
+			if (!ok)
+				closeClient(i);
+		}
+
+		if (fds[0].revents & POLLIN)
+		{
+			uint64_t count;
+			if (read(event_fd_, &count, sizeof(count)) < 0 && errno != EAGAIN)
+				LOG_ERROR("HttpPreview: failed to read eventfd");
+			if (abort_)
+				break;
+			sendFrame();
+		}
+
+		if (fds[1].revents & POLLIN)
+			acceptClient();
+
+		updateWanted();
+	}
+}
+
+void HttpPreview::acceptClient()
+{
+	int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (fd < 0)
+		return;
+	if (clients_.size() >= MAX_CLIENTS)
+	{
+		// This fits in any socket buffer, and if it somehow doesn't, it's no loss.
+		static const char busy[] = "HTTP/1.0 503 Service Unavailable\r\nConnection: close\r\n\r\n";
+		if (send(fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL) < 0)
+			LOG(2, "HttpPreview: couldn't turn away client: " << strerror(errno));
+		close(fd);
+		return;
+	}
+
+	clients_.push_back({ fd, Client::Request, "", std::chrono::steady_clock::now() });
+	LOG(2, "HttpPreview: client connected");
+}
+
+bool HttpPreview::handleRequest(Client &client)
+{
+	char buf[1024];
+	ssize_t n = recv(client.fd, buf, sizeof(buf) - 1, 0);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return true;
+	if (n <= 0)
+		return false;
+
+	// Once a client has made its request, anything more it sends is of no interest.
+	if (client.state != Client::Request)
+		return true;
+
+	buf[n] = 0;
+	char method[8], path[256];
+	if (sscanf(buf, "%7s %255s", method, path) != 2 || strcmp(method, "GET"))
+	{
+		client.state = Client::Done;
+		queue(client, "HTTP/1.0 400 Bad Request\r\nConnection: close\r\n\r\n");
+		return flush(client);
+	}
+
+	if (!strcmp(path, "/snapshot.jpg"))
+	{
+		// The next frame gets sent, and the connection closed.
+		client.state = Client::Snapshot;
+		return true;
+	}
+	else if (!strcmp(path, "/stream.mjpg") || !strcmp(path, "/"))
+	{
+		client.state = Client::Stream;
+		queue(client, "HTTP/1.0 200 OK\r\n"
+					  "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n"
+					  "Cache-Control: no-cache\r\n"
+					  "Connection: close\r\n\r\n");
+		return flush(client);
+	}
+
+	client.state = Client::Done;
+	queue(client, "HTTP/1.0 404 Not Found\r\nConnection: close\r\n\r\n");
+	return flush(client);
+}
+
+void HttpPreview::sendFrame()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!frame_ready_)
+			return;
+		std::swap(frame_, encode_frame_);
+		frame_ready_ = false;
+	}
+
+	uint8_t *jpeg_buffer = nullptr;
+	size_t jpeg_len = 0;
+	try
+	{
+		YUV420_to_JPEG_fast(encode_frame_.data.data(), encode_frame_.info, JPEG_QUALITY, 0, jpeg_buffer, jpeg_len);
+	}
+	catch (std::exception const &e)
+	{
+		// Anyone waiting will get the next frame instead.
+		LOG_ERROR("HttpPreview: " << e.what());
+		return;
+	}
+	const std::string jpeg((const char *)jpeg_buffer, jpeg_len);
+	free(jpeg_buffer);
+
+	const std::string length = "Content-Length: " + std::to_string(jpeg_len) + "\r\n\r\n";
+	for (size_t i = clients_.size(); i-- > 0;)
+	{
+		Client &client = clients_[i];
+		// A stream client still taking the last frame misses this one.
+		if (client.state == Client::Stream && client.output.empty())
+			queue(client, "--frame\r\nContent-Type: image/jpeg\r\n" + length + jpeg + "\r\n");
+		else if (client.state == Client::Snapshot)
+		{
+			// Snapshot clients get one frame and are done.
+			client.state = Client::Done;
+			queue(client, "HTTP/1.0 200 OK\r\nContent-Type: image/jpeg\r\nCache-Control: no-cache\r\n"
+						  "Connection: close\r\n" + length + jpeg);
+		}
+		else
+			continue;
+
+		if (!flush(client))
+			closeClient(i);
+	}
+}
+
+void HttpPreview::queue(Client &client, std::string const &data)
+{
+	if (client.output.empty())
+		client.last_sent = std::chrono::steady_clock::now();
+	client.output += data;
+}
+
+bool HttpPreview::flush(Client &client)
+{
+	// Send what the socket will take now, and leave the rest for when poll says there's room. Returns false once
+	// the client should be closed.
+	while (!client.output.empty())
+	{
+		ssize_t n = send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			return true;
+		if (n <= 0)
+			return false;
+		client.output.erase(0, n);
+		client.last_sent = std::chrono::steady_clock::now();
+	}
+	return client.state != Client::Done;
+}
+
+void HttpPreview::closeClient(size_t i)
+{
+	close(clients_[i].fd);
+	clients_.erase(clients_.begin() + i);
+	LOG(2, "HttpPreview: client disconnected");
+}
+
+void HttpPreview::updateWanted()
+{
+	bool snapshot = false, stream = false;
+	for (auto const &client : clients_)
+	{
+		snapshot |= client.state == Client::Snapshot;
+		stream |= client.state == Client::Stream;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	// A stream that's just started gets its first frame straight away.
+	if (stream && !stream_wanted_)
+		next_stream_frame_ = std::chrono::steady_clock::now();
+	snapshot_wanted_ = snapshot;
+	stream_wanted_ = stream;
+}
+
+Preview *make_http_preview(Options const *options)
+{
+	return new HttpPreview(options);
+}
@@ -13,10 +13,18 @@ Preview *make_null_preview(Options const *options);
 Preview *make_egl_preview(Options const *options);
 Preview *make_drm_preview(Options const *options);
 Preview *make_qt_preview(Options const *options);
+Preview *make_http_preview(Options const *options);
 
 Preview *make_preview(Options const *options)
 {
-	if (options->nopreview)
+	if (options->http_preview)
+	{
+		Preview *p = make_http_preview(options);
+		if (p)
+			LOG(1, "Made HTTP preview on port " << options->http_preview);
+		return p;
+	}
+	else if (options->nopreview)
 		return make_null_preview(options);
 #if QT_PRESENT
 	else if (options->qt_preview)
@@ -16,6 +16,9 @@
 
 struct Options;
 
+// How much lower than everything else the preview's threads' priority is (as a nice value).
+constexpr int PREVIEW_NICE = 10;
+
 class Preview
 {
 public:
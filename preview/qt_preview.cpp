@@ -5,11 +5,16 @@
  * qt_preview.cpp - Qt preview window
  */
 
+#include <errno.h>
+#include <sys/resource.h>
+
+#include <algorithm>
 #include <condition_variable>
 #include <iostream>
 #include <mutex>
 #include <string.h>
 #include <thread>
+#include <vector>
 
 // This header must be before the QT headers, as the latter #defines slot and emit!
 #include "core/options.hpp"
@@ -22,6 +27,7 @@
 #include <QWidget>
 
 #include "preview.hpp"
+#include "yuv420_converter.hpp"
 
 class MyMainWindow : public QMainWindow
 {
@@ -43,13 +49,23 @@ public:
 	{
 		image = QImage(size, QImage::Format_RGB888);
 		image.fill(0);
+		back_image = image.copy();
 	}
 	QSize size;
 	QImage image;
+	// Frames are converted into the back image, which is then swapped with the one being painted.
+	QImage back_image;
+	std::mutex image_mutex;
+	void swapImages()
+	{
+		std::lock_guard<std::mutex> lock(image_mutex);
+		image.swap(back_image);
+	}
 protected:
 	void paintEvent(QPaintEvent *) override
 	{
 		QPainter painter(this);
+		std::lock_guard<std::mutex> lock(image_mutex);
 		painter.drawImage(rect(), image, image.rect());
 	}
 	QSize sizeHint() const override { return size; }
@@ -67,115 +83,54 @@ public:
 		// This preview window is expensive, so make it small by default.
 		if (window_width_ == 0 || window_height_ == 0)
 			window_width_ = 512, window_height_ = 384;
+		// The conversion is split by rows across a few threads, of which the caller of Show() is one.
+		num_threads_ = std::clamp(std::thread::hardware_concurrency(), 1u, 4u);
+		stripes_.resize(num_threads_);
 		// As a hint, reserve twice the binned width for our widest current camera (V3)
-		tmp_stripe_.reserve(4608);
+		for (auto &stripe : stripes_)
+			stripe.reserve(4608);
+		for (unsigned int i = 1; i < num_threads_; i++)
+			workers_.emplace_back(&QtPreview::workerFunc, this, i);
 		thread_ = std::thread(&QtPreview::threadFunc, this, options);
 		std::unique_lock lock(mutex_);
 		while (!pane_)
 			cond_var_.wait(lock);
-		LOG(2, "Made Qt preview");
+		LOG(2, "Made Qt preview with " << num_threads_ << " conversion threads");
 	}
 	~QtPreview()
 	{
+		{
+			std::lock_guard<std::mutex> lock(work_mutex_);
+			work_abort_ = true;
+		}
+		work_cond_var_.notify_all();
+		for (auto &worker : workers_)
+			worker.join();
 		application_->exit();
 		thread_.join();
 	}
 	void SetInfoText(const std::string &text) override { main_window_->setWindowTitle(QString::fromStdString(text)); }
 	virtual void Show(int fd, libcamera::Span<uint8_t> span, StreamInfo const &info) override
 	{
-		// Quick and simple nearest-neighbour-ish resampling is used here.
-		// We further share U,V samples between adjacent output pixel pairs
-		// (even when downscaling) to speed up the conversion.
-		unsigned x_step = (info.width << 16) / window_width_;
-		unsigned y_step = (info.height << 16) / window_height_;
-
-		// Choose the right matrix to convert YUV back to RGB.
-		static const float YUV2RGB[3][9] = {
-			{ 1.0,   0.0, 1.402, 1.0,   -0.344, -0.714, 1.0,   1.772, 0.0 }, // JPEG
-			{ 1.164, 0.0, 1.596, 1.164, -0.392, -0.813, 1.164, 2.017, 0.0 }, // SMPTE170M
-			{ 1.164, 0.0, 1.793, 1.164, -0.213, -0.533, 1.164, 2.112, 0.0 }, // Rec709
-		};
-		int offsetY;
-		float coeffY, coeffVR, coeffUG, coeffVG, coeffUB;
-		if (info.colour_space == libcamera::ColorSpace::Smpte170m)
-		{
-			offsetY = 16;
-			coeffY = YUV2RGB[1][0];
-			coeffVR = YUV2RGB[1][2];
-			coeffUG = YUV2RGB[1][4];
-			coeffVG = YUV2RGB[1][5];
-			coeffUB = YUV2RGB[1][7];
-		}
-		else if (info.colour_space == libcamera::ColorSpace::Rec709)
-		{
-			offsetY = 16;
-			coeffY = YUV2RGB[2][0];
-			coeffVR = YUV2RGB[2][2];
-			coeffUG = YUV2RGB[2][4];
-			coeffVG = YUV2RGB[2][5];
-			coeffUB = YUV2RGB[2][7];
-		}
-		else
+		converter_.Configure(info, window_width_, window_height_);
+		src_ = span.data();
+		dest_ = pane_->back_image.bits();
+		dest_stride_ = pane_->back_image.bytesPerLine();
+
+		// Each thread converts a band of rows, this one included.
 		{
-			offsetY = 0;
-			coeffY = YUV2RGB[0][0];
-			coeffVR = YUV2RGB[0][2];
-			coeffUG = YUV2RGB[0][4];
-			coeffVG = YUV2RGB[0][5];
-			coeffUB = YUV2RGB[0][7];
-			if (info.colour_space != libcamera::ColorSpace::Sycc)
-				LOG(1, "QtPreview: unexpected colour space " << libcamera::ColorSpace::toString(info.colour_space));
+			std::lock_guard<std::mutex> lock(work_mutex_);
+			work_remaining_ = num_threads_ - 1;
+			work_generation_++;
 		}
-
-		// Because the source buffer is uncached, and we want to read it a byte at a time,
-		// take a copy of each row used. This is a speedup provided memcpy() is vectorized.
-		tmp_stripe_.resize(2 * info.stride);
-		uint8_t const *Y_start = span.data();
-		uint8_t *Y_row = &tmp_stripe_[0];
-		uint8_t *U_row = Y_row + info.stride;
-		uint8_t *V_row = U_row + (info.stride >> 1);
-
-		// Possibly this should be locked in case a repaint is happening? In practice the risk
-		// is only that there might be some tearing, so I don't think we worry. We could speed
-		// it up by getting the ISP to supply RGB, but I'm not sure I want to handle that extra
-		// possibility in our main application code, so we'll put up with the slow conversion.
-		for (unsigned int y = 0; y < window_height_; y++)
+		work_cond_var_.notify_all();
+		convertRows(0);
 		{
-			unsigned row = (y * y_step) >> 16;
-			uint8_t *dest = pane_->image.scanLine(y);
-			unsigned x_pos = x_step >> 1;
-
-			memcpy(Y_row, Y_start + row * info.stride, info.stride);
-			memcpy(U_row, Y_start + ((4 * info.height + row) >> 1) * (info.stride >> 1), info.stride >> 1);
-			memcpy(V_row, Y_start + ((5 * info.height + row) >> 1) * (info.stride >> 1), info.stride >> 1);
-
-			for (unsigned int x = 0; x < window_width_; x += 2)
-			{
-				int Y0 = Y_row[x_pos >> 16];
-				x_pos += x_step;
-				int Y1 = Y_row[x_pos >> 16];
-				int U = U_row[x_pos >> 17];
-				int V = V_row[x_pos >> 17];
-				x_pos += x_step;
-				Y0 -= offsetY;
-				Y1 -= offsetY;
-				U -= 128;
-				V -= 128;
-				int R0 = coeffY * Y0 + coeffVR * V;
-				int G0 = coeffY * Y0 + coeffUG * U + coeffVG * V;
-				int B0 = coeffY * Y0 + coeffUB * U;
-				int R1 = coeffY * Y1 + coeffVR * V;
-				int G1 = coeffY * Y1 + coeffUG * U + coeffVG * V;
-				int B1 = coeffY * Y1 + coeffUB * U;
-				*(dest++) = std::clamp(R0, 0, 255);
-				*(dest++) = std::clamp(G0, 0, 255);
-				*(dest++) = std::clamp(B0, 0, 255);
-				*(dest++) = std::clamp(R1, 0, 255);
-				*(dest++) = std::clamp(G1, 0, 255);
-				*(dest++) = std::clamp(B1, 0, 255);
-			}
+			std::unique_lock<std::mutex> lock(work_mutex_);
+			work_done_cond_var_.wait(lock, [this] { return work_remaining_ == 0; });
 		}
 
+		pane_->swapImages();
 		pane_->update();
 
 		// Return the buffer to the camera system.
@@ -190,6 +145,38 @@ public:
 	virtual void MaxImageSize(unsigned int &w, unsigned int &h) const override { w = h = 0; }
 
 private:
+	void convertRows(unsigned int thread)
+	{
+		const unsigned int begin = window_height_ * thread / num_threads_;
+		const unsigned int end = window_height_ * (thread + 1) / num_threads_;
+		converter_.ConvertRows(src_, begin, end, dest_, dest_stride_, stripes_[thread]);
+	}
+
+	void workerFunc(unsigned int thread)
+	{
+		// The workers share the preview thread's work, so they run at the same lowered priority.
+		if (setpriority(PRIO_PROCESS, 0, getpriority(PRIO_PROCESS, 0) + PREVIEW_NICE) < 0)
+			LOG(1, "QtPreview: failed to lower conversion thread priority: " << strerror(errno));
+
+		unsigned int generation = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(work_mutex_);
+				work_cond_var_.wait(lock, [&] { return work_abort_ || work_generation_ != generation; });
+				if (work_abort_)
+					return;
+				generation = work_generation_;
+			}
+
+			convertRows(thread);
+
+			std::lock_guard<std::mutex> lock(work_mutex_);
+			if (--work_remaining_ == 0)
+				work_done_cond_var_.notify_one();
+		}
+	}
+
 	void threadFunc(Options const *options)
 	{
 		// This acts as Qt's event loop. Really Qt prefers to own the application's event loop
@@ -217,7 +204,22 @@ private:
 	unsigned int window_width_, window_height_;
 	std::mutex mutex_;
 	std::condition_variable cond_var_;
-	std::vector<uint8_t> tmp_stripe_;
+
+	// The frame being converted, and where it's going.
+	Yuv420Converter converter_;
+	uint8_t const *src_ = nullptr;
+	uint8_t *dest_ = nullptr;
+	unsigned int dest_stride_ = 0;
+
+	unsigned int num_threads_;
+	std::vector<std::vector<uint8_t>> stripes_;
+	std::vector<std::thread> workers_;
+	std::mutex work_mutex_;
+	std::condition_variable work_cond_var_;
+	std::condition_variable work_done_cond_var_;
+	unsigned int work_generation_ = 0;
+	unsigned int work_remaining_ = 0;
+	bool work_abort_ = false;
 };
 
 Preview *make_qt_preview(Options const *options)
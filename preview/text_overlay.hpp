@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * text_overlay.hpp - draw the info text for a preview to lay over the camera image
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Draws a line of text, white on a translucent black box, into an ARGB8888 image using a small built-in bitmap
+// font, so that previews can show the info text on a plane or texture of its own, leaving the camera image alone.
+// It's only redrawn when the part of the text that fits changes, so callers can hand it the same string every
+// frame. Colours are the same premultiplied or not, and the same whichever way round red and blue are.
+class TextOverlay
+{
+public:
+	// Font pixels are scale x scale pixels, and the image is never wider than max_width (extra text is dropped).
+	TextOverlay(unsigned int scale, unsigned int max_width);
+
+	// Returns true if the text that fits has changed and the image been redrawn.
+	bool Update(std::string const &text);
+
+	// Both zero when there's no text to show.
+	unsigned int Width() const { return width_; }
+	unsigned int Height() const { return height_; }
+	// The height of any line of text.
+	unsigned int MaxHeight() const;
+	// Width() pixels to a row, alpha in the top byte.
+	const uint32_t *Data() const { return pixels_.data(); }
+
+private:
+	unsigned int scale_;
+	unsigned int max_width_;
+	std::string text_;
+	unsigned int width_ = 0;
+	unsigned int height_ = 0;
+	std::vector<uint32_t> pixels_;
+};
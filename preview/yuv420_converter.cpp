@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * yuv420_converter.cpp - resize and convert YUV420 images to RGB for display
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+#include "core/logging.hpp"
+
+#include "yuv420_converter.hpp"
+
+void Yuv420Converter::Configure(StreamInfo const &info, unsigned int width, unsigned int height)
+{
+	if (info.width != info_.width || info.height != info_.height || width != width_ || height != height_)
+	{
+		width_ = width, height_ = height;
+		makeMaps(info);
+	}
+	if (!tables_made_ || info.colour_space != info_.colour_space)
+		makeTables(info);
+	info_ = info;
+}
+
+void Yuv420Converter::makeMaps(StreamInfo const &info)
+{
+	// Quick and simple nearest-neighbour-ish resampling is used here.
+	// We further share U,V samples between adjacent output pixel pairs
+	// (even when downscaling) to speed up the conversion. Which source
+	// samples each output pixel uses only changes with the image size.
+	unsigned x_step = (info.width << 16) / width_;
+	unsigned y_step = (info.height << 16) / height_;
+
+	x_map_.resize(width_);
+	uv_map_.resize(width_ / 2);
+	unsigned x_pos = x_step >> 1;
+	for (unsigned int x = 0; x < width_; x += 2)
+	{
+		x_map_[x] = x_pos >> 16;
+		x_pos += x_step;
+		x_map_[x + 1] = x_pos >> 16;
+		uv_map_[x / 2] = x_pos >> 17;
+		x_pos += x_step;
+	}
+
+	y_map_.resize(height_);
+	for (unsigned int y = 0; y < height_; y++)
+		y_map_[y] = (y * y_step) >> 16;
+}
+
+void Yuv420Converter::makeTables(StreamInfo const &info)
+{
+	// Choose the right matrix to convert YUV back to RGB.
+	static const float YUV2RGB[3][9] = {
+		{ 1.0,   0.0, 1.402, 1.0,   -0.344, -0.714, 1.0,   1.772, 0.0 }, // JPEG
+		{ 1.164, 0.0, 1.596, 1.164, -0.392, -0.813, 1.164, 2.017, 0.0 }, // SMPTE170M
+		{ 1.164, 0.0, 1.793, 1.164, -0.213, -0.533, 1.164, 2.112, 0.0 }, // Rec709
+	};
+	int offsetY = 16;
+	unsigned int m = 0;
+	if (info.colour_space == libcamera::ColorSpace::Smpte170m)
+		m = 1;
+	else if (info.colour_space == libcamera::ColorSpace::Rec709)
+		m = 2;
+	else
+	{
+		offsetY = 0;
+		if (info.colour_space != libcamera::ColorSpace::Sycc)
+			LOG(1, "Yuv420Converter: unexpected colour space " << libcamera::ColorSpace::toString(info.colour_space));
+	}
+
+	// Every term of the matrix product only ever sees 256 different values, so look them up, in fixed point.
+	auto fixed = [](float coeff, int value) { return (int)std::lround(coeff * value * (1 << SHIFT)); };
+	for (int i = 0; i < 256; i++)
+	{
+		y_table_[i] = fixed(YUV2RGB[m][0], i - offsetY);
+		vr_table_[i] = fixed(YUV2RGB[m][2], i - 128);
+		ug_table_[i] = fixed(YUV2RGB[m][4], i - 128);
+		vg_table_[i] = fixed(YUV2RGB[m][5], i - 128);
+		ub_table_[i] = fixed(YUV2RGB[m][7], i - 128);
+	}
+	tables_made_ = true;
+}
+
+void Yuv420Converter::ConvertRows(const uint8_t *src, unsigned int begin, unsigned int end, uint8_t *dest,
+								  unsigned int dest_stride, std::vector<uint8_t> &stripe) const
+{
+	StreamInfo const &info = info_;
+
+	// Because the source buffer is uncached, and we want to read it a byte at a time,
+	// take a copy of each row used. This is a speedup provided memcpy() is vectorized.
+	stripe.resize(2 * info.stride);
+	uint8_t *Y_row = &stripe[0];
+	uint8_t *U_row = Y_row + info.stride;
+	uint8_t *V_row = U_row + (info.stride >> 1);
+
+	auto clamp = [](int v) { return (uint8_t)std::clamp(v >> SHIFT, 0, 255); };
+
+	for (unsigned int y = begin; y < end; y++)
+	{
+		unsigned row = y_map_[y];
+		uint8_t *out = dest + y * dest_stride;
+
+		memcpy(Y_row, src + row * info.stride, info.stride);
+		memcpy(U_row, src + ((4 * info.height + row) >> 1) * (info.stride >> 1), info.stride >> 1);
+		memcpy(V_row, src + ((5 * info.height + row) >> 1) * (info.stride >> 1), info.stride >> 1);
+
+		for (unsigned int x = 0; x < width_; x += 2)
+		{
+			const int Y0 = y_table_[Y_row[x_map_[x]]];
+			const int Y1 = y_table_[Y_row[x_map_[x + 1]]];
+			const int U = U_row[uv_map_[x / 2]];
+			const int V = V_row[uv_map_[x / 2]];
+			const int R = vr_table_[V];
+			const int G = ug_table_[U] + vg_table_[V];
+			const int B = ub_table_[U];
+			out[0] = clamp(Y0 + R);
+			out[1] = clamp(Y0 + G);
+			out[2] = clamp(Y0 + B);
+			out[3] = clamp(Y1 + R);
+			out[4] = clamp(Y1 + G);
+			out[5] = clamp(Y1 + B);
+			out += 6;
+		}
+	}
+}
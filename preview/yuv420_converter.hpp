@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * yuv420_converter.hpp - resize and convert YUV420 images to RGB for display
+ */
+
+#pragma once
+
+#include <array>
+#include <stdint.h>
+#include <vector>
+
+#include "core/stream_info.hpp"
+
+// Converts YUV420 images to packed RGB888 of another (even) size, for previews that can only show RGB. The
+// resampling is quick and simple nearest-neighbour-ish, and the colour conversion is fixed point through lookup
+// tables. The output is within a level of converting each sample exactly, in floating point.
+class Yuv420Converter
+{
+public:
+	// Get ready to convert images like this one to the given size. Only what depends on a changed size or colour
+	// space is redone.
+	void Configure(StreamInfo const &info, unsigned int width, unsigned int height);
+
+	// Convert output rows begin to end of the source image, which must match the last Configure(). The output row
+	// y goes to dest + y * dest_stride. Rows are copied into the stripe before reading them, so each thread needs
+	// its own. Different rows can be converted on different threads at once.
+	void ConvertRows(const uint8_t *src, unsigned int begin, unsigned int end, uint8_t *dest,
+					 unsigned int dest_stride, std::vector<uint8_t> &stripe) const;
+
+private:
+	// Fixed point fraction bits for the colour conversion.
+	static constexpr int SHIFT = 14;
+
+	void makeMaps(StreamInfo const &info);
+	void makeTables(StreamInfo const &info);
+
+	unsigned int width_ = 0, height_ = 0;
+	StreamInfo info_;
+	std::vector<unsigned int> x_map_, uv_map_, y_map_;
+	std::array<int, 256> y_table_, vr_table_, ug_table_, vg_table_, ub_table_;
+	bool tables_made_ = false;
+};
@@ -0,0 +1,185 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * cascade_test.cpp - run the detector to classifier cascade on a mock backend
+ */
+
+#include <map>
+#include <vector>
+
+#include "post_processing_stages/cascade.hpp"
+#include "test/check.hpp"
+
+static constexpr unsigned int WIDTH = 320, HEIGHT = 240, CROP = 16;
+
+// Scores each crop by its average red, green and blue, so the "class" is the dominant colour. Jobs
+// finish when they're polled, and can be made to fail.
+class ColourBackend : public InferenceBackend
+{
+public:
+	ColourBackend(unsigned int max_batch) : max_batch_(max_batch)
+	{
+		TensorInfo input;
+		input.type = TensorType::UInt8;
+		input.shape = { 1, CROP, CROP, 3 };
+		inputs_ = { input };
+		TensorInfo output;
+		output.shape = { 1, 3 };
+		outputs_ = { output };
+	}
+
+	void Load([[maybe_unused]] boost::property_tree::ptree const &params) override {}
+	std::vector<TensorInfo> const &Inputs() const override { return inputs_; }
+	std::vector<TensorInfo> const &Outputs() const override { return outputs_; }
+	unsigned int MaxBatch() const override { return max_batch_; }
+
+	int Submit(unsigned int sequence, const uint8_t *input) override { return SubmitBatch(sequence, input, 1); }
+
+	int SubmitBatch([[maybe_unused]] unsigned int sequence, const uint8_t *input, unsigned int count) override
+	{
+		if (count > max_batch_)
+			return -1;
+		TensorInfo info = outputs_[0];
+		info.shape[0] = count;
+		Tensor output = MakeTensor(info);
+		float *scores = reinterpret_cast<float *>(output.data.get());
+		for (unsigned int i = 0; i < count * CROP * CROP; i++, input += 3)
+		{
+			for (unsigned int c = 0; c < 3; c++)
+				scores[(i / (CROP * CROP)) * 3 + c] += input[c] / (255.0f * CROP * CROP);
+		}
+		batch_sizes.push_back(count);
+		jobs_[next_] = { output };
+		return next_++;
+	}
+
+	InferenceStatus Poll(int job, std::vector<Tensor> &outputs,
+						 [[maybe_unused]] std::chrono::milliseconds timeout) override
+	{
+		auto it = jobs_.find(job);
+		if (it == jobs_.end())
+			return InferenceStatus::Failed;
+		outputs = std::move(it->second);
+		jobs_.erase(it);
+		return fail ? InferenceStatus::Failed : InferenceStatus::Ok;
+	}
+
+	unsigned int Outstanding() const { return jobs_.size(); }
+
+	bool fail = false;
+	std::vector<unsigned int> batch_sizes;
+
+private:
+	unsigned int max_batch_;
+	std::vector<TensorInfo> inputs_;
+	std::vector<TensorInfo> outputs_;
+	std::map<int, std::vector<Tensor>> jobs_;
+	int next_ = 0;
+};
+
+// A YUV420 image with red, green and blue vertical stripes.
+static std::vector<uint8_t> make_image()
+{
+	const uint8_t yuv[3][3] = { { 76, 85, 255 }, { 150, 44, 21 }, { 29, 255, 107 } };
+	std::vector<uint8_t> image(WIDTH * HEIGHT * 3 / 2);
+	uint8_t *u = image.data() + WIDTH * HEIGHT, *v = u + WIDTH * HEIGHT / 4;
+	for (unsigned int y = 0; y < HEIGHT; y++)
+	{
+		for (unsigned int x = 0; x < WIDTH; x++)
+		{
+			const uint8_t *colour = yuv[x * 3 / WIDTH];
+			image[y * WIDTH + x] = colour[0];
+			if (!(x & 1) && !(y & 1))
+			{
+				u[(y / 2) * (WIDTH / 2) + x / 2] = colour[1];
+				v[(y / 2) * (WIDTH / 2) + x / 2] = colour[2];
+			}
+		}
+	}
+	return image;
+}
+
+static std::vector<Detection> make_detections()
+{
+	// One in the middle of each stripe, the red one the least confident.
+	return { Detection(1, "thing", 0.6, 20, 80, 60, 60), Detection(1, "thing", 0.9, 130, 80, 60, 60),
+			 Detection(1, "thing", 0.8, 240, 80, 60, 60) };
+}
+
+static void configure(Cascade &cascade, unsigned int crop_budget)
+{
+	CascadeConfig config;
+	config.crop_budget = crop_budget;
+	config.padding = 0;
+	config.labels = { "red", "green", "blue" };
+	StreamInfo info;
+	info.width = WIDTH;
+	info.height = HEIGHT;
+	info.stride = WIDTH;
+	cascade.Configure(config, info, libcamera::Size(WIDTH, HEIGHT));
+}
+
+// Only crop_budget crops are classified each frame, the most confident first, and the rest get
+// their turn on the next frame while the others keep their labels.
+static void test_budget()
+{
+	std::vector<uint8_t> image = make_image();
+	ColourBackend backend(4);
+	Cascade cascade;
+	configure(cascade, 2);
+
+	std::vector<Detection> detections = make_detections();
+	cascade.Process(0, detections, image.data(), backend);
+	CHECK(detections[0].label.empty());
+	CHECK(detections[1].label == "green");
+	CHECK(detections[2].label == "blue");
+	CHECK(detections[1].label_confidence > 0.5);
+	CHECK(backend.batch_sizes == std::vector<unsigned int>({ 2 }));
+
+	detections = make_detections();
+	cascade.Process(1, detections, image.data(), backend);
+	CHECK(detections[0].label == "red");
+	CHECK(detections[1].label == "green");
+	CHECK(detections[2].label == "blue");
+	CHECK(backend.Outstanding() == 0);
+}
+
+// A backend that takes fewer crops than the budget gets several jobs.
+static void test_batching()
+{
+	std::vector<uint8_t> image = make_image();
+	ColourBackend backend(2);
+	Cascade cascade;
+	configure(cascade, 3);
+
+	std::vector<Detection> detections = make_detections();
+	cascade.Process(0, detections, image.data(), backend);
+	CHECK(backend.batch_sizes == std::vector<unsigned int>({ 2, 1 }));
+	CHECK(detections[0].label == "red" && detections[1].label == "green" && detections[2].label == "blue");
+}
+
+// When classification fails, nothing is labelled, but every job is still collected.
+static void test_failure()
+{
+	std::vector<uint8_t> image = make_image();
+	ColourBackend backend(1);
+	backend.fail = true;
+	Cascade cascade;
+	configure(cascade, 3);
+
+	std::vector<Detection> detections = make_detections();
+	cascade.Process(0, detections, image.data(), backend);
+	CHECK(backend.batch_sizes.size() == 3);
+	CHECK(backend.Outstanding() == 0);
+	for (auto const &d : detections)
+		CHECK(d.label.empty());
+}
+
+int main()
+{
+	test_budget();
+	test_batching();
+	test_failure();
+	return failures ? 1 : 0;
+}
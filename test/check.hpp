@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * check.hpp - the checks the unit tests make
+ */
+
+#pragma once
+
+#include <iostream>
+
+// Each test is a single program. A check that fails is reported and counted, the test carries on, and main() returns
+// failures ? 1 : 0 at the end.
+static int failures = 0;
+
+#define CHECK(cond)                                                                                                    \
+	do                                                                                                                 \
+	{                                                                                                                  \
+		if (!(cond))                                                                                                   \
+		{                                                                                                              \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl;                         \
+			failures++;                                                                                                \
+		}                                                                                                              \
+	} while (0)
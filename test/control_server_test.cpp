@@ -0,0 +1,252 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * control_server_test.cpp - drive a ControlServer from a scripted client, with no camera
+ */
+
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/json_parser.hpp>
+
+#include "core/control_server.hpp"
+#include "core/event_loop.hpp"
+#include "test/check.hpp"
+
+using ptree = ControlServer::ptree;
+
+// Stands in for the application: the frames go by with these sequence numbers, and there's no request behind them.
+struct Frames
+{
+	void Next(ControlServer &server)
+	{
+		CompletedRequestPtr none;
+		server.ApplyPending(++sequence, none);
+	}
+
+	unsigned int sequence = 100;
+};
+
+// Let the server's event loop catch up with whatever the client has done.
+static void pump(EventLoop &loop)
+{
+	int timer = loop.AddTimer([&loop]() { loop.Quit(); });
+	loop.SetTimer(timer, std::chrono::milliseconds(20));
+	loop.Run();
+	loop.RemoveTimer(timer);
+}
+
+struct Client
+{
+	Client(std::string const &path)
+	{
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		sockaddr_un addr = {};
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+		if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+			throw std::runtime_error("can't connect to " + path);
+	}
+	~Client() { close(fd); }
+
+	void Send(std::string const &text) { CHECK(write(fd, text.data(), text.size()) == (ssize_t)text.size()); }
+
+	// All the replies that have arrived, one per line.
+	std::vector<ptree> Replies()
+	{
+		char buf[4096];
+		pollfd p = { fd, POLLIN, 0 };
+		while (poll(&p, 1, 20) > 0)
+		{
+			ssize_t n = read(fd, buf, sizeof(buf));
+			if (n <= 0)
+			{
+				closed = true;
+				break;
+			}
+			input.append(buf, n);
+		}
+
+		std::vector<ptree> replies;
+		size_t pos;
+		while ((pos = input.find('\n')) != std::string::npos)
+		{
+			std::istringstream line(input.substr(0, pos));
+			input.erase(0, pos + 1);
+			replies.emplace_back();
+			boost::property_tree::read_json(line, replies.back());
+		}
+		return replies;
+	}
+
+	int fd;
+	std::string input;
+	bool closed = false;
+};
+
+static bool ok(ptree const &reply)
+{
+	return reply.get<bool>("ok");
+}
+
+static void add_commands(ControlServer &server, Frames &frames)
+{
+	server.AddCommand("echo", [](CompletedRequestPtr &, ptree const &command, ptree &reply) {
+		reply.put("value", command.get<std::string>("value"));
+	});
+	server.AddCommand("fail", [](CompletedRequestPtr &, ptree const &, ptree &) {
+		throw std::runtime_error("failed on purpose");
+	});
+	// Takes effect once the frames reach the given sequence number, like controls waiting for their request.
+	server.AddDeferredCommand("until", [&frames](CompletedRequestPtr &, ptree const &command, ptree &) {
+		unsigned int sequence = command.get<unsigned int>("sequence");
+		return [&frames, sequence](CompletedRequestPtr &) { return frames.sequence >= sequence; };
+	});
+}
+
+static void test_commands(std::string const &path)
+{
+	EventLoop loop;
+	ControlServer server(path, loop);
+	Frames frames;
+	add_commands(server, frames);
+	Client client(path);
+
+	// Commands that can't run are answered straight away, without waiting for a frame.
+	client.Send("not json\n{ \"command\": \"nothing\", \"id\": \"2\" }\n\n");
+	pump(loop);
+	std::vector<ptree> replies = client.Replies();
+	CHECK(replies.size() == 2);
+	if (replies.size() == 2)
+	{
+		CHECK(!ok(replies[0]) && !replies[0].count("id") && !replies[0].count("sequence"));
+		CHECK(!ok(replies[1]) && replies[1].get<std::string>("id") == "2");
+		CHECK(replies[1].get<std::string>("error").find("unknown command") != std::string::npos);
+	}
+
+	// The rest wait for the next frame, and run in order. A command can come in pieces.
+	client.Send("{ \"command\": \"echo\", \"id\": \"3\", \"value\": \"hello\" }\n"
+				"{ \"command\": \"fail\", \"id\": \"4\" }\n{ \"command\": \"echo\", \"id\": \"5\", ");
+	pump(loop);
+	CHECK(client.Replies().empty());
+	client.Send("\"value\": \"again\" }\n");
+	pump(loop);
+	CHECK(client.Replies().empty());
+
+	frames.Next(server);
+	replies = client.Replies();
+	CHECK(replies.size() == 3);
+	if (replies.size() == 3)
+	{
+		CHECK(ok(replies[0]) && replies[0].get<std::string>("id") == "3");
+		CHECK(replies[0].get<std::string>("value") == "hello" && replies[0].get<unsigned int>("sequence") == 101);
+		CHECK(!ok(replies[1]) && replies[1].get<std::string>("error") == "failed on purpose");
+		CHECK(replies[1].get<unsigned int>("sequence") == 101);
+		CHECK(ok(replies[2]) && replies[2].get<std::string>("value") == "again");
+	}
+	frames.Next(server);
+	CHECK(client.Replies().empty());
+}
+
+static void test_deferred(std::string const &path)
+{
+	EventLoop loop;
+	ControlServer server(path, loop);
+	Frames frames;
+	add_commands(server, frames);
+	Client client(path);
+
+	// A command that takes effect later is answered with the frame where it did, and others can overtake it.
+	client.Send("{ \"command\": \"until\", \"id\": \"1\", \"sequence\": 104 }\n{ \"command\": \"echo\", \"id\": \"2\", "
+				"\"value\": \"x\" }\n");
+	pump(loop);
+	frames.Next(server);
+	std::vector<ptree> replies = client.Replies();
+	CHECK(replies.size() == 1 && replies[0].get<std::string>("id") == "2");
+
+	// Even one whose frame has come already has to wait for the next.
+	client.Send("{ \"command\": \"until\", \"id\": \"3\", \"sequence\": 0 }\n");
+	pump(loop);
+	frames.Next(server);
+	CHECK(client.Replies().empty());
+	frames.Next(server);
+	replies = client.Replies();
+	CHECK(replies.size() == 1 && replies[0].get<std::string>("id") == "3" && ok(replies[0]));
+	CHECK(replies.size() == 1 && replies[0].get<unsigned int>("sequence") == 103);
+
+	frames.Next(server);
+	replies = client.Replies();
+	CHECK(replies.size() == 1 && replies[0].get<std::string>("id") == "1" && ok(replies[0]));
+	CHECK(replies.size() == 1 && replies[0].get<unsigned int>("sequence") == 104);
+
+	// One that never takes effect fails, rather than keeping the client waiting for ever.
+	client.Send("{ \"command\": \"until\", \"id\": \"5\", \"sequence\": 100000 }\n");
+	pump(loop);
+	const unsigned int start = frames.sequence;
+	while (replies = client.Replies(), replies.empty() && frames.sequence < start + 2 * ControlServer::MAX_WAIT)
+		frames.Next(server);
+	CHECK(replies.size() == 1 && !ok(replies[0]) && replies[0].get<std::string>("id") == "5");
+	CHECK(frames.sequence == start + ControlServer::MAX_WAIT + 1);
+}
+
+static void test_finished_client(std::string const &path)
+{
+	EventLoop loop;
+	ControlServer server(path, loop);
+	Frames frames;
+	add_commands(server, frames);
+
+	// A client that stops sending still gets its replies, and is then disconnected.
+	Client client(path);
+	client.Send("{ \"command\": \"until\", \"id\": \"1\", \"sequence\": 102 }\n");
+	shutdown(client.fd, SHUT_WR);
+	pump(loop);
+	frames.Next(server);
+	CHECK(client.Replies().empty() && !client.closed);
+	frames.Next(server);
+	std::vector<ptree> replies = client.Replies();
+	CHECK(replies.size() == 1 && ok(replies[0]) && client.closed);
+
+	// One that goes away before its reply is dropped when the reply can't be sent.
+	{
+		Client gone(path);
+		gone.Send("{ \"command\": \"echo\", \"value\": \"x\" }\n");
+		pump(loop);
+	}
+	pump(loop);
+	frames.Next(server);
+
+	// And a line too long to be a command gets the client disconnected.
+	Client greedy(path);
+	greedy.Send("{ \"command\": \"echo\", \"value\": \"" + std::string(70000, 'x'));
+	pump(loop);
+	greedy.Replies();
+	CHECK(greedy.closed);
+}
+
+int main()
+{
+	char dir[] = "/tmp/control_server_test-XXXXXX";
+	if (!mkdtemp(dir))
+		return 1;
+	const std::string path = std::string(dir) + "/control.sock";
+
+	test_commands(path);
+	test_deferred(path);
+	test_finished_client(path);
+
+	std::filesystem::remove_all(dir);
+	return failures ? 1 : 0;
+}
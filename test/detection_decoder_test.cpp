@@ -0,0 +1,359 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * detection_decoder_test.cpp - decode synthetic detector outputs, and check the shared NMS
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "post_processing_stages/detection_decoder.hpp"
+#include "post_processing_stages/object_detect.hpp"
+#include "post_processing_stages/tiling.hpp"
+#include "test/check.hpp"
+
+using Rectangle = libcamera::Rectangle;
+using Size = libcamera::Size;
+
+static bool near(float a, float b)
+{
+	return std::abs(a - b) < 1e-4;
+}
+
+static Tensor float_tensor(std::vector<unsigned int> const &shape, std::vector<float> const &values)
+{
+	TensorInfo info;
+	info.shape = shape;
+	Tensor tensor = MakeTensor(info);
+	memcpy(tensor.data.get(), values.data(), std::min(values.size(), info.Elements()) * sizeof(float));
+	return tensor;
+}
+
+static void test_ssd()
+{
+	// Three detections of (y0, x0, y1, x1), the last below the threshold.
+	Tensor boxes = float_tensor({ 1, 3, 4 }, { 0.1, 0.2, 0.5, 0.6, 0.0, 0.0, 1.2, 0.5, 0.3, 0.3, 0.4, 0.4 });
+	Tensor classes = float_tensor({ 1, 3 }, { 4, 7, 2 });
+	Tensor scores = float_tensor({ 1, 3 }, { 0.9, 0.6, 0.3 });
+
+	std::vector<DecodedObject> objects = DecodeSsd(boxes, classes, scores, nullptr, 0.5);
+	CHECK(objects.size() == 2);
+	CHECK(objects[0].category == 4 && near(objects[0].confidence, 0.9));
+	CHECK(near(objects[0].x0, 0.2) && near(objects[0].y0, 0.1) && near(objects[0].x1, 0.6) && near(objects[0].y1, 0.5));
+	// Boxes are clamped to the input tensor.
+	CHECK(objects[1].category == 7 && near(objects[1].y1, 1.0));
+
+	// A count tensor limits how many are looked at.
+	Tensor count = float_tensor({ 1 }, { 1 });
+	CHECK(DecodeSsd(boxes, classes, scores, &count, 0.5).size() == 1);
+
+	// The same first box with all the y0s, then all the x0s and so on.
+	Tensor planar = float_tensor({ 4, 3 }, { 0.1, 0.0, 0.3, 0.2, 0.0, 0.3, 0.5, 1.0, 0.4, 0.6, 0.5, 0.4 });
+	objects = DecodeSsd(planar, classes, scores, nullptr, 0.5, true);
+	CHECK(objects.size() == 2);
+	CHECK(near(objects[0].x0, 0.2) && near(objects[0].y0, 0.1) && near(objects[0].x1, 0.6) && near(objects[0].y1, 0.5));
+
+	// Quantised scores are dequantised before the threshold.
+	TensorInfo info;
+	info.type = TensorType::UInt8;
+	info.shape = { 1, 3 };
+	info.scale = 0.01;
+	info.zero_point = 10;
+	Tensor quantised = MakeTensor(info);
+	const uint8_t q[] = { 100, 20, 70 }; // 0.9, 0.1, 0.6
+	memcpy(quantised.data.get(), q, sizeof(q));
+	objects = DecodeSsd(boxes, classes, quantised, nullptr, 0.5);
+	CHECK(objects.size() == 2 && objects[0].category == 4 && objects[1].category == 2);
+	CHECK(near(objects[1].confidence, 0.6));
+}
+
+static void test_yolov8()
+{
+	// Two classes and eight anchors, as [1, 4 + classes, anchors] in input tensor pixels. There are always more
+	// anchors than channels, which is how the decoder tells which way round the tensor is. Only the first three
+	// anchors score anything.
+	const Size input_size(100, 200);
+	const unsigned int anchors = 8, channels = 6;
+	std::vector<float> values(channels * anchors, 0.0f);
+	const float first[channels][3] = {
+		{ 50, 10, 90 }, // cx
+		{ 100, 20, 100 }, // cy
+		{ 20, 10, 10 }, // w
+		{ 40, 10, 10 }, // h
+		{ 0.1, 0.2, 0.9 }, // class 0
+		{ 0.8, 0.3, 0.1 }, // class 1
+	};
+	for (unsigned int c = 0; c < channels; c++)
+		for (unsigned int a = 0; a < 3; a++)
+			values[c * anchors + a] = first[c][a];
+
+	Tensor output = float_tensor({ 1, channels, anchors }, values);
+	std::vector<DecodedObject> objects = DecodeYoloV8(output, input_size, 0.5, true);
+	CHECK(objects.size() == 2);
+	CHECK(objects[0].category == 1 && near(objects[0].confidence, 0.8));
+	CHECK(near(objects[0].x0, 0.4) && near(objects[0].x1, 0.6) && near(objects[0].y0, 0.4) && near(objects[0].y1, 0.6));
+	CHECK(objects[1].category == 0 && near(objects[1].x0, 0.85) && near(objects[1].x1, 0.95));
+
+	// The same output the other way round, [1, anchors, 4 + classes].
+	std::vector<float> transposed(values.size());
+	for (unsigned int c = 0; c < channels; c++)
+		for (unsigned int a = 0; a < anchors; a++)
+			transposed[a * channels + c] = values[c * anchors + a];
+	output = float_tensor({ 1, anchors, channels }, transposed);
+	std::vector<DecodedObject> again = DecodeYoloV8(output, input_size, 0.5, true);
+	CHECK(again.size() == 2);
+	CHECK(again[0].category == 1 && near(again[0].x0, 0.4) && near(again[0].y1, 0.6));
+}
+
+static void test_hailo_nms()
+{
+	// Two classes with room for two boxes each: a count followed by (y0, x0, y1, x1, score) for each box.
+	std::vector<float> values = {
+		1, 0.1, 0.2, 0.3, 0.4, 0.9,
+		2, 0.5, 0.5, 0.7, 0.7, 0.3, 0.0, 0.0, 0.2, 0.2, 0.6,
+	};
+	Tensor output = float_tensor({ 2, 11 }, values);
+	std::vector<DecodedObject> objects = DecodeHailoNms(output, 0.5);
+	CHECK(objects.size() == 2);
+	CHECK(objects[0].category == 0 && near(objects[0].x0, 0.2) && near(objects[0].y0, 0.1));
+	CHECK(near(objects[0].x1, 0.4) && near(objects[0].y1, 0.3));
+	CHECK(objects[1].category == 1 && near(objects[1].confidence, 0.6) && near(objects[1].x1, 0.2));
+}
+
+static Tensor quantised_tensor(std::vector<unsigned int> const &shape, float scale, int zero_point, std::mt19937 &rng)
+{
+	TensorInfo info;
+	info.type = TensorType::UInt8;
+	info.shape = shape;
+	info.scale = scale;
+	info.zero_point = zero_point;
+	Tensor tensor = MakeTensor(info);
+	std::uniform_int_distribution<int> value(0, 255);
+	for (size_t i = 0; i < info.Elements(); i++)
+		tensor.data.get()[i] = value(rng);
+	return tensor;
+}
+
+static float reference_iou(DecodedFace const &a, DecodedFace const &b)
+{
+	float w = std::min(a.box[2], b.box[2]) - std::max(a.box[0], b.box[0]);
+	float h = std::min(a.box[3], b.box[3]) - std::max(a.box[1], b.box[1]);
+	if (w <= 0 || h <= 0)
+		return 0;
+	float area_a = (a.box[2] - a.box[0]) * (a.box[3] - a.box[1]);
+	float area_b = (b.box[2] - b.box[0]) * (b.box[3] - b.box[1]);
+	return w * h / (area_a + area_b - w * h);
+}
+
+// The SCRFD decode as the stage used to do it: dequantise every anchor's outputs, keep those whose score is over the
+// truncated quantised threshold, then mark each face that overlaps a more confident one as removed.
+static std::vector<DecodedFace> reference_scrfd(std::vector<ScrfdBranch> const &branches,
+												std::vector<float> const &anchors, float score_threshold,
+												float iou_threshold)
+{
+	std::vector<DecodedFace> faces;
+	size_t first = 0;
+	for (auto const &branch : branches)
+	{
+		auto dequantise = [](Tensor const &t, size_t i) {
+			return (t.data.get()[i] - t.info.zero_point) * t.info.scale;
+		};
+		const TensorInfo &sq = branch.scores.info;
+		const unsigned int threshold = score_threshold / sq.scale + sq.zero_point;
+		for (size_t n = 0; n < sq.Elements(); n++)
+		{
+			if (branch.scores.data.get()[n] <= threshold)
+				continue;
+			const float *anchor = &anchors[4 * (first + n)];
+			DecodedFace face;
+			face.confidence = dequantise(branch.scores, n);
+			face.box[0] = anchor[0] - dequantise(branch.boxes, 4 * n) * anchor[2];
+			face.box[1] = anchor[1] - dequantise(branch.boxes, 4 * n + 1) * anchor[3];
+			face.box[2] = anchor[0] + dequantise(branch.boxes, 4 * n + 2) * anchor[2];
+			face.box[3] = anchor[1] + dequantise(branch.boxes, 4 * n + 3) * anchor[3];
+			for (unsigned int k = 0; k < 10; k++)
+				face.landmarks[k] = anchor[k & 1] + dequantise(branch.landmarks, 10 * n + k) * anchor[2 + (k & 1)];
+			faces.push_back(face);
+		}
+		first += sq.Elements();
+	}
+
+	// Faces with the same score stay in anchor order.
+	std::stable_sort(faces.begin(), faces.end(),
+					 [](DecodedFace const &l, DecodedFace const &r) { return l.confidence > r.confidence; });
+	std::vector<bool> removed(faces.size(), false);
+	for (size_t i = 0; i < faces.size(); i++)
+		for (size_t j = i + 1; j < faces.size() && !removed[i]; j++)
+			removed[j] = removed[j] || reference_iou(faces[i], faces[j]) > iou_threshold;
+
+	std::vector<DecodedFace> kept;
+	for (size_t i = 0; i < faces.size(); i++)
+		if (!removed[i])
+			kept.push_back(faces[i]);
+	return kept;
+}
+
+static void test_scrfd()
+{
+	// Three branches at strides 8, 16 and 32 of a 128x128 input, with two anchors at each place, and random outputs
+	// quantised differently for every tensor. The scores are spread evenly, so many pass the threshold, and the
+	// small box distances give plenty of overlapping faces for NMS.
+	std::mt19937 rng(1);
+	std::vector<ScrfdBranch> branches;
+	std::vector<float> anchors;
+	for (unsigned int stride : { 8, 16, 32 })
+	{
+		const unsigned int size = 128 / stride;
+		ScrfdBranch branch;
+		branch.scores = quantised_tensor({ size, size, 2 }, 1.0f / 255, 0, rng);
+		branch.boxes = quantised_tensor({ size, size, 8 }, 0.02, 20 + stride, rng);
+		branch.landmarks = quantised_tensor({ size, size, 20 }, 0.03, 128, rng);
+		branches.push_back(std::move(branch));
+		for (unsigned int y = 0; y < size; y++)
+			for (unsigned int x = 0; x < size; x++)
+				for (unsigned int a = 0; a < 2; a++)
+					anchors.insert(anchors.end(), { (x + 0.5f) * stride / 128, (y + 0.5f) * stride / 128,
+													stride / 128.0f, stride / 128.0f });
+	}
+
+	std::vector<unsigned int> scratch;
+	for (float threshold : { 0.3f, 0.5f, 0.9f })
+	{
+		std::vector<DecodedFace> expected = reference_scrfd(branches, anchors, threshold, 0.4);
+		std::vector<DecodedFace> faces = DecodeScrfd(branches, anchors, threshold, 0.4, scratch);
+		CHECK(!faces.empty() && faces.size() == expected.size());
+		bool same = true;
+		for (size_t i = 0; i < std::min(faces.size(), expected.size()); i++)
+		{
+			same &= faces[i].confidence == expected[i].confidence;
+			same &= std::equal(faces[i].box, faces[i].box + 4, expected[i].box);
+			same &= std::equal(faces[i].landmarks, faces[i].landmarks + 10, expected[i].landmarks);
+		}
+		CHECK(same);
+		// Everything kept is over the threshold, and the most confident come first.
+		CHECK(faces.back().confidence > threshold);
+		CHECK(std::is_sorted(faces.begin(), faces.end(), [](DecodedFace const &l, DecodedFace const &r) {
+			return l.confidence > r.confidence;
+		}));
+	}
+
+	// The anchors must match the outputs.
+	anchors.resize(anchors.size() - 4);
+	bool thrown = false;
+	try
+	{
+		DecodeScrfd(branches, anchors, 0.5, 0.4, scratch);
+	}
+	catch (std::runtime_error const &)
+	{
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+
+static void test_overlap()
+{
+	CHECK(near(Iou(Rectangle(0, 0, 10, 10), Rectangle(5, 0, 10, 10)), 50.0f / 150));
+	CHECK(Iou(Rectangle(0, 0, 10, 10), Rectangle(20, 20, 10, 10)) == 0);
+	// A small box inside a big one overlaps it completely by this measure, if not by IoU.
+	CHECK(near(IntersectionOverSmaller(Rectangle(0, 0, 100, 100), Rectangle(10, 10, 20, 20)), 1));
+	CHECK(near(Iou(Rectangle(0, 0, 100, 100), Rectangle(10, 10, 20, 20)), 0.04));
+
+	const float a[4] = { 0, 0, 1, 1 }, b[4] = { 0.5, 0.5, 1.5, 1.5 };
+	CHECK(near(Iou(a, b), 0.25f / 1.75f));
+	CHECK(near(Iou(DecodedObject { 0, 1, 0, 0, 1, 1 }, DecodedObject { 0, 1, 0.5, 0.5, 1.5, 1.5 }), 0.25f / 1.75f));
+}
+
+static void test_nms()
+{
+	std::vector<DecodedObject> objects = {
+		{ 0, 0.6, 0.0, 0.0, 0.5, 0.5 },
+		{ 0, 0.9, 0.05, 0.0, 0.55, 0.5 }, // overlaps the first, and is more confident
+		{ 1, 0.7, 0.0, 0.0, 0.5, 0.5 }, // same place, different class
+		{ 0, 0.8, 0.6, 0.6, 1.0, 1.0 },
+	};
+
+	std::vector<DecodedObject> kept = objects;
+	NmsObjects(kept, 0.5, 20);
+	CHECK(kept.size() == 3);
+	CHECK(near(kept[0].confidence, 0.9) && near(kept[1].confidence, 0.8) && near(kept[2].confidence, 0.7));
+
+	kept = objects;
+	NmsObjects(kept, 0.5, 2);
+	CHECK(kept.size() == 2 && near(kept[1].confidence, 0.8));
+
+	// A threshold of 1 only sorts.
+	kept = objects;
+	NmsObjects(kept, 1.0, 20);
+	CHECK(kept.size() == 4 && near(kept[3].confidence, 0.6));
+
+	// Tiled detections: a box cut off by a tile edge sits inside the whole one, and goes.
+	std::vector<Detection> detections = {
+		Detection(3, "a", 0.9, 0, 0, 100, 100),
+		Detection(3, "a", 0.7, 0, 0, 40, 100),
+		Detection(4, "b", 0.6, 0, 0, 40, 100),
+	};
+	NmsDetections(detections, 0.5);
+	CHECK(detections.size() == 2);
+	CHECK(detections[0].category == 3 && detections[1].category == 4);
+}
+
+static void test_tile_results()
+{
+	// Three tiles across and the full frame, three of them a frame, so it takes two frames to run them all.
+	TilingConfig config;
+	config.tiles_per_frame = 3;
+	TileScheduler scheduler;
+	scheduler.Configure(config, Size(600, 300), Size(300, 300));
+	CHECK(scheduler.Tiles().size() == 4 && scheduler.Rotation() == 2);
+
+	TileResults results;
+	results.Configure(scheduler.Tiles().size(), scheduler.Rotation());
+
+	// Each tile sees its own object, away from the others, and every frame reports all of them, not just the ones
+	// from this frame's tiles. Then tile 1 stops giving results (its jobs fail, say), and its object goes once its
+	// last result is a rotation old.
+	for (unsigned int frame = 0; frame < 10; frame++)
+	{
+		for (unsigned int index : scheduler.Next())
+		{
+			if (index == 1 && frame >= 5)
+				continue;
+			results.Set(index, { Detection(index, "x", 0.9, index * 100, 0, 50, 50) });
+		}
+
+		std::vector<Detection> merged = results.Merge(config.overlap_threshold);
+		CHECK(merged.size() == (frame == 0 || frame > 5 ? 3 : 4));
+	}
+}
+
+static void test_decode_detections()
+{
+	DecoderConfig config;
+	config.type = "hailo_nms";
+	config.threshold = 0.2;
+	config.nms_threshold = 0.5;
+	config.max_detections = 1;
+	std::vector<float> values = { 2, 0, 0, 0.5, 0.5, 0.4, 0, 0, 0.5, 0.5, 0.8 };
+	std::vector<Tensor> outputs = { float_tensor({ 1, 11 }, values) };
+	std::vector<DecodedObject> objects = DecodeDetections(config, outputs, Size(100, 100));
+	CHECK(objects.size() == 1 && near(objects[0].confidence, 0.8));
+}
+
+int main()
+{
+	test_ssd();
+	test_yolov8();
+	test_hailo_nms();
+	test_scrfd();
+	test_overlap();
+	test_nms();
+	test_tile_results();
+	test_decode_detections();
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * dewarp_test.cpp - check the dewarp remap against a reference undistort
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "post_processing_stages/dewarp.hpp"
+#include "test/check.hpp"
+
+static constexpr unsigned int WIDTH = 320, HEIGHT = 240, STRIDE = 384;
+
+// The OpenCV models written out from their documentation, turning the virtual camera by tilt and then by pan.
+static void reference_undistort(LensModel const &lens, double pan, double tilt, double u, double v, double &x,
+								double &y)
+{
+	double a = (u - lens.cx) / (lens.fx * lens.zoom), b = (v - lens.cy) / (lens.fy * lens.zoom), c = 1;
+	double b1 = b * std::cos(tilt) - c * std::sin(tilt), c1 = b * std::sin(tilt) + c * std::cos(tilt);
+	double a2 = a * std::cos(pan) + c1 * std::sin(pan), c2 = -a * std::sin(pan) + c1 * std::cos(pan);
+	a = a2 / c2, b = b1 / c2;
+
+	double r2 = a * a + b * b, xd, yd;
+	auto const &k = lens.distortion;
+	if (lens.fisheye)
+	{
+		double r = std::sqrt(r2), theta = std::atan(r);
+		double theta_d = theta * (1 + k[0] * std::pow(theta, 2) + k[1] * std::pow(theta, 4) +
+								  k[2] * std::pow(theta, 6) + k[3] * std::pow(theta, 8));
+		xd = r > 0 ? a * theta_d / r : a, yd = r > 0 ? b * theta_d / r : b;
+	}
+	else
+	{
+		double radial = 1 + k[0] * r2 + k[1] * r2 * r2 + k[4] * r2 * r2 * r2;
+		xd = a * radial + 2 * k[2] * a * b + k[3] * (r2 + 2 * a * a);
+		yd = b * radial + k[2] * (r2 + 2 * b * b) + 2 * k[3] * a * b;
+	}
+	x = lens.fx * xd + lens.cx;
+	y = lens.fy * yd + lens.cy;
+}
+
+// A grid of smooth bumps, with a stride and a spare row so the remap can read past the last pixel.
+static std::vector<uint8_t> make_grid(unsigned int width, unsigned int height)
+{
+	std::vector<uint8_t> image(STRIDE * (height + 1) + 1, 0);
+	for (unsigned int y = 0; y < height; y++)
+		for (unsigned int x = 0; x < width; x++)
+			image[y * STRIDE + x] = std::lround(128 + 100 * std::sin(2 * M_PI * x / 32) * std::sin(2 * M_PI * y / 24));
+	return image;
+}
+
+static double bilinear(std::vector<uint8_t> const &image, unsigned int width, unsigned int height, double x, double y)
+{
+	unsigned int x0 = std::min<unsigned int>(x, width - 2), y0 = std::min<unsigned int>(y, height - 2);
+	double fx = x - x0, fy = y - y0;
+	const uint8_t *p = &image[y0 * STRIDE + x0];
+	return (p[0] * (1 - fx) + p[1] * fx) * (1 - fy) + (p[STRIDE] * (1 - fx) + p[STRIDE + 1] * fx) * fy;
+}
+
+// Check one plane, "scale" times smaller than the image the lens describes. Returns how many weights had rounded up
+// to a whole pixel.
+static unsigned int check_plane(LensModel const &lens, double pan, double tilt, unsigned int width,
+								unsigned int height, double scale)
+{
+	RemapTable table;
+	table.Build(lens, width, height, STRIDE, scale);
+
+	unsigned int valid = 0, rounded_up = 0;
+	double max_position_error = 0;
+	bool invalid_ok = true;
+	for (unsigned int j = 0; j < height; j++)
+	{
+		for (unsigned int i = 0; i < width; i++)
+		{
+			double x, y;
+			reference_undistort(lens, pan, tilt, (i + 0.5) * scale - 0.5, (j + 0.5) * scale - 0.5, x, y);
+			x = (x + 0.5) / scale - 0.5, y = (y + 0.5) / scale - 0.5;
+			uint32_t offset = table.offsets[j * width + i];
+			// Allow a little slack at the very edges, where the two calculations could round differently.
+			bool inside = x >= 1e-9 && y >= 1e-9 && x <= width - 1 - 1e-9 && y <= height - 1 - 1e-9;
+			bool outside = x < -1e-9 || y < -1e-9 || x > width - 1 + 1e-9 || y > height - 1 + 1e-9;
+			if (offset == RemapTable::INVALID)
+			{
+				invalid_ok &= !inside;
+				continue;
+			}
+			invalid_ok &= !outside;
+			valid++;
+
+			unsigned int x0 = offset % STRIDE, y0 = offset / STRIDE;
+			double table_x = x0 + table.weights_x[j * width + i] / 256.0;
+			double table_y = y0 + table.weights_y[j * width + i] / 256.0;
+			max_position_error = std::max({ max_position_error, std::abs(table_x - x), std::abs(table_y - y) });
+			rounded_up += std::floor(x) < x0 || std::floor(y) < y0;
+		}
+	}
+	CHECK(invalid_ok);
+	CHECK(valid > width * height / 2);
+	// Each weight is the nearest 1/256th of a pixel to the true position.
+	CHECK(max_position_error <= 0.5 / 256 + 1e-9);
+
+	// The remapped image should match a floating point bilinear sample at the reference position.
+	std::vector<uint8_t> source = make_grid(width, height), output(STRIDE * height, 0);
+	table.Remap(output.data(), source.data(), STRIDE, 7, 0, height / 2, 64, 16);
+	table.Remap(output.data(), source.data(), STRIDE, 7, height / 2, height, 64, 16);
+	double max_error = 0;
+	bool fill_ok = true;
+	for (unsigned int j = 0; j < height; j++)
+	{
+		for (unsigned int i = 0; i < width; i++)
+		{
+			uint8_t value = output[j * STRIDE + i];
+			if (table.offsets[j * width + i] == RemapTable::INVALID)
+			{
+				fill_ok &= value == 7;
+				continue;
+			}
+			double x, y;
+			reference_undistort(lens, pan, tilt, (i + 0.5) * scale - 0.5, (j + 0.5) * scale - 0.5, x, y);
+			x = std::clamp((x + 0.5) / scale - 0.5, 0.0, width - 1.0);
+			y = std::clamp((y + 0.5) / scale - 0.5, 0.0, height - 1.0);
+			max_error = std::max(max_error, std::abs(value - bilinear(source, width, height, x, y)));
+		}
+	}
+	CHECK(fill_ok);
+	CHECK(max_error <= 1);
+
+	return rounded_up;
+}
+
+static void check_lens(LensModel lens, double pan, double tilt)
+{
+	lens.SetRotation(pan, tilt);
+	check_plane(lens, pan, tilt, WIDTH, HEIGHT, 1);
+	check_plane(lens, pan, tilt, WIDTH / 2, HEIGHT / 2, 2);
+}
+
+int main()
+{
+	LensModel lens;
+	lens.fx = lens.fy = 300;
+	lens.cx = 161.3, lens.cy = 118.7;
+
+	lens.distortion = { -0.3, 0.1, 0.001, -0.002, -0.02 };
+	check_lens(lens, 0, 0);
+	check_lens(lens, 0.2, -0.1);
+	lens.zoom = 1.5;
+	check_lens(lens, 0, 0.15);
+
+	lens.fisheye = true, lens.zoom = 1;
+	lens.distortion = { 0.05, -0.01, 0.002, 0.0005 };
+	check_lens(lens, 0, 0);
+	check_lens(lens, -0.3, 0.2);
+
+	// With no distortion and a slight zoom, the source positions sweep through every fraction of a pixel, so some
+	// weights round up to a whole pixel, and the right hand column lands exactly on the last source pixel.
+	LensModel plain;
+	plain.fx = plain.fy = 300;
+	plain.cx = (WIDTH - 1) / 2.0, plain.cy = (HEIGHT - 1) / 2.0;
+	plain.distortion = { 0, 0, 0, 0, 0 };
+	plain.zoom = 1.003;
+	CHECK(check_plane(plain, 0, 0, WIDTH, HEIGHT, 1) > 0);
+	plain.zoom = 1;
+	check_plane(plain, 0, 0, WIDTH, HEIGHT, 1);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * flip_queue_test.cpp - drive a FlipQueue against a fake KMS display
+ */
+
+#include <set>
+
+#include "preview/flip_queue.hpp"
+#include "test/check.hpp"
+
+// Stands in for the display. A commit starts a flip, which lands on the next vblank, and only one can be in flight
+// at a time, as with a non-blocking atomic commit. It also keeps track of which buffers the application has given
+// to the queue, and checks that each comes back once, and never while the display is using it.
+struct FakeKms
+{
+	FakeKms() : queue([this](int fd) { return commit(fd); }, [this](int fd) { release(fd); }) {}
+
+	bool commit(int fd)
+	{
+		CHECK(in_flight < 0);
+		if (fail)
+			return false;
+		in_flight = fd;
+		return true;
+	}
+
+	void release(int fd)
+	{
+		CHECK(held.count(fd));
+		CHECK(fd != on_screen && fd != in_flight);
+		held.erase(fd);
+		released++;
+	}
+
+	void Show(int fd)
+	{
+		held.insert(fd);
+		queue.Submit(fd);
+	}
+
+	void VBlank()
+	{
+		if (in_flight < 0)
+			return;
+		on_screen = in_flight;
+		in_flight = -1;
+		queue.FlipDone();
+	}
+
+	// Turn the plane off, as removing its framebuffers does, so nothing is in use any more.
+	void Disable() { on_screen = in_flight = -1; }
+
+	FlipQueue queue;
+	int on_screen = -1;
+	int in_flight = -1;
+	bool fail = false;
+	std::set<int> held;
+	unsigned int released = 0;
+};
+
+static void test_latest_wins()
+{
+	FakeKms kms;
+	kms.Show(1);
+	CHECK(kms.queue.Pending() && kms.in_flight == 1);
+
+	// While the flip is in flight, each new frame replaces the one waiting.
+	kms.Show(2);
+	kms.Show(3);
+	kms.Show(4);
+	CHECK(kms.queue.Dropped() == 2 && !kms.held.count(2) && !kms.held.count(3));
+
+	kms.VBlank();
+	CHECK(kms.on_screen == 1 && kms.in_flight == 4);
+	kms.VBlank();
+	// The buffer the flip replaced comes back.
+	CHECK(kms.on_screen == 4 && !kms.held.count(1));
+	CHECK(!kms.queue.Pending() && kms.queue.Presented() == 2);
+	CHECK(kms.held == std::set<int>({ 4 }));
+}
+
+static void test_failed_commit()
+{
+	FakeKms kms;
+	kms.Show(1);
+	kms.VBlank();
+
+	// A rejected commit hands the frame straight back, and leaves what's on the screen alone.
+	kms.fail = true;
+	kms.Show(2);
+	CHECK(!kms.queue.Pending() && !kms.held.count(2) && kms.queue.Dropped() == 1);
+	CHECK(kms.on_screen == 1 && kms.held.count(1));
+
+	kms.fail = false;
+	kms.Show(3);
+	kms.VBlank();
+	CHECK(kms.on_screen == 3 && kms.held == std::set<int>({ 3 }));
+}
+
+static void test_clear()
+{
+	// Everything still held comes back when the queue is cleared: the buffer on the screen, the one being
+	// flipped to and the one waiting.
+	FakeKms kms;
+	kms.Show(1);
+	kms.VBlank();
+	kms.Show(2);
+	kms.Show(3);
+	kms.VBlank();
+	kms.Show(4);
+	CHECK(kms.on_screen == 2 && kms.in_flight == 3);
+	kms.VBlank();
+	kms.Show(5);
+	kms.Disable();
+	kms.queue.Clear();
+	CHECK(kms.held.empty());
+	CHECK(kms.released == 5 && kms.queue.Dropped() == 1);
+	CHECK(!kms.queue.Pending());
+
+	// A flip that never finished (the wait for it timed out) gives its buffer back too.
+	FakeKms stuck;
+	stuck.Show(5);
+	stuck.VBlank();
+	stuck.Show(6);
+	stuck.Disable();
+	stuck.queue.Clear();
+	CHECK(stuck.held.empty() && stuck.released == 2);
+
+	// And it starts again from nothing.
+	stuck.Show(7);
+	stuck.VBlank();
+	CHECK(stuck.on_screen == 7 && stuck.held == std::set<int>({ 7 }));
+}
+
+int main()
+{
+	test_latest_wins();
+	test_failed_commit();
+	test_clear();
+	return failures ? 1 : 0;
+}
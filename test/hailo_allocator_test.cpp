@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * hailo_allocator_test.cpp - check the pooled tensor buffers
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "post_processing_stages/hailo/hailo_allocator.hpp"
+#include "test/check.hpp"
+
+// Count every trip to the heap, so we can check that allocating from a reserved slab makes none.
+static std::atomic<unsigned int> heap_allocations { 0 };
+
+void *operator new(size_t size)
+{
+	heap_allocations++;
+	if (void *p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+static Allocator::Stats stats_for(Allocator const &allocator, unsigned int size)
+{
+	for (auto const &s : allocator.GetStats())
+	{
+		if (s.size == size)
+			return s;
+	}
+	return {};
+}
+
+static void test_no_heap()
+{
+	Allocator allocator;
+	allocator.Reserve(1000, 4);
+
+	unsigned int before = heap_allocations;
+	for (unsigned int i = 0; i < 100; i++)
+	{
+		std::shared_ptr<uint8_t> a = allocator.Allocate(1000);
+		std::shared_ptr<uint8_t> b = allocator.Allocate(1000);
+		std::shared_ptr<uint8_t> c = a;
+		CHECK(a && b && a != b);
+		a.get()[999] = b.get()[999] = 1;
+	}
+	CHECK(heap_allocations == before);
+
+	Allocator::Stats stats = stats_for(allocator, 1000);
+	CHECK(stats.capacity == 4);
+	CHECK(stats.in_use == 0);
+	CHECK(stats.high_water == 2);
+	CHECK(stats.grows == 0);
+}
+
+static void test_reuse_and_grow()
+{
+	Allocator allocator;
+	allocator.Reserve(64, 2);
+
+	std::vector<std::shared_ptr<uint8_t>> buffers;
+	for (unsigned int i = 0; i < 5; i++)
+		buffers.push_back(allocator.Allocate(64));
+
+	std::set<uint8_t *> distinct;
+	for (auto const &b : buffers)
+		distinct.insert(b.get());
+	CHECK(distinct.size() == 5);
+
+	Allocator::Stats stats = stats_for(allocator, 64);
+	CHECK(stats.in_use == 5);
+	CHECK(stats.capacity >= 5);
+	CHECK(stats.grows >= 1);
+
+	// A freed block is the one handed out next.
+	uint8_t *freed = buffers[1].get();
+	buffers[1].reset();
+	CHECK(allocator.Allocate(64).get() == freed);
+
+	buffers.clear();
+	CHECK(stats_for(allocator, 64).in_use == 0);
+}
+
+// Threads claiming and dropping blocks at once must never be given the same one.
+static void test_threads()
+{
+	Allocator allocator;
+	allocator.Reserve(256, 8);
+
+	std::atomic<unsigned int> clashes { 0 };
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&, t] {
+			for (unsigned int i = 0; i < 10000; i++)
+			{
+				std::shared_ptr<uint8_t> buffer = allocator.Allocate(256);
+				buffer.get()[0] = t;
+				std::this_thread::yield();
+				if (buffer.get()[0] != t)
+					clashes++;
+			}
+		});
+	}
+	for (auto &t : threads)
+		t.join();
+
+	CHECK(clashes == 0);
+	CHECK(stats_for(allocator, 256).in_use == 0);
+}
+
+int main()
+{
+	test_no_heap();
+	test_reuse_and_grow();
+	test_threads();
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * hailo_job_ring_test.cpp - drive the Hailo job ring with a mock device
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "post_processing_stages/hailo/hailo_job_ring.hpp"
+#include "test/check.hpp"
+
+using namespace std::chrono_literals;
+
+// Runs each job on its own thread. The job copies its input into the first output after
+// a delay, which comes from the first input byte (in milliseconds). Like a real device,
+// it reads the input at the end, so it must still be there.
+class MockDevice : public InferenceDevice
+{
+public:
+	~MockDevice() { Join(); }
+
+	bool Run(unsigned int slot, const uint8_t *input, std::vector<uint8_t *> const &outputs,
+			 std::function<void(bool)> done) override
+	{
+		std::scoped_lock<std::mutex> l(lock_);
+		in_flight_++;
+		max_in_flight_ = std::max(max_in_flight_.load(), in_flight_.load());
+		uint8_t *output = outputs[0];
+		threads_.emplace_back([this, input, output, done] {
+			std::this_thread::sleep_for(std::chrono::milliseconds(input[0]));
+			output[0] = input[0];
+			last_value_ = input[0];
+			in_flight_--;
+			done(true);
+		});
+		return true;
+	}
+
+	void Join()
+	{
+		std::vector<std::thread> threads;
+		{
+			std::scoped_lock<std::mutex> l(lock_);
+			threads.swap(threads_);
+		}
+		for (auto &t : threads)
+			t.join();
+	}
+
+	std::atomic<unsigned int> in_flight_ { 0 };
+	std::atomic<unsigned int> max_in_flight_ { 0 };
+	std::atomic<unsigned int> last_value_ { 0 };
+
+private:
+	std::mutex lock_;
+	std::vector<std::thread> threads_;
+};
+
+struct Buffers
+{
+	uint8_t input[1];
+	uint8_t output[1];
+};
+
+// Jobs that finish out of order must still be collected in sequence order, with no more in
+// flight than there are slots.
+static void test_order()
+{
+	MockDevice device;
+	JobRing ring;
+	ring.Configure(&device, 3);
+
+	const uint8_t delays[] = { 40, 5, 20, 1, 30, 10 };
+	std::vector<unsigned int> collected;
+	std::mutex collected_lock;
+	std::vector<std::thread> threads;
+	for (unsigned int i = 0; i < sizeof(delays); i++)
+	{
+		threads.emplace_back([&, i] {
+			auto buffers = std::make_shared<Buffers>();
+			buffers->input[0] = delays[i];
+			buffers->output[0] = 0;
+			InferenceJob job = ring.Submit(i, buffers->input, { buffers->output }, buffers, 1s);
+			CHECK(job.Valid());
+			CHECK(job.Wait(1s));
+			CHECK(buffers->output[0] == delays[i]);
+			std::scoped_lock<std::mutex> l(collected_lock);
+			collected.push_back(i);
+		});
+		// Let the submissions arrive in order.
+		std::this_thread::sleep_for(2ms);
+	}
+	for (auto &t : threads)
+		t.join();
+
+	CHECK(collected.size() == sizeof(delays));
+	for (unsigned int i = 0; i < collected.size(); i++)
+		CHECK(collected[i] == i);
+	CHECK(device.max_in_flight_ <= 3);
+	CHECK(ring.Drain(1s));
+}
+
+// Giving up on a job must leave its buffers alone until the device has finished writing them.
+static void test_timeout()
+{
+	MockDevice device;
+	JobRing ring;
+	ring.Configure(&device, 1);
+
+	std::weak_ptr<Buffers> weak;
+	{
+		auto buffers = std::make_shared<Buffers>();
+		buffers->input[0] = 50;
+		weak = buffers;
+		InferenceJob job = ring.Submit(0, buffers->input, { buffers->output }, buffers, 1s);
+		CHECK(job.Valid());
+		CHECK(!job.Wait(5ms));
+	}
+	CHECK(!weak.expired());
+
+	// The slot is still busy, so a new job can't start yet.
+	auto buffers = std::make_shared<Buffers>();
+	buffers->input[0] = 1;
+	CHECK(!ring.Submit(1, buffers->input, { buffers->output }, buffers, 5ms).Valid());
+
+	CHECK(ring.Drain(1s));
+	CHECK(weak.expired());
+
+	// Once the device is done, the slot is free again and the abandoned job doesn't hold anyone up.
+	InferenceJob job = ring.Submit(2, buffers->input, { buffers->output }, buffers, 1s);
+	CHECK(job.Valid());
+	CHECK(job.Wait(1s));
+}
+
+// The stages pass the input to the ring separately from the outputs, as a buffer of its own. An abandoned job must
+// keep that too, as the device may not have read it yet.
+static void test_abandoned_input()
+{
+	MockDevice device;
+	JobRing ring;
+	ring.Configure(&device, 2);
+
+	std::weak_ptr<uint8_t> weak_input;
+	{
+		std::shared_ptr<uint8_t> input(new uint8_t[1], std::default_delete<uint8_t[]>());
+		std::shared_ptr<uint8_t> output(new uint8_t[1], std::default_delete<uint8_t[]>());
+		input.get()[0] = 30;
+		weak_input = input;
+		uint8_t *input_data = input.get(), *output_data = output.get();
+		auto hold = std::make_shared<std::vector<std::shared_ptr<uint8_t>>>();
+		hold->push_back(std::move(input));
+		hold->push_back(std::move(output));
+		InferenceJob job = ring.Submit(0, input_data, { output_data }, std::move(hold), 1s);
+		CHECK(job.Valid());
+		CHECK(!job.Wait(5ms));
+	}
+	CHECK(!weak_input.expired());
+
+	CHECK(ring.Drain(1s));
+	CHECK(weak_input.expired());
+	CHECK(device.last_value_ == 30);
+}
+
+int main()
+{
+	test_order();
+	test_timeout();
+	test_abandoned_input();
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,141 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * imx500_network_state_test.cpp - find an IMX500 in a fake sysfs tree, and remember its loaded network
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "post_processing_stages/imx500/imx500_network_state.hpp"
+#include "test/check.hpp"
+
+namespace fs = std::filesystem;
+
+// Add a V4L2 subdevice to the fake sysfs tree, whose device link ends in device_name and is driven by module.
+static void add_subdev(fs::path const &sysfs, unsigned int n, std::string const &device_name,
+					   std::string const &module)
+{
+	const fs::path device = sysfs / "devices/platform/i2c" / device_name;
+	fs::create_directories(device);
+	fs::create_directories(sysfs / "module" / module);
+	fs::create_directories(sysfs / "drivers" / module);
+	fs::create_directory_symlink(sysfs / "module" / module, sysfs / "drivers" / module / "module");
+	fs::create_directory_symlink(sysfs / "drivers" / module, device / "driver");
+
+	const fs::path subdev = sysfs / "class/video4linux" / ("v4l-subdev" + std::to_string(n));
+	fs::create_directories(subdev);
+	fs::create_directory_symlink("../../../devices/platform/i2c/" + device_name, subdev / "device");
+}
+
+static void write_file(fs::path const &path, std::string const &contents)
+{
+	std::ofstream(path) << contents;
+}
+
+static void test_find_device(fs::path const &root)
+{
+	std::string device_id;
+
+	const fs::path empty = root / "empty";
+	fs::create_directories(empty);
+	CHECK(NetworkState::FindDevice(empty, device_id) == -1);
+
+	// Another sensor comes first, and is passed over.
+	const fs::path sysfs = root / "sys";
+	add_subdev(sysfs, 0, "10-0010", "imx219");
+	add_subdev(sysfs, 2, "10-001a", "imx500");
+	CHECK(NetworkState::FindDevice(sysfs, device_id) == 2);
+	CHECK(device_id == "10-001a");
+}
+
+static void test_state_dir(fs::path const &root)
+{
+	// Only a directory that root owns, and not everyone can write, will do. The test can only make one when it runs
+	// as root.
+	const fs::path run = root / "run";
+	fs::create_directories(run);
+	fs::permissions(run, fs::perms::owner_all | fs::perms::group_read | fs::perms::group_exec);
+	const std::string expected = geteuid() == 0 ? (run / "network-10-001a.state").string() : "";
+	CHECK(NetworkState::DefaultFile("10-001a", run) == expected);
+
+	fs::permissions(run, fs::perms::others_write, fs::perm_options::add);
+	CHECK(NetworkState::DefaultFile("10-001a", run).empty());
+	CHECK(NetworkState::DefaultFile("10-001a", root / "missing").empty());
+
+	// A link to a trusted directory isn't one.
+	fs::create_directory_symlink("/", root / "link");
+	CHECK(NetworkState::DefaultFile("10-001a", root / "link").empty());
+	CHECK(NetworkState::DefaultFile("10-001a", "/") == "/network-10-001a.state");
+}
+
+static void test_no_device_id(fs::path const &root)
+{
+	// A device link that doesn't end in a name leaves nothing to name the state file after.
+	const fs::path sysfs = root / "sys-noname";
+	add_subdev(sysfs, 1, "11-001a", "imx500");
+	const fs::path link = sysfs / "class/video4linux/v4l-subdev1/device";
+	fs::remove(link);
+	fs::create_directory_symlink("../../../devices/platform/i2c/11-001a/", link);
+
+	std::string device_id = "stale";
+	CHECK(NetworkState::FindDevice(sysfs, device_id) == 1);
+	CHECK(device_id.empty());
+	CHECK(NetworkState::DefaultFile(device_id, "/").empty());
+	CHECK(NetworkState::DefaultFile("..", "/").empty());
+	CHECK(NetworkState::DefaultFile("a/b", "/").empty());
+}
+
+static void test_state(fs::path const &root)
+{
+	const fs::path network = root / "network.rpk", other = root / "other.rpk";
+	write_file(network, "network firmware");
+	write_file(other, "other firmware");
+	const uint64_t hash = NetworkState::Hash(network);
+	CHECK(hash != NetworkState::Hash(other));
+
+	const std::string state_file = root / "network-10-001a.state";
+	NetworkState state(state_file);
+	CHECK(!state.Matches(hash));
+
+	state.Record(hash, network);
+	CHECK(state.Matches(hash));
+	CHECK(!state.Matches(NetworkState::Hash(other)));
+	// Another device keeps its own state.
+	CHECK(!NetworkState(root / "network-11-001a.state").Matches(hash));
+
+	// A different boot means the firmware is gone.
+	write_file(state_file, "not-this-boot " + std::to_string(hash) + "\n");
+	CHECK(!state.Matches(hash));
+
+	state.Record(hash, network);
+	state.Invalidate();
+	CHECK(!state.Matches(hash));
+	CHECK(!fs::exists(state_file));
+
+	// Nor is a link to a state file believed.
+	NetworkState(root / "real.state").Record(hash, network);
+	fs::create_symlink(root / "real.state", state_file);
+	CHECK(!state.Matches(hash));
+}
+
+int main()
+{
+	char dir[] = "/tmp/imx500_network_state_test-XXXXXX";
+	if (!mkdtemp(dir))
+		return 1;
+	const fs::path root = dir;
+
+	test_find_device(root);
+	test_state_dir(root);
+	test_no_device_id(root);
+	test_state(root);
+
+	fs::remove_all(root);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * imx500_roi_controller_test.cpp - steer the inference ROI on a simulated IMX500
+ */
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+#include <vector>
+
+#include <linux/videodev2.h>
+
+#include "post_processing_stages/imx500/imx500_roi_controller.hpp"
+#include "test/check.hpp"
+
+using Rectangle = libcamera::Rectangle;
+
+static const Rectangle FULL(0, 0, 4056, 3040);
+static constexpr int64_t FRAME = 33333333;
+static constexpr int DEVICE_FD = 42;
+
+static bool inside(const Rectangle &inner, const Rectangle &outer)
+{
+	return inner.x >= outer.x && inner.y >= outer.y && inner.x + inner.width <= outer.x + outer.width &&
+		   inner.y + inner.height <= outer.y + outer.height;
+}
+
+// Stands in for the sensor. The ROI control is written through the ioctl, and the sensor picks up the latest one
+// at the start of each frame. Writes can be made to fail.
+struct FakeImx500
+{
+	int Ioctl(int fd, unsigned long request, void *arg)
+	{
+		if (fd != DEVICE_FD || request != VIDIOC_S_EXT_CTRLS)
+			return errno = EINVAL, -1;
+		auto *ctrls = static_cast<v4l2_ext_controls *>(arg);
+		if (ctrls->count != 1 || ctrls->controls[0].id != 0x00982900 || ctrls->controls[0].size != 16)
+			return errno = EINVAL, -1;
+		if (fail)
+			return errno = EIO, -1;
+		const uint32_t *v = ctrls->controls[0].p_u32;
+		writes.emplace_back(now, Rectangle(v[0], v[1], v[2], v[3]));
+		return 0;
+	}
+
+	// The ROI the sensor used for the frame that started at this time.
+	Rectangle RoiAt(int64_t frame_start) const
+	{
+		Rectangle roi = FULL;
+		for (auto const &[time, r] : writes)
+		{
+			if (time < frame_start)
+				roi = r;
+		}
+		return roi;
+	}
+
+	int64_t now = 0;
+	bool fail = false;
+	std::vector<std::pair<int64_t, Rectangle>> writes;
+};
+
+static boost::property_tree::ptree params()
+{
+	boost::property_tree::ptree p;
+	p.put("reacquire_interval", 60);
+	p.put("reacquire_frames", 4);
+	return p;
+}
+
+// Run the controller on a subject, with results coming back 1 to 3 frames late in a scripted pattern. Each frame's
+// detection is given normalised to the ROI the sensor really used, and mapped back with the ROI the controller
+// says the frame had, so any mistake there moves the subject.
+static void run(FakeImx500 &device, InferenceRoiController &controller, const Rectangle &subject,
+				unsigned int frames, unsigned int first, unsigned int &mismatches, Rectangle &last_roi)
+{
+	static const unsigned int lateness[] = { 1, 2, 3, 2, 1, 1, 3 };
+	for (unsigned int n = first; n < first + frames; n++)
+	{
+		const int64_t start = n * FRAME;
+		device.now = std::max(device.now + 1, start + lateness[n % 7] * FRAME);
+
+		const Rectangle used = device.RoiAt(start);
+		const Rectangle tagged = controller.RoiForFrame(start);
+		if (tagged != used)
+			mismatches++;
+
+		std::vector<Rectangle> boxes;
+		if (inside(subject, used))
+		{
+			const double x = (double)(subject.x - used.x) / used.width, y = (double)(subject.y - used.y) / used.height;
+			const double w = (double)subject.width / used.width, h = (double)subject.height / used.height;
+			boxes.emplace_back(tagged.x + std::lround(x * tagged.width), tagged.y + std::lround(y * tagged.height),
+							   std::lround(w * tagged.width), std::lround(h * tagged.height));
+		}
+
+		Rectangle roi;
+		controller.Update(n, boxes, roi);
+		last_roi = device.RoiAt(device.now + 1);
+	}
+}
+
+static InferenceRoiController make_controller(FakeImx500 &device)
+{
+	auto ioctl_func = [&device](int fd, unsigned long request, void *arg) { return device.Ioctl(fd, request, arg); };
+	return InferenceRoiController(
+		params(), FULL, [ioctl_func](const Rectangle &roi) { return WriteInferenceRoi(DEVICE_FD, roi, ioctl_func); },
+		[&device]() { return device.now; });
+}
+
+static void test_tagging()
+{
+	FakeImx500 device;
+	InferenceRoiController controller = make_controller(device);
+	const Rectangle subject(2600, 1900, 240, 320);
+
+	unsigned int mismatches = 0;
+	Rectangle roi;
+	run(device, controller, subject, 200, 0, mismatches, roi);
+
+	// Every frame is tagged with the ROI the sensor used, however late its results were.
+	CHECK(mismatches == 0);
+	CHECK(device.writes.size() > 2);
+	// And it has zoomed in around the subject.
+	CHECK(inside(subject, roi));
+	CHECK(roi.width < FULL.width / 2 && roi.height < FULL.height / 2);
+}
+
+static void test_failed_writes()
+{
+	FakeImx500 device;
+	InferenceRoiController controller = make_controller(device);
+	const Rectangle subject(400, 300, 200, 200);
+
+	// After the full sensor that the controller starts with, the device won't take anything for a while, so
+	// nothing should be tagged with an ROI it never had.
+	device.fail = true;
+	unsigned int mismatches = 0;
+	Rectangle roi;
+	run(device, controller, subject, 30, 0, mismatches, roi);
+	CHECK(mismatches == 0);
+	CHECK(device.writes.size() == 1 && device.writes[0].second == FULL);
+	CHECK(roi == FULL);
+
+	// Once it works again, the controller catches up.
+	device.fail = false;
+	run(device, controller, subject, 100, 30, mismatches, roi);
+	CHECK(mismatches == 0);
+	CHECK(inside(subject, roi) && roi.width < FULL.width / 2);
+}
+
+static void test_reset()
+{
+	FakeImx500 device;
+	InferenceRoiController controller = make_controller(device);
+	unsigned int mismatches = 0;
+	Rectangle roi;
+	run(device, controller, Rectangle(1000, 1000, 200, 200), 100, 0, mismatches, roi);
+	CHECK(roi != FULL);
+
+	// A restart writes the full sensor, and frames from then on use it.
+	device.now += FRAME;
+	controller.Reset();
+	CHECK(device.RoiAt(device.now + 1) == FULL);
+	CHECK(controller.RoiForFrame(device.now + 1) == FULL);
+}
+
+int main()
+{
+	test_tagging();
+	test_failed_writes();
+	test_reset();
+	return failures ? 1 : 0;
+}
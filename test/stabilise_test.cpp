@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * stabilise_test.cpp - check the stabiliser against synthetic camera shake
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "post_processing_stages/stabilise.hpp"
+#include "test/check.hpp"
+
+static constexpr unsigned int WIDTH = 320, HEIGHT = 240, SCENE = 512;
+
+// A smooth random texture, so that bilinear sampling at sub-pixel offsets is meaningful.
+static std::vector<float> make_scene()
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> noise(0, 255);
+	std::vector<float> coarse((SCENE / 4 + 1) * (SCENE / 4 + 1));
+	for (auto &v : coarse)
+		v = noise(rng);
+
+	std::vector<float> scene(SCENE * SCENE);
+	for (unsigned int y = 0; y < SCENE; y++)
+	{
+		for (unsigned int x = 0; x < SCENE; x++)
+		{
+			unsigned int cx = x / 4, cy = y / 4;
+			float fx = (x % 4) / 4.0f, fy = (y % 4) / 4.0f;
+			const float *a = &coarse[cy * (SCENE / 4 + 1) + cx], *b = a + SCENE / 4 + 1;
+			scene[y * SCENE + x] = (a[0] * (1 - fx) + a[1] * fx) * (1 - fy) + (b[0] * (1 - fx) + b[1] * fx) * fy;
+		}
+	}
+	return scene;
+}
+
+// The camera image with its top left corner at (x, y) in the scene.
+static std::vector<uint8_t> render(std::vector<float> const &scene, float x, float y)
+{
+	std::vector<uint8_t> image(WIDTH * HEIGHT);
+	for (unsigned int j = 0; j < HEIGHT; j++)
+	{
+		for (unsigned int i = 0; i < WIDTH; i++)
+		{
+			float sx = x + i, sy = y + j;
+			unsigned int ix = sx, iy = sy;
+			float fx = sx - ix, fy = sy - iy;
+			const float *a = &scene[iy * SCENE + ix], *b = a + SCENE;
+			float v = (a[0] * (1 - fx) + a[1] * fx) * (1 - fy) + (b[0] * (1 - fx) + b[1] * fx) * fy;
+			image[j * WIDTH + i] = std::lround(v);
+		}
+	}
+	return image;
+}
+
+static void test_flat_image()
+{
+	std::vector<uint8_t> flat(WIDTH * HEIGHT, 128);
+	float x, y;
+	CHECK(!EstimateMotion(MotionConfig(), flat.data(), WIDTH, flat.data(), WIDTH, WIDTH, HEIGHT, x, y));
+}
+
+// A slow pan with random shake on top. Every motion estimate should be close to the truth, and the
+// stabilised output should move much less than the raw camera.
+static void test_jitter()
+{
+	std::vector<float> scene = make_scene();
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> shake(-3, 3);
+
+	MotionConfig config;
+	CameraPath path(15);
+	const float max = 0.1 * WIDTH;
+	float x = 96, y = 96, worst_error = 0;
+	double raw_sum = 0, residual_sum = 0;
+	std::vector<uint8_t> previous = render(scene, x, y);
+
+	for (unsigned int frame = 0; frame < 100; frame++)
+	{
+		float dx = 0.25 + shake(rng), dy = -0.1 + shake(rng);
+		x += dx;
+		y += dy;
+		std::vector<uint8_t> image = render(scene, x, y);
+
+		// The camera moving one way makes the image content move the other.
+		float motion_x, motion_y;
+		CHECK(EstimateMotion(config, previous.data(), WIDTH, image.data(), WIDTH, WIDTH, HEIGHT, motion_x, motion_y));
+		worst_error = std::max(worst_error, std::hypot(motion_x + dx, motion_y + dy));
+
+		float old_x = path.CorrectionX(), old_y = path.CorrectionY();
+		path.Update(motion_x, motion_y, max, max);
+		CHECK(std::abs(path.CorrectionX()) <= max && std::abs(path.CorrectionY()) <= max);
+
+		float residual_x = motion_x - (path.CorrectionX() - old_x);
+		float residual_y = motion_y - (path.CorrectionY() - old_y);
+		raw_sum += dx * dx + dy * dy;
+		residual_sum += residual_x * residual_x + residual_y * residual_y;
+		previous = std::move(image);
+	}
+
+	double raw_rms = std::sqrt(raw_sum / 100), residual_rms = std::sqrt(residual_sum / 100);
+	std::cout << "worst motion error " << worst_error << " raw rms " << raw_rms << " residual rms " << residual_rms
+			  << std::endl;
+	CHECK(worst_error < 0.35);
+	CHECK(residual_rms < 0.25 * raw_rms);
+}
+
+// Once the correction reaches the margin it must stay there, not wind up.
+static void test_clamp()
+{
+	CameraPath path(15);
+	for (unsigned int i = 0; i < 50; i++)
+		path.Update(10, 0, 5, 5);
+	CHECK(path.CorrectionX() == 5);
+	path.Update(-10, 0, 5, 5);
+	CHECK(path.CorrectionX() < 5);
+}
+
+int main()
+{
+	test_flat_image();
+	test_jitter();
+	test_clamp();
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * temporal_denoise_test.cpp - check the temporal filter on noisy synthetic frames
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "post_processing_stages/temporal_denoise.hpp"
+#include "test/check.hpp"
+
+static constexpr unsigned int WIDTH = 160, HEIGHT = 120, STRIDE = 192;
+static constexpr float SIGMA = 2.0, THRESHOLD = 2.5, STRENGTH = 0.25;
+
+// A noisy copy of the clean image, with the given stride.
+static std::vector<uint8_t> add_noise(std::vector<float> const &clean, std::mt19937 &rng)
+{
+	std::normal_distribution<float> noise(0, SIGMA);
+	std::vector<uint8_t> image(STRIDE * HEIGHT, 0);
+	for (unsigned int y = 0; y < HEIGHT; y++)
+		for (unsigned int x = 0; x < WIDTH; x++)
+			image[y * STRIDE + x] = std::clamp<long>(std::lround(clean[y * WIDTH + x] + noise(rng)), 0, 255);
+	return image;
+}
+
+class Filter
+{
+public:
+	Filter() : params_(THRESHOLD * SIGMA, STRENGTH) {}
+
+	// Filter the image in place, starting the history from the first one.
+	unsigned int Process(std::vector<uint8_t> &image)
+	{
+		if (history_.empty())
+		{
+			for (unsigned int y = 0; y < HEIGHT; y++)
+				for (unsigned int x = 0; x < WIDTH; x++)
+					history_.push_back(image[y * STRIDE + x] << 4);
+			return 0;
+		}
+		// Two bands, as the stage runs them.
+		return TemporalFilterRows(image.data(), STRIDE, history_.data(), WIDTH, 0, HEIGHT / 2, params_) +
+			   TemporalFilterRows(image.data(), STRIDE, history_.data(), WIDTH, HEIGHT / 2, HEIGHT, params_);
+	}
+
+private:
+	TemporalFilterParams params_;
+	std::vector<uint16_t> history_;
+};
+
+// RMS difference from the clean image, over pixels where the mask (if any) is set.
+static double rms_error(std::vector<uint8_t> const &image, std::vector<float> const &clean,
+						std::vector<bool> const &mask = {})
+{
+	double total = 0;
+	unsigned int count = 0;
+	for (unsigned int y = 0; y < HEIGHT; y++)
+	{
+		for (unsigned int x = 0; x < WIDTH; x++)
+		{
+			if (!mask.empty() && !mask[y * WIDTH + x])
+				continue;
+			double error = image[y * STRIDE + x] - clean[y * WIDTH + x];
+			total += error * error;
+			count++;
+		}
+	}
+	return std::sqrt(total / std::max(count, 1u));
+}
+
+// A gentle gradient with a bright square on it.
+static std::vector<float> make_scene(unsigned int square_x)
+{
+	std::vector<float> scene(WIDTH * HEIGHT);
+	for (unsigned int y = 0; y < HEIGHT; y++)
+	{
+		for (unsigned int x = 0; x < WIDTH; x++)
+		{
+			bool inside = x >= square_x && x < square_x + 40 && y >= 40 && y < 80;
+			scene[y * WIDTH + x] = inside ? 200 : 40 + 0.5 * x + 0.25 * y;
+		}
+	}
+	return scene;
+}
+
+static void test_static()
+{
+	// With nothing moving, the noise should settle well below its original level. A recursive filter blending in
+	// a quarter of each frame leaves sqrt(0.25 / 1.75) of it, or about 0.38.
+	std::mt19937 rng(1);
+	std::vector<float> clean = make_scene(20);
+	Filter filter;
+	double noisy = 0, filtered = 0;
+	unsigned int moving = 0;
+	for (unsigned int frame = 0; frame < 40; frame++)
+	{
+		std::vector<uint8_t> image = add_noise(clean, rng);
+		if (frame == 39)
+			noisy = rms_error(image, clean);
+		unsigned int count = filter.Process(image);
+		if (frame >= 20)
+			moving += count;
+		if (frame == 39)
+			filtered = rms_error(image, clean);
+	}
+	CHECK(noisy > 0.9 * SIGMA);
+	CHECK(filtered < 0.5 * noisy);
+	// Very little of the noise should be mistaken for motion.
+	CHECK(moving < 0.05 * 20 * WIDTH * HEIGHT);
+}
+
+static void test_motion()
+{
+	// Move the square across the frame. Pixels it has just covered or uncovered must take their new values straight
+	// away, rather than being smeared by the history.
+	std::mt19937 rng(2);
+	Filter filter;
+	double worst = 0, worst_static = 0;
+	for (unsigned int frame = 0; frame < 20; frame++)
+	{
+		const unsigned int square_x = 10 + 5 * frame;
+		std::vector<float> clean = make_scene(square_x), previous = make_scene(square_x - 5);
+		std::vector<bool> changed(WIDTH * HEIGHT), unchanged(WIDTH * HEIGHT);
+		for (unsigned int i = 0; i < WIDTH * HEIGHT; i++)
+			changed[i] = clean[i] != previous[i], unchanged[i] = !changed[i];
+
+		std::vector<uint8_t> image = add_noise(clean, rng);
+		filter.Process(image);
+		if (frame < 10)
+			continue;
+		worst = std::max(worst, rms_error(image, clean, changed));
+		worst_static = std::max(worst_static, rms_error(image, clean, unchanged));
+	}
+	// The changed pixels get the new frame's noise, but no trace of the old value, which was over 100 levels away.
+	CHECK(worst < 1.5 * SIGMA);
+	// And everything else is still filtered.
+	CHECK(worst_static < 0.6 * SIGMA);
+}
+
+int main()
+{
+	test_static();
+	test_motion();
+	return failures ? 1 : 0;
+}
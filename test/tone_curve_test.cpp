@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * tone_curve_test.cpp - check the tone curve LUTs and YUV grid against floating point
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <string>
+
+#include "post_processing_stages/tone_curve.hpp"
+#include "test/check.hpp"
+
+using ColorSpace = libcamera::ColorSpace;
+
+// The LUTs are rounded, so each entry should be within half a level of the float curve.
+static constexpr double LUT_TOLERANCE = 0.5 + 1e-9;
+
+static double lift_gamma_gain(ToneCurves const &curves, unsigned int i)
+{
+	double x = i / 255.0;
+	double y = std::pow(std::max(curves.lift + x * (curves.gain - curves.lift), 0.0), 1 / curves.gamma);
+	return std::clamp(y * 255, 0.0, 255.0);
+}
+
+static void test_luts()
+{
+	uint8_t lut_y[256], lut_u[256], lut_v[256];
+
+	// The defaults change nothing.
+	ToneCurves identity;
+	identity.BuildLuts(lut_y, lut_u, lut_v);
+	for (unsigned int i = 0; i < 256; i++)
+		CHECK(lut_y[i] == i && lut_u[i] == i && lut_v[i] == i);
+
+	// A large gamma makes the curve steep near black, where it used to be badly under-sampled.
+	for (double gamma : { 2.2, 0.4 })
+	{
+		ToneCurves curves;
+		curves.lift = 0.05, curves.gamma = gamma, curves.gain = 0.9;
+		curves.BuildLuts(lut_y, lut_u, lut_v);
+		double max_error = 0;
+		for (unsigned int i = 0; i < 256; i++)
+			max_error = std::max(max_error, std::abs(lut_y[i] - lift_gamma_gain(curves, i)));
+		CHECK(max_error <= LUT_TOLERANCE);
+
+		// The y_curve is applied after lift, gamma and gain.
+		curves.y_curve = Pwl({ { 0, 10 }, { 64, 100 }, { 192, 180 }, { 255, 250 } });
+		curves.BuildLuts(lut_y, lut_u, lut_v);
+		max_error = 0;
+		for (unsigned int i = 0; i < 256; i++)
+		{
+			double expected = curves.y_curve.Eval(lift_gamma_gain(curves, i));
+			max_error = std::max(max_error, std::abs(lut_y[i] - expected));
+		}
+		CHECK(max_error <= LUT_TOLERANCE);
+	}
+
+	// Saturation scales the chroma about 128, followed by the u_curve and v_curve.
+	ToneCurves curves;
+	curves.saturation = 0.5;
+	curves.v_curve = Pwl({ { 0, 255 }, { 255, 0 } });
+	curves.BuildLuts(lut_y, lut_u, lut_v);
+	double max_u = 0, max_v = 0;
+	for (unsigned int i = 0; i < 256; i++)
+	{
+		double expected = 128 + (i - 128.0) * 0.5;
+		max_u = std::max(max_u, std::abs(lut_u[i] - expected));
+		max_v = std::max(max_v, std::abs(lut_v[i] - (255 - expected)));
+	}
+	CHECK(lut_y[77] == 77);
+	CHECK(max_u <= LUT_TOLERANCE && max_v <= LUT_TOLERANCE);
+}
+
+// A cube of the given size, filled in by f.
+template <typename F> static Cube make_cube(unsigned int size, F f)
+{
+	Cube cube;
+	cube.size = size;
+	for (unsigned int b = 0; b < size; b++)
+	{
+		for (unsigned int g = 0; g < size; g++)
+		{
+			for (unsigned int r = 0; r < size; r++)
+			{
+				double in[3] = { r / (size - 1.0), g / (size - 1.0), b / (size - 1.0) }, out[3];
+				f(in, out);
+				cube.data.insert(cube.data.end(), out, out + 3);
+			}
+		}
+	}
+	return cube;
+}
+
+static void identity(double const in[3], double out[3])
+{
+	std::copy(in, in + 3, out);
+}
+
+static void test_identity_cube()
+{
+	// The identity grid should give back every YUV value, including ones outside the RGB gamut.
+	for (unsigned int cube_size : { 2, 17 })
+	{
+		Cube cube = make_cube(cube_size, identity);
+		for (auto colour_space : { std::optional<ColorSpace>(), std::optional<ColorSpace>(ColorSpace::Rec709) })
+		{
+			YuvMatrix matrix(colour_space);
+			for (unsigned int grid_size : { 2, 17, 33 })
+			{
+				YuvGrid grid;
+				grid.Build(cube, matrix, grid_size);
+				int max_error = 0;
+				for (unsigned int y = 0; y < 256; y++)
+				{
+					for (unsigned int u = 0; u < 256; u++)
+					{
+						for (unsigned int v = 0; v < 256; v++)
+						{
+							int out[3];
+							grid.Lookup(y, u, v, 0, 3, out);
+							max_error = std::max({ max_error, std::abs(out[0] - (int)y), std::abs(out[1] - (int)u),
+												   std::abs(out[2] - (int)v) });
+						}
+					}
+				}
+				CHECK(max_error <= 1);
+			}
+		}
+	}
+}
+
+static void test_graded_cube()
+{
+	// A contrast curve and some mixing between channels, compared with the float calculation on valid colours.
+	Cube cube = make_cube(33, [](double const in[3], double out[3]) {
+		for (unsigned int c = 0; c < 3; c++)
+		{
+			double x = 0.8 * in[c] + 0.1 * in[(c + 1) % 3] + 0.1 * in[(c + 2) % 3];
+			out[c] = x * x * (3 - 2 * x);
+		}
+	});
+	YuvMatrix matrix(ColorSpace::Rec709);
+
+	YuvGrid grid;
+	grid.Build(cube, matrix, 17);
+	double mean, max;
+	grid.Error(cube, matrix, 3, mean, max);
+	CHECK(mean < 0.6 && max < 3);
+
+	// A finer grid follows the cube more closely.
+	double fine_mean, fine_max;
+	grid.Build(cube, matrix, 65);
+	grid.Error(cube, matrix, 3, fine_mean, fine_max);
+	CHECK(fine_mean < mean && fine_max < 1);
+}
+
+static void test_cube_file()
+{
+	char dir[] = "/tmp/tone_curve_test-XXXXXX";
+	if (!mkdtemp(dir))
+	{
+		CHECK(false);
+		return;
+	}
+	const std::string filename = std::string(dir) + "/test.cube";
+	{
+		std::ofstream file(filename);
+		file << "# a comment\nTITLE \"test\"\nLUT_3D_SIZE 2\nDOMAIN_MIN 0 0 0\nDOMAIN_MAX 1 1 1\n\n";
+		for (unsigned int i = 0; i < 8; i++)
+			file << (i & 1) << " " << (i >> 1 & 1) * 0.5 << " " << (i >> 2) << "\n";
+	}
+
+	Cube cube;
+	cube.Load(filename);
+	double in[3] = { 0.25, 0.5, 0.75 }, out[3];
+	cube.Eval(in, out);
+	CHECK(cube.size == 2 && std::abs(out[0] - 0.25) < 1e-6 && std::abs(out[1] - 0.25) < 1e-6);
+	CHECK(std::abs(out[2] - 0.75) < 1e-6);
+
+	// A file that stops short is an error.
+	std::ofstream(filename) << "LUT_3D_SIZE 2\n0 0 0\n";
+	bool threw = false;
+	try
+	{
+		cube.Load(filename);
+	}
+	catch (std::exception const &)
+	{
+		threw = true;
+	}
+	CHECK(threw);
+
+	unlink(filename.c_str());
+	rmdir(dir);
+}
+
+int main()
+{
+	test_luts();
+	test_identity_cube();
+	test_graded_cube();
+	test_cube_file();
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+/*
+ * Copyright (C) 2026, Raspberry Pi Ltd
+ *
+ * yuv420_converter_test.cpp - check the preview's fixed point YUV420 conversion against floating point
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "preview/yuv420_converter.hpp"
+#include "test/check.hpp"
+
+static constexpr unsigned int WIDTH = 96, HEIGHT = 64, STRIDE = 128;
+// Output rows are padded, as in a QImage.
+static constexpr unsigned int OUT_STRIDE = WIDTH * 3 + 4;
+
+struct Image
+{
+	Image(unsigned int width, unsigned int height, unsigned int stride)
+		: width(width), height(height), stride(stride), data(stride * height * 3 / 2, 0)
+	{
+	}
+	uint8_t &Y(unsigned int x, unsigned int y) { return data[y * stride + x]; }
+	uint8_t &U(unsigned int x, unsigned int y) { return data[height * stride + y * stride / 2 + x]; }
+	uint8_t &V(unsigned int x, unsigned int y) { return data[height * stride * 5 / 4 + y * stride / 2 + x]; }
+	unsigned int width, height, stride;
+	std::vector<uint8_t> data;
+};
+
+// The conversion as the preview did it in floating point, truncating the result.
+static void float_convert(libcamera::ColorSpace const &colour_space, int Y, int U, int V, int rgb[3])
+{
+	float y_coeff = 1.164, vr = 1.596, ug = -0.392, vg = -0.813, ub = 2.017;
+	int offset = 16;
+	if (colour_space == libcamera::ColorSpace::Rec709)
+		vr = 1.793, ug = -0.213, vg = -0.533, ub = 2.112;
+	else if (colour_space == libcamera::ColorSpace::Sycc)
+		y_coeff = 1, vr = 1.402, ug = -0.344, vg = -0.714, ub = 1.772, offset = 0;
+
+	Y -= offset, U -= 128, V -= 128;
+	rgb[0] = std::clamp<int>(y_coeff * Y + vr * V, 0, 255);
+	rgb[1] = std::clamp<int>(y_coeff * Y + ug * U + vg * V, 0, 255);
+	rgb[2] = std::clamp<int>(y_coeff * Y + ub * U, 0, 255);
+}
+
+static StreamInfo stream_info(Image const &image, libcamera::ColorSpace const &colour_space)
+{
+	StreamInfo info;
+	info.width = image.width;
+	info.height = image.height;
+	info.stride = image.stride;
+	info.colour_space = colour_space;
+	return info;
+}
+
+// Convert in two bands, as two threads would.
+static std::vector<uint8_t> convert(Yuv420Converter &converter, Image const &image)
+{
+	std::vector<uint8_t> output(OUT_STRIDE * HEIGHT, 0), stripe;
+	converter.ConvertRows(image.data.data(), 0, HEIGHT / 2, output.data(), OUT_STRIDE, stripe);
+	converter.ConvertRows(image.data.data(), HEIGHT / 2, HEIGHT, output.data(), OUT_STRIDE, stripe);
+	return output;
+}
+
+static void test_accuracy()
+{
+	// At the same size, every output pixel comes from its own source pixel, and chroma sample.
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<int> value(0, 255);
+	Image image(WIDTH, HEIGHT, STRIDE);
+	for (auto &v : image.data)
+		v = value(rng);
+
+	Yuv420Converter converter;
+	for (auto const &colour_space :
+		 { libcamera::ColorSpace::Sycc, libcamera::ColorSpace::Smpte170m, libcamera::ColorSpace::Rec709 })
+	{
+		converter.Configure(stream_info(image, colour_space), WIDTH, HEIGHT);
+		std::vector<uint8_t> output = convert(converter, image);
+
+		int max_error = 0;
+		unsigned int differences = 0;
+		for (unsigned int y = 0; y < HEIGHT; y++)
+		{
+			for (unsigned int x = 0; x < WIDTH; x++)
+			{
+				int rgb[3];
+				float_convert(colour_space, image.Y(x, y), image.U(x / 2, y / 2), image.V(x / 2, y / 2), rgb);
+				for (unsigned int c = 0; c < 3; c++)
+				{
+					int error = std::abs(output[y * OUT_STRIDE + 3 * x + c] - rgb[c]);
+					max_error = std::max(max_error, error);
+					differences += error != 0;
+				}
+			}
+		}
+		// The fixed point tables can only tip a result over to the next level when it is within a hair of it.
+		CHECK(max_error <= 1);
+		CHECK(differences < WIDTH * HEIGHT * 3 / 100);
+
+		// Nothing is written past the end of each row.
+		bool padding_ok = true;
+		for (unsigned int y = 0; y < HEIGHT; y++)
+			padding_ok &= std::all_of(&output[y * OUT_STRIDE + 3 * WIDTH], &output[(y + 1) * OUT_STRIDE],
+									  [](uint8_t v) { return v == 0; });
+		CHECK(padding_ok);
+	}
+}
+
+static void test_downscale()
+{
+	// A source twice the size made of 2x2 blocks of grey levels, over a flat colour. Halving it should pick one
+	// sample from each block, however the pixel pairs share their chroma.
+	Image image(2 * WIDTH, 2 * HEIGHT, 2 * STRIDE);
+	for (unsigned int y = 0; y < 2 * HEIGHT; y++)
+		for (unsigned int x = 0; x < 2 * WIDTH; x++)
+			image.Y(x, y) = 16 + ((x / 2) * 7 + (y / 2) * 13) % 220;
+	for (unsigned int y = 0; y < HEIGHT; y++)
+		for (unsigned int x = 0; x < WIDTH; x++)
+			image.U(x, y) = 100, image.V(x, y) = 150;
+
+	Yuv420Converter converter;
+	// The maps must follow the source size, after converting another.
+	Image small(WIDTH, HEIGHT, STRIDE);
+	converter.Configure(stream_info(small, libcamera::ColorSpace::Rec709), WIDTH, HEIGHT);
+	converter.Configure(stream_info(image, libcamera::ColorSpace::Rec709), WIDTH, HEIGHT);
+	std::vector<uint8_t> output = convert(converter, image);
+
+	int max_error = 0;
+	for (unsigned int y = 0; y < HEIGHT; y++)
+	{
+		for (unsigned int x = 0; x < WIDTH; x++)
+		{
+			int rgb[3];
+			float_convert(libcamera::ColorSpace::Rec709, image.Y(2 * x, 2 * y), 100, 150, rgb);
+			for (unsigned int c = 0; c < 3; c++)
+				max_error = std::max(max_error, std::abs(output[y * OUT_STRIDE + 3 * x + c] - rgb[c]));
+		}
+	}
+	CHECK(max_error <= 1);
+}
+
+int main()
+{
+	test_accuracy();
+	test_downscale();
+	return failures ? 1 : 0;
+}